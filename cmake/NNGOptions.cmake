@@ -28,6 +28,7 @@ option(NNG_TESTS "Build and run tests." ${NNG_NATIVE_BUILD})
 option(NNG_TOOLS "Build extra tools." ${NNG_NATIVE_BUILD})
 option(NNG_ENABLE_NNGCAT "Enable building nngcat utility." ${NNG_TOOLS})
 option(NNG_ENABLE_COVERAGE "Enable coverage reporting." OFF)
+option(NNG_BENCHMARKS "Build microbenchmarks for core primitives." OFF)
 # Eliding deprecated functionality can be used to build a slimmed down
 # version of the library, or alternatively to test for application
 # preparedness for expected feature removals (in the next major release.)
@@ -47,6 +48,11 @@ option(NNG_ENABLE_COMPAT "Enable legacy nanomsg API." ON)
 option(NNG_ENABLE_STATS "Enable statistics." ON)
 mark_as_advanced(NNG_ENABLE_STATS)
 
+# USDT probes (for bpftrace, perf, SystemTap, etc.)  These need sys/sdt.h,
+# which on Linux usually comes from the systemtap-sdt-dev(el) package.
+option(NNG_ENABLE_USDT "Enable USDT (static tracepoint) probes." OFF)
+mark_as_advanced(NNG_ENABLE_USDT)
+
 # Protocols.
 option (NNG_PROTO_BUS0 "Enable BUSv0 protocol." ON)
 mark_as_advanced(NNG_PROTO_BUS0)
@@ -106,6 +112,11 @@ if (NNG_ENABLE_HTTP)
 endif()
 mark_as_advanced(NNG_ENABLE_HTTP)
 
+# Compression support for HTTP content encoding.  This uses the system
+# zlib, and is silently left out if zlib cannot be found.
+option (NNG_ENABLE_ZLIB "Enable compression with zlib, if found." ON)
+mark_as_advanced(NNG_ENABLE_ZLIB)
+
 # Some sites or kernels lack IPv6 support.  This override allows us
 # to prevent the use of IPv6 in environments where it isn't supported.
 option (NNG_ENABLE_IPV6 "Enable IPv6." ON)
@@ -729,6 +729,19 @@ NNG_DECL nng_listener nng_pipe_listener(nng_pipe);
 #define NNG_OPT_RECONNMINT "reconnect-time-min"
 #define NNG_OPT_RECONNMAXT "reconnect-time-max"
 
+// Receive spin time.  When non-zero, nng_recvmsg() and nng_recv() busy
+// wait (for at most this many microseconds) for a message to arrive before
+// going to sleep.  This trades CPU for lower latency.  The actual spin time
+// adapts to how often spinning succeeds.  This is an int, 0 (the default)
+// disables spinning, and the maximum is 1000000.
+#define NNG_OPT_RECVSPIN "recv-spin"
+
+// Per-pipe statistics.  This is a bool, true by default.  When false,
+// pipes created on the socket afterwards do not get their own statistics
+// (nor any transport specific ones); their traffic is still counted
+// by the dialer or listener that created them.
+#define NNG_OPT_PIPE_STATS "pipe-stats"
+
 // TLS options are only used when the underlying transport supports TLS.
 
 // NNG_OPT_TLS_CONFIG is a pointer to a nng_tls_config object.  Generally
@@ -818,6 +831,59 @@ NNG_DECL nng_listener nng_pipe_listener(nng_pipe);
 // which makes it more convenient than using the NNG_OPT_LOCADDR option.
 #define NNG_OPT_TCP_BOUND_PORT "tcp-bound-port"
 
+// Listener sharding.  When set on a listener to a value greater than one
+// (before it is started), the listener opens that many sockets bound to the
+// same address using SO_REUSEPORT, each serviced by a different poller
+// thread where possible.  The kernel spreads incoming connections across
+// them.  This can improve accept scalability during connection storms.
+// This is an int, between 1 (the default) and 64.  Not all platforms
+// support values other than 1.
+#define NNG_OPT_TCP_LISTEN_SHARDS "tcp-listen-shards"
+
+// Zero-copy send threshold.  When non-zero, writes of at least this many
+// bytes are sent using zero-copy (MSG_ZEROCOPY on Linux), avoiding copying
+// the data into the kernel.  Completion of such writes is deferred until the
+// kernel is done with the data, which usually means after the peer has
+// acknowledged it, so this is only beneficial for large messages.  This is
+// a size_t, and zero (the default) disables zero-copy.  Platforms without
+// zero-copy support reject non-zero values with NNG_ENOTSUP.
+#define NNG_OPT_TCP_ZEROCOPY_THRESHOLD "tcp-zerocopy-threshold"
+
+// Low-latency socket tuning.  These map directly onto the underlying
+// socket options of the same name, and may be set on dialers and listeners
+// (in which case they are applied to each new connection), or on an
+// established connection (pipe).  Options that the platform does not
+// support return NNG_ENOTSUP.  Until explicitly set, the operating system
+// defaults apply.
+
+// Busy poll time in microseconds (SO_BUSY_POLL).  When non-zero, blocking
+// receives on the socket spin on the device queue for up to this long.
+// This is an int.
+#define NNG_OPT_TCP_BUSY_POLL "tcp-busy-poll"
+
+// Quick ACK (TCP_QUICKACK).  When true, ACKs are sent immediately rather
+// than being delayed.  The kernel clears this on its own, so it is
+// reapplied after each receive.  This is a boolean.
+#define NNG_OPT_TCP_QUICKACK "tcp-quickack"
+
+// Limit on unsent data buffered in the kernel (TCP_NOTSENT_LOWAT).  Smaller
+// values reduce queueing latency for interactive traffic.  This is a size.
+#define NNG_OPT_TCP_NOTSENT_LOWAT "tcp-notsent-lowat"
+
+// Kernel send and receive buffer sizes (SO_SNDBUF and SO_RCVBUF).  Note
+// that some kernels (notably Linux) report back double the size that was
+// set, to account for bookkeeping overhead.  These are sizes.
+#define NNG_OPT_TCP_SNDBUF "tcp-sndbuf"
+#define NNG_OPT_TCP_RCVBUF "tcp-rcvbuf"
+
+// Preferred CPU for receive processing (SO_INCOMING_CPU).  This is an int.
+#define NNG_OPT_TCP_INCOMING_CPU "tcp-incoming-cpu"
+
+// Maximum time that transmitted data may remain unacknowledged before the
+// connection is forcibly closed (TCP_USER_TIMEOUT).  This is a duration,
+// and zero means to use the system default.
+#define NNG_OPT_TCP_USER_TIMEOUT "tcp-user-timeout"
+
 // IPC options.  These will largely vary depending on the platform,
 // as POSIX systems have very different options than Windows.
 
@@ -833,6 +899,14 @@ NNG_DECL nng_listener nng_pipe_listener(nng_pipe);
 // this for security.
 #define NNG_OPT_IPC_PERMISSIONS "ipc:permissions"
 
+// Packet mode.  When true, a listener uses SOCK_SEQPACKET sockets, so that
+// each message is carried by as few packets (and system calls) as possible.
+// Dialers with this set try packet mode first, and fall back to a byte
+// stream if the listener does not use it.  Pipes report the mode in use.
+// This is only available on POSIX systems that support SOCK_SEQPACKET for
+// UNIX domain sockets.
+#define NNG_OPT_IPC_SEQPACKET "ipc:seqpacket"
+
 // IPC peer options may also be used in some cases with other socket types.
 
 // Peer UID.  This is only available on POSIX style systems.
@@ -921,6 +995,33 @@ NNG_DECL nng_listener nng_pipe_listener(nng_pipe);
 // peers that cannot be coerced into sending binary frames.
 #define NNG_OPT_WS_RECV_TEXT "ws:recv-text"
 
+// NNG_OPT_WS_DEFLATE is a boolean that enables the permessage-deflate
+// extension (RFC 7692) on a listener or dialer.  The extension is only
+// used if the peer agrees to it during the handshake; on a connection
+// this option reports whether it was negotiated.  This requires zlib.
+#define NNG_OPT_WS_DEFLATE "ws:deflate"
+
+// NNG_OPT_WS_DEFLATE_NO_TAKEOVER is a boolean that asks for the compression
+// context to be discarded after each message, in both directions.  This
+// saves memory when there are many connections, at the cost of a worse
+// compression ratio.
+#define NNG_OPT_WS_DEFLATE_NO_TAKEOVER "ws:deflate-no-takeover"
+
+// NNG_OPT_WS_DEFLATE_WINDOW is the largest LZ77 window size, in bits
+// (9 to 15), that we will use or ask the peer to use.  Smaller windows use
+// less memory.  The default is 15.
+#define NNG_OPT_WS_DEFLATE_WINDOW "ws:deflate-window"
+
+// These read-only uint64 options on a connection report the compression
+// counters: the bytes given to and produced by the compressor, the bytes
+// given to and produced by the decompressor, and the time in microseconds
+// spent doing both.
+#define NNG_OPT_WS_DEFLATE_TX_RAW "ws:deflate-tx-raw"
+#define NNG_OPT_WS_DEFLATE_TX_WIRE "ws:deflate-tx-wire"
+#define NNG_OPT_WS_DEFLATE_RX_WIRE "ws:deflate-rx-wire"
+#define NNG_OPT_WS_DEFLATE_RX_RAW "ws:deflate-rx-raw"
+#define NNG_OPT_WS_DEFLATE_TIME "ws:deflate-time"
+
 // NNG_OPT_SOCKET_FD is a write-only integer property that is used to
 // file descriptors (or FILE HANDLE objects on Windows) to a
 // socket:// based listener.  This file descriptor will be taken
@@ -948,6 +1049,22 @@ NNG_DECL nng_listener nng_pipe_listener(nng_pipe);
 // the empty string is not suitable.
 NNG_DECL int nng_stats_get(nng_stat **);
 
+// nng_stats_get_filtered is like nng_stats_get, but only collects the
+// top level scopes with the given name (such as "socket") and id, and
+// within those only statistics of the given types.  A NULL scope or zero
+// id matches any, and types is a mask of NNG_STAT_MASK values, with zero
+// meaning all types.  Scopes are always collected, to hold the others.
+NNG_DECL int nng_stats_get_filtered(
+    nng_stat **, const char *, int, unsigned);
+
+#define NNG_STAT_MASK(type) (1u << (type))
+
+// nng_stats_update refreshes the values of a snapshot obtained from
+// nng_stats_get or nng_stats_get_filtered, without collecting it again.
+// Statistics created since then are not added, and those that have been
+// removed keep their last values.  This must be called on the root.
+NNG_DECL int nng_stats_update(nng_stat *);
+
 // nng_stats_free frees a previous list of snapshots.  This should only
 // be called on the parent statistic that obtained via nng_stats_get.
 NNG_DECL void nng_stats_free(nng_stat *);
@@ -991,12 +1108,13 @@ NNG_DECL nng_stat *nng_stat_find_dialer(nng_stat *, nng_dialer);
 NNG_DECL nng_stat *nng_stat_find_listener(nng_stat *, nng_listener);
 
 enum nng_stat_type_enum {
-	NNG_STAT_SCOPE   = 0, // Stat is for scoping, and carries no value
-	NNG_STAT_LEVEL   = 1, // Numeric "absolute" value, diffs meaningless
-	NNG_STAT_COUNTER = 2, // Incrementing value (diffs are meaningful)
-	NNG_STAT_STRING  = 3, // Value is a string
-	NNG_STAT_BOOLEAN = 4, // Value is a boolean
-	NNG_STAT_ID      = 5, // Value is a numeric ID
+	NNG_STAT_SCOPE     = 0, // Stat is for scoping, and carries no value
+	NNG_STAT_LEVEL     = 1, // Numeric "absolute" value, diffs meaningless
+	NNG_STAT_COUNTER   = 2, // Incrementing value (diffs are meaningful)
+	NNG_STAT_STRING    = 3, // Value is a string
+	NNG_STAT_BOOLEAN   = 4, // Value is a boolean
+	NNG_STAT_ID        = 5, // Value is a numeric ID
+	NNG_STAT_HISTOGRAM = 6, // Distribution of values (see percentile)
 };
 
 // nng_stat_unit provides information about the unit for the statistic,
@@ -1009,14 +1127,23 @@ enum nng_unit_enum {
 	NNG_UNIT_BYTES    = 1, // Bytes, e.g. bytes sent, etc.
 	NNG_UNIT_MESSAGES = 2, // Messages, one per message
 	NNG_UNIT_MILLIS   = 3, // Milliseconds
-	NNG_UNIT_EVENTS   = 4  // Some other type of event
+	NNG_UNIT_EVENTS   = 4, // Some other type of event
+	NNG_UNIT_MICROS   = 5  // Microseconds
 };
 
 // nng_stat_value returns the actual value of the statistic.
 // Statistic values reflect their value at the time that the corresponding
 // snapshot was updated, and are undefined until an update is performed.
+// For histograms, this is the number of values recorded.
 NNG_DECL uint64_t nng_stat_value(nng_stat *);
 
+// nng_stat_percentile returns the value below which the given percentage
+// (e.g. 50, 99, or 99.9) of the values recorded in a histogram fall.
+// The result is approximate, as values are grouped into buckets that are
+// up to 12.5% wide.  Zero is returned if the histogram is empty, or the
+// statistic is not a histogram.
+NNG_DECL uint64_t nng_stat_percentile(nng_stat *, double);
+
 // nng_stat_bool returns the boolean value of the statistic.
 NNG_DECL bool nng_stat_bool(nng_stat *);
 
@@ -1508,6 +1635,12 @@ enum {
 	// Default is determined by NNG_MAX_POLLER_THREADS compile time
 	// variable.
 	NNG_INIT_MAX_POLLER_THREADS,
+
+	// Record the latency of every asynchronous operation in the
+	// aio/latency histogram.  This is off (zero) by default, as it
+	// costs two clock reads and a shared atomic update per operation.
+	// Any non-zero value enables it.
+	NNG_INIT_AIO_LATENCY,
 };
 
 // Logging support.
@@ -1600,6 +1733,62 @@ NNG_DECL void nng_log_debug(const char *msgid, const char *msg, ...);
 NNG_DECL void nng_log_auth(
     nng_log_level level, const char *msgid, const char *msg, ...);
 
+// Deliver log messages asynchronously.  When enabled, messages are still
+// formatted by the caller, but are queued and handed to the logger by a
+// background thread, so that a slow logger cannot stall the caller.  If
+// the queue is full, messages are discarded.  Disabling this delivers any
+// messages still queued before returning.  This is disabled by default.
+NNG_DECL int nng_log_set_async(bool async);
+
+// Limit the number of messages logged per second with the same msgid.
+// Messages over the limit are discarded.  Zero (the default) disables this.
+NNG_DECL void nng_log_set_rate_limit(uint32_t limit);
+
+// Get the number of log messages discarded because the asynchronous
+// queue was full (overflow), or because of the rate limit (limited).
+// Either pointer may be NULL.
+NNG_DECL void nng_log_get_dropped(uint64_t *overflow, uint64_t *limited);
+
+// Flight recorder.  When enabled, NNG records compact binary events
+// (pipes coming and going, asynchronous operations starting and finishing,
+// messages dropped, retries, reconnects) into fixed size in-memory rings.
+// This is cheap enough to leave on in production, so that the recent
+// history is available after something goes wrong, without having to run
+// at debug log level.  Only the most recent events are kept.
+typedef enum nng_flight_type {
+	NNG_FLIGHT_PIPE_ADD   = 1, // id is pipe, arg is socket
+	NNG_FLIGHT_PIPE_REM   = 2, // id is pipe, arg is socket
+	NNG_FLIGHT_AIO_START  = 3, // arg is aio address
+	NNG_FLIGHT_AIO_FINISH = 4, // id is result, arg is aio address
+	NNG_FLIGHT_AIO_CANCEL = 5, // id is reason, arg is aio address
+	NNG_FLIGHT_QUEUE_FULL = 6, // id is pipe, arg is message length
+	NNG_FLIGHT_DROP       = 7, // id is pipe, arg is message length
+	NNG_FLIGHT_RETRY      = 8, // id is request id
+	NNG_FLIGHT_RECONNECT  = 9, // id is dialer, arg is delay in msec
+} nng_flight_type;
+
+typedef struct nng_flight_event {
+	uint64_t fe_time; // microseconds, from an arbitrary base
+	uint32_t fe_type; // nng_flight_type
+	uint32_t fe_id;   // object id or result, depending on type
+	uint64_t fe_arg;  // additional detail, depending on type
+} nng_flight_event;
+
+// nng_flight_enable turns recording on or off.  It is off by default.
+NNG_DECL void nng_flight_enable(bool);
+
+// nng_flight_snapshot copies up to the given number of the most recent
+// events, oldest first, returning the number copied.  This neither
+// allocates nor takes locks, so it may be called from a signal handler.
+NNG_DECL size_t nng_flight_snapshot(nng_flight_event *, size_t);
+
+// nng_flight_name returns a short name for the event type.
+NNG_DECL const char *nng_flight_name(uint32_t);
+
+// nng_flight_dump is a debugging function that prints all of the recorded
+// events to stdout, oldest first.
+NNG_DECL void nng_flight_dump(void);
+
 // Return an absolute time from some arbitrary point.  The value is
 // provided in milliseconds, and is of limited resolution based on the
 // system clock.  (Do not use it for fine-grained performance measurements.)
@@ -1,5 +1,5 @@
 //
-// Copyright 2020 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 // Copyright 2020 Dirac Research <robert.bielik@dirac.com>
 //
@@ -245,6 +245,12 @@ NNG_DECL void nng_http_conn_read(nng_http_conn *, nng_aio *);
 // finish until either all the requested data is read, or an error occurs.
 NNG_DECL void nng_http_conn_read_all(nng_http_conn *, nng_aio *);
 
+// nng_http_conn_read_body reads the entity body of a request, for handlers
+// that have enabled nng_http_handler_stream_body.  Chunked transfer
+// encoding is removed.  This completes as soon as some data is available,
+// and completes successfully with no data once the body has been read.
+NNG_DECL void nng_http_conn_read_body(nng_http_conn *, nng_aio *);
+
 // nng_http_conn_write attempts to write data, but it can write less
 // than the amount requested. (It completes as soon as at least one
 // byte is written.)
@@ -344,6 +350,11 @@ NNG_DECL int nng_http_handler_alloc_redirect(
 NNG_DECL int nng_http_handler_alloc_directory(
     nng_http_handler **, const char *, const char *);
 
+// nng_http_handler_alloc_stats creates a handler that serves up the
+// statistics of the library (see nng_stats_get) in the OpenMetrics text
+// format, suitable for scraping by Prometheus and similar systems.
+NNG_DECL int nng_http_handler_alloc_stats(nng_http_handler **, const char *);
+
 // nng_http_handler_set_method sets the method that the handler will be
 // called for.  By default this is GET.  If NULL is supplied for the
 // method, then the handler is executed regardless of method, and must
@@ -367,6 +378,13 @@ NNG_DECL int nng_http_handler_set_host(nng_http_handler *, const char *);
 // *any* data, use 0.  (The static and file handlers use 0 by default.)
 NNG_DECL int nng_http_handler_collect_body(nng_http_handler *, bool, size_t);
 
+// nng_http_handler_stream_body indicates that the handler reads the
+// content data itself as it arrives, using nng_http_conn_read_body, so
+// that large bodies need not be held in memory.  This takes precedence
+// over nng_http_handler_collect_body.  If the handler does not read the
+// entire body, the connection is closed after the response is sent.
+NNG_DECL int nng_http_handler_stream_body(nng_http_handler *, bool);
+
 // nng_http_handler_set_tree indicates that the handler is being registered
 // for a hierarchical tree, rather than just a single path, so it will be
 // called for all child paths supplied.  By default the handler is only
@@ -381,6 +399,28 @@ NNG_DECL int nng_http_handler_set_tree(nng_http_handler *);
 // when added to a server.
 NNG_DECL int nng_http_handler_set_tree_exclusive(nng_http_handler *);
 
+// nng_http_handler_set_cache enables caching of file contents in memory,
+// up to the given number of bytes, for handlers created with
+// nng_http_handler_alloc_file or nng_http_handler_alloc_directory.
+// Cached responses carry validators, so that conditional requests for
+// them can be answered without reading the file.  The default is zero,
+// which disables the cache.
+NNG_DECL int nng_http_handler_set_cache(nng_http_handler *, size_t);
+
+// nng_http_handler_set_pipeline indicates that the handler always
+// replies with a response object, and never uses the connection itself.
+// The server may then run the handler concurrently with others for
+// requests that a client has pipelined on the same connection.  Responses
+// are still sent in the order that requests were received.
+NNG_DECL int nng_http_handler_set_pipeline(nng_http_handler *, bool);
+
+// nng_http_handler_set_compress enables compression of responses from
+// the handler, for clients that accept it (using Accept-Encoding), if the
+// body is at least the given size.  Static, file and directory handlers
+// keep the compressed data for reuse.  This returns NNG_ENOTSUP if the
+// library was built without zlib.  The default is disabled.
+NNG_DECL int nng_http_handler_set_compress(nng_http_handler *, bool, size_t);
+
 // nng_http_handler_set_data is used to store additional data, along with
 // a possible clean up routine.  (The clean up is a custom de-allocator and
 // will be called with the supplied data as an argument, when the handler
@@ -488,8 +528,8 @@ NNG_DECL int nng_http_server_res_error(nng_http_server *, nng_http_res *);
 NNG_DECL int nng_http_hijack(nng_http_conn *);
 
 // nng_http_client represents a "client" object.  Clients can be used
-// to create HTTP connections.  At present, connections are not cached
-// or reused, but that could change in the future.
+// to create HTTP connections.  Connections used by nng_http_client_transact
+// are kept in a pool for reuse by later transactions.
 typedef struct nng_http_client nng_http_client;
 
 // nng_http_client_alloc allocates a client object, associated with
@@ -519,6 +559,13 @@ NNG_DECL int nng_http_client_get_tls(
 // in the first (index 0) output for the aio.
 NNG_DECL void nng_http_client_connect(nng_http_client *, nng_aio *);
 
+// nng_http_client_set_pool configures the pool of idle connections kept by
+// the client for nng_http_client_transact.  At most maxidle connections are
+// kept, each for no longer than the idle time.  Setting maxidle to zero
+// disables reuse, so that each transaction uses a new connection.
+NNG_DECL int nng_http_client_set_pool(
+    nng_http_client *, int maxidle, nng_duration idle);
+
 // nng_http_conn_transact is used to perform a round-trip exchange (i.e. a
 // single HTTP transaction).  It will not automatically close the connection,
 // unless some kind of significant error occurs.  The caller should close
@@ -527,8 +574,10 @@ NNG_DECL void nng_http_conn_transact(
     nng_http_conn *, nng_http_req *, nng_http_res *, nng_aio *);
 
 // nng_http_client_transact is used to execute a single transaction to a
-// server. The connection is opened, and will be closed when the transaction is
-// complete.
+// server. An idle connection from the client's pool is used if one is
+// available, otherwise a new connection is opened.  When the transaction is
+// complete, the connection is returned to the pool if it can be reused,
+// or closed.
 NNG_DECL void nng_http_client_transact(
     nng_http_client *, nng_http_req *, nng_http_res *, nng_aio *);
 
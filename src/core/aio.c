@@ -23,6 +23,12 @@ struct nni_aio_expire_q {
 static nni_aio_expire_q **nni_aio_expire_q_list;
 static int                nni_aio_expire_q_cnt;
 
+#ifdef NNG_ENABLE_STATS
+static nni_stat_item nni_aio_stat_root;
+static nni_stat_item nni_aio_stat_latency;
+static bool          nni_aio_latency; // set once, at init time
+#endif
+
 // Design notes.
 //
 // AIOs are only ever "completed" by the provider, which must call
@@ -312,6 +318,12 @@ nni_aio_wait(nni_aio *aio)
 	nni_task_wait(&aio->a_task);
 }
 
+bool
+nni_aio_spin(nni_aio *aio, int usec)
+{
+	return (nni_task_spin(&aio->a_task, usec));
+}
+
 bool
 nni_aio_busy(nni_aio *aio)
 {
@@ -349,15 +361,29 @@ nni_aio_begin(nni_aio *aio)
 		aio->a_expire    = NNI_TIME_NEVER;
 		aio->a_sleep     = false;
 		aio->a_expire_ok = false;
+		aio->a_latency   = NULL;
 		nni_mtx_unlock(&eq->eq_mtx);
 
 		return (NNG_ECANCELED);
 	}
 	nni_task_prep(&aio->a_task);
 	nni_mtx_unlock(&eq->eq_mtx);
+#ifdef NNG_ENABLE_STATS
+	if (nni_aio_latency || (aio->a_latency != NULL)) {
+		aio->a_start_us = nni_clock_us();
+	}
+#endif
+	NNI_PROBE1(aio_begin, aio);
+	nni_flight_record(NNG_FLIGHT_AIO_START, 0, (uintptr_t) aio);
 	return (0);
 }
 
+void
+nni_aio_record_latency(nni_aio *aio, nni_stat_item *item)
+{
+	aio->a_latency = item;
+}
+
 int
 nni_aio_schedule(nni_aio *aio, nni_aio_cancel_fn cancel, void *data)
 {
@@ -416,6 +442,9 @@ nni_aio_abort(nni_aio *aio, int rv)
 	aio->a_cancel_arg = NULL;
 	nni_mtx_unlock(&eq->eq_mtx);
 
+	nni_flight_record(
+	    NNG_FLIGHT_AIO_CANCEL, (uint32_t) rv, (uintptr_t) aio);
+
 	// Stop any I/O at the provider level.
 	if (fn != NULL) {
 		fn(aio, arg, rv);
@@ -432,6 +461,27 @@ nni_aio_finish_impl(
 {
 	nni_aio_expire_q *eq = aio->a_expire_q;
 
+#ifdef NNG_ENABLE_STATS
+	if (aio->a_start_us != 0) {
+		uint64_t us = nni_clock_us() - aio->a_start_us;
+
+		// Sleeps take as long as they were asked to, and would
+		// just add noise.
+		if (nni_aio_latency && !aio->a_sleep) {
+			nni_stat_record(&nni_aio_stat_latency, us);
+		}
+		if (aio->a_latency != NULL) {
+			nni_stat_record(aio->a_latency, us);
+		}
+		aio->a_start_us = 0;
+	}
+#endif
+	aio->a_latency = NULL;
+
+	NNI_PROBE3(aio_finish, aio, rv, count);
+	nni_flight_record(
+	    NNG_FLIGHT_AIO_FINISH, (uint32_t) rv, (uintptr_t) aio);
+
 	nni_mtx_lock(&eq->eq_mtx);
 
 	nni_aio_expire_rm(aio);
@@ -812,6 +862,10 @@ nni_aio_expire_q_alloc(void)
 void
 nni_aio_sys_fini(void)
 {
+#ifdef NNG_ENABLE_STATS
+	nni_stat_unregister(&nni_aio_stat_root);
+	nni_stat_fini(&nni_aio_stat_latency);
+#endif
 	for (int i = 0; i < nni_aio_expire_q_cnt; i++) {
 		nni_aio_expire_q_free(nni_aio_expire_q_list[i]);
 	}
@@ -860,5 +914,27 @@ nni_aio_sys_init(void)
 		nni_aio_expire_q_list[i] = eq;
 	}
 
+#ifdef NNG_ENABLE_STATS
+	static const nni_stat_info root_info = {
+		.si_name = "aio",
+		.si_desc = "asynchronous operations",
+		.si_type = NNG_STAT_SCOPE,
+	};
+	static const nni_stat_info latency_info = {
+		.si_name = "latency",
+		.si_desc = "time to complete operations",
+		.si_type = NNG_STAT_HISTOGRAM,
+		.si_unit = NNG_UNIT_MICROS,
+	};
+	nni_aio_latency = nni_init_get_param(NNG_INIT_AIO_LATENCY, 0) != 0;
+	nni_init_set_effective(NNG_INIT_AIO_LATENCY, nni_aio_latency);
+	nni_stat_init(&nni_aio_stat_root, &root_info);
+	nni_stat_init(&nni_aio_stat_latency, &latency_info);
+	if (nni_aio_latency) {
+		nni_stat_add(&nni_aio_stat_root, &nni_aio_stat_latency);
+	}
+	nni_stat_register(&nni_aio_stat_root);
+#endif
+
 	return (0);
 }
@@ -1,5 +1,5 @@
 //
-// Copyright 2023 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 //
 // This software is supplied under the terms of the MIT License, a
@@ -105,6 +105,10 @@ extern bool nni_aio_busy(nni_aio *);
 // lieu of a callback to build synchronous constructs on top of AIOs.
 extern void nni_aio_wait(nni_aio *);
 
+// nni_aio_spin is like nni_aio_wait, but busy waits for at most the
+// given number of microseconds.  It returns true if the aio completed.
+extern bool nni_aio_spin(nni_aio *, int);
+
 // nni_aio_list_init creates a list suitable for use by providers using
 // the a_prov_node member of the aio.  These operations are not locked,
 // but they do have some extra checks -- remove is idempotent for example,
@@ -137,6 +141,13 @@ extern void nni_aio_abort(nni_aio *, int rv);
 // nng_aio_finish family of functions.)
 extern int nni_aio_begin(nni_aio *);
 
+// nni_aio_record_latency arranges for the time taken by the next operation
+// on the aio, from nni_aio_begin until it finishes, to be recorded in the
+// given histogram.  This must be done before the operation is started.
+// If NNG_INIT_AIO_LATENCY is set, every operation is also recorded in the
+// library wide AIO histogram.
+extern void nni_aio_record_latency(nni_aio *, nni_stat_item *);
+
 extern void *nni_aio_get_prov_data(nni_aio *);
 extern void  nni_aio_set_prov_data(nni_aio *, void *);
 // nni_aio_advance_iov moves up the iov, reflecting that some I/O as
@@ -236,6 +247,10 @@ struct nng_aio {
 	nni_aio_expire_q *a_expire_q;
 	nni_list_node     a_expire_node; // Expiration node
 	nni_reap_node     a_reap_node;
+
+	// Latency statistics.
+	uint64_t       a_start_us; // When the operation began
+	nni_stat_item *a_latency;  // Histogram to record into
 };
 
 #endif // CORE_AIO_H
@@ -1,5 +1,5 @@
 //
-// Copyright 2021 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitoar.com>
 //
 // This software is supplied under the terms of the MIT License, a
@@ -44,6 +44,8 @@ typedef struct nni_dialer   nni_dialer;
 typedef struct nni_listener nni_listener;
 typedef struct nni_pipe     nni_pipe;
 
+typedef struct nni_stat_item nni_stat_item;
+
 typedef struct nni_sp_tran         nni_sp_tran;
 typedef struct nni_sp_dialer_ops   nni_sp_dialer_ops;
 typedef struct nni_sp_listener_ops nni_sp_listener_ops;
@@ -41,6 +41,13 @@ nni_dialer_destroy(nni_dialer *d)
 	if (d->d_data != NULL) {
 		d->d_ops.d_fini(d->d_data);
 	}
+#ifdef NNG_ENABLE_STATS
+	// Pipes may count against these until the very end.
+	nni_stat_fini(&d->st_rx_msgs);
+	nni_stat_fini(&d->st_tx_msgs);
+	nni_stat_fini(&d->st_rx_bytes);
+	nni_stat_fini(&d->st_tx_bytes);
+#endif
 	nni_mtx_fini(&d->d_mtx);
 	nni_url_free(d->d_url);
 	NNI_FREE_STRUCT(d);
@@ -144,6 +151,34 @@ dialer_stats_init(nni_dialer *d)
 		.si_type   = NNG_STAT_COUNTER,
 		.si_atomic = true,
 	};
+	static const nni_stat_info rx_msgs_info = {
+		.si_name  = "rx_msgs",
+		.si_desc  = "messages received by pipes",
+		.si_type  = NNG_STAT_COUNTER,
+		.si_unit  = NNG_UNIT_MESSAGES,
+		.si_shard = true,
+	};
+	static const nni_stat_info tx_msgs_info = {
+		.si_name  = "tx_msgs",
+		.si_desc  = "messages sent by pipes",
+		.si_type  = NNG_STAT_COUNTER,
+		.si_unit  = NNG_UNIT_MESSAGES,
+		.si_shard = true,
+	};
+	static const nni_stat_info rx_bytes_info = {
+		.si_name  = "rx_bytes",
+		.si_desc  = "bytes received by pipes",
+		.si_type  = NNG_STAT_COUNTER,
+		.si_unit  = NNG_UNIT_BYTES,
+		.si_shard = true,
+	};
+	static const nni_stat_info tx_bytes_info = {
+		.si_name  = "tx_bytes",
+		.si_desc  = "bytes sent by pipes",
+		.si_type  = NNG_STAT_COUNTER,
+		.si_unit  = NNG_UNIT_BYTES,
+		.si_shard = true,
+	};
 
 	nni_stat_init(&d->st_root, &root_info);
 
@@ -161,6 +196,10 @@ dialer_stats_init(nni_dialer *d)
 	dialer_stat_init(d, &d->st_auth, &auth_info);
 	dialer_stat_init(d, &d->st_oom, &oom_info);
 	dialer_stat_init(d, &d->st_reject, &reject_info);
+	dialer_stat_init(d, &d->st_rx_msgs, &rx_msgs_info);
+	dialer_stat_init(d, &d->st_tx_msgs, &tx_msgs_info);
+	dialer_stat_init(d, &d->st_rx_bytes, &rx_bytes_info);
+	dialer_stat_init(d, &d->st_tx_bytes, &tx_bytes_info);
 
 	nni_stat_set_id(&d->st_root, (int) d->d_id);
 	nni_stat_set_id(&d->st_id, (int) d->d_id);
@@ -211,6 +250,30 @@ nni_dialer_bump_error(nni_dialer *d, int err)
 #endif
 }
 
+void
+nni_dialer_bump_rx(nni_dialer *d, size_t bytes)
+{
+#ifdef NNG_ENABLE_STATS
+	nni_stat_inc(&d->st_rx_msgs, 1);
+	nni_stat_inc(&d->st_rx_bytes, bytes);
+#else
+	NNI_ARG_UNUSED(d);
+	NNI_ARG_UNUSED(bytes);
+#endif
+}
+
+void
+nni_dialer_bump_tx(nni_dialer *d, size_t bytes)
+{
+#ifdef NNG_ENABLE_STATS
+	nni_stat_inc(&d->st_tx_msgs, 1);
+	nni_stat_inc(&d->st_tx_bytes, bytes);
+#else
+	NNI_ARG_UNUSED(d);
+	NNI_ARG_UNUSED(bytes);
+#endif
+}
+
 // nni_dialer_create creates a dialer on the socket.
 // The caller should have a hold on the socket, and on success
 // the dialer inherits the callers hold.  (If the caller wants
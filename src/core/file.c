@@ -1,5 +1,5 @@
 //
-// Copyright 2018 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 //
 // This software is supplied under the terms of the MIT License, a
@@ -22,6 +22,30 @@ nni_file_get(const char *name, void **datap, size_t *szp)
 	return (nni_plat_file_get(name, datap, szp));
 }
 
+int
+nni_file_open(const char *name, void **fhp, uint64_t *szp)
+{
+	return (nni_plat_file_open(name, fhp, szp));
+}
+
+int
+nni_file_read(void *fh, uint64_t off, void *buf, size_t len, size_t *nread)
+{
+	return (nni_plat_file_read(fh, off, buf, len, nread));
+}
+
+void
+nni_file_close(void *fh)
+{
+	nni_plat_file_close(fh);
+}
+
+int
+nni_file_stat(const char *name, uint64_t *sizep, uint64_t *mtimep)
+{
+	return (nni_plat_file_stat(name, sizep, mtimep));
+}
+
 int
 nni_file_delete(const char *name)
 {
@@ -1,5 +1,5 @@
 //
-// Copyright 2018 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 //
 // This software is supplied under the terms of the MIT License, a
@@ -37,6 +37,23 @@ extern int nni_file_put(const char *, const void *, size_t);
 // using the supplied size when no longer needed.
 extern int nni_file_get(const char *, void **, size_t *);
 
+// nni_file_open opens the named file for reading in pieces, returning
+// a handle and the size of the file.  This is for files that may be too
+// large to read with nni_file_get.  The handle must be closed with
+// nni_file_close.
+extern int nni_file_open(const char *, void **, uint64_t *);
+
+// nni_file_read reads from the file at the given offset, returning the
+// number of bytes read.  A short read only happens at the end of the file.
+extern int nni_file_read(void *, uint64_t, void *, size_t, size_t *);
+
+// nni_file_close closes a handle from nni_file_open.
+extern void nni_file_close(void *);
+
+// nni_file_stat returns the size and modification time (in seconds since
+// the UNIX epoch) of the named file.
+extern int nni_file_stat(const char *, uint64_t *, uint64_t *);
+
 // nni_file_delete deletes the named file.
 extern int nni_file_delete(const char *);
 
@@ -0,0 +1,255 @@
+//
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#include "core/nng_impl.h"
+
+#include <string.h>
+
+// The flight recorder keeps the most recent events in a fixed number of
+// rings.  As with sharded statistics, the ring is chosen by CPU, so that
+// threads running at the same time rarely share one, and the only shared
+// write is the atomic increment that claims a slot.
+//
+// Each slot carries the sequence number of the event it holds, which is
+// cleared while the slot is being written.  Readers copy the slot, and
+// then check that the sequence number is unchanged, discarding the copy
+// otherwise.  The event itself is also kept in atomics, so that its
+// stores stay after the clearing of the sequence number, and its loads
+// before the second check of it; plain stores and loads could be moved
+// past those, and give us a torn event.  Nobody ever waits, which is what
+// lets us read the rings from a signal handler, or while the rest of the
+// library is wedged.  The price is that an event being written at that
+// moment may be missed.
+
+#define FLIGHT_RINGS 16
+#define FLIGHT_SLOTS 512 // per ring, must be a power of two
+
+typedef struct {
+	nni_atomic_u64 fs_seq;  // event sequence number, 0 while writing
+	nni_atomic_u64 fs_time; // fe_time
+	nni_atomic_u64 fs_type; // fe_type in the upper half, fe_id below
+	nni_atomic_u64 fs_arg;  // fe_arg
+} flight_slot;
+
+typedef struct {
+	nni_atomic_u64 fr_head; // number of events ever recorded
+	flight_slot    fr_slots[FLIGHT_SLOTS];
+} flight_ring;
+
+typedef struct {
+	flight_ring     *fc_ring;
+	uint64_t         fc_seq;   // next sequence number to look at
+	uint64_t         fc_left;  // number of slots not yet looked at
+	bool             fc_valid; // true if fc_ev holds an event
+	nng_flight_event fc_ev;
+} flight_cursor;
+
+typedef void (*flight_fn)(const nng_flight_event *, size_t, void *);
+
+static flight_ring     flight_rings[FLIGHT_RINGS];
+static nni_atomic_bool flight_enabled;
+
+void
+nng_flight_enable(bool on)
+{
+	nni_atomic_set_bool(&flight_enabled, on);
+}
+
+void
+nni_flight_record(nng_flight_type type, uint32_t id, uint64_t arg)
+{
+	flight_ring *r;
+	flight_slot *s;
+	uint64_t     seq;
+
+	if (!nni_atomic_get_bool(&flight_enabled)) {
+		return;
+	}
+	r   = &flight_rings[nni_plat_cpu_hint() % FLIGHT_RINGS];
+	seq = nni_atomic_inc64_nv(&r->fr_head);
+	s   = &r->fr_slots[(seq - 1) & (FLIGHT_SLOTS - 1)];
+
+	nni_atomic_set64(&s->fs_seq, 0);
+	nni_atomic_set64(&s->fs_time, nni_clock_us());
+	nni_atomic_set64(&s->fs_type, ((uint64_t) type << 32) | id);
+	nni_atomic_set64(&s->fs_arg, arg);
+	nni_atomic_set64(&s->fs_seq, seq);
+}
+
+static bool
+flight_read(flight_ring *r, uint64_t seq, nng_flight_event *ev)
+{
+	flight_slot *s = &r->fr_slots[(seq - 1) & (FLIGHT_SLOTS - 1)];
+	uint64_t     type;
+
+	if (nni_atomic_get64(&s->fs_seq) != seq) {
+		return (false); // overwritten, or being written
+	}
+	ev->fe_time = nni_atomic_get64(&s->fs_time);
+	type        = nni_atomic_get64(&s->fs_type);
+	ev->fe_arg  = nni_atomic_get64(&s->fs_arg);
+	ev->fe_type = (uint32_t) (type >> 32);
+	ev->fe_id   = (uint32_t) type;
+	return (nni_atomic_get64(&s->fs_seq) == seq);
+}
+
+static void
+flight_advance(flight_cursor *c, bool newest)
+{
+	c->fc_valid = false;
+	while ((c->fc_left > 0) && (!c->fc_valid)) {
+		c->fc_valid = flight_read(c->fc_ring, c->fc_seq, &c->fc_ev);
+		c->fc_seq   = newest ? c->fc_seq - 1 : c->fc_seq + 1;
+		c->fc_left--;
+	}
+}
+
+// flight_walk merges the rings by time, handing up to max events to the
+// function, either newest or oldest first.  It returns the number of
+// events handed over.
+static size_t
+flight_walk(bool newest, size_t max, flight_fn fn, void *arg)
+{
+	flight_cursor cursors[FLIGHT_RINGS];
+	size_t        n = 0;
+
+	for (int i = 0; i < FLIGHT_RINGS; i++) {
+		flight_cursor *c = &cursors[i];
+		uint64_t       head;
+
+		c->fc_ring = &flight_rings[i];
+		head       = nni_atomic_get64(&c->fc_ring->fr_head);
+		c->fc_left = head < FLIGHT_SLOTS ? head : FLIGHT_SLOTS;
+		c->fc_seq  = newest ? head : head - c->fc_left + 1;
+		flight_advance(c, newest);
+	}
+
+	while (n < max) {
+		flight_cursor *best = NULL;
+
+		for (int i = 0; i < FLIGHT_RINGS; i++) {
+			flight_cursor *c = &cursors[i];
+			if (!c->fc_valid) {
+				continue;
+			}
+			if ((best == NULL) ||
+			    (newest ? c->fc_ev.fe_time > best->fc_ev.fe_time
+			            : c->fc_ev.fe_time < best->fc_ev.fe_time)) {
+				best = c;
+			}
+		}
+		if (best == NULL) {
+			break;
+		}
+		fn(&best->fc_ev, n, arg);
+		n++;
+		flight_advance(best, newest);
+	}
+	return (n);
+}
+
+typedef struct {
+	nng_flight_event *evs;
+	size_t            max;
+} flight_copy_arg;
+
+static void
+flight_copy(const nng_flight_event *ev, size_t n, void *arg)
+{
+	flight_copy_arg *ca = arg;
+
+	// We walk backwards in time, so fill from the end.
+	ca->evs[ca->max - n - 1] = *ev;
+}
+
+size_t
+nng_flight_snapshot(nng_flight_event *evs, size_t max)
+{
+	flight_copy_arg ca;
+	size_t          n;
+
+	ca.evs = evs;
+	ca.max = max;
+	n      = flight_walk(true, max, flight_copy, &ca);
+	if (n < max) {
+		memmove(evs, evs + (max - n), n * sizeof(*evs));
+	}
+
+	// Threads sharing a ring can be preempted between claiming a slot
+	// and reading the clock, so the order is only nearly right.  An
+	// insertion sort is cheap for that.
+	for (size_t i = 1; i < n; i++) {
+		nng_flight_event ev = evs[i];
+		size_t           j  = i;
+		while ((j > 0) && (evs[j - 1].fe_time > ev.fe_time)) {
+			evs[j] = evs[j - 1];
+			j--;
+		}
+		evs[j] = ev;
+	}
+	return (n);
+}
+
+const char *
+nng_flight_name(uint32_t type)
+{
+	switch (type) {
+	case NNG_FLIGHT_PIPE_ADD:
+		return ("pipe-add");
+	case NNG_FLIGHT_PIPE_REM:
+		return ("pipe-rem");
+	case NNG_FLIGHT_AIO_START:
+		return ("aio-start");
+	case NNG_FLIGHT_AIO_FINISH:
+		return ("aio-finish");
+	case NNG_FLIGHT_AIO_CANCEL:
+		return ("aio-cancel");
+	case NNG_FLIGHT_QUEUE_FULL:
+		return ("queue-full");
+	case NNG_FLIGHT_DROP:
+		return ("drop");
+	case NNG_FLIGHT_RETRY:
+		return ("retry");
+	case NNG_FLIGHT_RECONNECT:
+		return ("reconnect");
+	default:
+		return ("unknown");
+	}
+}
+
+static void
+flight_print(const nng_flight_event *ev, size_t n, void *arg)
+{
+	unsigned long long sec  = ev->fe_time / 1000000;
+	unsigned long long usec = ev->fe_time % 1000000;
+
+	NNI_ARG_UNUSED(n);
+	NNI_ARG_UNUSED(arg);
+
+	switch (ev->fe_type) {
+	case NNG_FLIGHT_AIO_START:
+	case NNG_FLIGHT_AIO_FINISH:
+	case NNG_FLIGHT_AIO_CANCEL:
+		nni_plat_printf("%llu.%06llu %-12s %-10d %#llx\n", sec, usec,
+		    nng_flight_name(ev->fe_type), (int) ev->fe_id,
+		    (unsigned long long) ev->fe_arg);
+		break;
+	default:
+		nni_plat_printf("%llu.%06llu %-12s %-10u %llu\n", sec, usec,
+		    nng_flight_name(ev->fe_type), (unsigned) ev->fe_id,
+		    (unsigned long long) ev->fe_arg);
+		break;
+	}
+}
+
+void
+nng_flight_dump(void)
+{
+	(void) flight_walk(false, (size_t) -1, flight_print, NULL);
+}
@@ -0,0 +1,19 @@
+//
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#ifndef CORE_FLIGHT_H
+#define CORE_FLIGHT_H
+
+// nni_flight_record records an event in the flight recorder, if it is
+// enabled.  The meanings of the id and arg depend on the type, and are
+// documented with nng_flight_type.  This never blocks, and only costs a
+// function call and a branch when the recorder is disabled.
+extern void nni_flight_record(nng_flight_type, uint32_t, uint64_t);
+
+#endif // CORE_FLIGHT_H
@@ -0,0 +1,203 @@
+//
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#include "core/nng_impl.h"
+
+#include <nuts.h>
+
+#define FLIGHT_THREADS 4
+#define FLIGHT_LOOPS 100000
+
+static nng_flight_event flight_evs[1024];
+
+void
+test_flight_disabled(void)
+{
+	size_t n;
+	size_t n2;
+
+	nng_flight_enable(false);
+	n = nng_flight_snapshot(flight_evs, 1024);
+	nni_flight_record(NNG_FLIGHT_RETRY, 1, 2);
+	n2 = nng_flight_snapshot(flight_evs, 1024);
+	NUTS_TRUE(n == n2);
+}
+
+void
+test_flight_basic(void)
+{
+	size_t n;
+
+	nng_flight_enable(true);
+	nni_flight_record(NNG_FLIGHT_RETRY, 1234, 1);
+	nni_flight_record(NNG_FLIGHT_RECONNECT, 5678, 2);
+	nng_flight_enable(false);
+
+	n = nng_flight_snapshot(flight_evs, 2);
+	NUTS_TRUE(n == 2);
+	NUTS_TRUE(flight_evs[0].fe_type == NNG_FLIGHT_RETRY);
+	NUTS_TRUE(flight_evs[0].fe_id == 1234);
+	NUTS_TRUE(flight_evs[0].fe_arg == 1);
+	NUTS_TRUE(flight_evs[1].fe_type == NNG_FLIGHT_RECONNECT);
+	NUTS_TRUE(flight_evs[1].fe_id == 5678);
+	NUTS_TRUE(flight_evs[1].fe_arg == 2);
+	NUTS_TRUE(flight_evs[0].fe_time <= flight_evs[1].fe_time);
+	NUTS_MATCH(nng_flight_name(NNG_FLIGHT_RETRY), "retry");
+	NUTS_MATCH(nng_flight_name(NNG_FLIGHT_RECONNECT), "reconnect");
+	NUTS_MATCH(nng_flight_name(0), "unknown");
+
+	NUTS_TRUE(nng_flight_snapshot(NULL, 0) == 0);
+}
+
+void
+test_flight_wrap(void)
+{
+	size_t n;
+
+	// Far more than fits, so the rings all wrap.  We should get
+	// just the last ones, in order.
+	nng_flight_enable(true);
+	for (uint64_t i = 0; i < 100000; i++) {
+		nni_flight_record(NNG_FLIGHT_DROP, 0, i);
+	}
+	nng_flight_enable(false);
+
+	n = nng_flight_snapshot(flight_evs, 100);
+	NUTS_TRUE(n == 100);
+	for (size_t i = 0; i < n; i++) {
+		NUTS_TRUE(flight_evs[i].fe_type == NNG_FLIGHT_DROP);
+		NUTS_TRUE(flight_evs[i].fe_arg == 99900 + i);
+	}
+}
+
+typedef struct {
+	nng_mtx *mtx;
+	nng_cv  *cv;
+	int      ready;
+	bool     go;
+} flight_arg;
+
+static void
+flight_thread(void *arg)
+{
+	flight_arg *fa = arg;
+
+	nng_mtx_lock(fa->mtx);
+	fa->ready++;
+	nng_cv_wake(fa->cv);
+	while (!fa->go) {
+		nng_cv_wait(fa->cv);
+	}
+	nng_mtx_unlock(fa->mtx);
+	for (uint64_t i = 0; i < FLIGHT_LOOPS; i++) {
+		nni_flight_record(NNG_FLIGHT_AIO_START, 0, i);
+	}
+}
+
+void
+test_flight_threads(void)
+{
+	flight_arg  fa;
+	nng_thread *thrs[FLIGHT_THREADS];
+	uint64_t    start;
+	size_t      n;
+
+	NUTS_LOGGING();
+	memset(&fa, 0, sizeof(fa));
+	NUTS_PASS(nng_mtx_alloc(&fa.mtx));
+	NUTS_PASS(nng_cv_alloc(&fa.cv, fa.mtx));
+	nng_flight_enable(true);
+	for (int i = 0; i < FLIGHT_THREADS; i++) {
+		NUTS_PASS(nng_thread_create(&thrs[i], flight_thread, &fa));
+	}
+	nng_mtx_lock(fa.mtx);
+	while (fa.ready < FLIGHT_THREADS) {
+		nng_cv_wait(fa.cv);
+	}
+	start = nni_clock_us();
+	fa.go = true;
+	nng_cv_wake(fa.cv);
+	nng_mtx_unlock(fa.mtx);
+
+	// Reading while the writers are busy must be safe, and give us
+	// events in time order.
+	n = nng_flight_snapshot(flight_evs, 1024);
+	for (size_t i = 1; i < n; i++) {
+		NUTS_TRUE(flight_evs[i - 1].fe_time <= flight_evs[i].fe_time);
+	}
+
+	for (int i = 0; i < FLIGHT_THREADS; i++) {
+		nng_thread_destroy(thrs[i]);
+	}
+	start = nni_clock_us() - start;
+	nng_flight_enable(false);
+	nng_log_info("FLIGHT", "%d threads: %llu ns/event", FLIGHT_THREADS,
+	    (unsigned long long) (start * 1000 /
+	        (FLIGHT_THREADS * FLIGHT_LOOPS)));
+
+	// How many we get back depends on how many rings were used.
+	n = nng_flight_snapshot(flight_evs, 1024);
+	NUTS_TRUE(n > 0);
+	for (size_t i = 0; i < n; i++) {
+		NUTS_TRUE(flight_evs[i].fe_type == NNG_FLIGHT_AIO_START);
+		if (i > 0) {
+			NUTS_TRUE(
+			    flight_evs[i - 1].fe_time <= flight_evs[i].fe_time);
+		}
+	}
+	nng_cv_free(fa.cv);
+	nng_mtx_free(fa.mtx);
+}
+
+void
+test_flight_pipes(void)
+{
+	nng_socket s1;
+	nng_socket s2;
+	size_t     n;
+	bool       added = false;
+	bool       sent  = false;
+
+	nng_flight_enable(true);
+	NUTS_OPEN(s1);
+	NUTS_OPEN(s2);
+	NUTS_MARRY(s1, s2);
+	NUTS_SEND(s1, "ping");
+	NUTS_RECV(s2, "ping");
+	nng_flight_enable(false);
+
+	n = nng_flight_snapshot(flight_evs, 1024);
+	for (size_t i = 0; i < n; i++) {
+		switch (flight_evs[i].fe_type) {
+		case NNG_FLIGHT_PIPE_ADD:
+			if (flight_evs[i].fe_arg == (uint64_t) s1.id) {
+				added = true;
+			}
+			break;
+		case NNG_FLIGHT_AIO_FINISH:
+			sent = true;
+			break;
+		default:
+			break;
+		}
+	}
+	NUTS_TRUE(added);
+	NUTS_TRUE(sent);
+	NUTS_CLOSE(s1);
+	NUTS_CLOSE(s2);
+}
+
+NUTS_TESTS = {
+	{ "flight disabled", test_flight_disabled },
+	{ "flight basic", test_flight_basic },
+	{ "flight wrap", test_flight_wrap },
+	{ "flight threads", test_flight_threads },
+	{ "flight pipes", test_flight_pipes },
+	{ NULL, NULL },
+};
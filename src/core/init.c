@@ -17,6 +17,7 @@
 
 extern int  nni_tls_sys_init(void);
 extern void nni_tls_sys_fini(void);
+extern void nni_log_sys_fini(void);
 
 static bool nni_inited = false;
 
@@ -164,6 +165,7 @@ nni_fini(void)
 		nni_init_params_fini();
 		return;
 	}
+	nni_log_sys_fini();
 	nni_sp_tran_sys_fini();
 	nni_tls_sys_fini();
 	nni_reap_drain();
@@ -42,6 +42,13 @@ nni_listener_destroy(nni_listener *l)
 	if (l->l_data != NULL) {
 		l->l_ops.l_fini(l->l_data);
 	}
+#ifdef NNG_ENABLE_STATS
+	// Pipes may count against these until the very end.
+	nni_stat_fini(&l->st_rx_msgs);
+	nni_stat_fini(&l->st_tx_msgs);
+	nni_stat_fini(&l->st_rx_bytes);
+	nni_stat_fini(&l->st_tx_bytes);
+#endif
 	nni_url_free(l->l_url);
 	NNI_FREE_STRUCT(l);
 }
@@ -139,6 +146,34 @@ listener_stats_init(nni_listener *l)
 		.si_type   = NNG_STAT_COUNTER,
 		.si_atomic = true,
 	};
+	static const nni_stat_info rx_msgs_info = {
+		.si_name  = "rx_msgs",
+		.si_desc  = "messages received by pipes",
+		.si_type  = NNG_STAT_COUNTER,
+		.si_unit  = NNG_UNIT_MESSAGES,
+		.si_shard = true,
+	};
+	static const nni_stat_info tx_msgs_info = {
+		.si_name  = "tx_msgs",
+		.si_desc  = "messages sent by pipes",
+		.si_type  = NNG_STAT_COUNTER,
+		.si_unit  = NNG_UNIT_MESSAGES,
+		.si_shard = true,
+	};
+	static const nni_stat_info rx_bytes_info = {
+		.si_name  = "rx_bytes",
+		.si_desc  = "bytes received by pipes",
+		.si_type  = NNG_STAT_COUNTER,
+		.si_unit  = NNG_UNIT_BYTES,
+		.si_shard = true,
+	};
+	static const nni_stat_info tx_bytes_info = {
+		.si_name  = "tx_bytes",
+		.si_desc  = "bytes sent by pipes",
+		.si_type  = NNG_STAT_COUNTER,
+		.si_unit  = NNG_UNIT_BYTES,
+		.si_shard = true,
+	};
 
 	nni_stat_init(&l->st_root, &root_info);
 
@@ -155,6 +190,10 @@ listener_stats_init(nni_listener *l)
 	listener_stat_init(l, &l->st_auth, &auth_info);
 	listener_stat_init(l, &l->st_oom, &oom_info);
 	listener_stat_init(l, &l->st_reject, &reject_info);
+	listener_stat_init(l, &l->st_rx_msgs, &rx_msgs_info);
+	listener_stat_init(l, &l->st_tx_msgs, &tx_msgs_info);
+	listener_stat_init(l, &l->st_rx_bytes, &rx_bytes_info);
+	listener_stat_init(l, &l->st_tx_bytes, &tx_bytes_info);
 
 	nni_stat_set_id(&l->st_root, (int) l->l_id);
 	nni_stat_set_id(&l->st_id, (int) l->l_id);
@@ -199,6 +238,30 @@ nni_listener_bump_error(nni_listener *l, int err)
 #endif
 }
 
+void
+nni_listener_bump_rx(nni_listener *l, size_t bytes)
+{
+#ifdef NNG_ENABLE_STATS
+	nni_stat_inc(&l->st_rx_msgs, 1);
+	nni_stat_inc(&l->st_rx_bytes, bytes);
+#else
+	NNI_ARG_UNUSED(l);
+	NNI_ARG_UNUSED(bytes);
+#endif
+}
+
+void
+nni_listener_bump_tx(nni_listener *l, size_t bytes)
+{
+#ifdef NNG_ENABLE_STATS
+	nni_stat_inc(&l->st_tx_msgs, 1);
+	nni_stat_inc(&l->st_tx_bytes, bytes);
+#else
+	NNI_ARG_UNUSED(l);
+	NNI_ARG_UNUSED(bytes);
+#endif
+}
+
 // nni_listener_create creates a listener on the socket.
 // The caller should have a hold on the socket, and on success
 // the listener inherits the callers hold.  (If the caller wants
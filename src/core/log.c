@@ -19,11 +19,53 @@
 #include <syslog.h>
 #include <unistd.h>
 #endif
+#include <string.h>
 #include <time.h>
 
 static nng_log_level    log_level    = NNG_LOG_NOTICE;
 static nng_log_facility log_facility = NNG_LOG_USER;
 static nng_logger       log_logger   = nng_null_logger;
+static uint32_t         log_limit    = 0; // per msgid per second, 0 is none
+
+// Asynchronous logging.  Callers format the message directly into a slot
+// of a bounded multi-producer ring, and a single thread hands the slots
+// to the logger.  Producers claim slots with a compare-and-swap, and
+// each slot carries a sequence number that says whether it is free for
+// the producer or ready for the consumer.  If the ring is full, the
+// message is counted and discarded, so a slow logger can never hold up
+// the caller.  The only lock a producer might take is to wake the log
+// thread when it is idle, and that lock is never held while logging.
+
+#define LOG_SLOTS 256 // must be a power of two
+#define LOG_MSGID_LEN 32
+#define LOG_MSG_LEN 512
+#define LOG_RATE_BUCKETS 64
+
+typedef struct {
+	nni_atomic_u64   ls_seq;
+	nng_log_level    ls_level;
+	nng_log_facility ls_facility;
+	bool             ls_has_msgid;
+	char             ls_msgid[LOG_MSGID_LEN];
+	char             ls_msg[LOG_MSG_LEN];
+} log_slot;
+
+static log_slot        log_slots[LOG_SLOTS];
+static nni_atomic_u64  log_tail;     // next slot for producers
+static uint64_t        log_head;     // next slot for consumer
+static nni_atomic_bool log_async;    // true if producers use the ring
+static nni_atomic_bool log_sleeping; // log thread wants a wake up
+static nni_atomic_int  log_busy;     // producers that may use the ring
+static nni_atomic_u64  log_overflow; // discarded, ring was full
+static nni_atomic_u64  log_limited;  // discarded, rate limited
+static nni_atomic_u64  log_rate[LOG_RATE_BUCKETS];
+static bool            log_ring_ready = false;
+static bool            log_running    = false;
+static bool            log_stopping   = false; // log_thr being joined
+static nni_thr         log_thr;
+static nni_mtx         log_mtx     = NNI_MTX_INITIALIZER;
+static nni_cv          log_cv      = NNI_CV_INITIALIZER(&log_mtx);
+static nni_cv          log_stop_cv = NNI_CV_INITIALIZER(&log_mtx);
 
 void
 nng_log_set_facility(nng_log_facility facility)
@@ -252,6 +294,244 @@ nng_system_logger(nng_log_level level, nng_log_facility facility,
 #endif
 }
 
+void
+nng_log_set_rate_limit(uint32_t limit)
+{
+	log_limit = limit;
+}
+
+void
+nng_log_get_dropped(uint64_t *overflow, uint64_t *limited)
+{
+	if (overflow != NULL) {
+		*overflow = nni_atomic_get64(&log_overflow);
+	}
+	if (limited != NULL) {
+		*limited = nni_atomic_get64(&log_limited);
+	}
+}
+
+// log_allow applies the rate limit.  Each msgid hashes to a bucket that
+// holds the current second in the upper half, and the number of messages
+// logged during it in the lower half.  Message IDs that share a bucket
+// share the limit, which is fine for the handful that are ever busy.
+static bool
+log_allow(const char *msgid)
+{
+	uint32_t        limit = log_limit;
+	uint32_t        hash  = 2166136261u; // FNV-1a
+	uint64_t        now;
+	nni_atomic_u64 *bucket;
+
+	if (limit == 0) {
+		return (true);
+	}
+	for (const char *p = msgid; (p != NULL) && (*p != 0); p++) {
+		hash ^= (uint8_t) *p;
+		hash *= 16777619u;
+	}
+	bucket = &log_rate[hash % LOG_RATE_BUCKETS];
+	now    = (uint64_t) (uint32_t) (nni_clock() / 1000) << 32;
+
+	for (;;) {
+		uint64_t old = nni_atomic_get64(bucket);
+		uint64_t val;
+
+		if ((old & 0xffffffff00000000ull) != now) {
+			val = now | 1;
+		} else if ((old & 0xffffffffu) >= limit) {
+			nni_atomic_inc64(&log_limited);
+			return (false);
+		} else {
+			val = old + 1;
+		}
+		if (nni_atomic_cas64(bucket, old, val)) {
+			return (true);
+		}
+	}
+}
+
+// log_put places the message in the ring, returning false if it is full.
+static bool
+log_put(nng_log_level level, nng_log_facility facility, const char *msgid,
+    const char *msg, va_list ap)
+{
+	log_slot *s;
+	uint64_t  pos;
+
+	for (;;) {
+		uint64_t seq;
+
+		pos = nni_atomic_get64(&log_tail);
+		s   = &log_slots[pos & (LOG_SLOTS - 1)];
+		seq = nni_atomic_get64(&s->ls_seq);
+		if (seq == pos) {
+			if (nni_atomic_cas64(&log_tail, pos, pos + 1)) {
+				break;
+			}
+		} else if (seq < pos) {
+			// Consumer has not yet freed the slot, so full.
+			return (false);
+		}
+		// Otherwise another producer beat us to it, try again.
+	}
+
+	s->ls_level     = level;
+	s->ls_facility  = facility;
+	s->ls_has_msgid = (msgid != NULL);
+	if (msgid != NULL) {
+		(void) snprintf(s->ls_msgid, sizeof(s->ls_msgid), "%s", msgid);
+	}
+	(void) vsnprintf(s->ls_msg, sizeof(s->ls_msg), msg, ap);
+	nni_atomic_set64(&s->ls_seq, pos + 1);
+
+	if (nni_atomic_get_bool(&log_sleeping)) {
+		nni_mtx_lock(&log_mtx);
+		nni_cv_wake1(&log_cv);
+		nni_mtx_unlock(&log_mtx);
+	}
+	return (true);
+}
+
+static bool
+log_ready(void)
+{
+	log_slot *s = &log_slots[log_head & (LOG_SLOTS - 1)];
+	return (nni_atomic_get64(&s->ls_seq) == log_head + 1);
+}
+
+// log_deliver hands the oldest message in the ring to the logger.
+// Only one thread may call this at a time.
+static bool
+log_deliver(void)
+{
+	log_slot *s = &log_slots[log_head & (LOG_SLOTS - 1)];
+
+	if (!log_ready()) {
+		return (false);
+	}
+	log_logger(s->ls_level, s->ls_facility,
+	    s->ls_has_msgid ? s->ls_msgid : NULL, s->ls_msg);
+	nni_atomic_set64(&s->ls_seq, log_head + LOG_SLOTS);
+	log_head++;
+	return (true);
+}
+
+static void
+log_thread(void *arg)
+{
+	NNI_ARG_UNUSED(arg);
+
+	nni_thr_set_name(NULL, "nng:log");
+	for (;;) {
+		while (log_deliver()) {
+			continue;
+		}
+		nni_mtx_lock(&log_mtx);
+		if (!log_running) {
+			nni_mtx_unlock(&log_mtx);
+			return;
+		}
+		// Producers check log_sleeping after publishing, so setting
+		// it before checking the ring again cannot miss a message.
+		// The timeout is just a backstop.
+		nni_atomic_set_bool(&log_sleeping, true);
+		if (!log_ready()) {
+			(void) nni_cv_until(&log_cv, nni_clock() + 1000);
+		}
+		nni_atomic_set_bool(&log_sleeping, false);
+		nni_mtx_unlock(&log_mtx);
+	}
+}
+
+static void
+log_stop(void)
+{
+	// Caller holds log_mtx.
+	while (log_stopping) {
+		nni_cv_wait(&log_stop_cv);
+	}
+	if (!log_running) {
+		return;
+	}
+	nni_atomic_set_bool(&log_async, false);
+	log_running  = false;
+	log_stopping = true;
+	nni_cv_wake(&log_cv);
+	nni_mtx_unlock(&log_mtx);
+	nni_thr_fini(&log_thr);
+
+	// Producers that saw log_async before we cleared it may still be
+	// writing to the ring.  Once they are done, nobody else will.
+	while (nni_atomic_get(&log_busy) != 0) {
+		nni_msleep(1);
+	}
+	nni_mtx_lock(&log_mtx);
+
+	// Deliver anything that was queued while the thread was stopping.
+	while (log_deliver()) {
+		continue;
+	}
+	log_stopping = false;
+	nni_cv_wake(&log_stop_cv);
+}
+
+int
+nng_log_set_async(bool async)
+{
+	int rv;
+
+	if (async && ((rv = nni_init()) != 0)) {
+		return (rv);
+	}
+	nni_mtx_lock(&log_mtx);
+	if (!log_ring_ready) {
+		nni_atomic_init64(&log_tail);
+		nni_atomic_init64(&log_overflow);
+		nni_atomic_init64(&log_limited);
+		nni_atomic_init_bool(&log_async);
+		nni_atomic_init_bool(&log_sleeping);
+		nni_atomic_init(&log_busy);
+		for (uint64_t i = 0; i < LOG_SLOTS; i++) {
+			nni_atomic_init64(&log_slots[i].ls_seq);
+			nni_atomic_set64(&log_slots[i].ls_seq, i);
+		}
+		for (int i = 0; i < LOG_RATE_BUCKETS; i++) {
+			nni_atomic_init64(&log_rate[i]);
+		}
+		log_ring_ready = true;
+	}
+	if (!async) {
+		log_stop();
+		nni_mtx_unlock(&log_mtx);
+		return (0);
+	}
+	while (log_stopping) {
+		nni_cv_wait(&log_stop_cv);
+	}
+	if (log_running) {
+		nni_mtx_unlock(&log_mtx);
+		return (0);
+	}
+	if ((rv = nni_thr_init(&log_thr, log_thread, NULL)) != 0) {
+		nni_mtx_unlock(&log_mtx);
+		return (rv);
+	}
+	log_running = true;
+	nni_thr_run(&log_thr);
+	nni_atomic_set_bool(&log_async, true);
+	nni_mtx_unlock(&log_mtx);
+	return (0);
+}
+
+void
+nni_log_sys_fini(void)
+{
+	nni_mtx_lock(&log_mtx);
+	log_stop();
+	nni_mtx_unlock(&log_mtx);
+}
+
 static void
 nni_vlog(nng_log_level level, nng_log_facility facility, const char *msgid,
     const char *msg, va_list ap)
@@ -260,7 +540,23 @@ nni_vlog(nng_log_level level, nng_log_facility facility, const char *msgid,
 	if (level > log_level || log_level == 0 || facility == 0) {
 		return;
 	}
-	char formatted[512];
+	if (!log_allow(msgid)) {
+		return;
+	}
+	if (nni_atomic_get_bool(&log_async)) {
+		// Checked again once we are counted, so that log_stop can
+		// wait for everyone who might still use the ring.
+		nni_atomic_inc(&log_busy);
+		if (nni_atomic_get_bool(&log_async)) {
+			if (!log_put(level, facility, msgid, msg, ap)) {
+				nni_atomic_inc64(&log_overflow);
+			}
+			nni_atomic_dec(&log_busy);
+			return;
+		}
+		nni_atomic_dec(&log_busy);
+	}
+	char formatted[LOG_MSG_LEN];
 	vsnprintf(formatted, sizeof(formatted), msg, ap);
 	log_logger(level, facility, msgid, formatted);
 }
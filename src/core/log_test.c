@@ -12,6 +12,7 @@
 
 #include "nuts.h"
 #include <nng/nng.h>
+#include <nng/supplemental/util/platform.h>
 
 #ifdef NNG_PLATFORM_POSIX
 #include <stdlib.h>
@@ -178,11 +179,171 @@ test_log_system_logger(void)
 	nng_log_info("TEST", "This is only a test (INFO). Ignore me.");
 }
 
+static test_logs test_logs_async;
+void
+test_log_async_logger(nng_log_level level, nng_log_facility facility,
+    const char *msgid, const char *msg)
+{
+	custom_logger_base(&test_logs_async, level, facility, msgid, msg);
+}
+
+void
+test_log_async(void)
+{
+	nng_log_set_facility(NNG_LOG_USER);
+	nng_log_set_level(NNG_LOG_INFO);
+	NUTS_PASS(nng_log_set_async(true));
+	NUTS_PASS(nng_log_set_async(true)); // idempotent
+	nng_log_set_logger(test_log_async_logger);
+	nng_log_err("ASYNC1", "First %d", 1);
+	nng_log_debug("ASYNC2", "Filtered");
+	nng_log_warn(NULL, "Second %s", "message");
+	nng_log_info("AN-UNREASONABLY-LONG-MESSAGE-ID-FOR-TESTING", "Third");
+	NUTS_PASS(nng_log_set_async(false));
+
+	NUTS_ASSERT(test_logs_async.count == 3);
+	NUTS_ASSERT(strcmp(test_logs_async.entries[0].msgid, "ASYNC1") == 0);
+	NUTS_ASSERT(strcmp(test_logs_async.entries[0].msg, "First 1") == 0);
+	NUTS_ASSERT(test_logs_async.entries[0].level == NNG_LOG_ERR);
+	NUTS_ASSERT(test_logs_async.entries[1].msgid == NULL);
+	NUTS_ASSERT(
+	    strcmp(test_logs_async.entries[1].msg, "Second message") == 0);
+	NUTS_ASSERT(test_logs_async.entries[1].level == NNG_LOG_WARN);
+	NUTS_ASSERT(test_logs_async.entries[2].level == NNG_LOG_INFO);
+	NUTS_ASSERT(test_logs_async.entries[2].facility == NNG_LOG_USER);
+}
+
+static nng_mtx *test_log_block_mtx;
+static int      test_log_block_count;
+void
+test_log_block_logger(nng_log_level level, nng_log_facility facility,
+    const char *msgid, const char *msg)
+{
+	(void) level;
+	(void) facility;
+	(void) msgid;
+	(void) msg;
+	nng_mtx_lock(test_log_block_mtx);
+	test_log_block_count++;
+	nng_mtx_unlock(test_log_block_mtx);
+}
+
+void
+test_log_async_overflow(void)
+{
+	uint64_t before;
+	uint64_t after;
+
+	NUTS_PASS(nng_mtx_alloc(&test_log_block_mtx));
+	nng_log_set_logger(test_log_block_logger);
+	nng_log_set_level(NNG_LOG_INFO);
+	nng_log_get_dropped(&before, NULL);
+	NUTS_PASS(nng_log_set_async(true));
+
+	// With the logger stuck, we must not be.
+	nng_mtx_lock(test_log_block_mtx);
+	for (int i = 0; i < 1000; i++) {
+		nng_log_info("BLOCK", "Message %d", i);
+	}
+	nng_mtx_unlock(test_log_block_mtx);
+	NUTS_PASS(nng_log_set_async(false));
+
+	nng_log_get_dropped(&after, NULL);
+	NUTS_ASSERT(after > before);
+	NUTS_ASSERT(test_log_block_count + (int) (after - before) == 1000);
+	nng_log_set_logger(nng_null_logger);
+	nng_mtx_free(test_log_block_mtx);
+}
+
+#define LOG_TOGGLE_THREADS 4
+#define LOG_TOGGLE_MSGS 2000
+
+static void
+test_log_toggle_thread(void *arg)
+{
+	(void) arg;
+	for (int i = 0; i < LOG_TOGGLE_MSGS; i++) {
+		nng_log_info("TOGGLE", "Message %d", i);
+	}
+}
+
+void
+test_log_async_toggle(void)
+{
+	nng_thread *thrs[LOG_TOGGLE_THREADS];
+	uint64_t    before;
+	uint64_t    after;
+
+	NUTS_PASS(nng_mtx_alloc(&test_log_block_mtx));
+	test_log_block_count = 0;
+	nng_log_set_logger(test_log_block_logger);
+	nng_log_set_level(NNG_LOG_INFO);
+	nng_log_get_dropped(&before, NULL);
+	for (int i = 0; i < LOG_TOGGLE_THREADS; i++) {
+		NUTS_PASS(
+		    nng_thread_create(&thrs[i], test_log_toggle_thread, NULL));
+	}
+
+	// Every message is either delivered or counted as dropped, no
+	// matter when logging is switched between modes.
+	for (int i = 0; i < 200; i++) {
+		NUTS_PASS(nng_log_set_async((i % 2) == 0));
+	}
+	for (int i = 0; i < LOG_TOGGLE_THREADS; i++) {
+		nng_thread_destroy(thrs[i]);
+	}
+	NUTS_PASS(nng_log_set_async(false));
+
+	nng_log_get_dropped(&after, NULL);
+	NUTS_ASSERT(test_log_block_count + (int) (after - before) ==
+	    LOG_TOGGLE_THREADS * LOG_TOGGLE_MSGS);
+	nng_log_set_logger(nng_null_logger);
+	nng_mtx_free(test_log_block_mtx);
+}
+
+static test_logs test_logs_rate;
+void
+test_log_rate_logger(nng_log_level level, nng_log_facility facility,
+    const char *msgid, const char *msg)
+{
+	custom_logger_base(&test_logs_rate, level, facility, msgid, msg);
+}
+
+void
+test_log_rate_limit(void)
+{
+	uint64_t        before;
+	uint64_t        after;
+	test_log_entry *last;
+
+	nng_log_set_logger(test_log_rate_logger);
+	nng_log_set_level(NNG_LOG_INFO);
+	nng_log_get_dropped(NULL, &before);
+	nng_log_set_rate_limit(3);
+	for (int i = 0; i < 10; i++) {
+		nng_log_warn("RATE", "Message %d", i);
+	}
+	nng_log_warn("OTHER", "Different msgid");
+	nng_log_set_rate_limit(0);
+	nng_log_get_dropped(NULL, &after);
+
+	// If the second changes while we are logging, a few more get in.
+	NUTS_ASSERT(test_logs_rate.count >= 4);
+	NUTS_ASSERT(test_logs_rate.count <= 7);
+	NUTS_ASSERT(test_logs_rate.count + (int) (after - before) == 11);
+	last = &test_logs_rate.entries[test_logs_rate.count - 1];
+	NUTS_ASSERT(strcmp(last->msgid, "OTHER") == 0);
+}
+
 TEST_LIST = {
 	{ "log stderr", test_log_stderr },
 	{ "log priority", test_log_priority },
 	{ "log facility", test_log_facility },
 	{ "log null logger", test_log_null_logger },
 	{ "log system logger", test_log_system_logger },
+	{ "log async", test_log_async },
+	{ "log async overflow", test_log_async_overflow },
+	{ "log async toggle", test_log_async_toggle },
+	{ "log rate limit", test_log_rate_limit },
 	{ NULL, NULL },
 };
@@ -422,6 +422,7 @@ nni_msg_alloc(nni_msg **mp, size_t sz)
 	// We always start with a single valid reference count.
 	nni_atomic_init(&m->m_refcnt);
 	nni_atomic_set(&m->m_refcnt, 1);
+	NNI_PROBE2(msg_alloc, m, sz);
 	*mp = m;
 	return (0);
 }
@@ -447,6 +448,7 @@ nni_msg_dup(nni_msg **dup, const nni_msg *src)
 	m->m_pipe = src->m_pipe;
 	nni_atomic_init(&m->m_refcnt);
 	nni_atomic_set(&m->m_refcnt, 1);
+	NNI_PROBE2(msg_alloc, m, m->m_body.ch_len);
 
 	*dup = m;
 	return (0);
@@ -456,6 +458,7 @@ void
 nni_msg_free(nni_msg *m)
 {
 	if ((m != NULL) && (nni_atomic_dec_nv(&m->m_refcnt) == 0)) {
+		NNI_PROBE2(msg_free, m, m->m_body.ch_len);
 		nni_chunk_free(&m->m_body);
 		NNI_FREE_STRUCT(m);
 	}
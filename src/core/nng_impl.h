@@ -29,6 +29,7 @@
 #include "core/aio.h"
 #include "core/device.h"
 #include "core/file.h"
+#include "core/flight.h"
 #include "core/idhash.h"
 #include "core/init.h"
 #include "core/list.h"
@@ -38,6 +39,7 @@
 #include "core/options.h"
 #include "core/panic.h"
 #include "core/pollable.h"
+#include "core/probe.h"
 #include "core/protocol.h"
 #include "core/reap.h"
 #include "core/stats.h"
@@ -26,6 +26,24 @@ static nni_mtx pipes_lk = NNI_MTX_INITIALIZER;
 
 static void pipe_destroy(void *);
 
+#ifdef NNG_ENABLE_STATS
+// Per-pipe statistics are kept out of line, and only allocated when
+// the socket wants them (see NNG_OPT_PIPE_STATS).  Servers with many
+// short lived connections can turn them off, and rely on the totals
+// kept by the dialer or listener instead.  This saves the memory, and
+// avoids taking the global statistics lock for every accepted pipe.
+struct nni_pipe_stats {
+	nni_stat_item st_root;
+	nni_stat_item st_id;
+	nni_stat_item st_ep_id;
+	nni_stat_item st_sock_id;
+	nni_stat_item st_rx_msgs;
+	nni_stat_item st_tx_msgs;
+	nni_stat_item st_rx_bytes;
+	nni_stat_item st_tx_bytes;
+};
+#endif
+
 static nni_reap_list pipe_reap_list = {
 	.rl_offset = offsetof(nni_pipe, p_reap),
 	.rl_func   = pipe_destroy,
@@ -61,7 +79,9 @@ pipe_destroy(void *arg)
 	}
 
 #ifdef NNG_ENABLE_STATS
-	nni_stat_unregister(&p->st_root);
+	if (p->p_stats != NULL) {
+		nni_stat_unregister(&p->p_stats->st_root);
+	}
 #endif
 	nni_pipe_remove(p);
 
@@ -72,6 +92,11 @@ pipe_destroy(void *arg)
 		p->p_tran_ops.p_fini(p->p_tran_data);
 	}
 	nni_cv_fini(&p->p_cv);
+#ifdef NNG_ENABLE_STATS
+	if (p->p_stats != NULL) {
+		NNI_FREE_STRUCT(p->p_stats);
+	}
+#endif
 	nni_free(p, p->p_size);
 }
 
@@ -114,12 +139,14 @@ nni_pipe_id(nni_pipe *p)
 void
 nni_pipe_recv(nni_pipe *p, nni_aio *aio)
 {
+	NNI_PROBE2(pipe_recv, p->p_id, aio);
 	p->p_tran_ops.p_recv(p->p_tran_data, aio);
 }
 
 void
 nni_pipe_send(nni_pipe *p, nni_aio *aio)
 {
+	NNI_PROBE3(pipe_send, p->p_id, aio, nni_msg_len(nni_aio_get_msg(aio)));
 	p->p_tran_ops.p_send(p->p_tran_data, aio);
 }
 
@@ -162,10 +189,10 @@ static void
 pipe_stat_init(nni_pipe *p, nni_stat_item *item, const nni_stat_info *info)
 {
 	nni_stat_init(item, info);
-	nni_stat_add(&p->st_root, item);
+	nni_stat_add(&p->p_stats->st_root, item);
 }
 
-static void
+static int
 pipe_stats_init(nni_pipe *p)
 {
 	static const nni_stat_info root_info = {
@@ -212,17 +239,37 @@ pipe_stats_init(nni_pipe *p)
 		.si_atomic = true,
 	};
 
-	nni_stat_init(&p->st_root, &root_info);
-	pipe_stat_init(p, &p->st_id, &id_info);
-	pipe_stat_init(p, &p->st_sock_id, &socket_info);
-	pipe_stat_init(p, &p->st_rx_msgs, &rx_msgs_info);
-	pipe_stat_init(p, &p->st_tx_msgs, &tx_msgs_info);
-	pipe_stat_init(p, &p->st_rx_bytes, &rx_bytes_info);
-	pipe_stat_init(p, &p->st_tx_bytes, &tx_bytes_info);
-
-	nni_stat_set_id(&p->st_root, (int) p->p_id);
-	nni_stat_set_id(&p->st_id, (int) p->p_id);
-	nni_stat_set_id(&p->st_sock_id, (int) nni_sock_id(p->p_sock));
+	nni_pipe_stats *st;
+
+	if (!nni_sock_pipe_stats(p->p_sock)) {
+		return (0);
+	}
+	if ((st = NNI_ALLOC_STRUCT(st)) == NULL) {
+		return (NNG_ENOMEM);
+	}
+	p->p_stats = st;
+
+	nni_stat_init(&st->st_root, &root_info);
+	pipe_stat_init(p, &st->st_id, &id_info);
+	pipe_stat_init(p, &st->st_sock_id, &socket_info);
+	pipe_stat_init(p, &st->st_rx_msgs, &rx_msgs_info);
+	pipe_stat_init(p, &st->st_tx_msgs, &tx_msgs_info);
+	pipe_stat_init(p, &st->st_rx_bytes, &rx_bytes_info);
+	pipe_stat_init(p, &st->st_tx_bytes, &tx_bytes_info);
+
+	nni_stat_set_id(&st->st_root, (int) p->p_id);
+	nni_stat_set_id(&st->st_id, (int) p->p_id);
+	nni_stat_set_id(&st->st_sock_id, (int) nni_sock_id(p->p_sock));
+	return (0);
+}
+
+static void
+pipe_stats_add_ep(nni_pipe *p, const nni_stat_info *info, uint32_t id)
+{
+	if (p->p_stats != NULL) {
+		pipe_stat_init(p, &p->p_stats->st_ep_id, info);
+		nni_stat_set_id(&p->p_stats->st_ep_id, (int) id);
+	}
 }
 #endif // NNG_ENABLE_STATS
 
@@ -264,7 +311,9 @@ pipe_create(nni_pipe **pp, nni_sock *sock, nni_sp_tran *tran, void *tran_data)
 	nni_mtx_unlock(&pipes_lk);
 
 #ifdef NNG_ENABLE_STATS
-	pipe_stats_init(p);
+	if (rv == 0) {
+		rv = pipe_stats_init(p);
+	}
 #endif
 
 	if ((rv != 0) || ((rv = p->p_tran_ops.p_init(tran_data, p)) != 0) ||
@@ -295,8 +344,7 @@ nni_pipe_create_dialer(nni_pipe **pp, nni_dialer *d, void *tran_data)
 		.si_desc = "dialer for pipe",
 		.si_type = NNG_STAT_ID,
 	};
-	pipe_stat_init(p, &p->st_ep_id, &dialer_info);
-	nni_stat_set_id(&p->st_ep_id, (int) nni_dialer_id(d));
+	pipe_stats_add_ep(p, &dialer_info, nni_dialer_id(d));
 #endif
 	*pp = p;
 	return (0);
@@ -319,8 +367,7 @@ nni_pipe_create_listener(nni_pipe **pp, nni_listener *l, void *tran_data)
 		.si_desc = "listener for pipe",
 		.si_type = NNG_STAT_ID,
 	};
-	pipe_stat_init(p, &p->st_ep_id, &listener_info);
-	nni_stat_set_id(&p->st_ep_id, (int) nni_listener_id(l));
+	pipe_stats_add_ep(p, &listener_info, nni_listener_id(l));
 #endif
 	*pp = p;
 	return (0);
@@ -366,11 +413,25 @@ nni_pipe_dialer_id(nni_pipe *p)
 	return (p->p_dialer ? nni_dialer_id(p->p_dialer) : 0);
 }
 
+void
+nni_pipe_stats_register(nni_pipe *p)
+{
+#ifdef NNG_ENABLE_STATS
+	if (p->p_stats != NULL) {
+		nni_stat_register(&p->p_stats->st_root);
+	}
+#else
+	NNI_ARG_UNUSED(p);
+#endif
+}
+
 void
 nni_pipe_add_stat(nni_pipe *p, nni_stat_item *item)
 {
 #ifdef NNG_ENABLE_STATS
-	nni_stat_add(&p->st_root, item);
+	if (p->p_stats != NULL) {
+		nni_stat_add(&p->p_stats->st_root, item);
+	}
 #else
 	NNI_ARG_UNUSED(p);
 	NNI_ARG_UNUSED(item);
@@ -380,9 +441,17 @@ nni_pipe_add_stat(nni_pipe *p, nni_stat_item *item)
 void
 nni_pipe_bump_rx(nni_pipe *p, size_t bytes)
 {
+	NNI_PROBE2(pipe_rx, p->p_id, bytes);
 #ifdef NNG_ENABLE_STATS
-	nni_stat_inc(&p->st_rx_bytes, bytes);
-	nni_stat_inc(&p->st_rx_msgs, 1);
+	if (p->p_stats != NULL) {
+		nni_stat_inc(&p->p_stats->st_rx_bytes, bytes);
+		nni_stat_inc(&p->p_stats->st_rx_msgs, 1);
+	}
+	if (p->p_dialer != NULL) {
+		nni_dialer_bump_rx(p->p_dialer, bytes);
+	} else if (p->p_listener != NULL) {
+		nni_listener_bump_rx(p->p_listener, bytes);
+	}
 #else
 	NNI_ARG_UNUSED(p);
 	NNI_ARG_UNUSED(bytes);
@@ -392,15 +461,29 @@ nni_pipe_bump_rx(nni_pipe *p, size_t bytes)
 void
 nni_pipe_bump_tx(nni_pipe *p, size_t bytes)
 {
+	NNI_PROBE2(pipe_tx, p->p_id, bytes);
 #ifdef NNG_ENABLE_STATS
-	nni_stat_inc(&p->st_tx_bytes, bytes);
-	nni_stat_inc(&p->st_tx_msgs, 1);
+	if (p->p_stats != NULL) {
+		nni_stat_inc(&p->p_stats->st_tx_bytes, bytes);
+		nni_stat_inc(&p->p_stats->st_tx_msgs, 1);
+	}
+	if (p->p_dialer != NULL) {
+		nni_dialer_bump_tx(p->p_dialer, bytes);
+	} else if (p->p_listener != NULL) {
+		nni_listener_bump_tx(p->p_listener, bytes);
+	}
 #else
 	NNI_ARG_UNUSED(p);
 	NNI_ARG_UNUSED(bytes);
 #endif
 }
 
+void
+nni_pipe_time_tx(nni_pipe *p, nni_aio *aio)
+{
+	nni_sock_time_tx(p->p_sock, aio);
+}
+
 void
 nni_pipe_bump_error(nni_pipe *p, int err)
 {
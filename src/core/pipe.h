@@ -55,13 +55,19 @@ extern uint32_t nni_pipe_dialer_id(nni_pipe *);
 // nni_pipe_rele releases the hold on the pipe placed by nni_pipe_find.
 extern void nni_pipe_rele(nni_pipe *);
 
-// nni_pipe_add_stat adds a statistic to the pipe
+// nni_pipe_add_stat adds a statistic to the pipe.  This does nothing if
+// the pipe has no statistics (NNG_OPT_PIPE_STATS was false on the socket),
+// so the item must not need to be unregistered to release resources.
 extern void nni_pipe_add_stat(nni_pipe *, nni_stat_item *);
 
 extern void nni_pipe_bump_rx(nni_pipe *, size_t);
 extern void nni_pipe_bump_tx(nni_pipe *, size_t);
 extern void nni_pipe_bump_error(nni_pipe *, int);
 
+// nni_pipe_time_tx is called by transports just before they write to
+// the underlying connection, so that the time taken can be recorded.
+extern void nni_pipe_time_tx(nni_pipe *, nni_aio *);
+
 extern char *nni_pipe_peer_addr(nni_pipe *p, char buf[NNG_MAXADDRSTRLEN]);
 
 #endif // CORE_PIPE_H
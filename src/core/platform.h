@@ -203,6 +203,7 @@ extern uint64_t nni_atomic_get64(nni_atomic_u64 *);
 extern void     nni_atomic_set64(nni_atomic_u64 *, uint64_t);
 extern uint64_t nni_atomic_swap64(nni_atomic_u64 *, uint64_t);
 extern uint64_t nni_atomic_dec64_nv(nni_atomic_u64 *);
+extern uint64_t nni_atomic_inc64_nv(nni_atomic_u64 *);
 extern void     nni_atomic_inc64(nni_atomic_u64 *);
 
 // nni_atomic_cas64 is a compare and swap.  The second argument is the
@@ -249,6 +250,11 @@ extern void                  *nni_atomic_get_ptr(nni_atomic_ptr *);
 // option of using negative values for other purposes in the future.)
 extern nni_time nni_clock(void);
 
+// nni_clock_us is like nni_clock, but with microsecond resolution.  It is
+// intended for timing short intervals (such as spin budgets), and need
+// not share a base with nni_clock.
+extern uint64_t nni_clock_us(void);
+
 // Get the real time, in seconds and nanoseconds
 extern int nni_time_get(uint64_t *seconds, uint32_t *nanoseconds);
 
@@ -285,6 +291,12 @@ extern void nni_plat_fini(void);
 // used to scale the number of independent threads started.
 extern int nni_plat_ncpu(void);
 
+// nni_plat_cpu_hint returns a small number identifying the CPU the caller
+// is running on, or failing that, the calling thread.  It is only a hint,
+// as the caller may be moved at any time, and is used to spread updates
+// to shared data (such as statistics) so that they do not contend.
+extern unsigned nni_plat_cpu_hint(void);
+
 //
 // TCP Support.
 //
@@ -482,6 +494,23 @@ extern int nni_plat_file_put(const char *, const void *, size_t);
 // using the supplied size when no longer needed.
 extern int nni_plat_file_get(const char *, void **, size_t *);
 
+// nni_plat_file_open opens the named file for reading, returning a
+// handle and the size of the file.  This is for files that are too large
+// to read in one piece.  Only regular files can be opened.
+extern int nni_plat_file_open(const char *, void **, uint64_t *);
+
+// nni_plat_file_read reads up to the given number of bytes from the
+// file at the given offset, returning the number of bytes read.  Fewer
+// bytes are read only at the end of the file.
+extern int nni_plat_file_read(void *, uint64_t, void *, size_t, size_t *);
+
+// nni_plat_file_close closes a handle opened with nni_plat_file_open.
+extern void nni_plat_file_close(void *);
+
+// nni_plat_file_stat returns the size of the named file, and the time
+// it was last modified, in seconds since the UNIX epoch.
+extern int nni_plat_file_stat(const char *, uint64_t *, uint64_t *);
+
 // nni_plat_file_delete deletes the named file.  If the name refers to
 // a directory, then that will be removed only if empty.
 extern int nni_plat_file_delete(const char *);
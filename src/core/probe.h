@@ -0,0 +1,53 @@
+//
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#ifndef CORE_PROBE_H
+#define CORE_PROBE_H
+
+// Static tracepoints (USDT), for use with tools like bpftrace, perf,
+// or SystemTap.  These are only compiled in when NNG_ENABLE_USDT is set
+// (which requires sys/sdt.h).  Otherwise they expand to nothing, and
+// their arguments are not evaluated.  When compiled in, an unused probe
+// is just a no-op instruction, and the arguments are only evaluated
+// into registers that the tracer can find.
+//
+// All probes use the provider name "nng".  The probes are:
+//
+//   aio_begin(aio)                      operation started
+//   aio_finish(aio, result, count)      operation completed
+//   msg_alloc(msg, size)                message allocated (or duplicated)
+//   msg_free(msg, size)                 last reference to message dropped
+//   sock_send(socket, aio, size)        send submitted on socket
+//   sock_recv(socket, aio)              receive submitted on socket
+//   ctx_send(context, aio, size)        send submitted on context
+//   ctx_recv(context, aio)              receive submitted on context
+//   pipe_send(pipe, aio, size)          send handed to transport
+//   pipe_recv(pipe, aio)                receive handed to transport
+//   pipe_tx(pipe, bytes)                transport finished sending message
+//   pipe_rx(pipe, bytes)                transport finished receiving message
+//   pollq_dispatch(fd, events)          poller callback about to run
+//   task_start(task, arg)               task callback about to run
+//   task_done(task)                     task callback returned
+//
+// Socket, context and pipe arguments are their numeric IDs.  The aio
+// pointer can be used to match up the start and end of operations.
+
+#ifdef NNG_ENABLE_USDT
+#include <sys/sdt.h>
+
+#define NNI_PROBE1(name, a) DTRACE_PROBE1(nng, name, a)
+#define NNI_PROBE2(name, a, b) DTRACE_PROBE2(nng, name, a, b)
+#define NNI_PROBE3(name, a, b, c) DTRACE_PROBE3(nng, name, a, b, c)
+#else
+#define NNI_PROBE1(name, a)
+#define NNI_PROBE2(name, a, b)
+#define NNI_PROBE3(name, a, b, c)
+#endif
+
+#endif // CORE_PROBE_H
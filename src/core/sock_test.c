@@ -1,5 +1,5 @@
 //
-// Copyright 2020 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 //
 // This software is supplied under the terms of the MIT License, a
@@ -27,6 +27,58 @@ test_recv_timeout(void)
 	NUTS_CLOSE(s1);
 }
 
+void
+test_recv_spin(void)
+{
+	nng_socket s1;
+	nng_socket s2;
+	int        spin;
+	uint64_t   now;
+	nng_msg   *msg = NULL;
+
+	NUTS_OPEN(s1);
+	NUTS_OPEN(s2);
+	NUTS_PASS(nng_socket_get_int(s1, NNG_OPT_RECVSPIN, &spin));
+	NUTS_TRUE(spin == 0);
+	NUTS_FAIL(nng_socket_set_int(s1, NNG_OPT_RECVSPIN, -1), NNG_EINVAL);
+	NUTS_FAIL(
+	    nng_socket_set_int(s1, NNG_OPT_RECVSPIN, 1000001), NNG_EINVAL);
+	NUTS_FAIL(nng_socket_set_bool(s1, NNG_OPT_RECVSPIN, true),
+	    NNG_EBADTYPE);
+	NUTS_PASS(nng_socket_set_int(s1, NNG_OPT_RECVSPIN, 1000));
+	NUTS_PASS(nng_socket_get_int(s1, NNG_OPT_RECVSPIN, &spin));
+	NUTS_TRUE(spin == 1000);
+
+	// Timeouts still work while spinning.
+	NUTS_PASS(nng_socket_set_ms(s1, NNG_OPT_RECVTIMEO, 10));
+	NUTS_CLOCK(now);
+	NUTS_FAIL(nng_recvmsg(s1, &msg, 0), NNG_ETIMEDOUT);
+	NUTS_TRUE(msg == NULL);
+	NUTS_BEFORE(now + 500);
+	NUTS_AFTER(now + 9);
+
+	// Non-blocking receives do not spin, and are not counted as hits.
+	NUTS_FAIL(nng_recvmsg(s1, &msg, NNG_FLAG_NONBLOCK), NNG_EAGAIN);
+#ifdef NNG_ENABLE_STATS
+	nng_stat *stats;
+	nng_stat *hits;
+	NUTS_PASS(nng_stats_get(&stats));
+	NUTS_TRUE((hits = nng_stat_find_socket(stats, s1)) != NULL);
+	NUTS_TRUE((hits = nng_stat_find(hits, "recv_spin_hits")) != NULL);
+	NUTS_TRUE(nng_stat_value(hits) == 0);
+	nng_stats_free(stats);
+#endif
+
+	NUTS_PASS(nng_socket_set_ms(s1, NNG_OPT_RECVTIMEO, 1000));
+	NUTS_MARRY(s1, s2);
+	for (int i = 0; i < 10; i++) {
+		NUTS_SEND(s2, "spin");
+		NUTS_RECV(s1, "spin");
+	}
+	NUTS_CLOSE(s1);
+	NUTS_CLOSE(s2);
+}
+
 void
 test_recv_nonblock(void)
 {
@@ -635,6 +687,7 @@ test_size_options(void)
 NUTS_TESTS = {
 	{ "recv timeout", test_recv_timeout },
 	{ "recv non-block", test_recv_nonblock },
+	{ "recv spin", test_recv_spin },
 	{ "send timeout", test_send_timeout },
 	{ "send non-block", test_send_nonblock },
 	{ "read only options", test_readonly_options },
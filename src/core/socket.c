@@ -68,13 +68,16 @@ struct nni_socket {
 	nni_proto_ctx_ops  s_ctx_ops;
 
 	// options
-	nni_duration s_sndtimeo;  // send timeout
-	nni_duration s_rcvtimeo;  // receive timeout
-	nni_duration s_reconn;    // reconnect time
-	nni_duration s_reconnmax; // max reconnect time
-	size_t       s_rcvmaxsz;  // max receive size
-	nni_list     s_options;   // opts not handled by sock/proto
-	char         s_name[64];  // socket name (legacy compat)
+	nni_duration    s_sndtimeo;   // send timeout
+	nni_duration    s_rcvtimeo;   // receive timeout
+	nni_duration    s_reconn;     // reconnect time
+	nni_duration    s_reconnmax;  // max reconnect time
+	size_t          s_rcvmaxsz;   // max receive size
+	nni_atomic_int  s_spin;       // max receive spin (usec), 0 disables
+	nni_atomic_int  s_spin_cur;   // current (adaptive) receive spin
+	nni_atomic_bool s_pipe_stats; // per-pipe statistics for new pipes
+	nni_list        s_options;    // opts not handled by sock/proto
+	char            s_name[64];   // socket name (legacy compat)
 
 	nni_list s_listeners; // active listeners
 	nni_list s_dialers;   // active dialers
@@ -100,6 +103,10 @@ struct nni_socket {
 	nni_stat_item st_rx_msgs;   // number of msgs received
 	nni_stat_item st_tx_msgs;   // number of msgs sent
 	nni_stat_item st_rejects;   // pipes rejected
+	nni_stat_item st_spin_hit;  // receives completed while spinning
+	nni_stat_item st_spin_miss; // receives that slept after spinning
+	nni_stat_item st_tx_wait;   // time for sends to be accepted
+	nni_stat_item st_tx_write;  // time for transports to write
 #endif
 };
 
@@ -190,6 +197,45 @@ sock_get_sendtimeo(void *s, void *buf, size_t *szp, nni_type t)
 	return (nni_copyout_ms(SOCK(s)->s_sndtimeo, buf, szp, t));
 }
 
+static int
+sock_set_recvspin(void *s, const void *buf, size_t sz, nni_type t)
+{
+	int usec;
+	int rv;
+
+	if ((rv = nni_copyin_int(&usec, buf, sz, 0, 1000000, t)) != 0) {
+		return (rv);
+	}
+	nni_atomic_set(&SOCK(s)->s_spin, usec);
+	nni_atomic_set(&SOCK(s)->s_spin_cur, usec);
+	return (0);
+}
+
+static int
+sock_get_recvspin(void *s, void *buf, size_t *szp, nni_type t)
+{
+	return (nni_copyout_int(nni_atomic_get(&SOCK(s)->s_spin), buf, szp, t));
+}
+
+static int
+sock_set_pipe_stats(void *s, const void *buf, size_t sz, nni_type t)
+{
+	bool b;
+	int  rv;
+
+	if ((rv = nni_copyin_bool(&b, buf, sz, t)) == 0) {
+		nni_atomic_set_bool(&SOCK(s)->s_pipe_stats, b);
+	}
+	return (rv);
+}
+
+static int
+sock_get_pipe_stats(void *s, void *buf, size_t *szp, nni_type t)
+{
+	return (nni_copyout_bool(
+	    nni_atomic_get_bool(&SOCK(s)->s_pipe_stats), buf, szp, t));
+}
+
 static int
 sock_set_recvbuf(void *s, const void *buf, size_t sz, nni_type t)
 {
@@ -285,6 +331,16 @@ static const nni_option sock_options[] = {
 	    .o_get  = sock_get_sendtimeo,
 	    .o_set  = sock_set_sendtimeo,
 	},
+	{
+	    .o_name = NNG_OPT_RECVSPIN,
+	    .o_get  = sock_get_recvspin,
+	    .o_set  = sock_set_recvspin,
+	},
+	{
+	    .o_name = NNG_OPT_PIPE_STATS,
+	    .o_get  = sock_get_pipe_stats,
+	    .o_set  = sock_set_pipe_stats,
+	},
 	{
 	    .o_name = NNG_OPT_RECVFD,
 	    .o_get  = sock_get_recvfd,
@@ -463,33 +519,59 @@ sock_stats_init(nni_sock *s)
 		.si_atomic = true,
 	};
 	static const nni_stat_info tx_msgs_info = {
-		.si_name   = "tx_msgs",
-		.si_desc   = "sent messages",
-		.si_type   = NNG_STAT_COUNTER,
-		.si_unit   = NNG_UNIT_MESSAGES,
-		.si_atomic = true,
+		.si_name  = "tx_msgs",
+		.si_desc  = "sent messages",
+		.si_type  = NNG_STAT_COUNTER,
+		.si_unit  = NNG_UNIT_MESSAGES,
+		.si_shard = true,
 	};
 	static const nni_stat_info rx_msgs_info = {
-		.si_name   = "rx_msgs",
-		.si_desc   = "received messages",
-		.si_type   = NNG_STAT_COUNTER,
-		.si_unit   = NNG_UNIT_MESSAGES,
-		.si_atomic = true,
+		.si_name  = "rx_msgs",
+		.si_desc  = "received messages",
+		.si_type  = NNG_STAT_COUNTER,
+		.si_unit  = NNG_UNIT_MESSAGES,
+		.si_shard = true,
 	};
 	static const nni_stat_info tx_bytes_info = {
-		.si_name   = "tx_bytes",
-		.si_desc   = "sent bytes",
+		.si_name  = "tx_bytes",
+		.si_desc  = "sent bytes",
+		.si_type  = NNG_STAT_COUNTER,
+		.si_unit  = NNG_UNIT_BYTES,
+		.si_shard = true,
+	};
+	static const nni_stat_info rx_bytes_info = {
+		.si_name  = "rx_bytes",
+		.si_desc  = "received bytes",
+		.si_type  = NNG_STAT_COUNTER,
+		.si_unit  = NNG_UNIT_BYTES,
+		.si_shard = true,
+	};
+	static const nni_stat_info spin_hit_info = {
+		.si_name   = "recv_spin_hits",
+		.si_desc   = "receives completed while spinning",
 		.si_type   = NNG_STAT_COUNTER,
-		.si_unit   = NNG_UNIT_BYTES,
+		.si_unit   = NNG_UNIT_EVENTS,
 		.si_atomic = true,
 	};
-	static const nni_stat_info rx_bytes_info = {
-		.si_name   = "rx_bytes",
-		.si_desc   = "received messages",
+	static const nni_stat_info spin_miss_info = {
+		.si_name   = "recv_spin_misses",
+		.si_desc   = "receives that had to sleep after spinning",
 		.si_type   = NNG_STAT_COUNTER,
-		.si_unit   = NNG_UNIT_BYTES,
+		.si_unit   = NNG_UNIT_EVENTS,
 		.si_atomic = true,
 	};
+	static const nni_stat_info tx_wait_info = {
+		.si_name = "tx_wait",
+		.si_desc = "time for sends to be accepted",
+		.si_type = NNG_STAT_HISTOGRAM,
+		.si_unit = NNG_UNIT_MICROS,
+	};
+	static const nni_stat_info tx_write_info = {
+		.si_name = "tx_write",
+		.si_desc = "time for transports to write",
+		.si_type = NNG_STAT_HISTOGRAM,
+		.si_unit = NNG_UNIT_MICROS,
+	};
 
 	// To make collection cheap and atomic for the socket,
 	// we just use a single lock for the entire chain.
@@ -506,6 +588,10 @@ sock_stats_init(nni_sock *s)
 	sock_stat_init(s, &s->st_rx_msgs, &rx_msgs_info);
 	sock_stat_init(s, &s->st_tx_bytes, &tx_bytes_info);
 	sock_stat_init(s, &s->st_rx_bytes, &rx_bytes_info);
+	sock_stat_init(s, &s->st_spin_hit, &spin_hit_info);
+	sock_stat_init(s, &s->st_spin_miss, &spin_miss_info);
+	sock_stat_init(s, &s->st_tx_wait, &tx_wait_info);
+	sock_stat_init(s, &s->st_tx_write, &tx_write_info);
 
 	nni_stat_set_id(&s->st_id, (int) s->s_id);
 	nni_stat_set_string(&s->st_name, s->s_name);
@@ -534,6 +620,15 @@ sock_destroy(nni_sock *s)
 	}
 	nni_mtx_unlock(&s->s_mx);
 
+#ifdef NNG_ENABLE_STATS
+	nni_stat_fini(&s->st_rx_bytes);
+	nni_stat_fini(&s->st_tx_bytes);
+	nni_stat_fini(&s->st_rx_msgs);
+	nni_stat_fini(&s->st_tx_msgs);
+	nni_stat_fini(&s->st_tx_wait);
+	nni_stat_fini(&s->st_tx_write);
+#endif
+
 	nni_msgq_fini(s->s_urq);
 	nni_msgq_fini(s->s_uwq);
 	nni_cv_fini(&s->s_close_cv);
@@ -570,6 +665,10 @@ nni_sock_create(nni_sock **sp, const nni_proto *proto)
 	s->s_pipe_ops  = *proto->proto_pipe_ops;
 	s->s_closed    = false;
 	s->s_closing   = false;
+	nni_atomic_init(&s->s_spin);
+	nni_atomic_init(&s->s_spin_cur);
+	nni_atomic_init_bool(&s->s_pipe_stats);
+	nni_atomic_set_bool(&s->s_pipe_stats, true);
 
 	if (proto->proto_ctx_ops != NULL) {
 		s->s_ctx_ops = *proto->proto_ctx_ops;
@@ -836,6 +935,11 @@ void
 nni_sock_send(nni_sock *sock, nni_aio *aio)
 {
 	nni_aio_normalize_timeout(aio, sock->s_sndtimeo);
+#ifdef NNG_ENABLE_STATS
+	nni_aio_record_latency(aio, &sock->st_tx_wait);
+#endif
+	NNI_PROBE3(
+	    sock_send, sock->s_id, aio, nni_msg_len(nni_aio_get_msg(aio)));
 	sock->s_sock_ops.sock_send(sock->s_data, aio);
 }
 
@@ -843,9 +947,46 @@ void
 nni_sock_recv(nni_sock *sock, nni_aio *aio)
 {
 	nni_aio_normalize_timeout(aio, sock->s_rcvtimeo);
+	NNI_PROBE2(sock_recv, sock->s_id, aio);
 	sock->s_sock_ops.sock_recv(sock->s_data, aio);
 }
 
+// nni_sock_recv_spin busy waits for a receive submitted by nni_sock_recv
+// to complete, if the socket has been configured for that.  This saves the
+// cost of sleeping and being woken up again, which dominates latency on
+// fast links, at the expense of CPU.  The budget adapts: it is halved each
+// time spinning fails to pick up a message (down to a sixteenth of the
+// configured maximum), and doubled each time it succeeds.  Callers still
+// need to wait for the aio, as it may not be complete.
+void
+nni_sock_recv_spin(nni_sock *sock, nni_aio *aio)
+{
+	int max = nni_atomic_get(&sock->s_spin);
+	int cur;
+
+	// Non-blocking receives are already done, one way or the other,
+	// and must not skew the adaptive budget or the statistics.
+	if ((max == 0) || (nni_aio_get_timeout(aio) == NNG_DURATION_ZERO)) {
+		return;
+	}
+	cur = nni_atomic_get(&sock->s_spin_cur);
+	if (nni_aio_spin(aio, cur)) {
+		cur = (cur * 2 > max) ? max : cur * 2;
+#ifdef NNG_ENABLE_STATS
+		nni_stat_inc(&sock->st_spin_hit, 1);
+#endif
+	} else {
+		cur = (cur / 2 < max / 16) ? max / 16 : cur / 2;
+#ifdef NNG_ENABLE_STATS
+		nni_stat_inc(&sock->st_spin_miss, 1);
+#endif
+	}
+	if (cur < 1) {
+		cur = 1;
+	}
+	nni_atomic_set(&sock->s_spin_cur, cur);
+}
+
 // nni_sock_proto_id returns the socket's 16-bit protocol number.
 uint16_t
 nni_sock_proto_id(nni_sock *sock)
@@ -1233,6 +1374,12 @@ nni_sock_flags(nni_sock *sock)
 	return (sock->s_flags);
 }
 
+bool
+nni_sock_pipe_stats(nni_sock *sock)
+{
+	return (nni_atomic_get_bool(&sock->s_pipe_stats));
+}
+
 void
 nni_sock_set_pipe_cb(nni_sock *s, int ev, nng_pipe_cb cb, void *arg)
 {
@@ -1386,6 +1533,10 @@ void
 nni_ctx_send(nni_ctx *ctx, nni_aio *aio)
 {
 	nni_aio_normalize_timeout(aio, ctx->c_sndtimeo);
+#ifdef NNG_ENABLE_STATS
+	nni_aio_record_latency(aio, &ctx->c_sock->st_tx_wait);
+#endif
+	NNI_PROBE3(ctx_send, ctx->c_id, aio, nni_msg_len(nni_aio_get_msg(aio)));
 	ctx->c_ops.ctx_send(ctx->c_data, aio);
 }
 
@@ -1393,6 +1544,7 @@ void
 nni_ctx_recv(nni_ctx *ctx, nni_aio *aio)
 {
 	nni_aio_normalize_timeout(aio, ctx->c_rcvtimeo);
+	NNI_PROBE2(ctx_recv, ctx->c_id, aio);
 	ctx->c_ops.ctx_recv(ctx->c_data, aio);
 }
 
@@ -1460,6 +1612,7 @@ static void
 dialer_timer_start_locked(nni_dialer *d)
 {
 	nni_duration back_off;
+	nni_duration delay;
 
 	back_off = d->d_currtime;
 	if (d->d_maxrtime > 0) {
@@ -1476,8 +1629,9 @@ dialer_timer_start_locked(nni_dialer *d)
 	// This algorithm may lead to slight biases because we don't
 	// have a statistically perfect distribution with the modulo of
 	// the random number, but this really doesn't matter.
-	nni_sleep_aio(
-	    back_off ? (int) nni_random() % back_off : 0, &d->d_tmo_aio);
+	delay = back_off ? (int) nni_random() % back_off : 0;
+	nni_flight_record(NNG_FLIGHT_RECONNECT, d->d_id, (uint64_t) delay);
+	nni_sleep_aio(delay, &d->d_tmo_aio);
 }
 
 void
@@ -1538,11 +1692,7 @@ nni_dialer_add_pipe(nni_dialer *d, void *tpipe)
 		nni_pipe_rele(p);
 		return;
 	}
-#ifdef NNG_ENABLE_STATS
-	nni_stat_set_id(&p->st_root, (int) p->p_id);
-	nni_stat_set_id(&p->st_id, (int) p->p_id);
-	nni_stat_register(&p->st_root);
-#endif
+	nni_pipe_stats_register(p);
 	nni_pipe_run_cb(p, NNG_PIPE_EV_ADD_POST);
 	if (nng_log_get_level() >= NNG_LOG_DEBUG) {
 		char addr[NNG_MAXADDRSTRLEN];
@@ -1654,11 +1804,7 @@ nni_listener_add_pipe(nni_listener *l, void *tpipe)
 		nni_pipe_rele(p);
 		return;
 	}
-#ifdef NNG_ENABLE_STATS
-	nni_stat_set_id(&p->st_root, (int) p->p_id);
-	nni_stat_set_id(&p->st_id, (int) p->p_id);
-	nni_stat_register(&p->st_root);
-#endif
+	nni_pipe_stats_register(p);
 	nni_pipe_run_cb(p, NNG_PIPE_EV_ADD_POST);
 	if (nng_log_get_level() >= NNG_LOG_DEBUG) {
 		char addr[NNG_MAXADDRSTRLEN];
@@ -1739,6 +1885,12 @@ nni_pipe_run_cb(nni_pipe *p, nng_pipe_ev ev)
 	nng_pipe_cb cb;
 	void       *arg;
 
+	if (ev == NNG_PIPE_EV_ADD_POST) {
+		nni_flight_record(NNG_FLIGHT_PIPE_ADD, p->p_id, s->s_id);
+	} else if (ev == NNG_PIPE_EV_REM_POST) {
+		nni_flight_record(NNG_FLIGHT_PIPE_REM, p->p_id, s->s_id);
+	}
+
 	nni_mtx_lock(&s->s_pipe_cbs_mtx);
 	if (!p->p_cbs) {
 		if (ev == NNG_PIPE_EV_ADD_PRE) {
@@ -1813,6 +1965,17 @@ nni_sock_bump_tx(nni_sock *s, uint64_t sz)
 #endif
 }
 
+void
+nni_sock_time_tx(nni_sock *s, nni_aio *aio)
+{
+#ifdef NNG_ENABLE_STATS
+	nni_aio_record_latency(aio, &s->st_tx_write);
+#else
+	NNI_ARG_UNUSED(s);
+	NNI_ARG_UNUSED(aio);
+#endif
+}
+
 void
 nni_sock_bump_rx(nni_sock *s, uint64_t sz)
 {
@@ -1,5 +1,5 @@
 //
-// Copyright 2021 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 //
 // This software is supplied under the terms of the MIT License, a
@@ -33,6 +33,7 @@ extern int nni_sock_getopt(
     nni_sock *, const char *, void *, size_t *, nni_opt_type);
 extern void     nni_sock_send(nni_sock *, nni_aio *);
 extern void     nni_sock_recv(nni_sock *, nni_aio *);
+extern void     nni_sock_recv_spin(nni_sock *, nni_aio *);
 extern uint32_t nni_sock_id(nni_sock *);
 
 // These are socket methods that protocol operations can expect to call.
@@ -110,4 +111,9 @@ extern void nni_sock_bump_rx(nni_sock *s, uint64_t sz);
 // a consuming app.  It bumps the txmsgs by one and txbytes by the size.
 extern void nni_sock_bump_tx(nni_sock *s, uint64_t sz);
 
+// nni_sock_time_tx arranges for the next operation on the aio, which
+// should be a transport writing to its connection, to be recorded in
+// the socket's write time histogram.
+extern void nni_sock_time_tx(nni_sock *s, nni_aio *aio);
+
 #endif // CORE_SOCKET_H
@@ -1,5 +1,5 @@
 //
-// Copyright 2023 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 //
 // This software is supplied under the terms of the MIT License, a
@@ -15,6 +15,10 @@
 // and pipes.  This must not be exposed to other subsystems -- these internals
 // are subject to change at any time.
 
+#ifdef NNG_ENABLE_STATS
+typedef struct nni_pipe_stats nni_pipe_stats;
+#endif
+
 struct nni_dialer {
 	nni_sp_dialer_ops d_ops;  // transport ops
 	nni_sp_tran      *d_tran; // transport pointer
@@ -54,6 +58,10 @@ struct nni_dialer {
 	nni_stat_item st_auth;
 	nni_stat_item st_oom;
 	nni_stat_item st_reject;
+	nni_stat_item st_rx_msgs; // totals over all pipes
+	nni_stat_item st_tx_msgs;
+	nni_stat_item st_rx_bytes;
+	nni_stat_item st_tx_bytes;
 #endif
 };
 
@@ -89,6 +97,10 @@ struct nni_listener {
 	nni_stat_item st_auth;
 	nni_stat_item st_oom;
 	nni_stat_item st_reject;
+	nni_stat_item st_rx_msgs; // totals over all pipes
+	nni_stat_item st_tx_msgs;
+	nni_stat_item st_rx_bytes;
+	nni_stat_item st_tx_bytes;
 #endif
 };
 
@@ -112,17 +124,13 @@ struct nni_pipe {
 	nni_reap_node      p_reap;
 
 #ifdef NNG_ENABLE_STATS
-	nni_stat_item st_root;
-	nni_stat_item st_id;
-	nni_stat_item st_ep_id;
-	nni_stat_item st_sock_id;
-	nni_stat_item st_rx_msgs;
-	nni_stat_item st_tx_msgs;
-	nni_stat_item st_rx_bytes;
-	nni_stat_item st_tx_bytes;
+	nni_pipe_stats *p_stats; // NULL if per-pipe stats are disabled
 #endif
 };
 
+extern bool nni_sock_pipe_stats(nni_sock *);
+extern void nni_pipe_stats_register(nni_pipe *);
+
 extern int  nni_sock_add_dialer(nni_sock *, nni_dialer *);
 extern int  nni_sock_add_listener(nni_sock *, nni_listener *);
 extern void nni_sock_remove_listener(nni_listener *);
@@ -134,12 +142,16 @@ extern void nni_dialer_reap(nni_dialer *);
 extern void nni_dialer_destroy(nni_dialer *);
 extern void nni_dialer_timer_start(nni_dialer *);
 extern void nni_dialer_stop(nni_dialer *);
+extern void nni_dialer_bump_rx(nni_dialer *, size_t);
+extern void nni_dialer_bump_tx(nni_dialer *, size_t);
 
 extern void nni_listener_add_pipe(nni_listener *, void *);
 extern void nni_listener_shutdown(nni_listener *);
 extern void nni_listener_reap(nni_listener *);
 extern void nni_listener_destroy(nni_listener *);
 extern void nni_listener_stop(nni_listener *);
+extern void nni_listener_bump_rx(nni_listener *, size_t);
+extern void nni_listener_bump_tx(nni_listener *, size_t);
 
 extern void nni_pipe_remove(nni_pipe *);
 extern bool nni_pipe_is_closed(nni_pipe *);
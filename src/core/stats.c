@@ -1,5 +1,5 @@
 //
-// Copyright 2022 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 //
 // This software is supplied under the terms of the MIT License, a
@@ -8,6 +8,8 @@
 // found online at https://opensource.org/licenses/MIT.
 //
 
+#include <ctype.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -17,11 +19,13 @@ typedef struct nng_stat nni_stat;
 
 struct nng_stat {
 	const nni_stat_info *s_info;
-	const nni_stat_item *s_item; // Used during snapshot collection
+	const nni_stat_item *s_item; // Source item, NULL once removed
 	nni_list             s_children;
 	nni_stat            *s_parent;
 	nni_list_node        s_node;
 	nni_time             s_timestamp;
+	uint64_t            *s_hist; // histogram bucket values
+	uint64_t             s_gen;  // stats_gen when taken (root only)
 	union {
 		int      sv_id;
 		bool     sv_bool;
@@ -44,6 +48,10 @@ static nni_stat_item stats_root = {
 };
 static nni_mtx stats_lock     = NNI_MTX_INITIALIZER;
 static nni_mtx stats_val_lock = NNI_MTX_INITIALIZER;
+
+// stats_gen counts removals from the tree.  While it is unchanged, every
+// item referenced by a snapshot is still valid.
+static uint64_t stats_gen = 1;
 #endif
 
 void
@@ -94,6 +102,63 @@ stat_unregister(nni_stat_item *item)
 	}
 	nni_list_node_remove(&item->si_node);
 }
+
+// stat_hist_bucket returns the histogram bucket for the value.
+static unsigned
+stat_hist_bucket(uint64_t v)
+{
+	unsigned e = 0;
+	uint64_t x;
+
+	if (v < NNI_STAT_HIST_LINEAR) {
+		return ((unsigned) v);
+	}
+	if (v >= ((uint64_t) 1 << 32)) {
+		return (NNI_STAT_HIST_BUCKETS - 1);
+	}
+	// Find the highest bit set; this is at least 4.
+	x = v;
+	if (x >= (1U << 16)) {
+		x >>= 16;
+		e += 16;
+	}
+	if (x >= (1U << 8)) {
+		x >>= 8;
+		e += 8;
+	}
+	if (x >= (1U << 4)) {
+		x >>= 4;
+		e += 4;
+	}
+	if (x >= (1U << 2)) {
+		x >>= 2;
+		e += 2;
+	}
+	if (x >= (1U << 1)) {
+		e += 1;
+	}
+	// The three bits below the highest one select the sub-bucket.
+	return (NNI_STAT_HIST_LINEAR + (e - 4) * NNI_STAT_HIST_SUB +
+	    (unsigned) ((v >> (e - 3)) & (NNI_STAT_HIST_SUB - 1)));
+}
+
+// stat_shard returns the slot for the caller to update.
+static inline nni_atomic_u64 *
+stat_shard(nni_stat_item *item)
+{
+	unsigned cpu = nni_plat_cpu_hint();
+	return (&item->si_shards[cpu % NNI_STAT_SHARDS].ss_value);
+}
+
+static uint64_t
+stat_shard_sum(nni_stat_item *item)
+{
+	uint64_t sum = 0;
+	for (int i = 0; i < NNI_STAT_SHARDS; i++) {
+		sum += nni_atomic_get64(&item->si_shards[i].ss_value);
+	}
+	return (sum);
+}
 #endif
 
 void
@@ -102,6 +167,7 @@ nni_stat_unregister(nni_stat_item *item)
 #ifdef NNG_ENABLE_STATS
 	nni_mtx_lock(&stats_lock);
 	stat_unregister(item);
+	stats_gen++;
 	nni_mtx_unlock(&stats_lock);
 #else
 	NNI_ARG_UNUSED(item);
@@ -115,17 +181,52 @@ nni_stat_init(nni_stat_item *item, const nni_stat_info *info)
 	memset(item, 0, sizeof(*item));
 	NNI_LIST_INIT(&item->si_children, nni_stat_item, si_node);
 	item->si_info = info;
+
+	// Sharded counters are released by nni_stat_fini.  If we cannot
+	// get the memory, we just fall back to a single atomic counter.
+	if (info->si_shard) {
+		item->si_shards =
+		    nni_zalloc(sizeof(nni_stat_shard) * NNI_STAT_SHARDS);
+	}
+	// Histograms that cannot get their buckets just record nothing.
+	if (info->si_type == NNG_STAT_HISTOGRAM) {
+		item->si_u.sv_hist =
+		    nni_zalloc(sizeof(nni_atomic_u64) * NNI_STAT_HIST_BUCKETS);
+	}
 #else
 	NNI_ARG_UNUSED(item);
 	NNI_ARG_UNUSED(info);
 #endif
 }
 
+void
+nni_stat_fini(nni_stat_item *item)
+{
+#ifdef NNG_ENABLE_STATS
+	if (item->si_shards != NULL) {
+		nni_free(item->si_shards,
+		    sizeof(nni_stat_shard) * NNI_STAT_SHARDS);
+		item->si_shards = NULL;
+	}
+	if ((item->si_info != NULL) &&
+	    (item->si_info->si_type == NNG_STAT_HISTOGRAM) &&
+	    (item->si_u.sv_hist != NULL)) {
+		nni_free(item->si_u.sv_hist,
+		    sizeof(nni_atomic_u64) * NNI_STAT_HIST_BUCKETS);
+		item->si_u.sv_hist = NULL;
+	}
+#else
+	NNI_ARG_UNUSED(item);
+#endif
+}
+
 void
 nni_stat_inc(nni_stat_item *item, uint64_t inc)
 {
 #ifdef NNG_ENABLE_STATS
-	if (item->si_info->si_atomic) {
+	if (item->si_shards != NULL) {
+		nni_atomic_add64(stat_shard(item), inc);
+	} else if (item->si_info->si_atomic || item->si_info->si_shard) {
 		nni_atomic_add64(&item->si_u.sv_atomic, inc);
 	} else {
 		item->si_u.sv_number += inc;
@@ -140,8 +241,10 @@ void
 nni_stat_dec(nni_stat_item *item, uint64_t inc)
 {
 #ifdef NNG_ENABLE_STATS
-
-	if (item->si_info->si_atomic) {
+	if (item->si_shards != NULL) {
+		// Slots may wrap individually, but the sum is still right.
+		nni_atomic_sub64(stat_shard(item), inc);
+	} else if (item->si_info->si_atomic || item->si_info->si_shard) {
 		nni_atomic_sub64(&item->si_u.sv_atomic, inc);
 	} else {
 		item->si_u.sv_number -= inc;
@@ -152,6 +255,19 @@ nni_stat_dec(nni_stat_item *item, uint64_t inc)
 #endif
 }
 
+void
+nni_stat_record(nni_stat_item *item, uint64_t v)
+{
+#ifdef NNG_ENABLE_STATS
+	if (item->si_u.sv_hist != NULL) {
+		nni_atomic_inc64(&item->si_u.sv_hist[stat_hist_bucket(v)]);
+	}
+#else
+	NNI_ARG_UNUSED(item);
+	NNI_ARG_UNUSED(v);
+#endif
+}
+
 void
 nni_stat_set_id(nni_stat_item *item, int id)
 {
@@ -211,7 +327,15 @@ void
 nni_stat_set_value(nni_stat_item *item, uint64_t v)
 {
 #ifdef NNG_ENABLE_STATS
-	if (item->si_info->si_atomic) {
+	if (item->si_shards != NULL) {
+		// This is not atomic with respect to concurrent updates,
+		// but setting a counter while it is being bumped is not
+		// meaningful anyway.
+		for (int i = 1; i < NNI_STAT_SHARDS; i++) {
+			nni_atomic_set64(&item->si_shards[i].ss_value, 0);
+		}
+		nni_atomic_set64(&item->si_shards[0].ss_value, v);
+	} else if (item->si_info->si_atomic || item->si_info->si_shard) {
 		nni_atomic_set64(&item->si_u.sv_atomic, v);
 	} else {
 		item->si_u.sv_number = v;
@@ -235,6 +359,9 @@ nng_stats_free(nni_stat *st)
 	if (st->s_info->si_alloc) {
 		nni_strfree(st->s_val.sv_string);
 	}
+	if (st->s_hist != NULL) {
+		nni_free(st->s_hist, sizeof(uint64_t) * NNI_STAT_HIST_BUCKETS);
+	}
 	NNI_FREE_STRUCT(st);
 #else
 	NNI_ARG_UNUSED(st);
@@ -243,10 +370,9 @@ nng_stats_free(nni_stat *st)
 
 #ifdef NNG_ENABLE_STATS
 static int
-stat_make_tree(nni_stat_item *item, nni_stat **sp)
+stat_make_node(nni_stat_item *item, nni_stat **sp)
 {
-	nni_stat      *stat;
-	nni_stat_item *child;
+	nni_stat *stat;
 
 	if ((stat = NNI_ALLOC_STRUCT(stat)) == NULL) {
 		return (NNG_ENOMEM);
@@ -257,10 +383,35 @@ stat_make_tree(nni_stat_item *item, nni_stat **sp)
 	stat->s_item   = item;
 	stat->s_parent = NULL;
 
+	if ((item->si_info->si_type == NNG_STAT_HISTOGRAM) &&
+	    ((stat->s_hist = nni_zalloc(
+	          sizeof(uint64_t) * NNI_STAT_HIST_BUCKETS)) == NULL)) {
+		nng_stats_free(stat);
+		return (NNG_ENOMEM);
+	}
+	*sp = stat;
+	return (0);
+}
+
+// stat_make_tree copies the tree of items, skipping any that are not
+// of the types in the mask.  Scopes are always kept, to hold the rest.
+static int
+stat_make_tree(nni_stat_item *item, nni_stat **sp, unsigned types)
+{
+	nni_stat      *stat;
+	nni_stat_item *child;
+	int            rv;
+
+	if ((rv = stat_make_node(item, &stat)) != 0) {
+		return (rv);
+	}
 	NNI_LIST_FOREACH (&item->si_children, child) {
 		nni_stat *cs;
-		int       rv;
-		if ((rv = stat_make_tree(child, &cs)) != 0) {
+		if ((child->si_info->si_type != NNG_STAT_SCOPE) &&
+		    ((types & (1u << child->si_info->si_type)) == 0)) {
+			continue;
+		}
+		if ((rv = stat_make_tree(child, &cs, types)) != 0) {
 			nng_stats_free(stat);
 			return (rv);
 		}
@@ -271,8 +422,41 @@ stat_make_tree(nni_stat_item *item, nni_stat **sp)
 	return (0);
 }
 
+// stat_item_value reads the current numeric value of a counter or level.
+static uint64_t
+stat_item_value(const nni_stat_item *item)
+{
+	if (item->si_shards != NULL) {
+		return (stat_shard_sum((nni_stat_item *) item));
+	}
+	if (item->si_info->si_atomic || item->si_info->si_shard) {
+		return (nni_atomic_get64(
+		    (nni_atomic_u64 *) &item->si_u.sv_atomic));
+	}
+	return (item->si_u.sv_number);
+}
+
+// stat_item_hist copies the buckets of a histogram, returning the total.
+// The buckets are read one at a time, so values recorded while we do this
+// may or may not be included.
+static uint64_t
+stat_item_hist(const nni_stat_item *item, uint64_t *hist)
+{
+	uint64_t total = 0;
+
+	for (unsigned i = 0; i < NNI_STAT_HIST_BUCKETS; i++) {
+		uint64_t n = 0;
+		if (item->si_u.sv_hist != NULL) {
+			n = nni_atomic_get64(&item->si_u.sv_hist[i]);
+		}
+		hist[i] = n;
+		total += n;
+	}
+	return (total);
+}
+
 static void
-stat_update(nni_stat *stat)
+stat_update(nni_stat *stat, nni_time now)
 {
 	const nni_stat_item *item = stat->s_item;
 	const nni_stat_info *info = item->si_info;
@@ -289,12 +473,10 @@ stat_update(nni_stat *stat)
 		break;
 	case NNG_STAT_COUNTER:
 	case NNG_STAT_LEVEL:
-		if (info->si_atomic) {
-			stat->s_val.sv_value = nni_atomic_get64(
-			    (nni_atomic_u64 *) &item->si_u.sv_atomic);
-		} else {
-			stat->s_val.sv_value = item->si_u.sv_number;
-		}
+		stat->s_val.sv_value = stat_item_value(item);
+		break;
+	case NNG_STAT_HISTOGRAM:
+		stat->s_val.sv_value = stat_item_hist(item, stat->s_hist);
 		break;
 	case NNG_STAT_STRING:
 		nni_mtx_lock(&stats_val_lock);
@@ -303,12 +485,11 @@ stat_update(nni_stat *stat)
 
 		// If we have to allocate a new string, do so.  But
 		// only do it if new string is different.
-		if ((info->si_alloc) && (str != NULL) &&
-		    ((old == NULL) || (strcmp(str, old) != 0))) {
-
-			stat->s_val.sv_string = nni_strdup(str);
-			nni_strfree(old);
-
+		if ((info->si_alloc) && (str != NULL)) {
+			if ((old == NULL) || (strcmp(str, old) != 0)) {
+				stat->s_val.sv_string = nni_strdup(str);
+				nni_strfree(old);
+			}
 		} else if (info->si_alloc) {
 			nni_strfree(stat->s_val.sv_string);
 			stat->s_val.sv_string = NULL;
@@ -319,34 +500,96 @@ stat_update(nni_stat *stat)
 		nni_mtx_unlock(&stats_val_lock);
 		break;
 	}
-	stat->s_timestamp = nni_clock();
+	stat->s_timestamp = now;
 }
 
 static void
-stat_update_tree(nni_stat *stat)
+stat_update_tree(nni_stat *stat, nni_time now)
 {
 	nni_stat *child;
-	stat_update(stat);
+	if (stat->s_item == NULL) {
+		return; // removed since the snapshot was taken
+	}
+	stat_update(stat, now);
 	NNI_LIST_FOREACH (&stat->s_children, child) {
-		stat_update_tree(child);
+		stat_update_tree(child, now);
 	}
 }
 
-int
-nni_stat_snapshot(nni_stat **statp, nni_stat_item *item)
+// stat_refresh_tree is like stat_update_tree, but for use when items may
+// have been removed since the snapshot was taken.  The item is known to
+// be live, and we only follow the items of the snapshot once we have
+// found them among its children.  Children never move, so we look for
+// each one after the last one found.  Those that are gone keep their
+// last values, and are never looked at again.
+//
+// An item can be freed and a new one allocated at the same address (a
+// new pipe replacing a closed one, say), so scopes must also keep their
+// ID to be considered the same.
+static bool
+stat_same(const nni_stat *stat, const nni_stat_item *item)
 {
-	int       rv;
-	nni_stat *stat;
+	return ((item == stat->s_item) && (item->si_info == stat->s_info) &&
+	    ((stat->s_info->si_type != NNG_STAT_SCOPE) ||
+	        (item->si_u.sv_id == stat->s_val.sv_id)));
+}
+
+static void
+stat_refresh_tree(nni_stat *stat, nni_stat_item *item, nni_time now)
+{
+	nni_stat      *child;
+	nni_stat_item *next = nni_list_first(&item->si_children);
+
+	stat_update(stat, now);
+	NNI_LIST_FOREACH (&stat->s_children, child) {
+		nni_stat_item *scan = next;
+		if (child->s_item == NULL) {
+			continue;
+		}
+		while ((scan != NULL) && (!stat_same(child, scan))) {
+			scan = nni_list_next(&item->si_children, scan);
+		}
+		if (scan != NULL) {
+			stat_refresh_tree(child, scan, now);
+			next = nni_list_next(&item->si_children, scan);
+		} else {
+			child->s_item = NULL;
+		}
+	}
+}
 
-	if (item == NULL) {
-		item = &stats_root;
+static int
+stat_snapshot(nni_stat **statp, const char *scope, int id, unsigned types)
+{
+	int            rv;
+	nni_stat      *stat;
+	nni_stat_item *child;
+
+	if (types == 0) {
+		types = ~0u;
 	}
 	nni_mtx_lock(&stats_lock);
-	if ((rv = stat_make_tree(item, &stat)) != 0) {
+	if ((rv = stat_make_node(&stats_root, &stat)) != 0) {
 		nni_mtx_unlock(&stats_lock);
 		return (rv);
 	}
-	stat_update_tree(stat);
+	NNI_LIST_FOREACH (&stats_root.si_children, child) {
+		nni_stat *cs;
+		if (((scope != NULL) &&
+		        (strcmp(scope, child->si_info->si_name) != 0)) ||
+		    ((id != 0) && (id != child->si_u.sv_id))) {
+			continue;
+		}
+		if ((rv = stat_make_tree(child, &cs, types)) != 0) {
+			nni_mtx_unlock(&stats_lock);
+			nng_stats_free(stat);
+			return (rv);
+		}
+		nni_list_append(&stat->s_children, cs);
+		cs->s_parent = stat;
+	}
+	stat->s_gen = stats_gen;
+	stat_update_tree(stat, nni_clock());
 	nni_mtx_unlock(&stats_lock);
 	*statp = stat;
 	return (0);
@@ -355,15 +598,48 @@ nni_stat_snapshot(nni_stat **statp, nni_stat_item *item)
 
 int
 nng_stats_get(nng_stat **statp)
+{
+	return (nng_stats_get_filtered(statp, NULL, 0, 0));
+}
+
+int
+nng_stats_get_filtered(
+    nng_stat **statp, const char *scope, int id, unsigned types)
 {
 #ifdef NNG_ENABLE_STATS
 	int rv;
 	if ((rv = nni_init()) != 0) {
 		return (rv);
 	}
-	return (nni_stat_snapshot(statp, &stats_root));
+	return (stat_snapshot(statp, scope, id, types));
 #else
 	NNI_ARG_UNUSED(statp);
+	NNI_ARG_UNUSED(scope);
+	NNI_ARG_UNUSED(id);
+	NNI_ARG_UNUSED(types);
+	return (NNG_ENOTSUP);
+#endif
+}
+
+int
+nng_stats_update(nng_stat *stat)
+{
+#ifdef NNG_ENABLE_STATS
+	if ((stat->s_parent != NULL) || (stat->s_item != &stats_root)) {
+		return (NNG_EINVAL);
+	}
+	nni_mtx_lock(&stats_lock);
+	if (stat->s_gen == stats_gen) {
+		// Nothing has been removed, so every item is still there.
+		stat_update_tree(stat, nni_clock());
+	} else {
+		stat_refresh_tree(stat, &stats_root, nni_clock());
+		stat->s_gen = stats_gen;
+	}
+	nni_mtx_unlock(&stats_lock);
+	return (0);
+#else
+	NNI_ARG_UNUSED(stat);
 	return (NNG_ENOTSUP);
 #endif
 }
@@ -401,6 +677,68 @@ nng_stat_value(nni_stat *stat)
 	return (stat->s_val.sv_value);
 }
 
+#ifdef NNG_ENABLE_STATS
+// stat_hist_bound returns the largest value counted in the bucket.
+static uint64_t
+stat_hist_bound(unsigned i)
+{
+	unsigned e;
+	uint64_t lo;
+
+	if (i < NNI_STAT_HIST_LINEAR) {
+		return (i);
+	}
+	i -= NNI_STAT_HIST_LINEAR;
+	e  = 4 + i / NNI_STAT_HIST_SUB;
+	lo = (uint64_t) (NNI_STAT_HIST_SUB + i % NNI_STAT_HIST_SUB) << (e - 3);
+	return (lo + ((uint64_t) 1 << (e - 3)) - 1);
+}
+
+// stat_hist_percentile finds the nearest rank: the smallest value that has
+// at least pct percent of the values at or below it.
+static uint64_t
+stat_hist_percentile(const uint64_t *hist, uint64_t count, double pct)
+{
+	uint64_t rank;
+	uint64_t seen = 0;
+	double   want;
+
+	if (count == 0) {
+		return (0);
+	}
+	want = pct * (double) count / 100.0;
+	rank = (uint64_t) want;
+	if ((double) rank < want) {
+		rank++;
+	}
+	if (rank < 1) {
+		rank = 1;
+	}
+	for (unsigned i = 0; i < NNI_STAT_HIST_BUCKETS; i++) {
+		seen += hist[i];
+		if (seen >= rank) {
+			return (stat_hist_bound(i));
+		}
+	}
+	return (stat_hist_bound(NNI_STAT_HIST_BUCKETS - 1));
+}
+#endif
+
+uint64_t
+nng_stat_percentile(nng_stat *stat, double pct)
+{
+#ifdef NNG_ENABLE_STATS
+	if (stat->s_hist == NULL) {
+		return (0);
+	}
+	return (stat_hist_percentile(stat->s_hist, stat->s_val.sv_value, pct));
+#else
+	NNI_ARG_UNUSED(stat);
+	NNI_ARG_UNUSED(pct);
+	return (0);
+#endif
+}
+
 bool
 nng_stat_bool(nni_stat *stat)
 {
@@ -565,6 +903,9 @@ nng_stats_dump(nng_stat *stat)
 		case NNG_UNIT_MILLIS:
 			nni_plat_printf(" ms\n");
 			break;
+		case NNG_UNIT_MICROS:
+			nni_plat_printf(" us\n");
+			break;
 		case NNG_UNIT_NONE:
 		case NNG_UNIT_EVENTS:
 		default:
@@ -577,6 +918,16 @@ nng_stats_dump(nng_stat *stat)
 		nni_plat_printf(
 		    "%s%-32s%llu\n", indent, nng_stat_name(stat), val);
 		break;
+	case NNG_STAT_HISTOGRAM:
+		nni_plat_printf("%s%-32scount %llu, p50 %llu, p99 %llu, "
+		                "p999 %llu%s\n",
+		    indent, nng_stat_name(stat),
+		    (unsigned long long) nng_stat_value(stat),
+		    (unsigned long long) nng_stat_percentile(stat, 50),
+		    (unsigned long long) nng_stat_percentile(stat, 99),
+		    (unsigned long long) nng_stat_percentile(stat, 99.9),
+		    nng_stat_unit(stat) == NNG_UNIT_MICROS ? " us" : "");
+		break;
 	default:
 		nni_plat_printf("%s%-32s<?>\n", indent, nng_stat_name(stat));
 		break;
@@ -589,3 +940,393 @@ nng_stats_dump(nng_stat *stat)
 	NNI_ARG_UNUSED(stat);
 #endif
 }
+
+#ifdef NNG_ENABLE_STATS
+// OpenMetrics export.  The format requires all samples of a metric family
+// to be together, but our tree is organized by object (socket, pipe, ...)
+// instead.  So we walk the live tree once, with the lock held, appending
+// each sample to the text for its family, and join them at the end.
+// Families are identified by the names of the statistic and its scope;
+// the info structures are shared by every instance, so comparing those
+// first is usually enough.  ID and string values are used as
+// labels for the other statistics in their scope.
+
+typedef struct {
+	char  *buf;
+	size_t len;
+	size_t cap;
+} stat_text;
+
+typedef struct {
+	const nni_stat_info *info;
+	const nni_stat_info *scope;
+	stat_text            text;
+} stat_family;
+
+typedef struct {
+	stat_family *fams;
+	size_t       nfams;
+	size_t       cap;
+	size_t       last; // index of most recently used family
+	stat_text    name; // metric name prefix for the current scope
+	stat_text    lbls; // labels for the current scope, each with a comma
+	int          rv;
+} stat_export;
+
+static void
+stat_text_add(stat_export *ex, stat_text *t, const char *s, size_t len)
+{
+	if (ex->rv != 0) {
+		return;
+	}
+	if (t->len + len + 1 > t->cap) {
+		size_t cap = t->cap == 0 ? 256 : t->cap;
+		char  *buf;
+		while (t->len + len + 1 > cap) {
+			cap *= 2;
+		}
+		if ((buf = nni_alloc(cap)) == NULL) {
+			ex->rv = NNG_ENOMEM;
+			return;
+		}
+		if (t->len > 0) {
+			memcpy(buf, t->buf, t->len);
+		}
+		if (t->cap > 0) {
+			nni_free(t->buf, t->cap);
+		}
+		t->buf = buf;
+		t->cap = cap;
+	}
+	memcpy(t->buf + t->len, s, len);
+	t->len += len;
+	t->buf[t->len] = '\0';
+}
+
+static void
+stat_text_printf(stat_export *ex, stat_text *t, const char *fmt, ...)
+{
+	char    buf[64];
+	va_list va;
+	int     len;
+
+	va_start(va, fmt);
+	len = vsnprintf(buf, sizeof(buf), fmt, va);
+	va_end(va);
+	if ((len > 0) && ((size_t) len < sizeof(buf))) {
+		stat_text_add(ex, t, buf, (size_t) len);
+	}
+}
+
+static void
+stat_text_fini(stat_text *t)
+{
+	if (t->cap > 0) {
+		nni_free(t->buf, t->cap);
+	}
+}
+
+// stat_text_name appends a name, replacing characters not permitted in
+// metric and label names with underscores.
+static void
+stat_text_name(stat_export *ex, stat_text *t, const char *name)
+{
+	for (; *name != '\0'; name++) {
+		char c = *name;
+		if (!isalnum((unsigned char) c)) {
+			c = '_';
+		}
+		stat_text_add(ex, t, &c, 1);
+	}
+}
+
+// stat_text_escape appends a label value or help text, escaping it.
+static void
+stat_text_escape(stat_export *ex, stat_text *t, const char *s)
+{
+	for (; *s != '\0'; s++) {
+		switch (*s) {
+		case '\\':
+			stat_text_add(ex, t, "\\\\", 2);
+			break;
+		case '"':
+			stat_text_add(ex, t, "\\\"", 2);
+			break;
+		case '\n':
+			stat_text_add(ex, t, "\\n", 2);
+			break;
+		default:
+			stat_text_add(ex, t, s, 1);
+			break;
+		}
+	}
+}
+
+// stat_export_labels appends the labels of the current scope, plus
+// an extra one if given.
+static void
+stat_export_labels(stat_export *ex, stat_text *t, const char *extra)
+{
+	if ((ex->lbls.len == 0) && (extra == NULL)) {
+		return;
+	}
+	stat_text_add(ex, t, "{", 1);
+	if (ex->lbls.len > 0) {
+		// Skip the leading comma.
+		stat_text_add(ex, t, ex->lbls.buf + 1, ex->lbls.len - 1);
+		if (extra != NULL) {
+			stat_text_add(ex, t, ",", 1);
+		}
+	}
+	if (extra != NULL) {
+		stat_text_add(ex, t, extra, strlen(extra));
+	}
+	stat_text_add(ex, t, "}", 1);
+}
+
+static stat_family *
+stat_export_family(
+    stat_export *ex, const nni_stat_item *item, const nni_stat_item *scope)
+{
+	const nni_stat_info *info = item->si_info;
+	stat_family         *fam;
+	const char          *type;
+
+	if ((ex->last < ex->nfams) && (ex->fams[ex->last].info == info) &&
+	    (ex->fams[ex->last].scope == scope->si_info)) {
+		return (&ex->fams[ex->last]);
+	}
+	for (size_t i = 0; i < ex->nfams; i++) {
+		if ((ex->fams[i].info == info) &&
+		    (ex->fams[i].scope == scope->si_info)) {
+			ex->last = i;
+			return (&ex->fams[i]);
+		}
+	}
+	// Different protocols may have their own statistics of the same
+	// name, but they must still be a single family.
+	for (size_t i = 0; i < ex->nfams; i++) {
+		if ((strcmp(ex->fams[i].info->si_name, info->si_name) == 0) &&
+		    (strcmp(ex->fams[i].scope->si_name,
+		         scope->si_info->si_name) == 0)) {
+			ex->last = i;
+			return (&ex->fams[i]);
+		}
+	}
+	if (ex->nfams == ex->cap) {
+		size_t       cap = ex->cap == 0 ? 32 : ex->cap * 2;
+		stat_family *fams;
+		if ((fams = nni_zalloc(cap * sizeof(*fams))) == NULL) {
+			ex->rv = NNG_ENOMEM;
+			return (NULL);
+		}
+		if (ex->nfams > 0) {
+			memcpy(fams, ex->fams, ex->nfams * sizeof(*fams));
+			nni_free(ex->fams, ex->cap * sizeof(*fams));
+		}
+		ex->fams = fams;
+		ex->cap  = cap;
+	}
+	ex->last   = ex->nfams++;
+	fam        = &ex->fams[ex->last];
+	fam->info  = info;
+	fam->scope = scope->si_info;
+
+	switch (info->si_type) {
+	case NNG_STAT_COUNTER:
+		type = "counter";
+		break;
+	case NNG_STAT_HISTOGRAM:
+		type = "summary";
+		break;
+	default:
+		type = "gauge";
+		break;
+	}
+	stat_text_add(ex, &fam->text, "# TYPE ", 7);
+	stat_text_add(ex, &fam->text, ex->name.buf, ex->name.len);
+	stat_text_name(ex, &fam->text, info->si_name);
+	stat_text_printf(ex, &fam->text, " %s\n# HELP ", type);
+	stat_text_add(ex, &fam->text, ex->name.buf, ex->name.len);
+	stat_text_name(ex, &fam->text, info->si_name);
+	stat_text_add(ex, &fam->text, " ", 1);
+	stat_text_escape(ex, &fam->text, info->si_desc);
+	if (info->si_unit == NNG_UNIT_MICROS) {
+		stat_text_add(ex, &fam->text, " (microseconds)", 15);
+	} else if (info->si_unit == NNG_UNIT_MILLIS) {
+		stat_text_add(ex, &fam->text, " (milliseconds)", 15);
+	}
+	stat_text_add(ex, &fam->text, "\n", 1);
+	return (fam);
+}
+
+static void
+stat_export_sample(stat_export *ex, stat_text *t, const char *name,
+    const char *suffix, const char *extra, unsigned long long val)
+{
+	stat_text_add(ex, t, ex->name.buf, ex->name.len);
+	stat_text_name(ex, t, name);
+	stat_text_add(ex, t, suffix, strlen(suffix));
+	stat_export_labels(ex, t, extra);
+	stat_text_printf(ex, t, " %llu\n", val);
+}
+
+static void
+stat_export_item(
+    stat_export *ex, const nni_stat_item *item, const nni_stat_item *scope)
+{
+	const nni_stat_info *info = item->si_info;
+	const char          *name = info->si_name;
+	stat_family         *fam;
+	uint64_t             hist[NNI_STAT_HIST_BUCKETS];
+	uint64_t             count;
+
+	switch (info->si_type) {
+	case NNG_STAT_COUNTER:
+	case NNG_STAT_LEVEL:
+	case NNG_STAT_BOOLEAN:
+	case NNG_STAT_HISTOGRAM:
+		break;
+	default:
+		return; // labels, or nothing we can represent
+	}
+	if ((fam = stat_export_family(ex, item, scope)) == NULL) {
+		return;
+	}
+	switch (info->si_type) {
+	case NNG_STAT_COUNTER:
+		stat_export_sample(ex, &fam->text, name, "_total", NULL,
+		    stat_item_value(item));
+		break;
+	case NNG_STAT_LEVEL:
+		stat_export_sample(
+		    ex, &fam->text, name, "", NULL, stat_item_value(item));
+		break;
+	case NNG_STAT_BOOLEAN:
+		stat_export_sample(
+		    ex, &fam->text, name, "", NULL, item->si_u.sv_bool ? 1 : 0);
+		break;
+	case NNG_STAT_HISTOGRAM:
+		count = stat_item_hist(item, hist);
+		stat_export_sample(ex, &fam->text, name, "", "quantile=\"0.5\"",
+		    stat_hist_percentile(hist, count, 50));
+		stat_export_sample(ex, &fam->text, name, "",
+		    "quantile=\"0.99\"", stat_hist_percentile(hist, count, 99));
+		stat_export_sample(ex, &fam->text, name, "",
+		    "quantile=\"0.999\"",
+		    stat_hist_percentile(hist, count, 99.9));
+		stat_export_sample(ex, &fam->text, name, "_count", NULL, count);
+		break;
+	default:
+		break;
+	}
+}
+
+static void
+stat_export_scope(stat_export *ex, const nni_stat_item *scope)
+{
+	nni_stat_item       *child;
+	const char          *name     = scope->si_info->si_name;
+	size_t               name_len = ex->name.len;
+	size_t               lbls_len = ex->lbls.len;
+
+	if (*name != '\0') {
+		stat_text_name(ex, &ex->name, name);
+		stat_text_add(ex, &ex->name, "_", 1);
+	}
+
+	// IDs and strings label the other values in the scope.  The
+	// scope's own ID is named for the scope, e.g. socket="1".
+	NNI_LIST_FOREACH (&scope->si_children, child) {
+		const nni_stat_info *info = child->si_info;
+		const char          *lbl  = info->si_name;
+
+		if (strcmp(lbl, "id") == 0) {
+			lbl = name;
+		}
+		if (info->si_type == NNG_STAT_ID) {
+			stat_text_add(ex, &ex->lbls, ",", 1);
+			stat_text_name(ex, &ex->lbls, lbl);
+			stat_text_printf(
+			    ex, &ex->lbls, "=\"%d\"", child->si_u.sv_id);
+		} else if (info->si_type == NNG_STAT_STRING) {
+			nni_mtx_lock(&stats_val_lock);
+			if (child->si_u.sv_string != NULL) {
+				stat_text_add(ex, &ex->lbls, ",", 1);
+				stat_text_name(ex, &ex->lbls, lbl);
+				stat_text_add(ex, &ex->lbls, "=\"", 2);
+				stat_text_escape(
+				    ex, &ex->lbls, child->si_u.sv_string);
+				stat_text_add(ex, &ex->lbls, "\"", 1);
+			}
+			nni_mtx_unlock(&stats_val_lock);
+		}
+	}
+
+	NNI_LIST_FOREACH (&scope->si_children, child) {
+		if (child->si_info->si_type == NNG_STAT_SCOPE) {
+			stat_export_scope(ex, child);
+		} else {
+			stat_export_item(ex, child, scope);
+		}
+	}
+
+	// Put back the name and labels of the enclosing scope.
+	if (ex->rv == 0) {
+		ex->name.len = name_len;
+		ex->lbls.len = lbls_len;
+	}
+}
+#endif
+
+int
+nni_stat_openmetrics(char **bufp, size_t *sizep)
+{
+#ifdef NNG_ENABLE_STATS
+	stat_export ex;
+	size_t      size = 0;
+	char       *buf;
+	char       *ptr;
+
+	memset(&ex, 0, sizeof(ex));
+	stat_text_add(&ex, &ex.name, "nng_", 4);
+
+	nni_mtx_lock(&stats_lock);
+	stat_export_scope(&ex, &stats_root);
+	nni_mtx_unlock(&stats_lock);
+
+	if (ex.rv == 0) {
+		for (size_t i = 0; i < ex.nfams; i++) {
+			size += ex.fams[i].text.len;
+		}
+		size += 6; // "# EOF\n"
+		if ((buf = nni_alloc(size)) == NULL) {
+			ex.rv = NNG_ENOMEM;
+		} else {
+			ptr = buf;
+			for (size_t i = 0; i < ex.nfams; i++) {
+				memcpy(ptr, ex.fams[i].text.buf,
+				    ex.fams[i].text.len);
+				ptr += ex.fams[i].text.len;
+			}
+			memcpy(ptr, "# EOF\n", 6);
+			*bufp  = buf;
+			*sizep = size;
+		}
+	}
+
+	for (size_t i = 0; i < ex.nfams; i++) {
+		stat_text_fini(&ex.fams[i].text);
+	}
+	if (ex.cap > 0) {
+		nni_free(ex.fams, ex.cap * sizeof(stat_family));
+	}
+	stat_text_fini(&ex.name);
+	stat_text_fini(&ex.lbls);
+	return (ex.rv);
+#else
+	NNI_ARG_UNUSED(bufp);
+	NNI_ARG_UNUSED(sizep);
+	return (NNG_ENOTSUP);
+#endif
+}
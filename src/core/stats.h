@@ -1,5 +1,5 @@
 //
-// Copyright 2020 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 //
 // This software is supplied under the terms of the MIT License, a
@@ -23,8 +23,8 @@
 // In phase 2, we run the update, and copy the values. We conditionally
 // acquire the lock on the stat first though.
 
-typedef struct nni_stat_item nni_stat_item;
 typedef struct nni_stat_info nni_stat_info;
+typedef union nni_stat_shard nni_stat_shard;
 
 typedef void (*nni_stat_update)(nni_stat_item *);
 typedef enum nng_stat_type_enum nni_stat_type;
@@ -40,14 +40,41 @@ struct nni_stat_item {
 	nni_list             si_children; // children, framework use only
 	const nni_stat_info *si_info;     // statistic description
 	union {
-		uint64_t       sv_number;
-		nni_atomic_u64 sv_atomic;
-		char *         sv_string;
-		bool           sv_bool;
-		int            sv_id;
+		uint64_t        sv_number;
+		nni_atomic_u64  sv_atomic;
+		char *          sv_string;
+		bool            sv_bool;
+		int             sv_id;
+		nni_atomic_u64 *sv_hist; // histogram buckets
 	} si_u;
+	nni_stat_shard      *si_shards;   // sharded counter slots, if any
 };
 
+// NNI_STAT_SHARDS is the number of slots that a sharded counter spreads
+// its updates over.  Each slot lives in its own cache line, and callers
+// pick one based on the CPU they are running on, so that threads on
+// different CPUs do not fight over the same line.  The slots are summed
+// when a snapshot is taken.  This costs about a kilobyte per statistic,
+// so it is only used for counters shared by many threads (such as the
+// socket totals), and not for per-pipe values.
+#define NNI_STAT_SHARDS 16
+
+union nni_stat_shard {
+	nni_atomic_u64 ss_value;
+	uint8_t        ss_pad[64];
+};
+
+// Histograms (NNG_STAT_HISTOGRAM) record the distribution of values,
+// typically latencies in microseconds.  The buckets are log-linear: values
+// below 16 each have their own bucket, and above that each power of two
+// is split into 8 buckets, so a bucket is never more than 12.5% wide.
+// Values of 2^32 and above are all counted in the last bucket.  Recording
+// a value is a single atomic increment.
+#define NNI_STAT_HIST_LINEAR 16
+#define NNI_STAT_HIST_SUB 8
+#define NNI_STAT_HIST_BUCKETS \
+	(NNI_STAT_HIST_LINEAR + (32 - 4) * NNI_STAT_HIST_SUB)
+
 struct nni_stat_info {
 	const char *    si_name;       // name of statistic
 	const char *    si_desc;       // description of statistic (English)
@@ -56,6 +83,7 @@ struct nni_stat_info {
 	nni_stat_update si_update;     // update function (can be NULL)
 	bool            si_atomic : 1; // stat is atomic
 	bool            si_alloc : 1;  // stat string is allocated
+	bool            si_shard : 1;  // stat is sharded (implies atomic)
 };
 
 // nni_stat_add adds a statistic, but the operation is unlocked, and the
@@ -74,7 +102,22 @@ void nni_stat_set_id(nni_stat_item *, int);
 void nni_stat_set_bool(nni_stat_item *, bool);
 void nni_stat_set_string(nni_stat_item *, const char *);
 void nni_stat_init(nni_stat_item *, const nni_stat_info *);
+
+// nni_stat_fini releases the storage of a sharded counter or histogram.
+// This is separate from unregistering, as the owner may still update the
+// statistic until it is destroyed.  It is safe on a statistic that was
+// never initialized, provided the item was zeroed.
+void nni_stat_fini(nni_stat_item *);
 void nni_stat_inc(nni_stat_item *, uint64_t);
 void nni_stat_dec(nni_stat_item *, uint64_t);
 
+// nni_stat_record adds a value to a histogram.
+void nni_stat_record(nni_stat_item *, uint64_t);
+
+// nni_stat_openmetrics formats every registered statistic in the
+// OpenMetrics text format.  This reads the live values directly, rather
+// than taking a snapshot.  The buffer returned is exactly the size
+// returned, and must be freed with nni_free.
+int nni_stat_openmetrics(char **, size_t *);
+
 #endif // CORE_STATS_H
@@ -1,5 +1,5 @@
 //
-// Copyright 2022 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 //
 // This software is supplied under the terms of the MIT License, a
@@ -8,6 +8,9 @@
 // found online at https://opensource.org/licenses/MIT.
 //
 
+#include "core/nng_impl.h"
+
+#include <nng/supplemental/util/platform.h>
 #include <nuts.h>
 
 #define SECONDS(x) ((x) *1000)
@@ -89,8 +92,508 @@ test_stats_dump(void)
 #endif
 }
 
+#ifdef NNG_ENABLE_STATS
+#define BENCH_THREADS 8
+#define BENCH_LOOPS 200000
+
+typedef struct {
+	nni_stat_item *item;
+	nng_mtx       *mtx;
+	nng_cv        *cv;
+	int            ready;
+	bool           go;
+} bench_arg;
+
+static void
+bench_thread(void *arg)
+{
+	bench_arg *b = arg;
+
+	nng_mtx_lock(b->mtx);
+	b->ready++;
+	nng_cv_wake(b->cv);
+	while (!b->go) {
+		nng_cv_wait(b->cv);
+	}
+	nng_mtx_unlock(b->mtx);
+	for (int i = 0; i < BENCH_LOOPS; i++) {
+		nni_stat_inc(b->item, 1);
+	}
+}
+
+// bench_counter bumps the counter from several threads at once, and
+// returns the wall clock time per update, in nanoseconds.  With enough
+// CPUs, the plain atomic counter gets slower as threads are added, as
+// its cache line moves between them, while the sharded one does not.
+static uint64_t
+bench_counter(nni_stat_item *item)
+{
+	bench_arg   b;
+	nng_thread *thrs[BENCH_THREADS];
+	uint64_t    start;
+
+	memset(&b, 0, sizeof(b));
+	b.item = item;
+	NUTS_PASS(nng_mtx_alloc(&b.mtx));
+	NUTS_PASS(nng_cv_alloc(&b.cv, b.mtx));
+	for (int i = 0; i < BENCH_THREADS; i++) {
+		NUTS_PASS(nng_thread_create(&thrs[i], bench_thread, &b));
+	}
+	nng_mtx_lock(b.mtx);
+	while (b.ready < BENCH_THREADS) {
+		nng_cv_wait(b.cv);
+	}
+	start = nni_clock_us();
+	b.go  = true;
+	nng_cv_wake(b.cv);
+	nng_mtx_unlock(b.mtx);
+	for (int i = 0; i < BENCH_THREADS; i++) {
+		nng_thread_destroy(thrs[i]);
+	}
+	start = nni_clock_us() - start;
+	nng_cv_free(b.cv);
+	nng_mtx_free(b.mtx);
+	return (start * 1000 / (BENCH_THREADS * BENCH_LOOPS));
+}
+
+void
+test_stats_sharded(void)
+{
+	static const nni_stat_info root_info = {
+		.si_name = "bench",
+		.si_desc = "benchmark scope",
+		.si_type = NNG_STAT_SCOPE,
+	};
+	static const nni_stat_info atomic_info = {
+		.si_name   = "bench_atomic",
+		.si_desc   = "plain atomic counter",
+		.si_type   = NNG_STAT_COUNTER,
+		.si_atomic = true,
+	};
+	static const nni_stat_info shard_info = {
+		.si_name  = "bench_sharded",
+		.si_desc  = "sharded counter",
+		.si_type  = NNG_STAT_COUNTER,
+		.si_shard = true,
+	};
+	nni_stat_item root;
+	nni_stat_item atomic;
+	nni_stat_item shard;
+	nng_stat     *stats;
+	nng_stat     *item;
+	uint64_t      ns_atomic;
+	uint64_t      ns_shard;
+
+	NUTS_LOGGING();
+	NUTS_PASS(nni_init());
+	nni_stat_init(&root, &root_info);
+	nni_stat_init(&atomic, &atomic_info);
+	nni_stat_init(&shard, &shard_info);
+	nni_stat_add(&root, &atomic);
+	nni_stat_add(&root, &shard);
+	nni_stat_register(&root);
+
+	ns_atomic = bench_counter(&atomic);
+	ns_shard  = bench_counter(&shard);
+	nng_log_info("STATS",
+	    "%d threads: atomic %llu ns/op, sharded %llu ns/op", BENCH_THREADS,
+	    (unsigned long long) ns_atomic, (unsigned long long) ns_shard);
+
+	NUTS_PASS(nng_stats_get(&stats));
+	item = nng_stat_find(stats, "bench_atomic");
+	NUTS_ASSERT(item != NULL);
+	NUTS_TRUE(nng_stat_value(item) == BENCH_THREADS * BENCH_LOOPS);
+	item = nng_stat_find(stats, "bench_sharded");
+	NUTS_ASSERT(item != NULL);
+	NUTS_TRUE(nng_stat_value(item) == BENCH_THREADS * BENCH_LOOPS);
+	nng_stats_free(stats);
+
+	// Levels go down as well as up.
+	nni_stat_dec(&shard, 5);
+	nni_stat_inc(&shard, 2);
+	NUTS_PASS(nng_stats_get(&stats));
+	item = nng_stat_find(stats, "bench_sharded");
+	NUTS_ASSERT(item != NULL);
+	NUTS_TRUE(nng_stat_value(item) == BENCH_THREADS * BENCH_LOOPS - 3);
+	nng_stats_free(stats);
+
+	nni_stat_set_value(&shard, 42);
+	NUTS_PASS(nng_stats_get(&stats));
+	item = nng_stat_find(stats, "bench_sharded");
+	NUTS_ASSERT(item != NULL);
+	NUTS_TRUE(nng_stat_value(item) == 42);
+	nng_stats_free(stats);
+
+	nni_stat_unregister(&root);
+	nni_stat_fini(&shard);
+}
+
+void
+test_stats_filtered(void)
+{
+	nng_socket s1;
+	nng_socket s2;
+	nng_stat  *stats;
+	nng_stat  *sock;
+
+	NUTS_OPEN(s1);
+	NUTS_OPEN(s2);
+
+	NUTS_PASS(nng_stats_get_filtered(&stats, "socket", nng_socket_id(s1),
+	    NNG_STAT_MASK(NNG_STAT_COUNTER)));
+	NUTS_ASSERT(stats != NULL);
+	sock = nng_stat_child(stats);
+	NUTS_ASSERT(sock != NULL);
+	NUTS_TRUE(nng_stat_next(sock) == NULL);
+	NUTS_TRUE(nng_stat_find_socket(stats, s1) == sock);
+	NUTS_TRUE(nng_stat_find_socket(stats, s2) == NULL);
+	NUTS_ASSERT(nng_stat_find(sock, "tx_msgs") != NULL);
+	NUTS_TRUE(nng_stat_find(sock, "name") == NULL);
+	NUTS_TRUE(nng_stat_find(sock, "pipes") == NULL);
+	nng_stats_free(stats);
+
+	// All sockets, all types.
+	NUTS_PASS(nng_stats_get_filtered(&stats, "socket", 0, 0));
+	NUTS_ASSERT(nng_stat_find_socket(stats, s1) != NULL);
+	NUTS_ASSERT(nng_stat_find_socket(stats, s2) != NULL);
+	NUTS_ASSERT(nng_stat_find(stats, "name") != NULL);
+	NUTS_TRUE(nng_stat_find(stats, "aio") == NULL);
+	nng_stats_free(stats);
+
+	NUTS_CLOSE(s1);
+	NUTS_CLOSE(s2);
+}
+
+void
+test_stats_update(void)
+{
+	nng_socket s1;
+	nng_socket s2;
+	nng_socket s3;
+	nng_stat  *stats;
+	nng_stat  *st1;
+	nng_stat  *st3;
+	nng_stat  *item;
+
+	NUTS_OPEN(s1);
+	NUTS_OPEN(s2);
+	NUTS_OPEN(s3);
+	NUTS_PASS(nng_socket_set_string(s1, NNG_OPT_SOCKNAME, "first"));
+	NUTS_MARRY(s1, s2);
+
+	NUTS_PASS(nng_stats_get_filtered(&stats, "socket", 0, 0));
+	st1 = nng_stat_find_socket(stats, s1);
+	st3 = nng_stat_find_socket(stats, s3);
+	NUTS_ASSERT(st1 != NULL);
+	NUTS_ASSERT(st3 != NULL);
+	item = nng_stat_find(st1, "tx_msgs");
+	NUTS_ASSERT(item != NULL);
+	NUTS_TRUE(nng_stat_value(item) == 0);
+	NUTS_FAIL(nng_stats_update(st1), NNG_EINVAL);
+
+	NUTS_SEND(s1, "ping");
+	NUTS_RECV(s2, "ping");
+	NUTS_PASS(nng_stats_update(stats));
+	NUTS_TRUE(nng_stat_value(item) == 1);
+	NUTS_MATCH(nng_stat_string(nng_stat_find(st1, "name")), "first");
+
+	// Removing a socket leaves its values, but others still update.
+	NUTS_CLOSE(s3);
+	NUTS_SEND(s1, "ping");
+	NUTS_RECV(s2, "ping");
+	NUTS_PASS(nng_stats_update(stats));
+	NUTS_TRUE(nng_stat_value(item) == 2);
+	NUTS_MATCH(nng_stat_string(nng_stat_find(st1, "name")), "first");
+	NUTS_TRUE(nng_stat_find_socket(stats, s3) == st3);
+
+	NUTS_SEND(s1, "ping");
+	NUTS_RECV(s2, "ping");
+	NUTS_PASS(nng_stats_update(stats));
+	NUTS_TRUE(nng_stat_value(item) == 3);
+	nng_stats_free(stats);
+
+	NUTS_CLOSE(s1);
+	NUTS_CLOSE(s2);
+}
+
+void
+test_stats_update_reused(void)
+{
+	static const nni_stat_info root_info = {
+		.si_name = "reused",
+		.si_desc = "reused scope",
+		.si_type = NNG_STAT_SCOPE,
+	};
+	static const nni_stat_info count_info = {
+		.si_name = "reused_count",
+		.si_desc = "reused counter",
+		.si_type = NNG_STAT_COUNTER,
+	};
+	nni_stat_item root;
+	nni_stat_item count;
+	nng_stat     *stats;
+	nng_stat     *item;
+
+	NUTS_PASS(nni_init());
+	nni_stat_init(&root, &root_info);
+	nni_stat_init(&count, &count_info);
+	nni_stat_set_id(&root, 1);
+	nni_stat_set_value(&count, 5);
+	nni_stat_add(&root, &count);
+	nni_stat_register(&root);
+
+	NUTS_PASS(nng_stats_get_filtered(&stats, "reused", 0, 0));
+	item = nng_stat_find(stats, "reused_count");
+	NUTS_ASSERT(item != NULL);
+	NUTS_TRUE(nng_stat_value(item) == 5);
+
+	// A new scope at the same address is not the one in the snapshot.
+	nni_stat_unregister(&root);
+	nni_stat_init(&root, &root_info);
+	nni_stat_init(&count, &count_info);
+	nni_stat_set_id(&root, 2);
+	nni_stat_set_value(&count, 7);
+	nni_stat_add(&root, &count);
+	nni_stat_register(&root);
+
+	NUTS_PASS(nng_stats_update(stats));
+	NUTS_TRUE(nng_stat_value(item) == 5);
+	nng_stats_free(stats);
+
+	nni_stat_unregister(&root);
+}
+
+void
+test_stats_histogram(void)
+{
+	static const nni_stat_info root_info = {
+		.si_name = "hist",
+		.si_desc = "histogram scope",
+		.si_type = NNG_STAT_SCOPE,
+	};
+	static const nni_stat_info hist_info = {
+		.si_name = "hist_values",
+		.si_desc = "histogram of values",
+		.si_type = NNG_STAT_HISTOGRAM,
+		.si_unit = NNG_UNIT_MICROS,
+	};
+	nni_stat_item root;
+	nni_stat_item hist;
+	nng_stat     *stats;
+	nng_stat     *item;
+	uint64_t      v;
+
+	NUTS_PASS(nni_init());
+	nni_stat_init(&root, &root_info);
+	nni_stat_init(&hist, &hist_info);
+	nni_stat_add(&root, &hist);
+	nni_stat_register(&root);
+
+	// Empty histograms have no percentiles.
+	NUTS_PASS(nng_stats_get(&stats));
+	item = nng_stat_find(stats, "hist_values");
+	NUTS_ASSERT(item != NULL);
+	NUTS_TRUE(nng_stat_type(item) == NNG_STAT_HISTOGRAM);
+	NUTS_TRUE(nng_stat_unit(item) == NNG_UNIT_MICROS);
+	NUTS_TRUE(nng_stat_value(item) == 0);
+	NUTS_TRUE(nng_stat_percentile(item, 50) == 0);
+	nng_stats_free(stats);
+
+	for (v = 1; v <= 1000; v++) {
+		nni_stat_record(&hist, v);
+	}
+	NUTS_PASS(nng_stats_get(&stats));
+	item = nng_stat_find(stats, "hist_values");
+	NUTS_ASSERT(item != NULL);
+	NUTS_TRUE(nng_stat_value(item) == 1000);
+
+	// Small values are exact, larger ones are within 12.5%.
+	NUTS_TRUE(nng_stat_percentile(item, 1) == 10);
+	v = nng_stat_percentile(item, 50);
+	NUTS_TRUE(v >= 500 && v <= 500 + 500 / 8);
+	v = nng_stat_percentile(item, 99);
+	NUTS_TRUE(v >= 990 && v <= 990 + 990 / 8);
+	v = nng_stat_percentile(item, 99.9);
+	NUTS_TRUE(v >= 999 && v <= 999 + 999 / 8);
+	NUTS_TRUE(nng_stat_percentile(item, 100) == 1023);
+	nng_stats_free(stats);
+
+	// Outliers are captured.
+	nni_stat_record(&hist, 1000000000);
+	NUTS_PASS(nng_stats_get(&stats));
+	item = nng_stat_find(stats, "hist_values");
+	NUTS_ASSERT(item != NULL);
+	v = nng_stat_percentile(item, 100);
+	NUTS_TRUE(v >= 1000000000 && v <= 1125000000);
+	nng_stats_free(stats);
+
+	nni_stat_unregister(&root);
+	nni_stat_fini(&hist);
+}
+
+void
+test_stats_latency(void)
+{
+	nng_socket s1;
+	nng_socket s2;
+	nng_stat  *stats;
+	nng_stat  *sock;
+	nng_stat  *item;
+
+	nng_init_set_parameter(NNG_INIT_AIO_LATENCY, 1);
+	NUTS_OPEN(s1);
+	NUTS_OPEN(s2);
+	NUTS_MARRY(s1, s2);
+	NUTS_SEND(s1, "ping");
+	NUTS_RECV(s2, "ping");
+
+	NUTS_PASS(nng_stats_get(&stats));
+	sock = nng_stat_find_socket(stats, s1);
+	NUTS_ASSERT(sock != NULL);
+	item = nng_stat_find(sock, "tx_wait");
+	NUTS_ASSERT(item != NULL);
+	NUTS_TRUE(nng_stat_type(item) == NNG_STAT_HISTOGRAM);
+	NUTS_TRUE(nng_stat_value(item) == 1);
+	item = nng_stat_find(sock, "tx_write");
+	NUTS_ASSERT(item != NULL);
+	NUTS_TRUE(nng_stat_type(item) == NNG_STAT_HISTOGRAM);
+	item = nng_stat_find(stats, "aio");
+	NUTS_ASSERT(item != NULL);
+	item = nng_stat_find(item, "latency");
+	NUTS_ASSERT(item != NULL);
+	NUTS_TRUE(nng_stat_value(item) > 0);
+	nng_stats_free(stats);
+
+	NUTS_CLOSE(s1);
+	NUTS_CLOSE(s2);
+	nng_fini();
+}
+
+void
+test_stats_latency_off(void)
+{
+	nng_socket s1;
+	nng_socket s2;
+	nng_stat  *stats;
+	nng_stat  *item;
+
+	// The library wide histogram is opt-in, but the socket ones are not.
+	NUTS_OPEN(s1);
+	NUTS_OPEN(s2);
+	NUTS_MARRY(s1, s2);
+	NUTS_SEND(s1, "ping");
+	NUTS_RECV(s2, "ping");
+
+	NUTS_PASS(nng_stats_get(&stats));
+	item = nng_stat_find(stats, "aio");
+	NUTS_ASSERT(item != NULL);
+	NUTS_NULL(nng_stat_find(item, "latency"));
+	item = nng_stat_find_socket(stats, s1);
+	NUTS_ASSERT(item != NULL);
+	item = nng_stat_find(item, "tx_wait");
+	NUTS_ASSERT(item != NULL);
+	NUTS_TRUE(nng_stat_value(item) == 1);
+	nng_stats_free(stats);
+
+	NUTS_CLOSE(s1);
+	NUTS_CLOSE(s2);
+}
+
+// stat_wait refreshes the snapshot until the item reaches the value, or
+// a second has passed.  Sends are counted when the transport completes
+// them, which can be after the peer has already received the message.
+static uint64_t
+stat_wait(nng_stat *stats, nng_stat *item, uint64_t want)
+{
+	for (int i = 0; (i < 100) && (nng_stat_value(item) < want); i++) {
+		nng_msleep(10);
+		NUTS_PASS(nng_stats_update(stats));
+	}
+	return (nng_stat_value(item));
+}
+
+void
+test_stats_pipe_disabled(void)
+{
+	nng_socket   s1;
+	nng_socket   s2;
+	nng_listener l;
+	nng_dialer   d;
+	nng_stat    *stats;
+	nng_stat    *ep;
+	nng_stat    *item;
+	char        *addr;
+	bool         b;
+
+	NUTS_ADDR(addr, "tcp");
+	NUTS_OPEN(s1);
+	NUTS_OPEN(s2);
+	NUTS_PASS(nng_socket_get_bool(s1, NNG_OPT_PIPE_STATS, &b));
+	NUTS_TRUE(b);
+	NUTS_PASS(nng_socket_set_bool(s1, NNG_OPT_PIPE_STATS, false));
+	NUTS_PASS(nng_socket_set_bool(s2, NNG_OPT_PIPE_STATS, false));
+	NUTS_PASS(nng_socket_get_bool(s1, NNG_OPT_PIPE_STATS, &b));
+	NUTS_TRUE(!b);
+	NUTS_PASS(nng_listen(s1, addr, &l, 0));
+	NUTS_PASS(nng_dial(s2, addr, &d, 0));
+	NUTS_SEND(s2, "ping");
+	NUTS_RECV(s1, "ping");
+	NUTS_SEND(s1, "pong");
+	NUTS_RECV(s2, "pong");
+
+	NUTS_PASS(nng_stats_get(&stats));
+
+	// None of the pipes on our sockets should have statistics.
+	for (ep = nng_stat_child(stats); ep != NULL; ep = nng_stat_next(ep)) {
+		if (strcmp(nng_stat_name(ep), "pipe") != 0) {
+			continue;
+		}
+		item = nng_stat_find(ep, "socket");
+		NUTS_ASSERT(item != NULL);
+		NUTS_TRUE(nng_stat_value(item) != (uint64_t) s1.id);
+		NUTS_TRUE(nng_stat_value(item) != (uint64_t) s2.id);
+	}
+
+	// But the traffic is accounted for on the endpoints.
+	ep = nng_stat_find_listener(stats, l);
+	NUTS_ASSERT(ep != NULL);
+	item = nng_stat_find(ep, "rx_msgs");
+	NUTS_ASSERT(item != NULL);
+	NUTS_TRUE(nng_stat_value(item) == 1);
+	item = nng_stat_find(ep, "tx_msgs");
+	NUTS_ASSERT(item != NULL);
+	NUTS_TRUE(stat_wait(stats, item, 1) == 1);
+	item = nng_stat_find(ep, "rx_bytes");
+	NUTS_ASSERT(item != NULL);
+	NUTS_TRUE(nng_stat_value(item) >= 5);
+
+	ep = nng_stat_find_dialer(stats, d);
+	NUTS_ASSERT(ep != NULL);
+	item = nng_stat_find(ep, "rx_msgs");
+	NUTS_ASSERT(item != NULL);
+	NUTS_TRUE(nng_stat_value(item) == 1);
+	item = nng_stat_find(ep, "tx_bytes");
+	NUTS_ASSERT(item != NULL);
+	NUTS_TRUE(stat_wait(stats, item, 5) >= 5);
+	nng_stats_free(stats);
+
+	NUTS_CLOSE(s1);
+	NUTS_CLOSE(s2);
+}
+#endif
+
 NUTS_TESTS = {
 	{ "socket stats", test_stats_socket },
 	{ "dump stats", test_stats_dump },
+#ifdef NNG_ENABLE_STATS
+	{ "sharded stats", test_stats_sharded },
+	{ "filtered stats", test_stats_filtered },
+	{ "update stats", test_stats_update },
+	{ "update reused stats", test_stats_update_reused },
+	{ "histogram stats", test_stats_histogram },
+	{ "latency stats", test_stats_latency },
+	{ "latency stats off", test_stats_latency_off },
+	{ "pipe stats disabled", test_stats_pipe_disabled },
+#endif
 	{ NULL, NULL },
 };
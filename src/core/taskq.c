@@ -44,11 +44,14 @@ nni_taskq_thread(void *self)
 
 			nni_mtx_unlock(&tq->tq_mtx);
 
+			NNI_PROBE2(task_start, task, task->task_arg);
 			task->task_cb(task->task_arg);
+			NNI_PROBE1(task_done, task);
 
 			nni_mtx_lock(&task->task_mtx);
 			task->task_busy--;
 			if (task->task_busy == 0) {
+				nni_atomic_set_bool(&task->task_idle, true);
 				nni_cv_wake(&task->task_cv);
 			}
 			nni_mtx_unlock(&task->task_mtx);
@@ -134,16 +137,20 @@ nni_task_exec(nni_task *task)
 		task->task_prep = false;
 	} else {
 		task->task_busy++;
+		nni_atomic_set_bool(&task->task_idle, false);
 	}
 	nni_mtx_unlock(&task->task_mtx);
 
 	if (task->task_cb != NULL) {
+		NNI_PROBE2(task_start, task, task->task_arg);
 		task->task_cb(task->task_arg);
+		NNI_PROBE1(task_done, task);
 	}
 
 	nni_mtx_lock(&task->task_mtx);
 	task->task_busy--;
 	if (task->task_busy == 0) {
+		nni_atomic_set_bool(&task->task_idle, true);
 		nni_cv_wake(&task->task_cv);
 	}
 	nni_mtx_unlock(&task->task_mtx);
@@ -165,6 +172,7 @@ nni_task_dispatch(nni_task *task)
 		task->task_prep = false;
 	} else {
 		task->task_busy++;
+		nni_atomic_set_bool(&task->task_idle, false);
 	}
 	nni_mtx_unlock(&task->task_mtx);
 
@@ -180,6 +188,7 @@ nni_task_prep(nni_task *task)
 	nni_mtx_lock(&task->task_mtx);
 	task->task_busy++;
 	task->task_prep = true;
+	nni_atomic_set_bool(&task->task_idle, false);
 	nni_mtx_unlock(&task->task_mtx);
 }
 
@@ -192,6 +201,7 @@ nni_task_abort(nni_task *task)
 		task->task_prep = false;
 		task->task_busy--;
 		if (task->task_busy == 0) {
+			nni_atomic_set_bool(&task->task_idle, true);
 			nni_cv_wake(&task->task_cv);
 		}
 	}
@@ -217,6 +227,29 @@ nni_task_busy(nni_task *task)
 	return (busy);
 }
 
+// NNI_TASK_SPIN_CHECK is how many times nni_task_spin polls the task
+// between looks at the clock, which is much more expensive.
+#ifndef NNI_TASK_SPIN_CHECK
+#define NNI_TASK_SPIN_CHECK 64
+#endif
+
+bool
+nni_task_spin(nni_task *task, int usec)
+{
+	uint64_t end = nni_clock_us() + (uint64_t) usec;
+
+	// This only polls the lock-free idle flag; taking the task lock
+	// here would contend with the thread trying to complete the task.
+	do {
+		for (int i = 0; i < NNI_TASK_SPIN_CHECK; i++) {
+			if (nni_atomic_get_bool(&task->task_idle)) {
+				return (true);
+			}
+		}
+	} while (nni_clock_us() < end);
+	return (false);
+}
+
 void
 nni_task_init(nni_task *task, nni_taskq *tq, nni_cb cb, void *arg)
 {
@@ -228,6 +261,8 @@ nni_task_init(nni_task *task, nni_taskq *tq, nni_cb cb, void *arg)
 	task->task_cb   = cb;
 	task->task_arg  = arg;
 	task->task_tq   = tq != NULL ? tq : nni_taskq_systq;
+	nni_atomic_init_bool(&task->task_idle);
+	nni_atomic_set_bool(&task->task_idle, true);
 }
 
 void
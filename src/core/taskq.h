@@ -1,5 +1,5 @@
 //
-// Copyright 2022 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 //
 // This software is supplied under the terms of the MIT License, a
@@ -51,6 +51,11 @@ extern bool nni_task_busy(nni_task *);
 // work is scheduled on the task then it will not return until that
 // work (or any other work subsequently scheduled) is complete.
 extern void nni_task_wait(nni_task *);
+
+// nni_task_spin busy waits for up to the given number of microseconds
+// for the task to complete, returning true if it did.  This burns CPU,
+// but avoids the latency of sleeping and being woken again.
+extern bool nni_task_spin(nni_task *, int);
 extern void  nni_task_init(nni_task *, nni_taskq *, nni_cb, void *);
 
 // nni_task_fini destroys the task.  It will reap resources asynchronously
@@ -66,14 +71,15 @@ extern void nni_taskq_sys_fini(void);
 // nni_task_framework.  Placing here allows for inlining this in
 // consuming structures.
 struct nni_task {
-	nni_list_node task_node;
-	void *        task_arg;
-	nni_cb        task_cb;
-	nni_taskq *   task_tq;
-	unsigned      task_busy;
-	bool          task_prep;
-	nni_mtx       task_mtx;
-	nni_cv        task_cv;
+	nni_list_node   task_node;
+	void *          task_arg;
+	nni_cb          task_cb;
+	nni_taskq *     task_tq;
+	unsigned        task_busy;
+	bool            task_prep;
+	nni_atomic_bool task_idle; // task_busy is zero, for lock-free polling
+	nni_mtx         task_mtx;
+	nni_cv          task_cv;
 };
 
 #endif // CORE_TASKQ_H
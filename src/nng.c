@@ -136,6 +136,7 @@ nng_recvmsg(nng_socket s, nng_msg **msgp, int flags)
 		nng_aio_set_timeout(&aio, NNG_DURATION_DEFAULT);
 	}
 	nni_sock_recv(sock, &aio);
+	nni_sock_recv_spin(sock, &aio);
 	nni_sock_rele(sock);
 
 	nni_aio_wait(&aio);
@@ -1,5 +1,5 @@
 //
-// Copyright 2021 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 //
 // This software is supplied under the terms of the MIT License, a
@@ -180,6 +180,12 @@ nni_atomic_dec64_nv(nni_atomic_u64 *v)
 	return (ov - 1);
 }
 
+uint64_t
+nni_atomic_inc64_nv(nni_atomic_u64 *v)
+{
+	return ((uint64_t) atomic_fetch_add(&v->v, 1) + 1);
+}
+
 bool
 nni_atomic_cas64(nni_atomic_u64 *v, uint64_t comp, uint64_t new)
 {
@@ -276,6 +282,12 @@ nni_atomic_dec64_nv(nni_atomic_u64 *v)
 	return (__atomic_sub_fetch(&v->v, 1, __ATOMIC_SEQ_CST));
 }
 
+uint64_t
+nni_atomic_inc64_nv(nni_atomic_u64 *v)
+{
+	return (__atomic_add_fetch(&v->v, 1, __ATOMIC_SEQ_CST));
+}
+
 bool
 nni_atomic_cas64(nni_atomic_u64 *v, uint64_t comp, uint64_t new)
 {
@@ -486,6 +498,17 @@ nni_atomic_dec64_nv(nni_atomic_u64 *v)
 	return (nv);
 }
 
+uint64_t
+nni_atomic_inc64_nv(nni_atomic_u64 *v)
+{
+	uint64_t nv;
+	pthread_mutex_lock(&plat_atomic_lock);
+	v->v++;
+	nv = v->v;
+	pthread_mutex_unlock(&plat_atomic_lock);
+	return (nv);
+}
+
 bool
 nni_atomic_cas64(nni_atomic_u64 *v, uint64_t comp, uint64_t new)
 {
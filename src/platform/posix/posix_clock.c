@@ -1,5 +1,5 @@
 //
-// Copyright 2022 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2017 Capitar IT Group BV <info@capitar.com>
 //
 // This software is supplied under the terms of the MIT License, a
@@ -68,6 +68,22 @@ nni_clock(void)
 	return (msec);
 }
 
+uint64_t
+nni_clock_us(void)
+{
+	struct timespec ts;
+	uint64_t        usec;
+
+	if (clock_gettime(NNG_USE_CLOCKID, &ts) != 0) {
+		nni_panic("clock_gettime failed: %s", strerror(errno));
+	}
+
+	usec = ts.tv_sec;
+	usec *= 1000000;
+	usec += (ts.tv_nsec / 1000);
+	return (usec);
+}
+
 void
 nni_msleep(nni_duration ms)
 {
@@ -118,6 +134,22 @@ nni_clock(void)
 	return (ms);
 }
 
+uint64_t
+nni_clock_us(void)
+{
+	uint64_t       usec;
+	struct timeval tv;
+
+	if (gettimeofday(&tv, NULL) != 0) {
+		nni_panic("gettimeofday failed: %s", strerror(errno));
+	}
+
+	usec = tv.tv_sec;
+	usec *= 1000000;
+	usec += tv.tv_usec;
+	return (usec);
+}
+
 void
 nni_msleep(nni_duration ms)
 {
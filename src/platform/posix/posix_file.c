@@ -1,5 +1,5 @@
 //
-// Copyright 2020 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 //
 // This software is supplied under the terms of the MIT License, a
@@ -135,6 +135,78 @@ done:
 	return (rv);
 }
 
+// nni_plat_file_open opens the named file for reading a piece at a time.
+// The handle is just the file descriptor.
+int
+nni_plat_file_open(const char *name, void **fhp, uint64_t *szp)
+{
+	struct stat st;
+	int         fd;
+	int         rv;
+
+	if ((fd = open(name, O_RDONLY)) < 0) {
+		return (nni_plat_errno(errno));
+	}
+	(void) fcntl(fd, F_SETFD, FD_CLOEXEC);
+	if (fstat(fd, &st) != 0) {
+		rv = nni_plat_errno(errno);
+		(void) close(fd);
+		return (rv);
+	}
+	if (!S_ISREG(st.st_mode)) {
+		(void) close(fd);
+		return (NNG_EINVAL);
+	}
+	*fhp = (void *) (intptr_t) fd;
+	*szp = (uint64_t) st.st_size;
+	return (0);
+}
+
+int
+nni_plat_file_read(
+    void *fh, uint64_t off, void *buf, size_t len, size_t *nreadp)
+{
+	int     fd    = (int) (intptr_t) fh;
+	size_t  nread = 0;
+	ssize_t n;
+
+	while (nread < len) {
+		n = pread(fd, (char *) buf + nread, len - nread,
+		    (off_t) (off + nread));
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return (nni_plat_errno(errno));
+		}
+		if (n == 0) {
+			break; // end of file
+		}
+		nread += (size_t) n;
+	}
+	*nreadp = nread;
+	return (0);
+}
+
+void
+nni_plat_file_close(void *fh)
+{
+	(void) close((int) (intptr_t) fh);
+}
+
+int
+nni_plat_file_stat(const char *name, uint64_t *sizep, uint64_t *mtimep)
+{
+	struct stat st;
+
+	if (stat(name, &st) != 0) {
+		return (nni_plat_errno(errno));
+	}
+	*sizep  = (uint64_t) st.st_size;
+	*mtimep = (uint64_t) st.st_mtime;
+	return (0);
+}
+
 // nni_plat_file_delete deletes the named file or directory.
 int
 nni_plat_file_delete(const char *name)
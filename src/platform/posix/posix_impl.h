@@ -151,5 +151,7 @@ extern int  nni_posix_pollq_sysinit(void);
 extern void nni_posix_pollq_sysfini(void);
 extern int  nni_posix_resolv_sysinit(void);
 extern void nni_posix_resolv_sysfini(void);
+extern void nni_posix_tcp_sysinit(void);
+extern void nni_posix_tcp_sysfini(void);
 
 #endif // PLATFORM_POSIX_IMPL_H
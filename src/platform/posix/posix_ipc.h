@@ -1,5 +1,5 @@
 //
-// Copyright 2020 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 // Copyright 2019 Devolutions <info@devolutions.net>
 //
@@ -31,6 +31,8 @@ struct nni_ipc_conn {
 	nni_ipc_dialer *dialer;
 	nng_sockaddr    sa;
 	nni_reap_node   reap;
+	bool            seqpacket; // SOCK_SEQPACKET, not SOCK_STREAM
+	size_t          maxpkt;    // largest packet we can send, 0 = any
 };
 
 struct nni_ipc_dialer {
@@ -39,10 +41,15 @@ struct nni_ipc_dialer {
 	bool              closed;
 	nni_mtx           mtx;
 	nng_sockaddr      sa;
+	bool              seqpacket;
 	nni_atomic_u64    ref;
 	nni_atomic_bool   fini;
 };
 
+// Packets sent on SOCK_SEQPACKET connections are split when they are too
+// large for the socket buffer, but never below this many bytes.
+#define NNI_POSIX_IPC_MIN_PACKET 4096
+
 extern int nni_posix_ipc_alloc(
     nni_ipc_conn **, nni_sockaddr *, nni_ipc_dialer *);
 extern void nni_posix_ipc_init(nni_ipc_conn *, nni_posix_pfd *);
@@ -1,5 +1,5 @@
 //
-// Copyright 2023 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 // Copyright 2019 Devolutions <info@devolutions.net>
 //
@@ -28,6 +28,44 @@
 
 typedef struct nni_ipc_conn ipc_conn;
 
+// ipc_clip trims the vector so that it carries at most max bytes, returning
+// the number of elements still in use.
+static int
+ipc_clip(struct iovec *iov, int niov, size_t max)
+{
+	for (int i = 0; i < niov; i++) {
+		if (iov[i].iov_len >= max) {
+			iov[i].iov_len = max;
+			return (i + 1);
+		}
+		max -= iov[i].iov_len;
+	}
+	return (niov);
+}
+
+// ipc_shrink is called when a packet was too large for the socket buffer
+// of a SOCK_SEQPACKET connection.  It lowers the packet size limit, and
+// returns false if the packet cannot be made any smaller.
+static bool
+ipc_shrink(ipc_conn *c, struct iovec *iov, int niov)
+{
+	size_t len = 0;
+
+	if (!c->seqpacket) {
+		return (false);
+	}
+	for (int i = 0; i < niov; i++) {
+		len += iov[i].iov_len;
+	}
+	if (len <= NNI_POSIX_IPC_MIN_PACKET) {
+		return (false);
+	}
+	len /= 2;
+	c->maxpkt = len < NNI_POSIX_IPC_MIN_PACKET ? NNI_POSIX_IPC_MIN_PACKET
+	                                           : len;
+	return (true);
+}
+
 static void
 ipc_dowrite(ipc_conn *c)
 {
@@ -64,6 +102,12 @@ ipc_dowrite(ipc_conn *c)
 			}
 		}
 
+		// Packets that do not fit in the socket buffer are sent
+		// in pieces; the caller will resubmit the remainder.
+		if (c->maxpkt != 0) {
+			niov = ipc_clip(iovec, niov, c->maxpkt);
+		}
+
 		hdr.msg_iovlen = niov;
 		hdr.msg_iov    = iovec;
 
@@ -71,6 +115,13 @@ ipc_dowrite(ipc_conn *c)
 			switch (errno) {
 			case EINTR:
 				continue;
+			case EMSGSIZE:
+				if (ipc_shrink(c, iovec, niov)) {
+					continue;
+				}
+				nni_aio_list_remove(aio);
+				nni_aio_finish_error(aio, NNG_EMSGSIZE);
+				return;
 			case EAGAIN:
 #ifdef EWOULDBLOCK
 #if EWOULDBLOCK != EAGAIN
@@ -88,7 +139,8 @@ ipc_dowrite(ipc_conn *c)
 
 		nni_aio_bump_count(aio, n);
 		// We completed the entire operation on this aio.
-		// (Sendmsg never returns a partial result.)
+		// (Sendmsg never returns a partial result, although we
+		// may have clipped the request above.)
 		nni_aio_list_remove(aio);
 		nni_aio_finish(aio, 0, nni_aio_count(aio));
 
@@ -129,7 +181,23 @@ ipc_doread(ipc_conn *c)
 			}
 		}
 
-		if ((n = readv(fd, iovec, niov)) < 0) {
+		if (c->seqpacket) {
+			// Each read consumes exactly one packet, and anything
+			// that did not fit in the buffer is lost.
+			struct msghdr hdr;
+			memset(&hdr, 0, sizeof(hdr));
+			hdr.msg_iov    = iovec;
+			hdr.msg_iovlen = niov;
+			if (((n = recvmsg(fd, &hdr, 0)) > 0) &&
+			    ((hdr.msg_flags & MSG_TRUNC) != 0)) {
+				nni_aio_list_remove(aio);
+				nni_aio_finish_error(aio, NNG_EMSGSIZE);
+				continue;
+			}
+		} else {
+			n = readv(fd, iovec, niov);
+		}
+		if (n < 0) {
 			switch (errno) {
 			case EINTR:
 				continue;
@@ -413,6 +481,13 @@ ipc_free(void *arg)
 	nni_reap(&ipc_reap_list, c);
 }
 
+static int
+ipc_get_seqpacket(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	ipc_conn *c = arg;
+	return (nni_copyout_bool(c->seqpacket, buf, szp, t));
+}
+
 static const nni_option ipc_options[] = {
 	{
 	    .o_name = NNG_OPT_LOCADDR,
@@ -438,6 +513,10 @@ static const nni_option ipc_options[] = {
 	    .o_name = NNG_OPT_IPC_PEER_ZONEID,
 	    .o_get  = ipc_get_peer_zoneid,
 	},
+	{
+	    .o_name = NNG_OPT_IPC_SEQPACKET,
+	    .o_get  = ipc_get_seqpacket,
+	},
 	{
 	    .o_name = NULL,
 	},
@@ -467,6 +546,8 @@ nni_posix_ipc_alloc(nni_ipc_conn **cp, nni_sockaddr *sa, nni_ipc_dialer *d)
 	}
 
 	c->closed         = false;
+	c->seqpacket      = false;
+	c->maxpkt         = 0;
 	c->dialer         = d;
 	c->stream.s_free  = ipc_free;
 	c->stream.s_close = ipc_close;
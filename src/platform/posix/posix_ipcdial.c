@@ -1,5 +1,5 @@
 //
-// Copyright 2023 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 // Copyright 2019 Devolutions <info@devolutions.net>
 //
@@ -148,12 +148,13 @@ ipc_dialer_cb(nni_posix_pfd *pfd, unsigned ev, void *arg)
 	nni_aio_finish(aio, 0, 0);
 }
 
-// We don't give local address binding support.  Outbound dialers always
-// get an ephemeral port.
-void
-ipc_dialer_dial(void *arg, nni_aio *aio)
+// ipc_dialer_connect starts a connection using the given socket type.
+// If the connection cannot be started, the error is returned, and the
+// aio is left for the caller to complete.  Otherwise the aio either
+// completes or is queued for the asynchronous connect.
+static int
+ipc_dialer_connect(ipc_dialer *d, nni_aio *aio, int type)
 {
-	ipc_dialer *            d = arg;
 	nni_ipc_conn *          c;
 	nni_posix_pfd *         pfd = NULL;
 	struct sockaddr_storage ss;
@@ -161,19 +162,13 @@ ipc_dialer_dial(void *arg, nni_aio *aio)
 	int                     fd;
 	int                     rv;
 
-	if (nni_aio_begin(aio) != 0) {
-		return;
-	}
-
 	if (((len = nni_posix_nn2sockaddr(&ss, &d->sa)) == 0) ||
 	    (ss.ss_family != AF_UNIX)) {
-		nni_aio_finish_error(aio, NNG_EADDRINVAL);
-		return;
+		return (NNG_EADDRINVAL);
 	}
 
-	if ((fd = socket(ss.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
-		nni_aio_finish_error(aio, nni_plat_errno(errno));
-		return;
+	if ((fd = socket(ss.ss_family, type | SOCK_CLOEXEC, 0)) < 0) {
+		return (nni_plat_errno(errno));
 	}
 
 	nni_atomic_inc64(&d->ref);
@@ -181,8 +176,7 @@ ipc_dialer_dial(void *arg, nni_aio *aio)
 	if ((rv = nni_posix_ipc_alloc(&c, &d->sa, d)) != 0) {
 		(void) close(fd);
 		nni_posix_ipc_dialer_rele(d);
-		nni_aio_finish_error(aio, rv);
-		return;
+		return (rv);
 	}
 
 	// This arranges for the fd to be in non-blocking mode, and adds the
@@ -195,26 +189,32 @@ ipc_dialer_dial(void *arg, nni_aio *aio)
 
 	nni_posix_ipc_init(c, pfd);
 	nni_posix_pfd_set_cb(pfd, ipc_dialer_cb, c);
+#ifdef SOCK_SEQPACKET
+	c->seqpacket = (type == SOCK_SEQPACKET);
+#endif
 
 	nni_mtx_lock(&d->mtx);
 	if (d->closed) {
 		rv = NNG_ECLOSED;
 		goto error;
 	}
-	if ((rv = nni_aio_schedule(aio, ipc_dialer_cancel, d)) != 0) {
-		goto error;
-	}
 	if (connect(fd, (void *) &ss, len) != 0) {
 		if (errno != EINPROGRESS) {
 			if (errno == ENOENT) {
 				// No socket present means nobody listening.
 				rv = NNG_ECONNREFUSED;
+			} else if (errno == EPROTOTYPE) {
+				// Listener uses a different socket type.
+				rv = NNG_EPROTO;
 			} else {
 				rv = nni_plat_errno(errno);
 			}
 			goto error;
 		}
 		// Asynchronous connect.
+		if ((rv = nni_aio_schedule(aio, ipc_dialer_cancel, d)) != 0) {
+			goto error;
+		}
 		if ((rv = nni_posix_pfd_arm(pfd, NNI_POLL_OUT)) != 0) {
 			goto error;
 		}
@@ -222,25 +222,99 @@ ipc_dialer_dial(void *arg, nni_aio *aio)
 		nni_aio_set_prov_data(aio, c);
 		nni_list_append(&d->connq, aio);
 		nni_mtx_unlock(&d->mtx);
-		return;
+		return (0);
 	}
 	// Immediate connect, cool!  This probably only happens
 	// on loop back, and probably not on every platform.
-	nni_aio_set_prov_data(aio, NULL);
 	nni_mtx_unlock(&d->mtx);
 	nni_posix_ipc_start(c);
 	nni_aio_set_output(aio, 0, c);
 	nni_aio_finish(aio, 0, 0);
-	return;
+	return (0);
 
 error:
 	nni_aio_set_prov_data(aio, NULL);
 	nni_mtx_unlock(&d->mtx);
 	nng_stream_free(&c->stream);
-	nni_aio_finish_error(aio, rv);
+	return (rv);
 }
 
+// We don't give local address binding support.  Outbound dialers always
+// get an ephemeral port.
+void
+ipc_dialer_dial(void *arg, nni_aio *aio)
+{
+	ipc_dialer *d = arg;
+	int         rv;
+
+	if (nni_aio_begin(aio) != 0) {
+		return;
+	}
+
+#ifdef SOCK_SEQPACKET
+	bool seqpacket;
+
+	nni_mtx_lock(&d->mtx);
+	seqpacket = d->seqpacket;
+	nni_mtx_unlock(&d->mtx);
+
+	// Packet mode is tried first when requested.  If the platform
+	// lacks it, or the listener is using a byte stream, then we fall
+	// back to a stream, as that is what every listener understands.
+	if (seqpacket) {
+		rv = ipc_dialer_connect(d, aio, SOCK_SEQPACKET);
+		if ((rv != NNG_EPROTO) && (rv != NNG_ENOTSUP)) {
+			goto done;
+		}
+	}
+#endif
+	rv = ipc_dialer_connect(d, aio, SOCK_STREAM);
+
+#ifdef SOCK_SEQPACKET
+done:
+#endif
+	if (rv != 0) {
+		nni_aio_finish_error(aio, rv);
+	}
+}
+
+#ifdef SOCK_SEQPACKET
+static int
+ipc_dialer_get_seqpacket(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	ipc_dialer *d = arg;
+	bool        b;
+
+	nni_mtx_lock(&d->mtx);
+	b = d->seqpacket;
+	nni_mtx_unlock(&d->mtx);
+	return (nni_copyout_bool(b, buf, szp, t));
+}
+
+static int
+ipc_dialer_set_seqpacket(void *arg, const void *buf, size_t sz, nni_type t)
+{
+	ipc_dialer *d = arg;
+	bool        b;
+	int         rv;
+
+	if ((rv = nni_copyin_bool(&b, buf, sz, t)) == 0) {
+		nni_mtx_lock(&d->mtx);
+		d->seqpacket = b;
+		nni_mtx_unlock(&d->mtx);
+	}
+	return (rv);
+}
+#endif
+
 static const nni_option ipc_dialer_options[] = {
+#ifdef SOCK_SEQPACKET
+	{
+	    .o_name = NNG_OPT_IPC_SEQPACKET,
+	    .o_get  = ipc_dialer_get_seqpacket,
+	    .o_set  = ipc_dialer_set_seqpacket,
+	},
+#endif
 	{
 	    .o_name = NULL,
 	},
@@ -305,6 +379,7 @@ nni_ipc_dialer_alloc(nng_stream_dialer **dp, const nng_url *url)
 	nni_mtx_init(&d->mtx);
 	nni_aio_list_init(&d->connq);
 	d->closed      = false;
+	d->seqpacket   = false;
 	d->sd.sd_free  = ipc_dialer_free;
 	d->sd.sd_close = ipc_dialer_close;
 	d->sd.sd_dial  = ipc_dialer_dial;
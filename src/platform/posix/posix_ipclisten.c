@@ -1,5 +1,5 @@
 //
-// Copyright 2020 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 // Copyright 2019 Devolutions <info@devolutions.net>
 //
@@ -38,6 +38,7 @@ typedef struct {
 	bool                closed;
 	char *              path;
 	mode_t              perms;
+	bool                seqpacket;
 	nni_mtx             mtx;
 } ipc_listener;
 
@@ -86,7 +87,7 @@ ipc_listener_doaccept(ipc_listener *l)
 
 		fd = nni_posix_pfd_fd(l->pfd);
 
-#ifdef NNG_USE_ACCEPT4
+#ifdef NNG_HAVE_ACCEPT4
 		newfd = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
 		if ((newfd < 0) && ((errno == ENOSYS) || (errno == ENOTSUP))) {
 			newfd = accept(fd, NULL, NULL);
@@ -139,6 +140,7 @@ ipc_listener_doaccept(ipc_listener *l)
 		}
 
 		nni_posix_ipc_init(c, pfd);
+		c->seqpacket = l->seqpacket;
 
 		nni_aio_list_remove(aio);
 		nni_posix_ipc_start(c);
@@ -254,6 +256,41 @@ ipc_listener_set_perms(void *arg, const void *buf, size_t sz, nni_type t)
 	return (0);
 }
 
+#ifdef SOCK_SEQPACKET
+static int
+ipc_listener_get_seqpacket(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	ipc_listener *l = arg;
+	bool          b;
+
+	nni_mtx_lock(&l->mtx);
+	b = l->seqpacket;
+	nni_mtx_unlock(&l->mtx);
+	return (nni_copyout_bool(b, buf, szp, t));
+}
+
+static int
+ipc_listener_set_seqpacket(
+    void *arg, const void *buf, size_t sz, nni_type t)
+{
+	ipc_listener *l = arg;
+	bool          b;
+	int           rv;
+
+	if ((rv = nni_copyin_bool(&b, buf, sz, t)) != 0) {
+		return (rv);
+	}
+	nni_mtx_lock(&l->mtx);
+	if (l->started) {
+		nni_mtx_unlock(&l->mtx);
+		return (NNG_EBUSY);
+	}
+	l->seqpacket = b;
+	nni_mtx_unlock(&l->mtx);
+	return (0);
+}
+#endif
+
 static const nni_option ipc_listener_options[] = {
 	{
 	    .o_name = NNG_OPT_LOCADDR,
@@ -263,6 +300,13 @@ static const nni_option ipc_listener_options[] = {
 	    .o_name = NNG_OPT_IPC_PERMISSIONS,
 	    .o_set  = ipc_listener_set_perms,
 	},
+#ifdef SOCK_SEQPACKET
+	{
+	    .o_name = NNG_OPT_IPC_SEQPACKET,
+	    .o_get  = ipc_listener_get_seqpacket,
+	    .o_set  = ipc_listener_set_seqpacket,
+	},
+#endif
 	{
 	    .o_name = NULL,
 	},
@@ -307,6 +351,7 @@ ipc_listener_listen(void *arg)
 	struct sockaddr_storage ss;
 	int                     rv;
 	int                     fd;
+	int                     type;
 	nni_posix_pfd *         pfd;
 	char *                  path;
 
@@ -339,7 +384,13 @@ ipc_listener_listen(void *arg)
 		return (NNG_EADDRINVAL);
 	}
 
-	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+	type = SOCK_STREAM;
+#ifdef SOCK_SEQPACKET
+	if (l->seqpacket) {
+		type = SOCK_SEQPACKET;
+	}
+#endif
+	if ((fd = socket(AF_UNIX, type | SOCK_CLOEXEC, 0)) < 0) {
 		rv = nni_plat_errno(errno);
 		nni_mtx_unlock(&l->mtx);
 		nni_strfree(path);
@@ -506,6 +557,7 @@ nni_ipc_listener_alloc(nng_stream_listener **lp, const nng_url *url)
 	l->closed       = false;
 	l->started      = false;
 	l->perms        = 0;
+	l->seqpacket    = false;
 	l->sl.sl_free   = ipc_listener_free;
 	l->sl.sl_close  = ipc_listener_close;
 	l->sl.sl_listen = ipc_listener_listen;
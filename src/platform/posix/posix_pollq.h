@@ -32,6 +32,22 @@ extern int  nni_posix_pfd_fd(nni_posix_pfd *);
 extern void nni_posix_pfd_close(nni_posix_pfd *);
 extern void nni_posix_pfd_set_cb(nni_posix_pfd *, nni_posix_pfd_cb, void *);
 
+// nni_posix_pfd_init_index is like nni_posix_pfd_init, but asks for the
+// descriptor to be serviced by a specific poller thread (modulo the number
+// of poller threads).  Backends with only a single poller ignore the index.
+extern int nni_posix_pfd_init_index(nni_posix_pfd **, int, unsigned);
+
+// nni_posix_pollq_count returns the number of poller threads.
+extern int nni_posix_pollq_count(void);
+
+// nni_posix_pollq_grow asks for at least the given number of poller
+// threads, for callers that want to spread descriptors across them.
+// This is best effort; it is limited by the number of CPUs and by
+// NNG_INIT_MAX_POLLER_THREADS, and does nothing if the application fixed
+// the number with NNG_INIT_NUM_POLLER_THREADS.  Backends with only a
+// single poller ignore it.
+extern void nni_posix_pollq_grow(int);
+
 #define NNI_POLL_IN ((unsigned) POLLIN)
 #define NNI_POLL_OUT ((unsigned) POLLOUT)
 #define NNI_POLL_HUP ((unsigned) POLLHUP)
@@ -1,5 +1,5 @@
 //
-// Copyright 2020 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 // Copyright 2018 Liam Staskawicz <liam@stask.net>
 //
@@ -74,18 +74,46 @@ struct nni_posix_pfd {
 	nni_cv           cv;
 };
 
-// single global instance for now.
-static nni_posix_pollq nni_posix_global_pollq;
+// We can have multiple poller threads, each with its own epoll instance.
+// Descriptors are spread across them round-robin, unless the caller asks
+// for a specific one (e.g. to shard a listener across poller threads.)
+// By default only a single poller is started.  More are only started if
+// the application asks for them with NNG_INIT_NUM_POLLER_THREADS, or
+// when a sharded listener needs them (up to the number of CPUs, and
+// subject to NNG_INIT_MAX_POLLER_THREADS).  The array is sized for the
+// most we will ever start, so that it never moves underneath readers.
+static nni_posix_pollq *nni_posix_pollqs;
+static int              nni_posix_pollq_limit;
+static nni_atomic_int   nni_posix_npollq;
+static nni_atomic_int   nni_posix_pollq_next;
+static nni_mtx          nni_posix_pollq_mtx = NNI_MTX_INITIALIZER;
+
+int
+nni_posix_pollq_count(void)
+{
+	return (nni_atomic_get(&nni_posix_npollq));
+}
 
 int
 nni_posix_pfd_init(nni_posix_pfd **pfdp, int fd)
+{
+	// A race here just means two descriptors share a poller, which
+	// is harmless.
+	unsigned index = (unsigned) nni_atomic_get(&nni_posix_pollq_next);
+	nni_atomic_inc(&nni_posix_pollq_next);
+	return (nni_posix_pfd_init_index(pfdp, fd, index));
+}
+
+int
+nni_posix_pfd_init_index(nni_posix_pfd **pfdp, int fd, unsigned index)
 {
 	nni_posix_pfd *    pfd;
 	nni_posix_pollq *  pq;
 	struct epoll_event ev;
 	int                rv;
 
-	pq = &nni_posix_global_pollq;
+	pq = &nni_posix_pollqs[index %
+	    (unsigned) nni_atomic_get(&nni_posix_npollq)];
 
 	(void) fcntl(fd, F_SETFD, FD_CLOEXEC);
 	(void) fcntl(fd, F_SETFL, O_NONBLOCK);
@@ -288,6 +316,8 @@ nni_posix_poll_thr(void *arg)
 
 				// Execute the callback with lock released
 				if (cb != NULL) {
+					NNI_PROBE2(
+					    pollq_dispatch, pfd->fd, mask);
 					cb(pfd, mask, cbarg);
 				}
 			}
@@ -394,16 +424,99 @@ nni_posix_pollq_create(nni_posix_pollq *pq)
 	return (0);
 }
 
+void
+nni_posix_pollq_grow(int num)
+{
+	int n;
+
+	nni_mtx_lock(&nni_posix_pollq_mtx);
+	if (num > nni_posix_pollq_limit) {
+		num = nni_posix_pollq_limit;
+	}
+	while ((n = nni_atomic_get(&nni_posix_npollq)) < num) {
+		// Failure here is not fatal, descriptors just end up
+		// sharing the pollers we already have.
+		if (nni_posix_pollq_create(&nni_posix_pollqs[n]) != 0) {
+			break;
+		}
+		// Publish only once the poller is fully set up.
+		nni_atomic_set(&nni_posix_npollq, n + 1);
+	}
+	nni_mtx_unlock(&nni_posix_pollq_mtx);
+}
+
+#ifndef NNG_MAX_POLLER_THREADS
+#define NNG_MAX_POLLER_THREADS 8
+#endif
+#ifndef NNG_NUM_POLLER_THREADS
+#define NNG_NUM_POLLER_THREADS 1
+#endif
+
 int
 nni_posix_pollq_sysinit(void)
 {
-	return (nni_posix_pollq_create(&nni_posix_global_pollq));
+	int rv;
+	int num_thr;
+	int max_thr;
+	int limit;
+
+	max_thr = (int) nni_init_get_param(
+	    NNG_INIT_MAX_POLLER_THREADS, NNG_MAX_POLLER_THREADS);
+
+	num_thr = (int) nni_init_get_param(NNG_INIT_NUM_POLLER_THREADS, 0);
+
+	if (num_thr > 0) {
+		// Application fixed the number, so do not grow later.
+		limit = num_thr;
+	} else {
+		num_thr = NNG_NUM_POLLER_THREADS;
+		limit   = nni_plat_ncpu();
+	}
+	if ((max_thr > 0) && (num_thr > max_thr)) {
+		num_thr = max_thr;
+	}
+	if (num_thr < 1) {
+		num_thr = 1;
+	}
+	if ((max_thr > 0) && (limit > max_thr)) {
+		limit = max_thr;
+	}
+	if (limit < num_thr) {
+		limit = num_thr;
+	}
+	nni_init_set_effective(NNG_INIT_NUM_POLLER_THREADS, num_thr);
+
+	if ((nni_posix_pollqs = NNI_ALLOC_STRUCTS(nni_posix_pollqs, limit)) ==
+	    NULL) {
+		return (NNG_ENOMEM);
+	}
+	nni_posix_pollq_limit = limit;
+	nni_atomic_init(&nni_posix_npollq);
+	nni_atomic_init(&nni_posix_pollq_next);
+	for (int i = 0; i < num_thr; i++) {
+		if ((rv = nni_posix_pollq_create(&nni_posix_pollqs[i])) != 0) {
+			nni_posix_pollq_sysfini();
+			return (rv);
+		}
+		nni_atomic_set(&nni_posix_npollq, i + 1);
+	}
+	return (0);
 }
 
 void
 nni_posix_pollq_sysfini(void)
 {
-	nni_posix_pollq_destroy(&nni_posix_global_pollq);
+	int n = nni_atomic_get(&nni_posix_npollq);
+
+	for (int i = 0; i < n; i++) {
+		nni_posix_pollq_destroy(&nni_posix_pollqs[i]);
+	}
+	if (nni_posix_pollqs != NULL) {
+		NNI_FREE_STRUCTS(nni_posix_pollqs, nni_posix_pollq_limit);
+	}
+	nni_posix_pollqs      = NULL;
+	nni_posix_pollq_limit = 0;
+	nni_atomic_set(&nni_posix_npollq, 0);
 }
 
 #endif // NNG_HAVE_EPOLL
@@ -1,5 +1,5 @@
 //
-// Copyright 2020 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 //
 // This software is supplied under the terms of the MIT License, a
@@ -288,6 +288,8 @@ nni_posix_poll_thr(void *arg)
 				nni_mtx_unlock(&pfd->mtx);
 
 				if (cb) {
+					NNI_PROBE2(
+					    pollq_dispatch, pfd->fd, events);
 					cb(pfd, events, arg);
 				}
 			}
@@ -335,6 +337,26 @@ nni_posix_pollq_create(nni_posix_pollq *pq)
 	return (0);
 }
 
+int
+nni_posix_pfd_init_index(nni_posix_pfd **pfdp, int fd, unsigned index)
+{
+	// We only have a single poller thread.
+	NNI_ARG_UNUSED(index);
+	return (nni_posix_pfd_init(pfdp, fd));
+}
+
+int
+nni_posix_pollq_count(void)
+{
+	return (1);
+}
+
+void
+nni_posix_pollq_grow(int num)
+{
+	NNI_ARG_UNUSED(num);
+}
+
 int
 nni_posix_pollq_sysinit(void)
 {
@@ -1,5 +1,5 @@
 //
-// Copyright 2020 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 // Copyright 2018 Devolutions <info@devolutions.net>
 //
@@ -16,6 +16,17 @@
 
 #include "platform/posix/posix_aio.h"
 
+// Socket tuning options (see NNG_OPT_TCP_BUSY_POLL and friends) that
+// dialers and listeners apply to the connections they create.  Only the
+// values that were explicitly set are applied, so that the operating
+// system defaults are otherwise left alone.
+#define NNI_TCP_NUM_TUNABLES 7
+
+typedef struct nni_tcp_tunables {
+	unsigned set; // bit mask of values that have been set
+	int      val[NNI_TCP_NUM_TUNABLES];
+} nni_tcp_tunables;
+
 struct nni_tcp_conn {
 	nng_stream      stream;
 	nni_posix_pfd * pfd;
@@ -26,6 +37,24 @@ struct nni_tcp_conn {
 	nni_aio *       dial_aio;
 	nni_tcp_dialer *dialer;
 	nni_reap_node   reap;
+
+	nni_tcp_tunables tune;     // applied when the connection is started
+	bool             quickack; // TCP_QUICKACK is reapplied after reads
+
+	// Zero-copy send state.  Writes at least zc_thresh bytes long are
+	// sent with MSG_ZEROCOPY, and then parked on zcq until the kernel
+	// tells us (via the error queue) that it is done with the buffers.
+	// Nothing else may complete them, not even close or cancellation.
+	size_t   zc_thresh;
+	bool     zc_enabled;
+	uint32_t zc_seq;    // next zero-copy send sequence number
+	nni_aio *zc_aio;    // aio with a partially completed zero-copy send
+	nni_iov  zc_iov[8]; // original iov of zc_aio, restored at completion
+	unsigned zc_niov;
+	nni_list zcq;
+	int      zc_err;    // result for zcq, once the connection is aborted
+	bool     zc_timing; // zc_timer is running
+	nni_aio  zc_timer;  // reaps completions after the connection is gone
 };
 
 struct nni_tcp_dialer {
@@ -33,6 +62,8 @@ struct nni_tcp_dialer {
 	bool                    closed;
 	bool                    nodelay;
 	bool                    keepalive;
+	size_t                  zc_thresh;
+	nni_tcp_tunables        tune;
 	struct sockaddr_storage src;
 	size_t                  srclen;
 	nni_mtx                 mtx;
@@ -45,4 +76,15 @@ extern void nni_posix_tcp_init(nni_tcp_conn *, nni_posix_pfd *);
 extern void nni_posix_tcp_start(nni_tcp_conn *, int, int);
 extern void nni_posix_tcp_dialer_rele(nni_tcp_dialer *);
 
+// Zero-copy threshold option handling, shared by dialers and listeners.
+extern int nni_posix_tcp_set_zerocopy(size_t *, const void *, size_t, nni_type);
+
+// Socket tuning option handling, shared by dialers and listeners.  These
+// return NNG_ENOTSUP if the name is not a tuning option, so that callers
+// can fall back to their own option tables.
+extern int nni_posix_tcp_tune_set(
+    nni_tcp_tunables *, const char *, const void *, size_t, nni_type);
+extern int nni_posix_tcp_tune_get(
+    nni_tcp_tunables *, const char *, void *, size_t *, nni_type);
+
 #endif // PLATFORM_POSIX_TCP_H
\ No newline at end of file
@@ -1,5 +1,5 @@
 //
-// Copyright 2020 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 // Copyright 2019 Devolutions <info@devolutions.net>
 //
@@ -13,6 +13,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <poll.h>
@@ -20,13 +21,73 @@
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/uio.h>
+#include <time.h>
 
 #ifndef MSG_NOSIGNAL
 #define MSG_NOSIGNAL 0
 #endif
 
+#ifdef NNG_HAVE_MSG_ZEROCOPY
+#include <linux/errqueue.h>
+#endif
+
 #include "posix_tcp.h"
 
+// Socket options that may be missing on some platforms.  We use -1 to
+// indicate that the option is not supported.
+#ifdef SO_BUSY_POLL
+#define NNI_SO_BUSY_POLL SO_BUSY_POLL
+#else
+#define NNI_SO_BUSY_POLL (-1)
+#endif
+#ifdef TCP_QUICKACK
+#define NNI_TCP_QUICKACK TCP_QUICKACK
+#else
+#define NNI_TCP_QUICKACK (-1)
+#endif
+#ifdef TCP_NOTSENT_LOWAT
+#define NNI_TCP_NOTSENT_LOWAT TCP_NOTSENT_LOWAT
+#else
+#define NNI_TCP_NOTSENT_LOWAT (-1)
+#endif
+#ifdef SO_INCOMING_CPU
+#define NNI_SO_INCOMING_CPU SO_INCOMING_CPU
+#else
+#define NNI_SO_INCOMING_CPU (-1)
+#endif
+#ifdef TCP_USER_TIMEOUT
+#define NNI_TCP_USER_TIMEOUT TCP_USER_TIMEOUT
+#else
+#define NNI_TCP_USER_TIMEOUT (-1)
+#endif
+
+#ifdef NNG_ENABLE_STATS
+static nni_stat_item tcp_stat_root;
+static nni_stat_item tcp_stat_copy_sends;
+static nni_stat_item tcp_stat_zc_sends;
+static nni_stat_item tcp_stat_zc_copied;
+#endif
+
+static void tcp_abort(nni_tcp_conn *, int);
+
+// tcp_zc_park moves an aio with a partially sent zero-copy write over to
+// the completion queue.  The kernel may still be sending the parts that
+// were handed to it, so the aio cannot complete until those are reaped.
+static void
+tcp_zc_park(nni_tcp_conn *c)
+{
+	nni_aio *aio;
+
+	if ((aio = c->zc_aio) != NULL) {
+		c->zc_aio = NULL;
+		(void) nni_aio_set_iov(aio, c->zc_niov, c->zc_iov);
+		nni_aio_set_prov_data(
+		    aio, (void *) (uintptr_t) (c->zc_seq - 1));
+		nni_aio_list_remove(aio);
+		nni_aio_list_append(&c->zcq, aio);
+	}
+}
+
 static void
 tcp_dowrite(nni_tcp_conn *c)
 {
@@ -45,6 +106,9 @@ tcp_dowrite(nni_tcp_conn *c)
 		nni_iov *     aiov;
 		struct msghdr hdr;
 		struct iovec  iovec[16];
+		size_t        total;
+		int           flags;
+		bool          zc;
 
 		memset(&hdr, 0, sizeof(hdr));
 		nni_aio_get_iov(aio, &naiov, &aiov);
@@ -55,18 +119,32 @@ tcp_dowrite(nni_tcp_conn *c)
 			continue;
 		}
 
-		for (niov = 0, i = 0; i < naiov; i++) {
+		for (total = 0, niov = 0, i = 0; i < naiov; i++) {
 			if (aiov[i].iov_len > 0) {
 				iovec[niov].iov_len  = aiov[i].iov_len;
 				iovec[niov].iov_base = aiov[i].iov_buf;
+				total += aiov[i].iov_len;
 				niov++;
 			}
 		}
 
 		hdr.msg_iovlen = niov;
 		hdr.msg_iov    = iovec;
+		flags          = MSG_NOSIGNAL;
+
+		// Large writes may use zero-copy.  Once any part of an aio
+		// has been sent that way, we keep going with it (the rest
+		// may be short, but the aio cannot complete until the kernel
+		// releases the earlier part anyway).
+		zc = c->zc_enabled &&
+		    ((c->zc_aio == aio) || (total >= c->zc_thresh));
+#ifdef NNG_HAVE_MSG_ZEROCOPY
+		if (zc) {
+			flags |= MSG_ZEROCOPY;
+		}
+#endif
 
-		if ((n = sendmsg(fd, &hdr, MSG_NOSIGNAL)) < 0) {
+		if ((n = sendmsg(fd, &hdr, flags)) < 0) {
 			switch (errno) {
 			case EINTR:
 				continue;
@@ -77,7 +155,21 @@ tcp_dowrite(nni_tcp_conn *c)
 #endif
 #endif
 				return;
+			case ENOBUFS:
+				// Zero-copy sends fail with ENOBUFS if we
+				// exceed the socket's optmem limit.  Fall
+				// back to copying on this connection.
+				if (zc && (c->zc_aio == NULL)) {
+					c->zc_enabled = false;
+					continue;
+				}
+				// FALLTHROUGH
 			default:
+				if (c->zc_aio == aio) {
+					// Some of it is already on the wire.
+					tcp_abort(c, nni_plat_errno(errno));
+					return;
+				}
 				nni_aio_list_remove(aio);
 				nni_aio_finish_error(
 				    aio, nni_plat_errno(errno));
@@ -86,13 +178,183 @@ tcp_dowrite(nni_tcp_conn *c)
 		}
 
 		nni_aio_bump_count(aio, n);
-		// We completed the entire operation on this aio.
-		// (Sendmsg never returns a partial result.)
-		nni_aio_list_remove(aio);
-		nni_aio_finish(aio, 0, nni_aio_count(aio));
 
-		// Go back to start of loop to see if there is another
-		// aio ready for us to process.
+		if (!zc) {
+#ifdef NNG_ENABLE_STATS
+			nni_stat_inc(&tcp_stat_copy_sends, 1);
+#endif
+			// We completed the entire operation on this aio.
+			// (Sendmsg never returns a partial result.)
+			nni_aio_list_remove(aio);
+			nni_aio_finish(aio, 0, nni_aio_count(aio));
+
+			// Go back to start of loop to see if there is
+			// another aio ready for us to process.
+			continue;
+		}
+
+		// Zero-copy send.  Each successful send consumes a sequence
+		// number, which the kernel reports back when it is done.
+		if (c->zc_aio != aio) {
+			c->zc_aio  = aio;
+			c->zc_niov = naiov;
+			memcpy(c->zc_iov, aiov, sizeof(nni_iov) * naiov);
+		}
+		c->zc_seq++;
+
+		if ((size_t) n < total) {
+			// Partial send; we cannot complete this until all
+			// of it is sent, so advance and keep going.
+			nni_aio_iov_advance(aio, n);
+			continue;
+		}
+
+		// Everything has been handed to the kernel.  Park the aio
+		// until the kernel is done with its buffers.
+		tcp_zc_park(c);
+	}
+}
+
+#ifdef NNG_HAVE_MSG_ZEROCOPY
+// tcp_zc_reap drains zero-copy completion notifications from the socket
+// error queue, and completes any aios whose buffers are no longer in use
+// by the kernel.
+static void
+tcp_zc_reap(nni_tcp_conn *c)
+{
+	int fd = nni_posix_pfd_fd(c->pfd);
+
+	for (;;) {
+		struct msghdr   hdr;
+		struct cmsghdr *cm;
+		union {
+			char buf[CMSG_SPACE(sizeof(struct sock_extended_err) +
+			    sizeof(struct sockaddr_storage))];
+			struct cmsghdr align;
+		} ctl;
+
+		memset(&hdr, 0, sizeof(hdr));
+		hdr.msg_control    = ctl.buf;
+		hdr.msg_controllen = sizeof(ctl.buf);
+
+		if (recvmsg(fd, &hdr, MSG_ERRQUEUE) < 0) {
+			// Typically EAGAIN, meaning we've drained it all.
+			return;
+		}
+
+		for (cm = CMSG_FIRSTHDR(&hdr); cm != NULL;
+		     cm = CMSG_NXTHDR(&hdr, cm)) {
+			struct sock_extended_err *serr;
+			uint32_t                  lo;
+			uint32_t                  hi;
+			nni_aio                  *aio;
+
+			if (!(((cm->cmsg_level == SOL_IP) &&
+			          (cm->cmsg_type == IP_RECVERR)) ||
+			        ((cm->cmsg_level == SOL_IPV6) &&
+			            (cm->cmsg_type == IPV6_RECVERR)))) {
+				continue;
+			}
+			serr = (void *) CMSG_DATA(cm);
+			if ((serr->ee_errno != 0) ||
+			    (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)) {
+				continue;
+			}
+			lo = serr->ee_info;
+			hi = serr->ee_data;
+
+#ifdef NNG_ENABLE_STATS
+			// The kernel may have elected to copy anyway
+			// (for example on loopback), which is useful to know
+			// when tuning the threshold.
+			if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+				nni_stat_inc(&tcp_stat_zc_copied, hi - lo + 1);
+			} else {
+				nni_stat_inc(&tcp_stat_zc_sends, hi - lo + 1);
+			}
+#else
+			NNI_ARG_UNUSED(lo);
+#endif
+
+			// Notifications for TCP arrive in order, so
+			// everything up to and including hi is done.
+			while ((aio = nni_list_first(&c->zcq)) != NULL) {
+				uint32_t id = (uint32_t) (uintptr_t)
+				    nni_aio_get_prov_data(aio);
+				if ((int32_t) (id - hi) > 0) {
+					break;
+				}
+				nni_aio_list_remove(aio);
+				nni_aio_finish(
+				    aio, c->zc_err, nni_aio_count(aio));
+			}
+		}
+	}
+}
+#endif
+
+// tcp_zc_timer_cb keeps reaping zero-copy completions after the
+// connection has been torn down, when the poller no longer does it.
+static void
+tcp_zc_timer_cb(void *arg)
+{
+	nni_tcp_conn *c = arg;
+
+	nni_mtx_lock(&c->mtx);
+	c->zc_timing = false;
+#ifdef NNG_HAVE_MSG_ZEROCOPY
+	if (nni_aio_result(&c->zc_timer) == 0) {
+		tcp_zc_reap(c);
+		if (!nni_list_empty(&c->zcq)) {
+			c->zc_timing = true;
+			nni_sleep_aio(1, &c->zc_timer);
+		}
+	}
+#endif
+	nni_mtx_unlock(&c->mtx);
+}
+
+// tcp_abort fails the outstanding operations of a connection that is
+// going away, and shuts it down.  Zero-copy sends are the exception, as
+// the kernel may still be reading from their buffers; those are only
+// completed by tcp_zc_reap.  To make that happen promptly, we reset the
+// connection, so that the kernel discards (and releases) whatever it has
+// not yet sent.  Must be called with the lock held.
+static void
+tcp_abort(nni_tcp_conn *c, int err)
+{
+	nni_aio *aio;
+
+	if (c->zc_err == 0) {
+		c->zc_err = err;
+	}
+	tcp_zc_park(c);
+	while (((aio = nni_list_first(&c->readq)) != NULL) ||
+	    ((aio = nni_list_first(&c->writeq)) != NULL)) {
+		nni_aio_list_remove(aio);
+		nni_aio_finish_error(aio, err);
+	}
+#ifdef NNG_HAVE_MSG_ZEROCOPY
+	if (!nni_list_empty(&c->zcq)) {
+		struct sockaddr sa;
+
+		// Connecting to AF_UNSPEC disconnects the socket, which
+		// purges its send queue.
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_family = AF_UNSPEC;
+		(void) connect(nni_posix_pfd_fd(c->pfd), &sa, sizeof(sa));
+		tcp_zc_reap(c);
+
+		// Notifications can still lag behind (e.g. for buffers
+		// held by the NIC), so poll for them until they arrive.
+		if ((!nni_list_empty(&c->zcq)) && (!c->zc_timing)) {
+			c->zc_timing = true;
+			nni_sleep_aio(1, &c->zc_timer);
+		}
+	}
+#endif
+	if (c->pfd != NULL) {
+		nni_posix_pfd_close(c->pfd);
 	}
 }
 
@@ -152,6 +414,14 @@ tcp_doread(nni_tcp_conn *c)
 
 		nni_aio_bump_count(aio, n);
 
+		// Linux clears quick ACK mode as it sees fit, so if the
+		// user asked for it, we have to keep turning it back on.
+		if (c->quickack) {
+			int one = 1;
+			(void) setsockopt(fd, IPPROTO_TCP, NNI_TCP_QUICKACK,
+			    &one, sizeof(one));
+		}
+
 		// We completed the entire operation on this aio.
 		nni_aio_list_remove(aio);
 		nni_aio_finish(aio, 0, nni_aio_count(aio));
@@ -165,17 +435,9 @@ static void
 tcp_error(void *arg, int err)
 {
 	nni_tcp_conn *c = arg;
-	nni_aio *     aio;
 
 	nni_mtx_lock(&c->mtx);
-	while (((aio = nni_list_first(&c->readq)) != NULL) ||
-	    ((aio = nni_list_first(&c->writeq)) != NULL)) {
-		nni_aio_list_remove(aio);
-		nni_aio_finish_error(aio, err);
-	}
-	if (c->pfd != NULL) {
-		nni_posix_pfd_close(c->pfd);
-	}
+	tcp_abort(c, err);
 	nni_mtx_unlock(&c->mtx);
 }
 
@@ -185,16 +447,8 @@ tcp_close(void *arg)
 	nni_tcp_conn *c = arg;
 	nni_mtx_lock(&c->mtx);
 	if (!c->closed) {
-		nni_aio *aio;
 		c->closed = true;
-		while (((aio = nni_list_first(&c->readq)) != NULL) ||
-		    ((aio = nni_list_first(&c->writeq)) != NULL)) {
-			nni_aio_list_remove(aio);
-			nni_aio_finish_error(aio, NNG_ECLOSED);
-		}
-		if (c->pfd != NULL) {
-			nni_posix_pfd_close(c->pfd);
-		}
+		tcp_abort(c, NNG_ECLOSED);
 	}
 	nni_mtx_unlock(&c->mtx);
 }
@@ -206,6 +460,22 @@ tcp_fini(void *arg)
 {
 	nni_tcp_conn *c = arg;
 	tcp_close(c);
+	nni_aio_stop(&c->zc_timer);
+#ifdef NNG_HAVE_MSG_ZEROCOPY
+	// The owner should have waited for its sends to complete, but if
+	// it did not, we still cannot let go of them before the kernel does.
+	nni_mtx_lock(&c->mtx);
+	while (!nni_list_empty(&c->zcq)) {
+		tcp_zc_reap(c);
+		if (!nni_list_empty(&c->zcq)) {
+			nni_mtx_unlock(&c->mtx);
+			nni_msleep(1);
+			nni_mtx_lock(&c->mtx);
+		}
+	}
+	nni_mtx_unlock(&c->mtx);
+#endif
+	nni_aio_fini(&c->zc_timer);
 	if (c->pfd != NULL) {
 		nni_posix_pfd_fini(c->pfd);
 	}
@@ -233,11 +503,34 @@ tcp_cb(nni_posix_pfd *pfd, unsigned events, void *arg)
 {
 	nni_tcp_conn *c = arg;
 
+#ifdef NNG_HAVE_MSG_ZEROCOPY
+	bool zc_notify = false;
+	// Zero-copy completions are posted to the socket error queue,
+	// which raises POLLERR even though nothing is wrong.  Only treat
+	// it as an error if the socket actually has one pending.
+	if (((events & (NNI_POLL_HUP | NNI_POLL_INVAL)) == 0) &&
+	    ((events & NNI_POLL_ERR) != 0) && (c->zc_thresh > 0)) {
+		int       err = 0;
+		socklen_t len = sizeof(err);
+		(void) getsockopt(nni_posix_pfd_fd(pfd), SOL_SOCKET, SO_ERROR,
+		    &err, &len);
+		if (err == 0) {
+			events &= ~NNI_POLL_ERR;
+			zc_notify = true;
+		}
+	}
+#endif
+
 	if (events & (NNI_POLL_HUP | NNI_POLL_ERR | NNI_POLL_INVAL)) {
 		tcp_error(c, NNG_ECONNSHUT);
 		return;
 	}
 	nni_mtx_lock(&c->mtx);
+#ifdef NNG_HAVE_MSG_ZEROCOPY
+	if (zc_notify || !nni_list_empty(&c->zcq)) {
+		tcp_zc_reap(c);
+	}
+#endif
 	if ((events & NNI_POLL_IN) != 0) {
 		tcp_doread(c);
 	}
@@ -251,21 +544,45 @@ tcp_cb(nni_posix_pfd *pfd, unsigned events, void *arg)
 	if (!nni_list_empty(&c->readq)) {
 		events |= NNI_POLL_IN;
 	}
+	if (!nni_list_empty(&c->zcq)) {
+		events |= NNI_POLL_ERR;
+	}
 	if ((!c->closed) && (events != 0)) {
 		nni_posix_pfd_arm(pfd, events);
 	}
 	nni_mtx_unlock(&c->mtx);
 }
 
+// tcp_zc_pending returns true if the aio is waiting for the kernel to
+// release its zero-copy buffers.  Such aios cannot be canceled.
+static bool
+tcp_zc_pending(nni_tcp_conn *c, nni_aio *aio)
+{
+	nni_aio *zaio;
+
+	NNI_LIST_FOREACH (&c->zcq, zaio) {
+		if (zaio == aio) {
+			return (true);
+		}
+	}
+	return (false);
+}
+
 static void
 tcp_cancel(nni_aio *aio, void *arg, int rv)
 {
 	nni_tcp_conn *c = arg;
 
 	nni_mtx_lock(&c->mtx);
-	if (nni_aio_list_active(aio)) {
-		nni_aio_list_remove(aio);
-		nni_aio_finish_error(aio, rv);
+	if (nni_aio_list_active(aio) && !tcp_zc_pending(c, aio)) {
+		if (c->zc_aio == aio) {
+			// Part of the message is already on the wire, and
+			// abandoning the rest would corrupt the stream.
+			tcp_abort(c, NNG_ECONNABORTED);
+		} else {
+			nni_aio_list_remove(aio);
+			nni_aio_finish_error(aio, rv);
+		}
 	}
 	nni_mtx_unlock(&c->mtx);
 }
@@ -295,6 +612,9 @@ tcp_send(void *arg, nni_aio *aio)
 		// complete us.
 		if (nni_list_first(&c->writeq) == aio) {
 			nni_posix_pfd_arm(c->pfd, POLLOUT);
+		} else if (nni_list_last(&c->zcq) == aio) {
+			// Wait for the zero-copy completion.
+			nni_posix_pfd_arm(c->pfd, NNI_POLL_ERR);
 		}
 	}
 	nni_mtx_unlock(&c->mtx);
@@ -442,6 +762,256 @@ tcp_get_keepalive(void *arg, void *buf, size_t *szp, nni_type t)
 	return (nni_copyout_bool(val, buf, szp, t));
 }
 
+// tcp_zc_enable turns on zero-copy for the connection, if the platform
+// supports it.  The caller must hold the lock.
+static int
+tcp_zc_enable(nni_tcp_conn *c)
+{
+#if defined(NNG_HAVE_MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+	int on = 1;
+	if (setsockopt(nni_posix_pfd_fd(c->pfd), SOL_SOCKET, SO_ZEROCOPY, &on,
+	        sizeof(on)) != 0) {
+		return (nni_plat_errno(errno));
+	}
+	c->zc_enabled = true;
+	return (0);
+#else
+	NNI_ARG_UNUSED(c);
+	return (NNG_ENOTSUP);
+#endif
+}
+
+int
+nni_posix_tcp_set_zerocopy(
+    size_t *thresh, const void *buf, size_t sz, nni_type t)
+{
+	size_t val;
+	int    rv;
+
+	if ((rv = nni_copyin_size(&val, buf, sz, 0, NNI_MAXSZ, t)) != 0) {
+		return (rv);
+	}
+#if !defined(NNG_HAVE_MSG_ZEROCOPY) || !defined(SO_ZEROCOPY)
+	if (val != 0) {
+		return (NNG_ENOTSUP);
+	}
+#endif
+	if (thresh != NULL) {
+		*thresh = val;
+	}
+	return (0);
+}
+
+static int
+tcp_set_zerocopy(void *arg, const void *buf, size_t sz, nni_type t)
+{
+	nni_tcp_conn *c = arg;
+	size_t        val;
+	int           rv;
+
+	if (((rv = nni_posix_tcp_set_zerocopy(&val, buf, sz, t)) != 0) ||
+	    (c == NULL)) {
+		return (rv);
+	}
+	nni_mtx_lock(&c->mtx);
+	if ((val > 0) && (!c->zc_enabled) && ((rv = tcp_zc_enable(c)) != 0)) {
+		nni_mtx_unlock(&c->mtx);
+		return (rv);
+	}
+	// Once enabled on the socket, we cannot turn SO_ZEROCOPY off again,
+	// but we can stop using it.
+	c->zc_thresh  = val;
+	c->zc_enabled = (val > 0);
+	nni_mtx_unlock(&c->mtx);
+	return (0);
+}
+
+static int
+tcp_get_zerocopy(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	nni_tcp_conn *c = arg;
+	size_t        val;
+
+	nni_mtx_lock(&c->mtx);
+	val = c->zc_thresh;
+	nni_mtx_unlock(&c->mtx);
+	return (nni_copyout_size(val, buf, szp, t));
+}
+
+// Tuning options are table driven, as they all map directly onto a
+// single integer valued socket option.  The index in this table is also
+// the index into nni_tcp_tunables.
+typedef struct {
+	const char *name;
+	int         level;
+	int         opt; // -1 if not supported on this platform
+	nni_type    type;
+} tcp_tunable;
+
+// Quick ACK needs special handling, as the kernel does not keep it set.
+#define TCP_TUNE_QUICKACK 1
+
+static const tcp_tunable tcp_tunables[NNI_TCP_NUM_TUNABLES] = {
+	{ NNG_OPT_TCP_BUSY_POLL, SOL_SOCKET, NNI_SO_BUSY_POLL, NNI_TYPE_INT32 },
+	{ NNG_OPT_TCP_QUICKACK, IPPROTO_TCP, NNI_TCP_QUICKACK, NNI_TYPE_BOOL },
+	{ NNG_OPT_TCP_NOTSENT_LOWAT, IPPROTO_TCP, NNI_TCP_NOTSENT_LOWAT,
+	    NNI_TYPE_SIZE },
+	{ NNG_OPT_TCP_SNDBUF, SOL_SOCKET, SO_SNDBUF, NNI_TYPE_SIZE },
+	{ NNG_OPT_TCP_RCVBUF, SOL_SOCKET, SO_RCVBUF, NNI_TYPE_SIZE },
+	{ NNG_OPT_TCP_INCOMING_CPU, SOL_SOCKET, NNI_SO_INCOMING_CPU,
+	    NNI_TYPE_INT32 },
+	{ NNG_OPT_TCP_USER_TIMEOUT, IPPROTO_TCP, NNI_TCP_USER_TIMEOUT,
+	    NNI_TYPE_DURATION },
+};
+
+static int
+tcp_tune_find(const char *name)
+{
+	for (int i = 0; i < NNI_TCP_NUM_TUNABLES; i++) {
+		if (strcmp(tcp_tunables[i].name, name) == 0) {
+			return (i);
+		}
+	}
+	return (-1);
+}
+
+static int
+tcp_tune_copyin(
+    const tcp_tunable *tt, int *valp, const void *buf, size_t sz, nni_type t)
+{
+	bool         b;
+	size_t       s;
+	nng_duration d;
+	int          rv;
+
+	switch (tt->type) {
+	case NNI_TYPE_BOOL:
+		if ((rv = nni_copyin_bool(&b, buf, sz, t)) == 0) {
+			*valp = b ? 1 : 0;
+		}
+		return (rv);
+	case NNI_TYPE_SIZE:
+		if ((rv = nni_copyin_size(&s, buf, sz, 0, INT_MAX, t)) == 0) {
+			*valp = (int) s;
+		}
+		return (rv);
+	case NNI_TYPE_DURATION:
+		if ((rv = nni_copyin_ms(&d, buf, sz, t)) != 0) {
+			return (rv);
+		}
+		if (d < 0) {
+			return (NNG_EINVAL);
+		}
+		*valp = (int) d;
+		return (0);
+	default:
+		return (nni_copyin_int(valp, buf, sz, 0, INT_MAX, t));
+	}
+}
+
+static int
+tcp_tune_copyout(const tcp_tunable *tt, int val, void *buf, size_t *szp,
+    nni_type t)
+{
+	switch (tt->type) {
+	case NNI_TYPE_BOOL:
+		return (nni_copyout_bool(val != 0, buf, szp, t));
+	case NNI_TYPE_SIZE:
+		return (nni_copyout_size((size_t) val, buf, szp, t));
+	case NNI_TYPE_DURATION:
+		return (nni_copyout_ms(val, buf, szp, t));
+	default:
+		return (nni_copyout_int(val, buf, szp, t));
+	}
+}
+
+int
+nni_posix_tcp_tune_set(nni_tcp_tunables *tune, const char *name,
+    const void *buf, size_t sz, nni_type t)
+{
+	const tcp_tunable *tt;
+	int                idx;
+	int                val;
+	int                rv;
+
+	if ((idx = tcp_tune_find(name)) < 0) {
+		return (NNG_ENOTSUP);
+	}
+	tt = &tcp_tunables[idx];
+	if ((rv = tcp_tune_copyin(tt, &val, buf, sz, t)) != 0) {
+		return (rv);
+	}
+	if (tt->opt < 0) {
+		return (NNG_ENOTSUP);
+	}
+	if (tune != NULL) {
+		tune->val[idx] = val;
+		tune->set |= (1u << idx);
+	}
+	return (0);
+}
+
+int
+nni_posix_tcp_tune_get(nni_tcp_tunables *tune, const char *name, void *buf,
+    size_t *szp, nni_type t)
+{
+	int idx;
+
+	if (((idx = tcp_tune_find(name)) < 0) ||
+	    (tcp_tunables[idx].opt < 0)) {
+		return (NNG_ENOTSUP);
+	}
+	return (tcp_tune_copyout(
+	    &tcp_tunables[idx], tune->val[idx], buf, szp, t));
+}
+
+static int
+tcp_set_tunable(
+    nni_tcp_conn *c, int idx, const void *buf, size_t sz, nni_type t)
+{
+	const tcp_tunable *tt = &tcp_tunables[idx];
+	int                val;
+	int                rv;
+
+	if ((rv = tcp_tune_copyin(tt, &val, buf, sz, t)) != 0) {
+		return (rv);
+	}
+	if (tt->opt < 0) {
+		return (NNG_ENOTSUP);
+	}
+	nni_mtx_lock(&c->mtx);
+	if (setsockopt(nni_posix_pfd_fd(c->pfd), tt->level, tt->opt, &val,
+	        sizeof(val)) != 0) {
+		rv = nni_plat_errno(errno);
+	} else if (idx == TCP_TUNE_QUICKACK) {
+		c->quickack = (val != 0);
+	}
+	nni_mtx_unlock(&c->mtx);
+	return (rv);
+}
+
+static int
+tcp_get_tunable(nni_tcp_conn *c, int idx, void *buf, size_t *szp, nni_type t)
+{
+	const tcp_tunable *tt    = &tcp_tunables[idx];
+	int                val   = 0;
+	socklen_t          valsz = sizeof(val);
+
+	if (tt->opt < 0) {
+		return (NNG_ENOTSUP);
+	}
+	if (idx == TCP_TUNE_QUICKACK) {
+		// The kernel value is transient; report what was asked for.
+		nni_mtx_lock(&c->mtx);
+		val = c->quickack ? 1 : 0;
+		nni_mtx_unlock(&c->mtx);
+	} else if (getsockopt(nni_posix_pfd_fd(c->pfd), tt->level, tt->opt,
+	               &val, &valsz) != 0) {
+		return (nni_plat_errno(errno));
+	}
+	return (tcp_tune_copyout(tt, val, buf, szp, t));
+}
+
 static const nni_option tcp_options[] = {
 	{
 	    .o_name = NNG_OPT_REMADDR,
@@ -461,6 +1031,11 @@ static const nni_option tcp_options[] = {
 	    .o_get  = tcp_get_keepalive,
 	    .o_set  = tcp_set_keepalive,
 	},
+	{
+	    .o_name = NNG_OPT_TCP_ZEROCOPY_THRESHOLD,
+	    .o_get  = tcp_get_zerocopy,
+	    .o_set  = tcp_set_zerocopy,
+	},
 	{
 	    .o_name = NULL,
 	},
@@ -470,6 +1045,11 @@ static int
 tcp_get(void *arg, const char *name, void *buf, size_t *szp, nni_type t)
 {
 	nni_tcp_conn *c = arg;
+	int           idx;
+
+	if ((idx = tcp_tune_find(name)) >= 0) {
+		return (tcp_get_tunable(c, idx, buf, szp, t));
+	}
 	return (nni_getopt(tcp_options, name, c, buf, szp, t));
 }
 
@@ -477,6 +1057,11 @@ static int
 tcp_set(void *arg, const char *name, const void *buf, size_t sz, nni_type t)
 {
 	nni_tcp_conn *c = arg;
+	int           idx;
+
+	if ((idx = tcp_tune_find(name)) >= 0) {
+		return (tcp_set_tunable(c, idx, buf, sz, t));
+	}
 	return (nni_setopt(tcp_options, name, c, buf, sz, t));
 }
 
@@ -494,6 +1079,8 @@ nni_posix_tcp_alloc(nni_tcp_conn **cp, nni_tcp_dialer *d)
 	nni_mtx_init(&c->mtx);
 	nni_aio_list_init(&c->readq);
 	nni_aio_list_init(&c->writeq);
+	nni_aio_list_init(&c->zcq);
+	nni_aio_init(&c->zc_timer, tcp_zc_timer_cb, c);
 
 	c->stream.s_free  = tcp_free;
 	c->stream.s_close = tcp_close;
@@ -521,5 +1108,75 @@ nni_posix_tcp_start(nni_tcp_conn *c, int nodelay, int keepalive)
 	(void) setsockopt(nni_posix_pfd_fd(c->pfd), SOL_SOCKET, SO_KEEPALIVE,
 	    &keepalive, sizeof(int));
 
+	// Apply any tuning options inherited from the dialer or listener.
+	// Like the above, failures here are not fatal.
+	for (int i = 0; i < NNI_TCP_NUM_TUNABLES; i++) {
+		const tcp_tunable *tt = &tcp_tunables[i];
+		if (((c->tune.set & (1u << i)) == 0) || (tt->opt < 0)) {
+			continue;
+		}
+		(void) setsockopt(nni_posix_pfd_fd(c->pfd), tt->level, tt->opt,
+		    &c->tune.val[i], sizeof(int));
+		if (i == TCP_TUNE_QUICKACK) {
+			c->quickack = (c->tune.val[i] != 0);
+		}
+	}
+
+	// If zero-copy was requested (by the dialer or listener), but
+	// cannot be enabled, we silently fall back to copying.
+	if ((c->zc_thresh > 0) && (tcp_zc_enable(c) != 0)) {
+		c->zc_thresh = 0;
+	}
+
 	nni_posix_pfd_set_cb(c->pfd, tcp_cb, c);
 }
+
+void
+nni_posix_tcp_sysinit(void)
+{
+#ifdef NNG_ENABLE_STATS
+	static const nni_stat_info root_info = {
+		.si_name = "tcp",
+		.si_desc = "tcp stream statistics",
+		.si_type = NNG_STAT_SCOPE,
+	};
+	static const nni_stat_info copy_sends_info = {
+		.si_name   = "copy_sends",
+		.si_desc   = "sends copied into the kernel",
+		.si_type   = NNG_STAT_COUNTER,
+		.si_unit   = NNG_UNIT_EVENTS,
+		.si_atomic = true,
+	};
+	static const nni_stat_info zc_sends_info = {
+		.si_name   = "zerocopy_sends",
+		.si_desc   = "sends completed with zero-copy",
+		.si_type   = NNG_STAT_COUNTER,
+		.si_unit   = NNG_UNIT_EVENTS,
+		.si_atomic = true,
+	};
+	static const nni_stat_info zc_copied_info = {
+		.si_name   = "zerocopy_copied",
+		.si_desc   = "zero-copy sends the kernel copied anyway",
+		.si_type   = NNG_STAT_COUNTER,
+		.si_unit   = NNG_UNIT_EVENTS,
+		.si_atomic = true,
+	};
+
+	nni_stat_init(&tcp_stat_root, &root_info);
+	nni_stat_init(&tcp_stat_copy_sends, &copy_sends_info);
+	nni_stat_init(&tcp_stat_zc_sends, &zc_sends_info);
+	nni_stat_init(&tcp_stat_zc_copied, &zc_copied_info);
+	nni_stat_add(&tcp_stat_root, &tcp_stat_copy_sends);
+	nni_stat_add(&tcp_stat_root, &tcp_stat_zc_sends);
+	nni_stat_add(&tcp_stat_root, &tcp_stat_zc_copied);
+	nni_stat_register(&tcp_stat_root);
+#endif
+}
+
+void
+nni_posix_tcp_sysfini(void)
+{
+#ifdef NNG_ENABLE_STATS
+	nni_stat_unregister(&tcp_stat_root);
+#endif
+}
@@ -153,8 +153,10 @@ tcp_dialer_cb(nni_posix_pfd *pfd, unsigned ev, void *arg)
 	c->dial_aio = NULL;
 	nni_aio_list_remove(aio);
 	nni_aio_set_prov_data(aio, NULL);
-	nd = d->nodelay ? 1 : 0;
-	ka = d->keepalive ? 1 : 0;
+	nd           = d->nodelay ? 1 : 0;
+	ka           = d->keepalive ? 1 : 0;
+	c->zc_thresh = d->zc_thresh;
+	c->tune      = d->tune;
 
 	nni_mtx_unlock(&d->mtx);
 
@@ -251,8 +253,10 @@ nni_tcp_dial(nni_tcp_dialer *d, const nni_sockaddr *sa, nni_aio *aio)
 	// Immediate connect, cool!  This probably only happens
 	// on loop back, and probably not on every platform.
 	nni_aio_set_prov_data(aio, NULL);
-	nd = d->nodelay ? 1 : 0;
-	ka = d->keepalive ? 1 : 0;
+	nd           = d->nodelay ? 1 : 0;
+	ka           = d->keepalive ? 1 : 0;
+	c->zc_thresh = d->zc_thresh;
+	c->tune      = d->tune;
 	nni_mtx_unlock(&d->mtx);
 	nni_posix_tcp_start(c, nd, ka);
 	nni_aio_set_output(aio, 0, c);
@@ -388,6 +392,34 @@ tcp_dialer_set_locaddr(void *arg, const void *buf, size_t sz, nni_type t)
 	return (0);
 }
 
+static int
+tcp_dialer_set_zerocopy(void *arg, const void *buf, size_t sz, nni_type t)
+{
+	nni_tcp_dialer *d = arg;
+	size_t          val;
+	int             rv;
+
+	if (((rv = nni_posix_tcp_set_zerocopy(&val, buf, sz, t)) != 0) ||
+	    (d == NULL)) {
+		return (rv);
+	}
+	nni_mtx_lock(&d->mtx);
+	d->zc_thresh = val;
+	nni_mtx_unlock(&d->mtx);
+	return (0);
+}
+
+static int
+tcp_dialer_get_zerocopy(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	nni_tcp_dialer *d = arg;
+	size_t          val;
+	nni_mtx_lock(&d->mtx);
+	val = d->zc_thresh;
+	nni_mtx_unlock(&d->mtx);
+	return (nni_copyout_size(val, buf, szp, t));
+}
+
 static const nni_option tcp_dialer_options[] = {
 	{
 	    .o_name = NNG_OPT_LOCADDR,
@@ -404,6 +436,11 @@ static const nni_option tcp_dialer_options[] = {
 	    .o_get  = tcp_dialer_get_keepalive,
 	    .o_set  = tcp_dialer_set_keepalive,
 	},
+	{
+	    .o_name = NNG_OPT_TCP_ZEROCOPY_THRESHOLD,
+	    .o_get  = tcp_dialer_get_zerocopy,
+	    .o_set  = tcp_dialer_set_zerocopy,
+	},
 	{
 	    .o_name = NULL,
 	},
@@ -413,6 +450,14 @@ int
 nni_tcp_dialer_get(
     nni_tcp_dialer *d, const char *name, void *buf, size_t *szp, nni_type t)
 {
+	int rv;
+
+	nni_mtx_lock(&d->mtx);
+	rv = nni_posix_tcp_tune_get(&d->tune, name, buf, szp, t);
+	nni_mtx_unlock(&d->mtx);
+	if (rv != NNG_ENOTSUP) {
+		return (rv);
+	}
 	return (nni_getopt(tcp_dialer_options, name, d, buf, szp, t));
 }
 
@@ -420,5 +465,13 @@ int
 nni_tcp_dialer_set(nni_tcp_dialer *d, const char *name, const void *buf,
     size_t sz, nni_type t)
 {
+	int rv;
+
+	nni_mtx_lock(&d->mtx);
+	rv = nni_posix_tcp_tune_set(&d->tune, name, buf, sz, t);
+	nni_mtx_unlock(&d->mtx);
+	if (rv != NNG_ENOTSUP) {
+		return (rv);
+	}
 	return (nni_setopt(tcp_dialer_options, name, d, buf, sz, t));
 }
@@ -1,5 +1,5 @@
 //
-// Copyright 2020 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 // Copyright 2018 Devolutions <info@devolutions.net>
 //
@@ -33,14 +33,43 @@
 
 #include "posix_tcp.h"
 
+// The listener may be sharded across several sockets bound to the same
+// address with SO_REUSEPORT.  The kernel load balances incoming connections
+// across the shards, and each shard is serviced by a different poller
+// thread, so that accepting connections scales across cores.  Readiness
+// on any shard causes us to drain multiple pending connections (up to
+// NNI_TCP_ACCEPT_BATCH) in one go; connections that have been accepted but
+// not yet claimed by a waiting aio are held in a small backlog.
+
+#ifndef NNI_TCP_ACCEPT_BATCH
+#define NNI_TCP_ACCEPT_BATCH 16
+#endif
+
+#ifndef NNI_TCP_MAX_SHARDS
+#define NNI_TCP_MAX_SHARDS 64
+#endif
+
+typedef struct tcp_listener_shard {
+	nni_posix_pfd    *pfd;
+	nni_tcp_listener *l;
+	bool              armed;
+} tcp_listener_shard;
+
 struct nni_tcp_listener {
-	nni_posix_pfd *pfd;
-	nni_list       acceptq;
-	bool           started;
-	bool           closed;
-	bool           nodelay;
-	bool           keepalive;
-	nni_mtx        mtx;
+	tcp_listener_shard *shards;
+	int                 nshards;
+	int                 want_shards;
+	int                 next_shard;
+	int                 backlog[NNI_TCP_ACCEPT_BATCH];
+	int                 nbacklog;
+	nni_list            acceptq;
+	bool                started;
+	bool                closed;
+	bool                nodelay;
+	bool                keepalive;
+	size_t              zc_thresh;
+	nni_tcp_tunables    tune;
+	nni_mtx             mtx;
 };
 
 int
@@ -53,9 +82,12 @@ nni_tcp_listener_init(nni_tcp_listener **lp)
 
 	nni_mtx_init(&l->mtx);
 
-	l->pfd     = NULL;
-	l->closed  = false;
-	l->started = false;
+	l->shards      = NULL;
+	l->nshards     = 0;
+	l->want_shards = 1;
+	l->nbacklog    = 0;
+	l->closed      = false;
+	l->started     = false;
 
 	nni_aio_list_init(&l->acceptq);
 	*lp = l;
@@ -73,8 +105,13 @@ tcp_listener_doclose(nni_tcp_listener *l)
 		nni_aio_finish_error(aio, NNG_ECLOSED);
 	}
 
-	if (l->pfd != NULL) {
-		nni_posix_pfd_close(l->pfd);
+	while (l->nbacklog > 0) {
+		l->nbacklog--;
+		(void) close(l->backlog[l->nbacklog]);
+	}
+
+	for (int i = 0; i < l->nshards; i++) {
+		nni_posix_pfd_close(l->shards[i].pfd);
 	}
 }
 
@@ -86,23 +123,18 @@ nni_tcp_listener_close(nni_tcp_listener *l)
 	nni_mtx_unlock(&l->mtx);
 }
 
-static void
-tcp_listener_doaccept(nni_tcp_listener *l)
+// tcp_listener_drain accepts as many connections as are pending on the
+// shard (up to the space remaining in the backlog).  It returns zero when
+// the shard would block or the backlog is full, or an error otherwise.
+static int
+tcp_listener_drain(nni_tcp_listener *l, tcp_listener_shard *s)
 {
-	nni_aio *aio;
+	int fd = nni_posix_pfd_fd(s->pfd);
 
-	while ((aio = nni_list_first(&l->acceptq)) != NULL) {
-		int            newfd;
-		int            fd;
-		int            rv;
-		int            nd;
-		int            ka;
-		nni_posix_pfd *pfd;
-		nni_tcp_conn  *c;
-
-		fd = nni_posix_pfd_fd(l->pfd);
+	while (l->nbacklog < NNI_TCP_ACCEPT_BATCH) {
+		int newfd;
 
-#ifdef NNG_USE_ACCEPT4
+#ifdef NNG_HAVE_ACCEPT4
 		newfd = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
 		if ((newfd < 0) && ((errno == ENOSYS) || (errno == ENOTSUP))) {
 			newfd = accept(fd, NULL, NULL);
@@ -118,28 +150,80 @@ tcp_listener_doaccept(nni_tcp_listener *l)
 			case EWOULDBLOCK:
 #endif
 #endif
-				rv = nni_posix_pfd_arm(l->pfd, NNI_POLL_IN);
-				if (rv != 0) {
-					nni_aio_list_remove(aio);
-					nni_aio_finish_error(aio, rv);
-					continue;
-				}
-				// Come back later...
-				return;
+				return (0);
 			case ECONNABORTED:
 			case ECONNRESET:
 				// Eat them, they aren't interesting.
 				continue;
 			default:
+				return (nni_plat_errno(errno));
+			}
+		}
+		l->backlog[l->nbacklog++] = newfd;
+	}
+	return (0);
+}
+
+static void
+tcp_listener_doaccept(nni_tcp_listener *l)
+{
+	nni_aio *aio;
+
+	while ((aio = nni_list_first(&l->acceptq)) != NULL) {
+		int            newfd;
+		int            rv;
+		int            nd;
+		int            ka;
+		nni_posix_pfd *pfd;
+		nni_tcp_conn  *c;
+
+		if (l->nbacklog == 0) {
+			// Visit the shards in rotation, so that a busy
+			// shard cannot starve the others.
+			rv = 0;
+			for (int i = 0; i < l->nshards; i++) {
+				int n = (l->next_shard + i) % l->nshards;
+				if ((rv = tcp_listener_drain(
+				         l, &l->shards[n])) != 0) {
+					break;
+				}
+			}
+			l->next_shard = (l->next_shard + 1) % l->nshards;
+			if ((rv != 0) && (l->nbacklog == 0)) {
 				// Error this one, but keep moving to the next.
-				rv = nni_plat_errno(errno);
-				NNI_ASSERT(rv != 0);
 				nni_aio_list_remove(aio);
 				nni_aio_finish_error(aio, rv);
 				continue;
 			}
 		}
 
+		if (l->nbacklog == 0) {
+			// Come back later...
+			for (int i = 0; i < l->nshards; i++) {
+				tcp_listener_shard *s = &l->shards[i];
+				if (s->armed) {
+					continue;
+				}
+				if ((rv = nni_posix_pfd_arm(
+				         s->pfd, NNI_POLL_IN)) != 0) {
+					nni_aio_list_remove(aio);
+					nni_aio_finish_error(aio, rv);
+					break;
+				}
+				s->armed = true;
+			}
+			if (nni_list_first(&l->acceptq) == aio) {
+				return;
+			}
+			continue;
+		}
+
+		// Take the oldest connection first.
+		newfd = l->backlog[0];
+		l->nbacklog--;
+		memmove(&l->backlog[0], &l->backlog[1],
+		    sizeof(l->backlog[0]) * (size_t) l->nbacklog);
+
 		if ((rv = nni_posix_tcp_alloc(&c, NULL)) != 0) {
 			close(newfd);
 			nni_aio_list_remove(aio);
@@ -157,8 +241,10 @@ tcp_listener_doaccept(nni_tcp_listener *l)
 
 		nni_posix_tcp_init(c, pfd);
 
-		ka = l->keepalive ? 1 : 0;
-		nd = l->nodelay ? 1 : 0;
+		ka           = l->keepalive ? 1 : 0;
+		nd           = l->nodelay ? 1 : 0;
+		c->zc_thresh = l->zc_thresh;
+		c->tune      = l->tune;
 		nni_aio_list_remove(aio);
 		nni_posix_tcp_start(c, nd, ka);
 		nni_aio_set_output(aio, 0, c);
@@ -169,16 +255,25 @@ tcp_listener_doaccept(nni_tcp_listener *l)
 static void
 tcp_listener_cb(nni_posix_pfd *pfd, unsigned events, void *arg)
 {
-	nni_tcp_listener *l = arg;
+	tcp_listener_shard *s = arg;
+	nni_tcp_listener   *l = s->l;
 	NNI_ARG_UNUSED(pfd);
 
 	nni_mtx_lock(&l->mtx);
+	s->armed = false;
 	if ((events & NNI_POLL_INVAL) != 0) {
 		tcp_listener_doclose(l);
 		nni_mtx_unlock(&l->mtx);
 		return;
 	}
 
+	// Pull in everything that is pending on this shard, even if
+	// there are not enough waiters for it yet.  Subsequent accept
+	// calls will be satisfied from the backlog without a system call.
+	if (!l->closed) {
+		(void) tcp_listener_drain(l, s);
+	}
+
 	// Anything else will turn up in accept.
 	tcp_listener_doaccept(l);
 	nni_mtx_unlock(&l->mtx);
@@ -200,42 +295,21 @@ tcp_listener_cancel(nni_aio *aio, void *arg, int rv)
 	nni_mtx_unlock(&l->mtx);
 }
 
-int
-nni_tcp_listener_listen(nni_tcp_listener *l, const nni_sockaddr *sa)
+static int
+tcp_listener_open_shard(nni_tcp_listener *l, int index,
+    struct sockaddr_storage *ss, socklen_t len)
 {
-	socklen_t               len;
-	struct sockaddr_storage ss;
-	int                     rv;
-	int                     fd;
-	nni_posix_pfd          *pfd;
-
-	if (((len = nni_posix_nn2sockaddr(&ss, sa)) == 0) ||
-#ifdef NNG_ENABLE_IPV6
-	    ((ss.ss_family != AF_INET) && (ss.ss_family != AF_INET6))
-#else
-	    (ss.ss_family != AF_INET)
-#endif
-	) {
-		return (NNG_EADDRINVAL);
-	}
-
-	nni_mtx_lock(&l->mtx);
-	if (l->started) {
-		nni_mtx_unlock(&l->mtx);
-		return (NNG_ESTATE);
-	}
-	if (l->closed) {
-		nni_mtx_unlock(&l->mtx);
-		return (NNG_ECLOSED);
-	}
+	int            rv;
+	int            fd;
+	nni_posix_pfd *pfd;
 
-	if ((fd = socket(ss.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
-		nni_mtx_unlock(&l->mtx);
+	if ((fd = socket(ss->ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
 		return (nni_plat_errno(errno));
 	}
 
-	if ((rv = nni_posix_pfd_init(&pfd, fd)) != 0) {
-		nni_mtx_unlock(&l->mtx);
+	// Each shard gets its own poller thread, if we have enough of them.
+	if ((rv = nni_posix_pfd_init_index(&pfd, fd, (unsigned) index)) !=
+	    0) {
 		(void) close(fd);
 		return (rv);
 	}
@@ -253,9 +327,20 @@ nni_tcp_listener_listen(nni_tcp_listener *l, const nni_sockaddr *sa)
 	}
 #endif
 
-	if (bind(fd, (struct sockaddr *) &ss, len) < 0) {
+#ifdef SO_REUSEPORT
+	if (l->want_shards > 1) {
+		int on = 1;
+		if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on,
+		        sizeof(on)) != 0) {
+			rv = nni_plat_errno(errno);
+			nni_posix_pfd_fini(pfd);
+			return (rv);
+		}
+	}
+#endif
+
+	if (bind(fd, (struct sockaddr *) ss, len) < 0) {
 		rv = nni_plat_errno(errno);
-		nni_mtx_unlock(&l->mtx);
 		nni_posix_pfd_fini(pfd);
 		return (rv);
 	}
@@ -264,14 +349,91 @@ nni_tcp_listener_listen(nni_tcp_listener *l, const nni_sockaddr *sa)
 	// bad things are going to happen.
 	if (listen(fd, 128) != 0) {
 		rv = nni_plat_errno(errno);
-		nni_mtx_unlock(&l->mtx);
 		nni_posix_pfd_fini(pfd);
 		return (rv);
 	}
 
-	nni_posix_pfd_set_cb(pfd, tcp_listener_cb, l);
+	// If we bound to an ephemeral port, the remaining shards must
+	// bind to the port that the kernel chose for the first one.
+	if (index == 0) {
+		struct sockaddr_storage bound;
+		socklen_t               blen = sizeof(bound);
+		if (getsockname(fd, (struct sockaddr *) &bound, &blen) == 0) {
+			if (ss->ss_family == AF_INET) {
+				((struct sockaddr_in *) ss)->sin_port =
+				    ((struct sockaddr_in *) &bound)->sin_port;
+			}
+#ifdef NNG_ENABLE_IPV6
+			else if (ss->ss_family == AF_INET6) {
+				((struct sockaddr_in6 *) ss)->sin6_port =
+				    ((struct sockaddr_in6 *) &bound)
+				        ->sin6_port;
+			}
+#endif
+		}
+	}
+
+	l->shards[index].pfd   = pfd;
+	l->shards[index].l     = l;
+	l->shards[index].armed = false;
+	return (0);
+}
+
+int
+nni_tcp_listener_listen(nni_tcp_listener *l, const nni_sockaddr *sa)
+{
+	socklen_t               len;
+	struct sockaddr_storage ss;
+	int                     rv;
+	int                     n;
+
+	if (((len = nni_posix_nn2sockaddr(&ss, sa)) == 0) ||
+#ifdef NNG_ENABLE_IPV6
+	    ((ss.ss_family != AF_INET) && (ss.ss_family != AF_INET6))
+#else
+	    (ss.ss_family != AF_INET)
+#endif
+	) {
+		return (NNG_EADDRINVAL);
+	}
+
+	nni_mtx_lock(&l->mtx);
+	if (l->started) {
+		nni_mtx_unlock(&l->mtx);
+		return (NNG_ESTATE);
+	}
+	if (l->closed) {
+		nni_mtx_unlock(&l->mtx);
+		return (NNG_ECLOSED);
+	}
+
+	n = l->want_shards;
+	if (n > 1) {
+		// Make sure there are pollers to spread the shards over.
+		nni_posix_pollq_grow(n);
+	}
+	if ((l->shards = NNI_ALLOC_STRUCTS(l->shards, n)) == NULL) {
+		nni_mtx_unlock(&l->mtx);
+		return (NNG_ENOMEM);
+	}
+	for (int i = 0; i < n; i++) {
+		if ((rv = tcp_listener_open_shard(l, i, &ss, len)) != 0) {
+			while (i > 0) {
+				i--;
+				nni_posix_pfd_fini(l->shards[i].pfd);
+			}
+			NNI_FREE_STRUCTS(l->shards, n);
+			l->shards = NULL;
+			nni_mtx_unlock(&l->mtx);
+			return (rv);
+		}
+	}
+	for (int i = 0; i < n; i++) {
+		nni_posix_pfd_set_cb(
+		    l->shards[i].pfd, tcp_listener_cb, &l->shards[i]);
+	}
 
-	l->pfd     = pfd;
+	l->nshards = n;
 	l->started = true;
 	nni_mtx_unlock(&l->mtx);
 
@@ -281,15 +443,18 @@ nni_tcp_listener_listen(nni_tcp_listener *l, const nni_sockaddr *sa)
 void
 nni_tcp_listener_fini(nni_tcp_listener *l)
 {
-	nni_posix_pfd *pfd;
-
 	nni_mtx_lock(&l->mtx);
 	tcp_listener_doclose(l);
-	pfd = l->pfd;
 	nni_mtx_unlock(&l->mtx);
 
-	if (pfd != NULL) {
-		nni_posix_pfd_fini(pfd);
+	// No new shards can be added once we are closed, so it is safe
+	// to walk them without the lock.  (We must not hold the lock
+	// while waiting for the poller to let go of the descriptors.)
+	for (int i = 0; i < l->nshards; i++) {
+		nni_posix_pfd_fini(l->shards[i].pfd);
+	}
+	if (l->shards != NULL) {
+		NNI_FREE_STRUCTS(l->shards, l->want_shards);
 	}
 	nni_mtx_fini(&l->mtx);
 	NNI_FREE_STRUCT(l);
@@ -341,7 +506,7 @@ tcp_listener_get_locaddr(void *arg, void *buf, size_t *szp, nni_type t)
 		struct sockaddr_storage ss;
 		socklen_t               len = sizeof(ss);
 		(void) getsockname(
-		    nni_posix_pfd_fd(l->pfd), (void *) &ss, &len);
+		    nni_posix_pfd_fd(l->shards[0].pfd), (void *) &ss, &len);
 		(void) nni_posix_sockaddr2nn(&sa, &ss, len);
 	} else {
 		sa.s_family = NNG_AF_UNSPEC;
@@ -404,6 +569,72 @@ tcp_listener_get_keepalive(void *arg, void *buf, size_t *szp, nni_type t)
 	return (nni_copyout_bool(b, buf, szp, t));
 }
 
+static int
+tcp_listener_set_zerocopy(void *arg, const void *buf, size_t sz, nni_type t)
+{
+	nni_tcp_listener *l = arg;
+	size_t            val;
+	int               rv;
+
+	if (((rv = nni_posix_tcp_set_zerocopy(&val, buf, sz, t)) != 0) ||
+	    (l == NULL)) {
+		return (rv);
+	}
+	nni_mtx_lock(&l->mtx);
+	l->zc_thresh = val;
+	nni_mtx_unlock(&l->mtx);
+	return (0);
+}
+
+static int
+tcp_listener_get_zerocopy(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	nni_tcp_listener *l = arg;
+	size_t            val;
+	nni_mtx_lock(&l->mtx);
+	val = l->zc_thresh;
+	nni_mtx_unlock(&l->mtx);
+	return (nni_copyout_size(val, buf, szp, t));
+}
+
+static int
+tcp_listener_set_shards(void *arg, const void *buf, size_t sz, nni_type t)
+{
+	nni_tcp_listener *l = arg;
+	int               rv;
+	int               n;
+
+	if (((rv = nni_copyin_int(&n, buf, sz, 1, NNI_TCP_MAX_SHARDS, t)) !=
+	        0) ||
+	    (l == NULL)) {
+		return (rv);
+	}
+#ifndef SO_REUSEPORT
+	if (n > 1) {
+		return (NNG_ENOTSUP);
+	}
+#endif
+	nni_mtx_lock(&l->mtx);
+	if (l->started) {
+		nni_mtx_unlock(&l->mtx);
+		return (NNG_EBUSY);
+	}
+	l->want_shards = n;
+	nni_mtx_unlock(&l->mtx);
+	return (0);
+}
+
+static int
+tcp_listener_get_shards(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	int               n;
+	nni_tcp_listener *l = arg;
+	nni_mtx_lock(&l->mtx);
+	n = l->want_shards;
+	nni_mtx_unlock(&l->mtx);
+	return (nni_copyout_int(n, buf, szp, t));
+}
+
 static const nni_option tcp_listener_options[] = {
 	{
 	    .o_name = NNG_OPT_LOCADDR,
@@ -419,6 +650,16 @@ static const nni_option tcp_listener_options[] = {
 	    .o_set  = tcp_listener_set_keepalive,
 	    .o_get  = tcp_listener_get_keepalive,
 	},
+	{
+	    .o_name = NNG_OPT_TCP_ZEROCOPY_THRESHOLD,
+	    .o_set  = tcp_listener_set_zerocopy,
+	    .o_get  = tcp_listener_get_zerocopy,
+	},
+	{
+	    .o_name = NNG_OPT_TCP_LISTEN_SHARDS,
+	    .o_set  = tcp_listener_set_shards,
+	    .o_get  = tcp_listener_get_shards,
+	},
 	{
 	    .o_name = NULL,
 	},
@@ -428,6 +669,14 @@ int
 nni_tcp_listener_get(
     nni_tcp_listener *l, const char *name, void *buf, size_t *szp, nni_type t)
 {
+	int rv;
+
+	nni_mtx_lock(&l->mtx);
+	rv = nni_posix_tcp_tune_get(&l->tune, name, buf, szp, t);
+	nni_mtx_unlock(&l->mtx);
+	if (rv != NNG_ENOTSUP) {
+		return (rv);
+	}
 	return (nni_getopt(tcp_listener_options, name, l, buf, szp, t));
 }
 
@@ -435,5 +684,13 @@ int
 nni_tcp_listener_set(nni_tcp_listener *l, const char *name, const void *buf,
     size_t sz, nni_type t)
 {
+	int rv;
+
+	nni_mtx_lock(&l->mtx);
+	rv = nni_posix_tcp_tune_set(&l->tune, name, buf, sz, t);
+	nni_mtx_unlock(&l->mtx);
+	if (rv != NNG_ENOTSUP) {
+		return (rv);
+	}
 	return (nni_setopt(tcp_listener_options, name, l, buf, sz, t));
 }
@@ -1,5 +1,5 @@
 //
-// Copyright 2021 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 //
 // This software is supplied under the terms of the MIT License, a
@@ -28,6 +28,10 @@
 #include <pthread_np.h>
 #endif
 
+#ifdef NNG_HAVE_SCHED_GETCPU
+#include <sched.h>
+#endif
+
 #ifdef NNG_SETSTACKSIZE
 #include <limits.h>
 #include <sys/resource.h>
@@ -419,8 +423,11 @@ nni_plat_init(int (*helper)(void))
 		pthread_attr_destroy(&nni_thrattr);
 		return (NNG_ENOMEM);
 	}
+	nni_posix_tcp_sysinit();
 	if ((rv = helper()) == 0) {
 		nni_plat_inited = 1;
+	} else {
+		nni_posix_tcp_sysfini();
 	}
 	pthread_mutex_unlock(&nni_plat_init_lock);
 
@@ -432,6 +439,7 @@ nni_plat_fini(void)
 {
 	pthread_mutex_lock(&nni_plat_init_lock);
 	if (nni_plat_inited) {
+		nni_posix_tcp_sysfini();
 		nni_posix_resolv_sysfini();
 		nni_posix_pollq_sysfini();
 		pthread_mutexattr_destroy(&nni_mxattr);
@@ -454,4 +462,38 @@ nni_plat_ncpu(void)
 #endif
 }
 
+// Lacking a way to ask which CPU we are on, we number the threads instead.
+// That is nearly as good, since the goal is just to keep threads that run
+// at the same time from sharing slots.
+static pthread_once_t nni_plat_cpu_once = PTHREAD_ONCE_INIT;
+static pthread_key_t  nni_plat_cpu_key;
+static unsigned       nni_plat_cpu_next;
+
+static void
+nni_plat_cpu_init(void)
+{
+	(void) pthread_key_create(&nni_plat_cpu_key, NULL);
+}
+
+unsigned
+nni_plat_cpu_hint(void)
+{
+	uintptr_t id;
+
+#ifdef NNG_HAVE_SCHED_GETCPU
+	int cpu;
+	if ((cpu = sched_getcpu()) >= 0) {
+		return ((unsigned) cpu);
+	}
+#endif
+	(void) pthread_once(&nni_plat_cpu_once, nni_plat_cpu_init);
+	if ((id = (uintptr_t) pthread_getspecific(nni_plat_cpu_key)) == 0) {
+		pthread_mutex_lock(&nni_plat_init_lock);
+		id = ++nni_plat_cpu_next;
+		pthread_mutex_unlock(&nni_plat_init_lock);
+		(void) pthread_setspecific(nni_plat_cpu_key, (void *) id);
+	}
+	return ((unsigned) (id - 1));
+}
+
 #endif // NNG_PLATFORM_POSIX
@@ -21,6 +21,22 @@ nni_clock(void)
 	return (GetTickCount64());
 }
 
+uint64_t
+nni_clock_us(void)
+{
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER        now;
+
+	// The frequency is fixed at boot, so racing to set it is harmless.
+	if (freq.QuadPart == 0) {
+		QueryPerformanceFrequency(&freq);
+	}
+	QueryPerformanceCounter(&now);
+	return ((uint64_t) (now.QuadPart / freq.QuadPart) * 1000000 +
+	    (uint64_t) (now.QuadPart % freq.QuadPart) * 1000000 /
+	        freq.QuadPart);
+}
+
 int
 nni_time_get(uint64_t *seconds, uint32_t *nanoseconds)
 {
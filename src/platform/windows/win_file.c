@@ -1,5 +1,5 @@
 //
-// Copyright 2018 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 // Copyright 2018 QXSoftware <lh563566994@126.com>
 //
@@ -16,6 +16,7 @@
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 // File support.
 
@@ -164,6 +165,90 @@ done:
 	return (rv);
 }
 
+// nni_plat_file_open opens the named file for reading a piece at a time.
+// The handle is the Windows file handle.
+int
+nni_plat_file_open(const char *name, void **fhp, uint64_t *szp)
+{
+	HANDLE        h;
+	LARGE_INTEGER sz;
+	int           rv;
+
+	h = CreateFile(name, GENERIC_READ, FILE_SHARE_READ, NULL,
+	    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (h == INVALID_HANDLE_VALUE) {
+		return (nni_win_error(GetLastError()));
+	}
+	if (GetFileType(h) != FILE_TYPE_DISK) {
+		(void) CloseHandle(h);
+		return (NNG_EINVAL);
+	}
+	if (!GetFileSizeEx(h, &sz)) {
+		rv = nni_win_error(GetLastError());
+		(void) CloseHandle(h);
+		return (rv);
+	}
+	*fhp = h;
+	*szp = (uint64_t) sz.QuadPart;
+	return (0);
+}
+
+int
+nni_plat_file_read(
+    void *fh, uint64_t off, void *buf, size_t len, size_t *nreadp)
+{
+	size_t nread = 0;
+
+	while (nread < len) {
+		OVERLAPPED ov;
+		DWORD      n;
+		DWORD      want;
+
+		want = (len - nread) > 0x40000000 ? 0x40000000
+		                                  : (DWORD) (len - nread);
+		memset(&ov, 0, sizeof(ov));
+		ov.Offset     = (DWORD) ((off + nread) & 0xffffffffu);
+		ov.OffsetHigh = (DWORD) ((off + nread) >> 32);
+		if (!ReadFile(fh, (char *) buf + nread, want, &n, &ov)) {
+			if (GetLastError() == ERROR_HANDLE_EOF) {
+				break;
+			}
+			return (nni_win_error(GetLastError()));
+		}
+		if (n == 0) {
+			break; // end of file
+		}
+		nread += n;
+	}
+	*nreadp = nread;
+	return (0);
+}
+
+void
+nni_plat_file_close(void *fh)
+{
+	(void) CloseHandle(fh);
+}
+
+int
+nni_plat_file_stat(const char *name, uint64_t *sizep, uint64_t *mtimep)
+{
+	WIN32_FILE_ATTRIBUTE_DATA fa;
+	uint64_t                  t;
+
+	if (!GetFileAttributesEx(name, GetFileExInfoStandard, &fa)) {
+		return (nni_win_error(GetLastError()));
+	}
+	*sizep = ((uint64_t) fa.nFileSizeHigh << 32) | fa.nFileSizeLow;
+
+	// FILETIME is 100ns units since 1601; convert to the UNIX epoch.
+	t = ((uint64_t) fa.ftLastWriteTime.dwHighDateTime << 32) |
+	    fa.ftLastWriteTime.dwLowDateTime;
+	t /= 10000000u;
+	*mtimep = t > 11644473600u ? t - 11644473600u : 0;
+	return (0);
+}
+
 // nni_plat_file_delete deletes the named file.
 int
 nni_plat_file_delete(const char *name)
@@ -1,5 +1,5 @@
 //
-// Copyright 2021 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 //
 // This software is supplied under the terms of the MIT License, a
@@ -267,6 +267,16 @@ nni_atomic_dec64_nv(nni_atomic_u64 *v)
 #endif
 }
 
+uint64_t
+nni_atomic_inc64_nv(nni_atomic_u64 *v)
+{
+#ifdef _WIN64
+	return ((uint64_t) (InterlockedIncrementAcquire64(&v->v)));
+#else
+	return ((uint64_t) (InterlockedIncrement64(&v->v)));
+#endif
+}
+
 void
 nni_atomic_dec64(nni_atomic_u64 *v)
 {
@@ -427,6 +437,12 @@ nni_plat_ncpu(void)
 	return ((int) (info.dwNumberOfProcessors));
 }
 
+unsigned
+nni_plat_cpu_hint(void)
+{
+	return ((unsigned) GetCurrentProcessorNumber());
+}
+
 int
 nni_plat_init(int (*helper)(void))
 {
@@ -244,6 +244,8 @@ bus0_pipe_recv_cb(void *arg)
 		nni_pollable_raise(&s->can_recv);
 	} else {
 		// dropped message due to no room
+		nni_flight_record(NNG_FLIGHT_QUEUE_FULL, nni_pipe_id(p->pipe),
+		    nni_msg_len(msg));
 		nni_msg_free(msg);
 	}
 	nni_mtx_unlock(&s->mtx);
@@ -336,6 +336,7 @@ pair1_pipe_recv_cb(void *arg)
 	// keep getting more.
 	if ((int) hdr > nni_atomic_get(&s->ttl)) {
 		BUMP_STAT(&s->stat_ttl_drop);
+		nni_flight_record(NNG_FLIGHT_DROP, nni_pipe_id(pipe), len);
 		nni_msg_free(msg);
 		nni_aio_set_msg(&p->aio_recv, NULL);
 		nni_pipe_recv(pipe, &p->aio_recv);
@@ -318,6 +318,7 @@ pair1poly_pipe_recv_cb(void *arg)
 	// keep getting more.
 	if ((int) hdr > nni_atomic_get(&s->ttl)) {
 		BUMP_STAT(&s->stat_ttl_drop);
+		nni_flight_record(NNG_FLIGHT_DROP, nni_pipe_id(pipe), len);
 		nni_msg_free(msg);
 		nni_pipe_recv(pipe, &p->aio_recv);
 		return;
@@ -364,6 +365,13 @@ pair1poly_sock_get_cb(void *arg)
 	// buffering in the send_queue.
 	if ((p == NULL) || nni_msgq_tryput(p->send_queue, msg) != 0) {
 		BUMP_STAT(&s->stat_tx_drop);
+		if (p == NULL) {
+			nni_flight_record(
+			    NNG_FLIGHT_DROP, id, nni_msg_len(msg));
+		} else {
+			nni_flight_record(NNG_FLIGHT_QUEUE_FULL,
+			    nni_pipe_id(p->pipe), nni_msg_len(msg));
+		}
 		nni_msg_free(msg);
 	}
 
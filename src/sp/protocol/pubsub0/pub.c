@@ -238,6 +238,8 @@ pub0_sock_send(void *arg, nni_aio *aio)
 				// Make space for the new message.
 				nni_msg *old;
 				(void) nni_lmq_get(&p->sendq, &old);
+				nni_flight_record(NNG_FLIGHT_QUEUE_FULL,
+				    nni_pipe_id(p->pipe), nni_msg_len(old));
 				nni_msg_free(old);
 			}
 			nni_lmq_put(&p->sendq, msg);
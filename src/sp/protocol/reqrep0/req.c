@@ -43,6 +43,7 @@ struct req0_ctx {
 	nng_msg      *rep_msg;    // reply message
 	nni_duration  retry;
 	nni_time      retry_time; // retry after this expires
+	uint64_t      sent_us;    // when the request was last sent
 	bool          conn_reset; // sent message w/o retry, peer disconnect
 };
 
@@ -65,6 +66,7 @@ struct req0_sock {
 	nni_pollable   writable;
 	nni_duration   retry_tick; // clock interval for retry timer
 	nni_mtx        mtx;
+	nni_stat_item  stat_rtt; // request round trip times
 };
 
 // A req0_pipe is our per-pipe protocol private structure.
@@ -87,8 +89,6 @@ req0_sock_init(void *arg, nni_sock *sock)
 {
 	req0_sock *s = arg;
 
-	NNI_ARG_UNUSED(sock);
-
 	// Request IDs are 32 bits, with the high order bit set.
 	// We start at a random point, to minimize likelihood of
 	// accidental collision across restarts.
@@ -116,6 +116,19 @@ req0_sock_init(void *arg, nni_sock *sock)
 
 	nni_atomic_init(&s->ttl);
 	nni_atomic_set(&s->ttl, 8);
+
+#ifdef NNG_ENABLE_STATS
+	static const nni_stat_info rtt_info = {
+		.si_name = "rtt",
+		.si_desc = "request round trip time",
+		.si_type = NNG_STAT_HISTOGRAM,
+		.si_unit = NNG_UNIT_MICROS,
+	};
+	nni_stat_init(&s->stat_rtt, &rtt_info);
+	nni_sock_add_stat(sock, &s->stat_rtt);
+#else
+	NNI_ARG_UNUSED(sock);
+#endif
 }
 
 static void
@@ -151,6 +164,7 @@ req0_sock_fini(void *arg)
 	nni_pollable_fini(&s->writable);
 	nni_id_map_fini(&s->requests);
 	nni_aio_fini(&s->retry_aio);
+	nni_stat_fini(&s->stat_rtt);
 	nni_mtx_fini(&s->mtx);
 }
 
@@ -358,6 +372,9 @@ req0_recv_cb(void *arg)
 		nni_msg_free(ctx->req_msg);
 		ctx->req_msg = NULL;
 	}
+#ifdef NNG_ENABLE_STATS
+	nni_stat_record(&s->stat_rtt, nni_clock_us() - ctx->sent_us);
+#endif
 
 	// Is there an aio waiting for us?
 	if ((aio = ctx->recv_aio) != NULL) {
@@ -406,6 +423,7 @@ req0_retry_cb(void *arg)
 		if (!nni_list_node_active(&ctx->send_node)) {
 			nni_list_append(&s->send_queue, ctx);
 		}
+		nni_flight_record(NNG_FLIGHT_RETRY, ctx->request_id, 0);
 		reschedule = true;
 	}
 	if (!nni_list_empty(&s->retry_queue)) {
@@ -530,6 +548,9 @@ req0_run_send_queue(req0_sock *s, nni_aio_completions *sent_list)
 		// the user, so we don't have to worry about making it
 		// unique.  We can freely clone it.
 		nni_msg_clone(ctx->req_msg);
+#ifdef NNG_ENABLE_STATS
+		ctx->sent_us = nni_clock_us();
+#endif
 		nni_aio_set_msg(&p->aio_send, ctx->req_msg);
 		nni_pipe_send(p->pipe, &p->aio_send);
 	}
@@ -1,5 +1,5 @@
 //
-// Copyright 2023 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 //
 // This software is supplied under the terms of the MIT License, a
@@ -185,6 +185,46 @@ test_req_rep_exchange(void)
 	NUTS_CLOSE(rep);
 }
 
+void
+test_req_rtt_stat(void)
+{
+#ifdef NNG_ENABLE_STATS
+	nng_socket req;
+	nng_socket rep;
+	nng_stat  *stats;
+	nng_stat  *sock;
+	nng_stat  *rtt;
+
+	NUTS_PASS(nng_req0_open(&req));
+	NUTS_PASS(nng_rep0_open(&rep));
+	NUTS_PASS(nng_socket_set_ms(req, NNG_OPT_RECVTIMEO, SECOND));
+	NUTS_PASS(nng_socket_set_ms(rep, NNG_OPT_RECVTIMEO, SECOND));
+
+	NUTS_MARRY(rep, req);
+
+	for (int i = 0; i < 10; i++) {
+		NUTS_SEND(req, "ping");
+		NUTS_RECV(rep, "ping");
+		NUTS_SEND(rep, "pong");
+		NUTS_RECV(req, "pong");
+	}
+
+	NUTS_PASS(nng_stats_get(&stats));
+	sock = nng_stat_find_socket(stats, req);
+	NUTS_ASSERT(sock != NULL);
+	rtt = nng_stat_find(sock, "rtt");
+	NUTS_ASSERT(rtt != NULL);
+	NUTS_TRUE(nng_stat_type(rtt) == NNG_STAT_HISTOGRAM);
+	NUTS_TRUE(nng_stat_unit(rtt) == NNG_UNIT_MICROS);
+	NUTS_TRUE(nng_stat_value(rtt) == 10);
+	NUTS_TRUE(nng_stat_percentile(rtt, 50) <= 1000000);
+	nng_stats_free(stats);
+
+	NUTS_CLOSE(req);
+	NUTS_CLOSE(rep);
+#endif
+}
+
 void
 test_req_resend(void)
 {
@@ -1010,6 +1050,7 @@ NUTS_TESTS = {
 	{ "req recv bad state", test_req_recv_bad_state },
 	{ "req recv garbage", test_req_recv_garbage },
 	{ "req rep exchange", test_req_rep_exchange },
+	{ "req rtt stat", test_req_rtt_stat },
 	{ "req resend", test_req_resend },
 	{ "req resend disconnect", test_req_resend_disconnect },
 	{ "req disconnect no retry", test_req_disconnect_no_retry },
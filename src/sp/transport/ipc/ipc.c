@@ -10,6 +10,7 @@
 //
 
 #include <stdio.h>
+#include <string.h>
 
 #include "core/nng_impl.h"
 
@@ -23,6 +24,13 @@
 typedef struct ipc_pipe ipc_pipe;
 typedef struct ipc_ep   ipc_ep;
 
+// In packet mode (NNG_OPT_IPC_SEQPACKET), the message header and the start
+// of the message go in a leading packet of no more than this many bytes,
+// so that the receiver can collect them in a single read.  The platform
+// never splits packets this small.  Any remainder follows in as many
+// packets as needed.
+#define IPC_SEQPACKET_HEAD 4096
+
 // ipc_pipe is one end of an IPC connection.
 struct ipc_pipe {
 	nng_stream     *conn;
@@ -41,6 +49,10 @@ struct ipc_pipe {
 	size_t          got_rx_head;
 	size_t          want_tx_head;
 	size_t          want_rx_head;
+	size_t          tx_len;
+	size_t          tx_off;
+	bool            seqpacket;
+	uint8_t        *rx_pkt;
 	nni_list        recv_q;
 	nni_list        send_q;
 	nni_aio         tx_aio;
@@ -73,6 +85,7 @@ struct ipc_ep {
 };
 
 static void ipc_pipe_send_start(ipc_pipe *p);
+static int  ipc_pipe_send_iov(ipc_pipe *, nni_msg *, nni_iov *);
 static void ipc_pipe_recv_start(ipc_pipe *p);
 static void ipc_pipe_send_cb(void *);
 static void ipc_pipe_recv_cb(void *);
@@ -157,6 +170,9 @@ ipc_pipe_fini(void *arg)
 	if (p->rx_msg) {
 		nni_msg_free(p->rx_msg);
 	}
+	if (p->rx_pkt != NULL) {
+		nni_free(p->rx_pkt, IPC_SEQPACKET_HEAD);
+	}
 	nni_mtx_fini(&p->mtx);
 	NNI_FREE_STRUCT(p);
 }
@@ -256,6 +272,18 @@ ipc_pipe_nego_cb(void *arg)
 
 	NNI_GET16(&p->rx_head[4], p->peer);
 
+	// Packet mode needs a buffer for the leading packet.
+	if ((nng_stream_get_bool(p->conn, NNG_OPT_IPC_SEQPACKET,
+	         &p->seqpacket) == 0) &&
+	    p->seqpacket) {
+		if ((p->rx_pkt = nni_alloc(IPC_SEQPACKET_HEAD)) == NULL) {
+			rv = NNG_ENOMEM;
+			goto error;
+		}
+	} else {
+		p->seqpacket = false;
+	}
+
 	// We are ready now.  We put this in the wait list, and
 	// then try to run the matcher.
 	nni_list_remove(&ep->nego_pipes, p);
@@ -313,14 +341,30 @@ ipc_pipe_send_cb(void *arg)
 	}
 
 	n = nni_aio_count(tx_aio);
+	p->tx_off += n;
 	nni_aio_iov_advance(tx_aio, n);
 	if (nni_aio_iov_count(tx_aio) != 0) {
+		nni_pipe_time_tx(p->pipe, tx_aio);
 		nng_stream_send(p->conn, tx_aio);
 		nni_mtx_unlock(&p->mtx);
 		return;
 	}
 
 	aio = nni_list_first(&p->send_q);
+	if (p->tx_off < p->tx_len) {
+		// The leading packet went by itself, now send the rest.
+		nni_iov iov[3];
+		int     nio;
+
+		nio = ipc_pipe_send_iov(p, nni_aio_get_msg(aio), iov);
+		nni_aio_set_iov(tx_aio, nio, iov);
+		nni_aio_iov_advance(tx_aio, p->tx_off);
+		nni_pipe_time_tx(p->pipe, tx_aio);
+		nng_stream_send(p->conn, tx_aio);
+		nni_mtx_unlock(&p->mtx);
+		return;
+	}
+
 	nni_aio_list_remove(aio);
 	ipc_pipe_send_start(p);
 
@@ -354,12 +398,25 @@ ipc_pipe_recv_cb(void *arg)
 	}
 
 	n = nni_aio_count(rx_aio);
-	nni_aio_iov_advance(rx_aio, n);
-	if (nni_aio_iov_count(rx_aio) != 0) {
-		// Was this a partial read?  If so then resubmit for the rest.
-		nng_stream_recv(p->conn, rx_aio);
-		nni_mtx_unlock(&p->mtx);
-		return;
+	if (p->seqpacket && (p->rx_msg == NULL)) {
+		// In packet mode the header arrives together with the
+		// leading part of the message, in a single packet.
+		if (n < sizeof(p->rx_head)) {
+			rv = NNG_EPROTO;
+			goto error;
+		}
+		memcpy(p->rx_head, p->rx_pkt, sizeof(p->rx_head));
+		n -= sizeof(p->rx_head);
+	} else {
+		nni_aio_iov_advance(rx_aio, n);
+		if (nni_aio_iov_count(rx_aio) != 0) {
+			// Was this a partial read?  If so then resubmit for
+			// the rest.
+			nng_stream_recv(p->conn, rx_aio);
+			nni_mtx_unlock(&p->mtx);
+			return;
+		}
+		n = 0;
 	}
 
 	// If we don't have a message yet, we were reading the message
@@ -406,12 +463,22 @@ ipc_pipe_recv_cb(void *arg)
 			goto error;
 		}
 
-		if (len != 0) {
+		// Collect whatever came with the header (packet mode).
+		if (n > len) {
+			rv = NNG_EPROTO;
+			goto error;
+		}
+		if (n > 0) {
+			memcpy(nni_msg_body(p->rx_msg),
+			    p->rx_pkt + sizeof(p->rx_head), n);
+		}
+
+		if (len != n) {
 			nni_iov iov;
 			// Submit the rest of the data for a read -- we want to
 			// read the entire message now.
-			iov.iov_buf = nni_msg_body(p->rx_msg);
-			iov.iov_len = (size_t) len;
+			iov.iov_buf = nni_msg_body(p->rx_msg) + n;
+			iov.iov_len = (size_t) (len - n);
 
 			nni_aio_set_iov(rx_aio, 1, &iov);
 			nng_stream_recv(p->conn, rx_aio);
@@ -475,6 +542,29 @@ ipc_pipe_send_cancel(nni_aio *aio, void *arg, int rv)
 	nni_aio_finish_error(aio, rv);
 }
 
+// ipc_pipe_send_iov describes the entire message on the wire, including
+// the transport header, returning the number of elements used.
+static int
+ipc_pipe_send_iov(ipc_pipe *p, nni_msg *msg, nni_iov *iov)
+{
+	int nio = 0;
+
+	iov[0].iov_buf = p->tx_head;
+	iov[0].iov_len = sizeof(p->tx_head);
+	nio++;
+	if (nni_msg_header_len(msg) > 0) {
+		iov[nio].iov_buf = nni_msg_header(msg);
+		iov[nio].iov_len = nni_msg_header_len(msg);
+		nio++;
+	}
+	if (nni_msg_len(msg) > 0) {
+		iov[nio].iov_buf = nni_msg_body(msg);
+		iov[nio].iov_len = nni_msg_len(msg);
+		nio++;
+	}
+	return (nio);
+}
+
 static void
 ipc_pipe_send_start(ipc_pipe *p)
 {
@@ -483,6 +573,7 @@ ipc_pipe_send_start(ipc_pipe *p)
 	int      nio;
 	nni_iov  iov[3];
 	uint64_t len;
+	size_t   max;
 
 	if (p->closed) {
 		while ((aio = nni_list_first(&p->send_q)) != NULL) {
@@ -502,21 +593,24 @@ ipc_pipe_send_start(ipc_pipe *p)
 	p->tx_head[0] = 1; // message type, 1.
 	NNI_PUT64(p->tx_head + 1, len);
 
-	nio            = 0;
-	iov[0].iov_buf = p->tx_head;
-	iov[0].iov_len = sizeof(p->tx_head);
-	nio++;
-	if (nni_msg_header_len(msg) > 0) {
-		iov[nio].iov_buf = nni_msg_header(msg);
-		iov[nio].iov_len = nni_msg_header_len(msg);
-		nio++;
-	}
-	if (nni_msg_len(msg) > 0) {
-		iov[nio].iov_buf = nni_msg_body(msg);
-		iov[nio].iov_len = nni_msg_len(msg);
-		nio++;
+	p->tx_len = sizeof(p->tx_head) + (size_t) len;
+	p->tx_off = 0;
+
+	nio = ipc_pipe_send_iov(p, msg, iov);
+	if (p->seqpacket) {
+		// Trim to the leading packet; send_cb does the rest.
+		max = IPC_SEQPACKET_HEAD;
+		for (int i = 0; i < nio; i++) {
+			if (iov[i].iov_len >= max) {
+				iov[i].iov_len = max;
+				nio            = i + 1;
+				break;
+			}
+			max -= iov[i].iov_len;
+		}
 	}
 	nni_aio_set_iov(&p->tx_aio, nio, iov);
+	nni_pipe_time_tx(p->pipe, &p->tx_aio);
 	nng_stream_send(p->conn, &p->tx_aio);
 }
 
@@ -587,9 +681,15 @@ ipc_pipe_recv_start(ipc_pipe *p)
 		return;
 	}
 
-	// Schedule a read of the IPC header.
-	iov.iov_buf = p->rx_head;
-	iov.iov_len = sizeof(p->rx_head);
+	// Schedule a read of the IPC header.  In packet mode, this is
+	// the entire leading packet.
+	if (p->seqpacket) {
+		iov.iov_buf = p->rx_pkt;
+		iov.iov_len = IPC_SEQPACKET_HEAD;
+	} else {
+		iov.iov_buf = p->rx_head;
+		iov.iov_len = sizeof(p->rx_head);
+	}
 	nni_aio_set_iov(&p->rx_aio, 1, &iov);
 
 	nng_stream_recv(p->conn, &p->rx_aio);
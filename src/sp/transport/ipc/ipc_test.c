@@ -1,5 +1,5 @@
 //
-// Copyright 2020 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Cody Piersall <cody.piersall@gmail.com>
 //
 // This software is supplied under the terms of the MIT License, a
@@ -433,6 +433,81 @@ test_ipc_pipe_peer(void)
 #endif // NNG_PLATFORM_POSIX
 }
 
+void
+test_ipc_seqpacket(void)
+{
+#ifdef NNG_PLATFORM_LINUX
+	nng_socket   s0, s1;
+	nng_listener l;
+	nng_dialer   d;
+	nng_msg     *msg;
+	nng_pipe     p;
+	bool         b;
+	char        *addr;
+	size_t       sizes[] = { 0, 1, 4087, 4088, 65536, 1024 * 1024 };
+
+	NUTS_ADDR(addr, "ipc");
+	NUTS_OPEN(s0);
+	NUTS_OPEN(s1);
+	NUTS_PASS(nng_socket_set_ms(s0, NNG_OPT_RECVTIMEO, 1000));
+	NUTS_PASS(nng_socket_set_ms(s1, NNG_OPT_SENDTIMEO, 1000));
+	NUTS_PASS(nng_socket_set_size(s0, NNG_OPT_RECVMAXSZ, 0));
+	NUTS_PASS(nng_listener_create(&l, s0, addr));
+	NUTS_PASS(nng_listener_get_bool(l, NNG_OPT_IPC_SEQPACKET, &b));
+	NUTS_TRUE(b == false);
+	NUTS_PASS(nng_listener_set_bool(l, NNG_OPT_IPC_SEQPACKET, true));
+	NUTS_PASS(nng_listener_start(l, 0));
+	NUTS_FAIL(
+	    nng_listener_set_bool(l, NNG_OPT_IPC_SEQPACKET, false), NNG_EBUSY);
+
+	NUTS_PASS(nng_dialer_create(&d, s1, addr));
+	NUTS_PASS(nng_dialer_set_bool(d, NNG_OPT_IPC_SEQPACKET, true));
+	NUTS_PASS(nng_dialer_start(d, 0));
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		NUTS_PASS(nng_msg_alloc(&msg, sizes[i]));
+		for (size_t j = 0; j < sizes[i]; j++) {
+			((uint8_t *) nng_msg_body(msg))[j] = (uint8_t) j;
+		}
+		NUTS_PASS(nng_sendmsg(s1, msg, 0));
+		NUTS_PASS(nng_recvmsg(s0, &msg, 0));
+		NUTS_TRUE(nng_msg_len(msg) == sizes[i]);
+		for (size_t j = 0; j < sizes[i]; j++) {
+			if (((uint8_t *) nng_msg_body(msg))[j] != (uint8_t) j) {
+				NUTS_ASSERT(false);
+				break;
+			}
+		}
+		p = nng_msg_get_pipe(msg);
+		NUTS_PASS(nng_pipe_get_bool(p, NNG_OPT_IPC_SEQPACKET, &b));
+		NUTS_TRUE(b);
+		nng_msg_free(msg);
+	}
+	NUTS_CLOSE(s0);
+	NUTS_CLOSE(s1);
+
+	// A packet mode dialer falls back to a stream listener.
+	NUTS_ADDR(addr, "ipc");
+	NUTS_OPEN(s0);
+	NUTS_OPEN(s1);
+	NUTS_PASS(nng_socket_set_ms(s0, NNG_OPT_RECVTIMEO, 1000));
+	NUTS_PASS(nng_socket_set_ms(s1, NNG_OPT_SENDTIMEO, 1000));
+	NUTS_PASS(nng_listen(s0, addr, NULL, 0));
+	NUTS_PASS(nng_dialer_create(&d, s1, addr));
+	NUTS_PASS(nng_dialer_set_bool(d, NNG_OPT_IPC_SEQPACKET, true));
+	NUTS_PASS(nng_dialer_start(d, 0));
+	NUTS_SEND(s1, "stream");
+	NUTS_PASS(nng_recvmsg(s0, &msg, 0));
+	p = nng_msg_get_pipe(msg);
+	NUTS_PASS(nng_pipe_get_bool(p, NNG_OPT_IPC_SEQPACKET, &b));
+	NUTS_TRUE(b == false);
+	NUTS_MATCH(nng_msg_body(msg), "stream");
+	nng_msg_free(msg);
+	NUTS_CLOSE(s0);
+	NUTS_CLOSE(s1);
+#endif // NNG_PLATFORM_LINUX
+}
+
 TEST_LIST = {
 	{ "ipc path too long", test_path_too_long },
 	{ "ipc dialer perms", test_ipc_dialer_perms },
@@ -446,5 +521,6 @@ TEST_LIST = {
 	{ "ipc abstract embedded null", test_abstract_null },
 	{ "ipc unix alias", test_unix_alias },
 	{ "ipc peer id", test_ipc_pipe_peer },
+	{ "ipc seqpacket", test_ipc_seqpacket },
 	{ NULL, NULL },
 };
@@ -1,5 +1,5 @@
 //
-// Copyright 2023 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 // Copyright 2019 Devolutions <info@devolutions.net>
 //
@@ -320,6 +320,7 @@ sfd_tran_pipe_send_cb(void *arg)
 	n = nni_aio_count(txaio);
 	nni_aio_iov_advance(txaio, n);
 	if (nni_aio_iov_count(txaio) > 0) {
+		nni_pipe_time_tx(p->npipe, txaio);
 		nng_stream_send(p->conn, txaio);
 		nni_mtx_unlock(&p->mtx);
 		return;
@@ -496,6 +497,7 @@ sfd_tran_pipe_send_start(sfd_tran_pipe *p)
 		niov++;
 	}
 	nni_aio_set_iov(txaio, niov, iov);
+	nni_pipe_time_tx(p->npipe, txaio);
 	nng_stream_send(p->conn, txaio);
 }
 
@@ -328,6 +328,7 @@ tcptran_pipe_send_cb(void *arg)
 	n = nni_aio_count(txaio);
 	nni_aio_iov_advance(txaio, n);
 	if (nni_aio_iov_count(txaio) > 0) {
+		nni_pipe_time_tx(p->npipe, txaio);
 		nng_stream_send(p->conn, txaio);
 		nni_mtx_unlock(&p->mtx);
 		return;
@@ -518,6 +519,7 @@ tcptran_pipe_send_start(tcptran_pipe *p)
 		niov++;
 	}
 	nni_aio_set_iov(txaio, niov, iov);
+	nni_pipe_time_tx(p->npipe, txaio);
 	nng_stream_send(p->conn, txaio);
 }
 
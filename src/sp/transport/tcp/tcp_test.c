@@ -278,6 +278,227 @@ test_tcp_recv_max(void)
 	NUTS_CLOSE(s1);
 }
 
+void
+test_tcp_listen_shards(void)
+{
+	nng_socket   pull;
+	nng_socket   push[8];
+	nng_listener l;
+	int          n;
+	int          port;
+	char         addr[NNG_MAXADDRLEN];
+
+	NUTS_PASS(nng_pull0_open(&pull));
+	NUTS_PASS(nng_socket_set_ms(pull, NNG_OPT_RECVTIMEO, 2000));
+	NUTS_PASS(nng_listener_create(&l, pull, "tcp://127.0.0.1:0"));
+	NUTS_PASS(nng_listener_get_int(l, NNG_OPT_TCP_LISTEN_SHARDS, &n));
+	NUTS_TRUE(n == 1);
+	NUTS_FAIL(nng_listener_set_int(l, NNG_OPT_TCP_LISTEN_SHARDS, 0),
+	    NNG_EINVAL);
+	NUTS_FAIL(nng_listener_set_int(l, NNG_OPT_TCP_LISTEN_SHARDS, 1000),
+	    NNG_EINVAL);
+	NUTS_FAIL(nng_listener_set_bool(l, NNG_OPT_TCP_LISTEN_SHARDS, true),
+	    NNG_EBADTYPE);
+	if (nng_listener_set_int(l, NNG_OPT_TCP_LISTEN_SHARDS, 4) ==
+	    NNG_ENOTSUP) {
+		// Platform lacks SO_REUSEPORT.
+		NUTS_CLOSE(pull);
+		return;
+	}
+	NUTS_PASS(nng_listener_get_int(l, NNG_OPT_TCP_LISTEN_SHARDS, &n));
+	NUTS_TRUE(n == 4);
+	NUTS_PASS(nng_listener_start(l, 0));
+	NUTS_FAIL(nng_listener_set_int(l, NNG_OPT_TCP_LISTEN_SHARDS, 2),
+	    NNG_EBUSY);
+	NUTS_PASS(nng_listener_get_int(l, NNG_OPT_TCP_BOUND_PORT, &port));
+	NUTS_TRUE(port != 0);
+
+	(void) snprintf(addr, sizeof(addr), "tcp://127.0.0.1:%d", port);
+	for (int i = 0; i < 8; i++) {
+		NUTS_PASS(nng_push0_open(&push[i]));
+		NUTS_PASS(nng_socket_set_ms(push[i], NNG_OPT_SENDTIMEO, 2000));
+		NUTS_PASS(nng_dial(push[i], addr, NULL, 0));
+		NUTS_SEND(push[i], "shard");
+	}
+	for (int i = 0; i < 8; i++) {
+		NUTS_RECV(pull, "shard");
+	}
+	for (int i = 0; i < 8; i++) {
+		NUTS_CLOSE(push[i]);
+	}
+	NUTS_CLOSE(pull);
+}
+
+void
+test_tcp_zerocopy(void)
+{
+	nng_socket   s0;
+	nng_socket   s1;
+	nng_listener l;
+	nng_dialer   d;
+	nng_msg     *m;
+	size_t       sz;
+	int          rv;
+	char        *addr;
+	const size_t big = 1024 * 1024;
+
+	NUTS_ADDR(addr, "tcp");
+	NUTS_OPEN(s0);
+	NUTS_OPEN(s1);
+	NUTS_PASS(nng_socket_set_ms(s0, NNG_OPT_RECVTIMEO, 5000));
+	NUTS_PASS(nng_socket_set_ms(s1, NNG_OPT_RECVTIMEO, 5000));
+	NUTS_PASS(nng_socket_set_size(s0, NNG_OPT_RECVMAXSZ, 0));
+	NUTS_PASS(nng_socket_set_size(s1, NNG_OPT_RECVMAXSZ, 0));
+	NUTS_PASS(nng_listener_create(&l, s0, addr));
+	NUTS_PASS(nng_dialer_create(&d, s1, addr));
+	NUTS_PASS(nng_listener_get_size(
+	    l, NNG_OPT_TCP_ZEROCOPY_THRESHOLD, &sz));
+	NUTS_TRUE(sz == 0);
+	NUTS_FAIL(
+	    nng_listener_set_bool(l, NNG_OPT_TCP_ZEROCOPY_THRESHOLD, true),
+	    NNG_EBADTYPE);
+	rv = nng_listener_set_size(l, NNG_OPT_TCP_ZEROCOPY_THRESHOLD, 4096);
+	if (rv == NNG_ENOTSUP) {
+		// Platform lacks zero-copy support.
+		NUTS_CLOSE(s1);
+		NUTS_CLOSE(s0);
+		return;
+	}
+	NUTS_PASS(rv);
+	NUTS_PASS(nng_dialer_set_size(d, NNG_OPT_TCP_ZEROCOPY_THRESHOLD, 4096));
+	NUTS_PASS(
+	    nng_dialer_get_size(d, NNG_OPT_TCP_ZEROCOPY_THRESHOLD, &sz));
+	NUTS_TRUE(sz == 4096);
+	NUTS_PASS(nng_listener_start(l, 0));
+	NUTS_PASS(nng_dialer_start(d, 0));
+
+	// Mix of small (copied) and large (zero-copy) messages, in
+	// both directions.
+	for (int i = 0; i < 4; i++) {
+		size_t len = (i % 2) ? big : 16;
+		NUTS_PASS(nng_msg_alloc(&m, len));
+		memset(nng_msg_body(m), 'a' + i, len);
+		NUTS_PASS(nng_sendmsg(s1, m, 0));
+		NUTS_PASS(nng_recvmsg(s0, &m, 0));
+		NUTS_TRUE(nng_msg_len(m) == len);
+		NUTS_TRUE(((char *) nng_msg_body(m))[len - 1] == 'a' + i);
+		NUTS_PASS(nng_sendmsg(s0, m, 0));
+		NUTS_PASS(nng_recvmsg(s1, &m, 0));
+		NUTS_TRUE(nng_msg_len(m) == len);
+		nng_msg_free(m);
+	}
+
+#ifdef NNG_ENABLE_STATS
+	// Loopback often copies anyway, but we sent at least four.  The
+	// last completions may still be in flight, so give them a moment.
+	uint64_t total = 0;
+	for (int i = 0; (i < 100) && (total < 4); i++) {
+		nng_stat *stats;
+		nng_stat *zc;
+		nng_stat *zc_copied;
+		NUTS_PASS(nng_stats_get(&stats));
+		zc        = nng_stat_find(stats, "zerocopy_sends");
+		zc_copied = nng_stat_find(stats, "zerocopy_copied");
+		NUTS_ASSERT(zc != NULL);
+		NUTS_ASSERT(zc_copied != NULL);
+		total = nng_stat_value(zc) + nng_stat_value(zc_copied);
+		nng_stats_free(stats);
+		if (total < 4) {
+			nng_msleep(10);
+		}
+	}
+	NUTS_TRUE(total >= 4);
+#endif
+
+	// Closing with zero-copy sends still in flight must neither hang
+	// nor release their buffers early.  Nobody is receiving, so these
+	// eventually back up.
+	NUTS_PASS(nng_socket_set_ms(s1, NNG_OPT_SENDTIMEO, 100));
+	for (int i = 0; i < 8; i++) {
+		NUTS_PASS(nng_msg_alloc(&m, big));
+		memset(nng_msg_body(m), 'z', big);
+		if ((rv = nng_sendmsg(s1, m, 0)) != 0) {
+			NUTS_FAIL(rv, NNG_ETIMEDOUT);
+			nng_msg_free(m);
+			break;
+		}
+	}
+	NUTS_CLOSE(s1);
+	NUTS_CLOSE(s0);
+}
+
+void
+test_tcp_tuning_options(void)
+{
+	nng_socket   s0;
+	nng_socket   s1;
+	nng_listener l;
+	nng_dialer   d;
+	nng_msg     *m;
+	nng_pipe     p;
+	size_t       sz;
+	bool         b;
+	nng_duration ms;
+	char        *addr;
+
+	NUTS_ADDR(addr, "tcp");
+	NUTS_OPEN(s0);
+	NUTS_OPEN(s1);
+	NUTS_PASS(nng_socket_set_ms(s0, NNG_OPT_RECVTIMEO, 5000));
+	NUTS_PASS(nng_socket_set_ms(s1, NNG_OPT_RECVTIMEO, 5000));
+	NUTS_PASS(nng_listener_create(&l, s0, addr));
+	NUTS_PASS(nng_dialer_create(&d, s1, addr));
+
+	// Unset values read back as zero.
+	NUTS_PASS(nng_listener_get_size(l, NNG_OPT_TCP_RCVBUF, &sz));
+	NUTS_TRUE(sz == 0);
+	NUTS_FAIL(nng_listener_set_bool(l, NNG_OPT_TCP_RCVBUF, true),
+	    NNG_EBADTYPE);
+	NUTS_FAIL(nng_dialer_set_ms(d, NNG_OPT_TCP_USER_TIMEOUT, -1),
+	    NNG_EINVAL);
+	NUTS_FAIL(nng_dialer_set_int(d, NNG_OPT_TCP_BUSY_POLL, -1),
+	    NNG_EINVAL);
+
+	NUTS_PASS(nng_listener_set_size(l, NNG_OPT_TCP_RCVBUF, 65536));
+	NUTS_PASS(nng_listener_set_size(l, NNG_OPT_TCP_SNDBUF, 65536));
+	NUTS_PASS(nng_listener_get_size(l, NNG_OPT_TCP_RCVBUF, &sz));
+	NUTS_TRUE(sz == 65536);
+	NUTS_PASS(nng_dialer_set_size(d, NNG_OPT_TCP_RCVBUF, 32768));
+	NUTS_PASS(nng_listener_start(l, 0));
+	NUTS_PASS(nng_dialer_start(d, 0));
+
+	NUTS_SEND(s1, "ping");
+	NUTS_PASS(nng_recvmsg(s0, &m, 0));
+	p = nng_msg_get_pipe(m);
+	nng_msg_free(m);
+
+	// The accepted pipe inherits the listener settings.  Some kernels
+	// double the value, so we cannot check for an exact match.
+	NUTS_PASS(nng_pipe_get_size(p, NNG_OPT_TCP_RCVBUF, &sz));
+	NUTS_TRUE(sz >= 65536);
+	NUTS_PASS(nng_pipe_get_size(p, NNG_OPT_TCP_SNDBUF, &sz));
+	NUTS_TRUE(sz >= 65536);
+
+#if defined(NNG_PLATFORM_LINUX)
+	NUTS_PASS(nng_pipe_get_bool(p, NNG_OPT_TCP_QUICKACK, &b));
+	NUTS_TRUE(b == false);
+	NUTS_PASS(nng_dialer_set_bool(d, NNG_OPT_TCP_QUICKACK, true));
+	NUTS_PASS(nng_dialer_get_bool(d, NNG_OPT_TCP_QUICKACK, &b));
+	NUTS_TRUE(b);
+	NUTS_PASS(nng_dialer_set_ms(d, NNG_OPT_TCP_USER_TIMEOUT, 1000));
+	NUTS_PASS(nng_dialer_get_ms(d, NNG_OPT_TCP_USER_TIMEOUT, &ms));
+	NUTS_TRUE(ms == 1000);
+	NUTS_PASS(nng_pipe_get_ms(p, NNG_OPT_TCP_USER_TIMEOUT, &ms));
+	NUTS_TRUE(ms == 0);
+#else
+	(void) b;
+	(void) ms;
+#endif
+
+	NUTS_CLOSE(s1);
+	NUTS_CLOSE(s0);
+}
+
 NUTS_TESTS = {
 
 	{ "tcp wild card connect fail", test_tcp_wild_card_connect_fail },
@@ -290,5 +511,8 @@ NUTS_TESTS = {
 	{ "tcp no delay option", test_tcp_no_delay_option },
 	{ "tcp keep alive option", test_tcp_keep_alive_option },
 	{ "tcp recv max", test_tcp_recv_max },
+	{ "tcp listen shards", test_tcp_listen_shards },
+	{ "tcp zero copy", test_tcp_zerocopy },
+	{ "tcp tuning options", test_tcp_tuning_options },
 	{ NULL, NULL },
 };
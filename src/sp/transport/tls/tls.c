@@ -325,6 +325,7 @@ tlstran_pipe_send_cb(void *arg)
 	n = nni_aio_count(txaio);
 	nni_aio_iov_advance(txaio, n);
 	if (nni_aio_iov_count(txaio) > 0) {
+		nni_pipe_time_tx(p->npipe, txaio);
 		nng_stream_send(p->tls, txaio);
 		nni_mtx_unlock(&p->mtx);
 		return;
@@ -501,6 +502,7 @@ tlstran_pipe_send_start(tlstran_pipe *p)
 	}
 
 	nni_aio_set_iov(txaio, niov, iov);
+	nni_pipe_time_tx(p->npipe, txaio);
 	nng_stream_send(p->tls, txaio);
 }
 
@@ -50,6 +50,7 @@ struct ws_pipe {
 	nni_aio    *txaio;
 	nni_aio    *rxaio;
 	nng_stream *ws;
+	nni_pipe   *npipe;
 };
 
 static void
@@ -174,6 +175,7 @@ wstran_pipe_send(void *arg, nni_aio *aio)
 	nni_aio_set_msg(p->txaio, nni_aio_get_msg(aio));
 	nni_aio_set_msg(aio, NULL);
 
+	nni_pipe_time_tx(p->npipe, p->txaio);
 	nng_stream_send(p->ws, p->txaio);
 	nni_mtx_unlock(&p->mtx);
 }
@@ -190,8 +192,10 @@ wstran_pipe_stop(void *arg)
 static int
 wstran_pipe_init(void *arg, nni_pipe *pipe)
 {
-	NNI_ARG_UNUSED(arg);
-	NNI_ARG_UNUSED(pipe);
+	ws_pipe *p = arg;
+
+	p->npipe = pipe;
+	nni_ws_pipe_stats(p->ws, pipe);
 	return (0);
 }
 
@@ -1,5 +1,5 @@
 //
-// Copyright 2020 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Cody Piersall <cody.piersall@gmail.com>
 //
 // This software is supplied under the terms of the MIT License, a
@@ -170,11 +170,129 @@ test_ws_recv_max(void)
 	NUTS_CLOSE(s1);
 }
 
+void
+test_ws_deflate(void)
+{
+	char         msg[4000];
+	nng_socket   s0;
+	nng_socket   s1;
+	nng_listener l;
+	nng_dialer   d;
+	nng_msg     *m;
+	nng_pipe     p;
+	bool         on;
+	uint64_t     raw;
+	uint64_t     wire;
+	char        *addr;
+
+	for (size_t i = 0; i < sizeof(msg); i++) {
+		msg[i] = "pack my box with five dozen liquor jugs "[i % 40];
+	}
+
+	NUTS_ADDR(addr, "ws");
+	NUTS_OPEN(s0);
+	NUTS_OPEN(s1);
+	NUTS_PASS(nng_socket_set_ms(s0, NNG_OPT_RECVTIMEO, 1000));
+	NUTS_PASS(nng_socket_set_ms(s1, NNG_OPT_RECVTIMEO, 1000));
+	NUTS_PASS(nng_listener_create(&l, s0, addr));
+#ifdef NNG_HAVE_ZLIB
+	NUTS_PASS(nng_listener_set_bool(l, NNG_OPT_WS_DEFLATE, true));
+#else
+	NUTS_FAIL(
+	    nng_listener_set_bool(l, NNG_OPT_WS_DEFLATE, true), NNG_ENOTSUP);
+#endif
+	NUTS_PASS(nng_listener_start(l, 0));
+	NUTS_PASS(nng_dialer_create(&d, s1, addr));
+#ifdef NNG_HAVE_ZLIB
+	NUTS_PASS(nng_dialer_set_bool(d, NNG_OPT_WS_DEFLATE, true));
+#endif
+	NUTS_PASS(nng_dialer_start(d, 0));
+
+	for (int i = 0; i < 10; i++) {
+		NUTS_PASS(nng_send(s1, msg, sizeof(msg), 0));
+		NUTS_PASS(nng_recvmsg(s0, &m, 0));
+		NUTS_TRUE(nng_msg_len(m) == sizeof(msg));
+		NUTS_TRUE(memcmp(nng_msg_body(m), msg, sizeof(msg)) == 0);
+		p = nng_msg_get_pipe(m);
+		nng_msg_free(m);
+	}
+
+	NUTS_PASS(nng_pipe_get_bool(p, NNG_OPT_WS_DEFLATE, &on));
+	NUTS_PASS(nng_pipe_get_uint64(p, NNG_OPT_WS_DEFLATE_RX_RAW, &raw));
+	NUTS_PASS(nng_pipe_get_uint64(p, NNG_OPT_WS_DEFLATE_RX_WIRE, &wire));
+#ifdef NNG_HAVE_ZLIB
+	NUTS_TRUE(on);
+	NUTS_TRUE(raw >= 10 * sizeof(msg));
+	NUTS_TRUE(wire < raw / 4);
+#else
+	NUTS_TRUE(on == false);
+	NUTS_TRUE(raw == 0);
+	NUTS_TRUE(wire == 0);
+#endif
+	NUTS_CLOSE(s0);
+	NUTS_CLOSE(s1);
+}
+
+// Large messages broadcast to many peers are written from the one
+// shared message, so make sure every subscriber sees all of it, even
+// when it is split into many frames.
+void
+test_ws_broadcast(void)
+{
+	nng_socket   pub;
+	nng_socket   subs[8];
+	nng_listener l;
+	nng_msg     *m;
+	size_t       len = 256 * 1024;
+	char        *addr;
+
+	NUTS_ADDR(addr, "ws");
+	NUTS_PASS(nng_pub0_open(&pub));
+	NUTS_PASS(nng_listener_create(&l, pub, addr));
+	NUTS_PASS(nng_listener_set_size(l, NNG_OPT_WS_SENDMAXFRAME, 10000));
+	NUTS_PASS(nng_listener_start(l, 0));
+
+	for (int i = 0; i < 8; i++) {
+		NUTS_PASS(nng_sub0_open(&subs[i]));
+		NUTS_PASS(nng_socket_set_ms(subs[i], NNG_OPT_RECVTIMEO, 5000));
+		NUTS_PASS(nng_socket_set_size(subs[i], NNG_OPT_RECVMAXSZ, 0));
+		NUTS_PASS(
+		    nng_socket_set(subs[i], NNG_OPT_SUB_SUBSCRIBE, "", 0));
+		NUTS_PASS(nng_dial(subs[i], addr, NULL, 0));
+	}
+	NUTS_SLEEP(100); // give the pipes a chance to be ready
+
+	NUTS_PASS(nng_msg_alloc(&m, len));
+	for (size_t i = 0; i < len; i++) {
+		((uint8_t *) nng_msg_body(m))[i] = (uint8_t) (i % 251);
+	}
+	NUTS_PASS(nng_msg_header_append_u32(m, 0x12345678));
+	NUTS_PASS(nng_sendmsg(pub, m, 0));
+
+	for (int i = 0; i < 8; i++) {
+		uint8_t *body;
+		bool     ok = true;
+		NUTS_PASS(nng_recvmsg(subs[i], &m, 0));
+		NUTS_TRUE(nng_msg_len(m) == len + 4);
+		body = nng_msg_body(m);
+		NUTS_TRUE(memcmp(body, "\x12\x34\x56\x78", 4) == 0);
+		for (size_t j = 0; j < len; j++) {
+			ok = ok && (body[j + 4] == (uint8_t) (j % 251));
+		}
+		NUTS_TRUE(ok);
+		nng_msg_free(m);
+		NUTS_CLOSE(subs[i]);
+	}
+	NUTS_CLOSE(pub);
+}
+
 TEST_LIST = {
 	{ "ws url path filters", test_ws_url_path_filters },
 	{ "ws wild card port", test_wild_card_port },
 	{ "ws wild card host", test_wild_card_host },
 	{ "ws empty host", test_empty_host },
 	{ "ws recv max", test_ws_recv_max },
+	{ "ws deflate", test_ws_deflate },
+	{ "ws broadcast", test_ws_broadcast },
 	{ NULL, NULL },
 };
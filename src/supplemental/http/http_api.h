@@ -1,5 +1,5 @@
 //
-// Copyright 2023 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 // Copyright 2019 Devolutions <info@devolutions.net>
 //
@@ -38,12 +38,14 @@ extern const char *nni_http_reason(uint16_t);
 extern int   nni_http_req_init(nni_http_req **);
 extern void  nni_http_req_reset(nni_http_req *);
 extern int   nni_http_req_get_buf(nni_http_req *, void **, size_t *);
+extern int   nni_http_req_render(nni_http_req *, char **, size_t *, size_t *);
 extern int   nni_http_req_parse(nni_http_req *, void *, size_t, size_t *);
 extern char *nni_http_req_headers(nni_http_req *);
 extern void  nni_http_req_get_data(nni_http_req *, void **, size_t *);
 
 extern void  nni_http_res_reset(nni_http_res *);
 extern int   nni_http_res_get_buf(nni_http_res *, void **, size_t *);
+extern int   nni_http_res_render(nni_http_res *, char **, size_t *, size_t *);
 extern int   nni_http_res_parse(nni_http_res *, void *, size_t, size_t *);
 extern void  nni_http_res_get_data(nni_http_res *, void **, size_t *);
 extern char *nni_http_res_headers(nni_http_res *);
@@ -72,9 +74,44 @@ extern void *nni_http_chunk_data(nni_http_chunk *);
 
 extern int nni_http_chunks_parse(nni_http_chunks *, void *, size_t, size_t *);
 
+// nni_http_chunks_stream resets the list for decoding a new body without
+// collecting it.  In this mode nni_http_chunks_next is used instead of
+// nni_http_chunks_parse, and the size limit does not apply.
+extern void nni_http_chunks_stream(nni_http_chunks *);
+
+// nni_http_chunks_next consumes framing from the buffer until it finds
+// entity data, which is returned in place (at most the given maximum).
+// The amount of the buffer consumed is returned through the first size
+// pointer.  Returns 0 when the final chunk and trailers are consumed,
+// and NNG_EAGAIN if more is needed.
+extern int nni_http_chunks_next(nni_http_chunks *, void *, size_t, size_t,
+    size_t *, void **, size_t *);
+
 extern void nni_http_read_chunks(
     nni_http_conn *, nni_http_chunks *, nni_aio *);
 
+// Content encodings that we can compress responses with.
+typedef enum {
+	NNI_HTTP_ENC_IDENTITY,
+	NNI_HTTP_ENC_GZIP,
+	NNI_HTTP_ENC_DEFLATE,
+} nni_http_enc;
+
+// nni_http_accept_encoding chooses the encoding to use, given the value
+// of an Accept-Encoding header (or NULL if there was none).  Encodings
+// we cannot produce are never chosen.
+extern nni_http_enc nni_http_accept_encoding(const char *);
+
+// nni_http_enc_name returns the Content-Encoding name for the encoding,
+// or NULL for the identity encoding.
+extern const char *nni_http_enc_name(nni_http_enc);
+
+// nni_http_compress compresses the data, returning a buffer that the
+// caller must free with nni_free.  Returns NNG_ENOTSUP if the library
+// was built without compression support.
+extern int nni_http_compress(
+    nni_http_enc, const void *, size_t, void **, size_t *);
+
 // Private to the server. (Used to support session hijacking.)
 extern void  nni_http_conn_set_ctx(nni_http_conn *, void *);
 extern void *nni_http_conn_get_ctx(nni_http_conn *);
@@ -132,6 +169,8 @@ extern int nni_http_req_copy_data(nni_http_req *, const void *, size_t);
 extern int nni_http_res_copy_data(nni_http_res *, const void *, size_t);
 extern int nni_http_req_set_data(nni_http_req *, const void *, size_t);
 extern int nni_http_res_set_data(nni_http_res *, const void *, size_t);
+extern int nni_http_res_set_data_ref(
+    nni_http_res *, const void *, size_t, void (*)(void *), void *);
 extern int nni_http_req_alloc_data(nni_http_req *, size_t);
 extern int nni_http_res_alloc_data(nni_http_res *, size_t);
 extern const char *nni_http_req_get_method(nni_http_req *);
@@ -161,6 +200,21 @@ extern int nni_http_alloc_html_error(char **, uint16_t, const char *);
 
 extern void nni_http_read(nni_http_conn *, nni_aio *);
 extern void nni_http_read_full(nni_http_conn *, nni_aio *);
+
+// nni_http_conn_set_body prepares the connection to deliver an entity
+// body through nni_http_read_body, either chunked, or of the given length.
+// Any part of the body already buffered is delivered first.
+extern int nni_http_conn_set_body(nni_http_conn *, bool, uint64_t);
+
+// nni_http_conn_body_done returns true if the entire body set up with
+// nni_http_conn_set_body has been read.
+extern bool nni_http_conn_body_done(nni_http_conn *);
+
+// nni_http_read_body reads the decoded entity body.  It completes as soon
+// as any data is available, and completes with no data at the end of the
+// body.
+extern void nni_http_read_body(nni_http_conn *, nni_aio *);
+
 extern void nni_http_write(nni_http_conn *, nni_aio *);
 extern void nni_http_write_full(nni_http_conn *, nni_aio *);
 
@@ -191,6 +245,14 @@ extern int nni_http_server_add_handler(nni_http_server *, nni_http_handler *);
 // to make assumptions about the validity of the handler.
 extern int nni_http_server_del_handler(nni_http_server *, nni_http_handler *);
 
+// nni_http_server_lookup finds the handler that would be used for a
+// request with the given host, method, and (canonical) path.  On success
+// the caller owns a reference to the handler, and must release it with
+// nni_http_handler_fini.  NNG_ENOENT is returned if no handler matches,
+// and NNG_ENOTSUP if handlers match the path but not the method.
+extern int nni_http_server_lookup(nni_http_server *, const char *,
+    const char *, const char *, nni_http_handler **);
+
 // nni_http_server_set_tls adds a TLS configuration to the server,
 // and enables the use of it.  This returns NNG_EBUSY if the server is
 // already started.   This wipes out the entire TLS configuration on the
@@ -293,6 +355,10 @@ extern int nni_http_handler_init_static(
 extern int nni_http_handler_init_redirect(
     nni_http_handler **, const char *, uint16_t, const char *);
 
+// nni_http_handler_init_stats creates a handler that serves up all of the
+// statistics, in the OpenMetrics text format used by Prometheus.
+extern int nni_http_handler_init_stats(nni_http_handler **, const char *);
+
 // nni_http_handler_fini destroys a handler.  This should only be done before
 // the handler is added, or after it is deleted.  The server automatically
 // calls this for any handlers still registered with it if it is destroyed.
@@ -303,6 +369,11 @@ extern void nni_http_handler_fini(nni_http_handler *);
 // size to accept.
 extern void nni_http_handler_collect_body(nni_http_handler *, bool, size_t);
 
+// nni_http_handler_stream_body informs the server that the handler reads
+// the entity data itself, as it arrives, with nni_http_read_body.  This
+// takes precedence over nni_http_handler_collect_body.
+extern int nni_http_handler_stream_body(nni_http_handler *, bool);
+
 // nni_http_handler_set_tree marks the handler as servicing the entire
 // tree (e.g. a directory), rather than just a leaf node.  The handler
 // will probably need to inspect the URL of the request.
@@ -315,6 +386,21 @@ extern int nni_http_handler_set_tree(nni_http_handler *);
 // will probably need to inspect the URL of the request.
 extern int nni_http_handler_set_tree_exclusive(nni_http_handler *);
 
+// nni_http_handler_set_cache enables an in memory cache of up to the
+// given number of bytes, for file and directory handlers.  Other handlers
+// return NNG_ENOTSUP.
+extern int nni_http_handler_set_cache(nni_http_handler *, size_t);
+
+// nni_http_handler_set_pipeline marks the handler as always responding
+// with a response object, and never using the connection directly.  Such
+// handlers may be run concurrently for requests pipelined on a single
+// connection.
+extern int nni_http_handler_set_pipeline(nni_http_handler *, bool);
+
+// nni_http_handler_set_compress enables compression of responses with a
+// body of at least the given size, for clients that accept it.
+extern int nni_http_handler_set_compress(nni_http_handler *, bool, size_t);
+
 // nni_http_handler_set_host limits the handler to only being called for
 // the given Host: field.  This can be used to set up multiple virtual
 // hosts.  Note that host names must match exactly.  If NULL or an empty
@@ -373,6 +459,11 @@ extern int nni_http_client_get(
 
 extern void nni_http_client_connect(nni_http_client *, nni_aio *);
 
+// nni_http_client_set_pool configures the pool of idle connections used
+// by nni_http_transact.  At most maxidle connections are kept, each for no
+// longer than the idle time.  A maxidle of zero disables reuse.
+extern int nni_http_client_set_pool(nni_http_client *, int, nng_duration);
+
 // nni_http_transact_conn is used to perform a round-trip exchange (i.e. a
 // single HTTP transaction).  It will not automatically close the connection,
 // unless some kind of significant error occurs.  The caller should dispose
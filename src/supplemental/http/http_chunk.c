@@ -1,5 +1,5 @@
 //
-// Copyright 2018 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 //
 // This software is supplied under the terms of the MIT License, a
@@ -38,6 +38,8 @@ enum chunk_state {
 	CS_DATA,   // actual data
 	CS_TRLR,   // trailer
 	CS_TRLRCR, // CRLF at end of trailer
+	CS_DATACR, // CR after data (streaming only)
+	CS_DATALF, // LF after data (streaming only)
 	CS_DONE,
 };
 
@@ -46,6 +48,8 @@ struct nng_http_chunks {
 	size_t           cl_maxsz;
 	size_t           cl_size; // parsed size (so far)
 	size_t           cl_line; // bytes since last newline
+	size_t           cl_resid; // data left in chunk, when streaming
+	bool             cl_stream; // data is returned, not collected
 	enum chunk_state cl_state;
 };
 
@@ -71,13 +75,10 @@ nni_http_chunks_init(nni_http_chunks **clp, size_t maxsz)
 	return (0);
 }
 
-void
-nni_http_chunks_free(nni_http_chunks *cl)
+static void
+chunks_discard(nni_http_chunks *cl)
 {
 	nni_http_chunk *ch;
-	if (cl == NULL) {
-		return;
-	}
 	while ((ch = nni_list_first(&cl->cl_chunks)) != NULL) {
 		nni_list_remove(&cl->cl_chunks, ch);
 		if (ch->c_data != NULL) {
@@ -85,9 +86,29 @@ nni_http_chunks_free(nni_http_chunks *cl)
 		}
 		NNI_FREE_STRUCT(ch);
 	}
+}
+
+void
+nni_http_chunks_free(nni_http_chunks *cl)
+{
+	if (cl == NULL) {
+		return;
+	}
+	chunks_discard(cl);
 	NNI_FREE_STRUCT(cl);
 }
 
+void
+nni_http_chunks_stream(nni_http_chunks *cl)
+{
+	chunks_discard(cl);
+	cl->cl_size   = 0;
+	cl->cl_line   = 0;
+	cl->cl_resid  = 0;
+	cl->cl_state  = CS_INIT;
+	cl->cl_stream = true;
+}
+
 nni_http_chunk *
 nni_http_chunks_iter(nni_http_chunks *cl, nni_http_chunk *last)
 {
@@ -123,6 +144,10 @@ nni_http_chunk_data(nni_http_chunk *ch)
 static int
 chunk_ingest_len(nni_http_chunks *cl, char c)
 {
+	if (isxdigit(c) && (cl->cl_size > (SIZE_MAX >> 4))) {
+		// Would overflow; nobody sends chunks this large.
+		return (NNG_EPROTO);
+	}
 	if (isdigit(c)) {
 		cl->cl_size *= 16;
 		cl->cl_size += (c - '0');
@@ -166,6 +191,13 @@ chunk_ingest_newline(nni_http_chunks *cl, char c)
 		cl->cl_state = CS_TRLR;
 		return (0);
 	}
+	if (cl->cl_stream) {
+		// The data is handed back to the caller as it arrives,
+		// so there is nothing to allocate.
+		cl->cl_resid = cl->cl_size;
+		cl->cl_state = CS_DATA;
+		return (0);
+	}
 	if ((cl->cl_maxsz > 0) &&
 	    ((nni_http_chunks_size(cl) + cl->cl_size) > cl->cl_maxsz)) {
 		return (NNG_EMSGSIZE);
@@ -220,6 +252,25 @@ chunk_ingest_trailercr(nni_http_chunks *cl, char c)
 	return (0);
 }
 
+static int
+chunk_ingest_datacrlf(nni_http_chunks *cl, char c)
+{
+	if (cl->cl_state == CS_DATACR) {
+		if (c != '\r') {
+			return (NNG_EPROTO);
+		}
+		cl->cl_state = CS_DATALF;
+		return (0);
+	}
+	if (c != '\n') {
+		return (NNG_EPROTO);
+	}
+	cl->cl_state = CS_INIT;
+	cl->cl_size  = 0;
+	cl->cl_line  = 0;
+	return (0);
+}
+
 static int
 chunk_ingest_char(nni_http_chunks *cl, char c)
 {
@@ -247,6 +298,10 @@ chunk_ingest_char(nni_http_chunks *cl, char c)
 	case CS_TRLRCR:
 		rv = chunk_ingest_trailercr(cl, c);
 		break;
+	case CS_DATACR:
+	case CS_DATALF:
+		rv = chunk_ingest_datacrlf(cl, c);
+		break;
 	default:
 		// NB: No support for CS_DATA here, as that is handled
 		// in the caller for reasons of efficiency.
@@ -339,3 +394,51 @@ nni_http_chunks_parse(nni_http_chunks *cl, void *buf, size_t n, size_t *lenp)
 	}
 	return (0);
 }
+
+int
+nni_http_chunks_next(nni_http_chunks *cl, void *buf, size_t n, size_t max,
+    size_t *lenp, void **datap, size_t *dlenp)
+{
+	size_t i   = 0;
+	char * src = buf;
+
+	NNI_ASSERT(cl->cl_stream);
+	*datap = NULL;
+	*dlenp = 0;
+
+	while ((cl->cl_state != CS_DONE) && (i < n)) {
+		int    rv;
+		size_t cnt;
+
+		if (cl->cl_state == CS_DATA) {
+			// Hand back as much of this chunk as we can, in
+			// place.  The caller consumes it before calling us
+			// again.
+			cnt = n - i;
+			if (cnt > cl->cl_resid) {
+				cnt = cl->cl_resid;
+			}
+			if (cnt > max) {
+				cnt = max;
+			}
+			*datap = src + i;
+			*dlenp = cnt;
+			i += cnt;
+			cl->cl_resid -= cnt;
+			if (cl->cl_resid == 0) {
+				cl->cl_state = CS_DATACR;
+			}
+			break;
+		}
+		if ((rv = chunk_ingest_char(cl, src[i])) != 0) {
+			return (rv);
+		}
+		i++;
+	}
+
+	*lenp = i;
+	if (cl->cl_state != CS_DONE) {
+		return (NNG_EAGAIN);
+	}
+	return (0);
+}
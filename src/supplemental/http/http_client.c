@@ -1,5 +1,5 @@
 //
-// Copyright 2021 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 // Copyright 2019 Devolutions <info@devolutions.net>
 //
@@ -21,14 +21,221 @@
 
 static nni_mtx http_txn_lk = NNI_MTX_INITIALIZER;
 
+// Defaults for the pool of idle connections used by nni_http_transact.
+// Pooling is off unless asked for, as requests that cannot be retried
+// may fail if the server closes the connection just as it is reused.
+// The idle time is kept below common server keep-alive timeouts (five
+// seconds for Apache), to make that less likely when it is on.
+#define HTTP_POOL_MAX 0
+#define HTTP_POOL_TIME 4000
+
+// http_pooled is an idle connection, kept for reuse by nni_http_transact.
+typedef struct http_pooled {
+	nni_list_node  node;
+	nni_http_conn *conn;
+	nni_time       expire;
+} http_pooled;
+
 struct nng_http_client {
 	nni_list           aios;
 	nni_mtx            mtx;
 	bool               closed;
+	int                refcnt;
 	nni_aio *          aio;
 	nng_stream_dialer *dialer;
+	nni_list           pool;      // idle connections, oldest first
+	size_t             pool_cnt;  // number of idle connections
+	size_t             pool_max;  // limit on idle connections, 0 disables
+	nng_duration       pool_time; // how long to keep an idle connection
+	nni_aio *          pool_aio;  // expires idle connections
+	bool               pool_busy; // pool_aio is sleeping
+#ifdef NNG_ENABLE_STATS
+	nni_stat_item st_root;
+	nni_stat_item st_host;
+	nni_stat_item st_hits;
+	nni_stat_item st_misses;
+	nni_stat_item st_idle;
+#endif
 };
 
+static void
+http_pool_free(nni_list *list)
+{
+	http_pooled *pc;
+
+	while ((pc = nni_list_first(list)) != NULL) {
+		nni_list_remove(list, pc);
+		nni_http_conn_fini(pc->conn);
+		NNI_FREE_STRUCT(pc);
+	}
+}
+
+// http_pool_expire moves idle connections that have expired by the
+// given time onto the dead list, so they can be freed without the lock.
+static void
+http_pool_expire(nni_http_client *c, nni_time now, nni_list *dead)
+{
+	http_pooled *pc;
+
+	while (((pc = nni_list_first(&c->pool)) != NULL) &&
+	    (pc->expire <= now)) {
+		nni_list_remove(&c->pool, pc);
+		nni_list_append(dead, pc);
+		c->pool_cnt--;
+	}
+#ifdef NNG_ENABLE_STATS
+	nni_stat_set_value(&c->st_idle, c->pool_cnt);
+#endif
+}
+
+static void
+http_pool_cb(void *arg)
+{
+	nni_http_client *c = arg;
+	http_pooled *    pc;
+	nni_list         dead;
+	nni_time         now;
+
+	NNI_LIST_INIT(&dead, http_pooled, node);
+	nni_mtx_lock(&c->mtx);
+	c->pool_busy = false;
+	if ((nni_aio_result(c->pool_aio) == 0) && (!c->closed)) {
+		now = nni_clock();
+		http_pool_expire(c, now, &dead);
+		if ((pc = nni_list_first(&c->pool)) != NULL) {
+			c->pool_busy = true;
+			nni_sleep_aio((nng_duration) (pc->expire - now),
+			    c->pool_aio);
+		}
+	}
+	nni_mtx_unlock(&c->mtx);
+	http_pool_free(&dead);
+}
+
+// http_pool_get returns an idle connection for reuse, or NULL if there
+// is none and a new connection must be made.  The most recently used
+// connection is preferred, as it is the least likely to have been closed
+// by the server.
+static nni_http_conn *
+http_pool_get(nni_http_client *c)
+{
+	http_pooled *  pc;
+	nni_http_conn *conn = NULL;
+	nni_list       dead;
+
+	NNI_LIST_INIT(&dead, http_pooled, node);
+	nni_mtx_lock(&c->mtx);
+	http_pool_expire(c, nni_clock(), &dead);
+	if ((pc = nni_list_last(&c->pool)) != NULL) {
+		nni_list_remove(&c->pool, pc);
+		c->pool_cnt--;
+		conn = pc->conn;
+		NNI_FREE_STRUCT(pc);
+	}
+#ifdef NNG_ENABLE_STATS
+	nni_stat_set_value(&c->st_idle, c->pool_cnt);
+	nni_stat_inc(conn != NULL ? &c->st_hits : &c->st_misses, 1);
+#endif
+	nni_mtx_unlock(&c->mtx);
+	http_pool_free(&dead);
+	return (conn);
+}
+
+// http_pool_put returns a connection that finished a transaction cleanly
+// to the pool, or closes it if the pool has no room for it.
+static void
+http_pool_put(nni_http_client *c, nni_http_conn *conn)
+{
+	http_pooled *pc;
+
+	nni_mtx_lock(&c->mtx);
+	if (c->closed || (c->pool_cnt >= c->pool_max) ||
+	    ((pc = NNI_ALLOC_STRUCT(pc)) == NULL)) {
+		nni_mtx_unlock(&c->mtx);
+		nni_http_conn_fini(conn);
+		return;
+	}
+	pc->conn   = conn;
+	pc->expire = nni_clock() + c->pool_time;
+	nni_list_append(&c->pool, pc);
+	c->pool_cnt++;
+#ifdef NNG_ENABLE_STATS
+	nni_stat_set_value(&c->st_idle, c->pool_cnt);
+#endif
+	if (!c->pool_busy) {
+		c->pool_busy = true;
+		nni_sleep_aio(c->pool_time, c->pool_aio);
+	}
+	nni_mtx_unlock(&c->mtx);
+}
+
+static void
+http_client_rele(nni_http_client *c)
+{
+	nni_mtx_lock(&c->mtx);
+	c->refcnt--;
+	if (c->refcnt > 0) {
+		nni_mtx_unlock(&c->mtx);
+		return;
+	}
+	nni_mtx_unlock(&c->mtx);
+
+	// A transaction may reconnect until it lets go of the client.
+	nni_aio_free(c->aio);
+	nng_stream_dialer_free(c->dialer);
+	nni_mtx_fini(&c->mtx);
+	NNI_FREE_STRUCT(c);
+}
+
+static void
+http_client_stats_init(nni_http_client *c, const nni_url *url)
+{
+#ifdef NNG_ENABLE_STATS
+	static const nni_stat_info root_info = {
+		.si_name = "http-client",
+		.si_desc = "http client statistics",
+		.si_type = NNG_STAT_SCOPE,
+	};
+	static const nni_stat_info host_info = {
+		.si_name  = "host",
+		.si_desc  = "remote host and port",
+		.si_type  = NNG_STAT_STRING,
+		.si_alloc = true,
+	};
+	static const nni_stat_info hits_info = {
+		.si_name   = "pool_hits",
+		.si_desc   = "transactions reusing an idle connection",
+		.si_type   = NNG_STAT_COUNTER,
+		.si_atomic = true,
+	};
+	static const nni_stat_info misses_info = {
+		.si_name   = "pool_misses",
+		.si_desc   = "transactions needing a new connection",
+		.si_type   = NNG_STAT_COUNTER,
+		.si_atomic = true,
+	};
+	static const nni_stat_info idle_info = {
+		.si_name = "pool_idle",
+		.si_desc = "idle connections",
+		.si_type = NNG_STAT_LEVEL,
+	};
+
+	nni_stat_init(&c->st_root, &root_info);
+	nni_stat_init(&c->st_host, &host_info);
+	nni_stat_init(&c->st_hits, &hits_info);
+	nni_stat_init(&c->st_misses, &misses_info);
+	nni_stat_init(&c->st_idle, &idle_info);
+	nni_stat_add(&c->st_root, &c->st_host);
+	nni_stat_add(&c->st_root, &c->st_hits);
+	nni_stat_add(&c->st_root, &c->st_misses);
+	nni_stat_add(&c->st_root, &c->st_idle);
+	nni_stat_set_string(&c->st_host, url->u_host);
+#else
+	NNI_ARG_UNUSED(c);
+	NNI_ARG_UNUSED(url);
+#endif
+}
+
 static void
 http_dial_start(nni_http_client *c)
 {
@@ -86,13 +293,41 @@ http_dial_cb(void *arg)
 	nni_aio_finish(aio, 0, 0);
 }
 
+// http_client_close tears down the client, apart from its statistics,
+// which are only registered once initialization has succeeded.
+static void
+http_client_close(nni_http_client *c)
+{
+	nni_list dead;
+	nni_aio *aio;
+
+	NNI_LIST_INIT(&dead, http_pooled, node);
+	nni_aio_stop(c->pool_aio);
+	nni_mtx_lock(&c->mtx);
+	c->closed = true;
+	http_pool_expire(c, NNI_TIME_NEVER, &dead);
+	while ((aio = nni_list_first(&c->aios)) != NULL) {
+		nni_aio_list_remove(aio);
+		nni_aio_finish_error(aio, NNG_ECLOSED);
+	}
+	nni_mtx_unlock(&c->mtx);
+	http_pool_free(&dead);
+	nni_aio_stop(c->aio);
+
+	nni_aio_free(c->pool_aio);
+
+	// Transactions in progress hold a reference, and will return
+	// their connections to the (now closed) pool when they finish.
+	http_client_rele(c);
+}
+
 void
 nni_http_client_fini(nni_http_client *c)
 {
-	nni_aio_free(c->aio);
-	nng_stream_dialer_free(c->dialer);
-	nni_mtx_fini(&c->mtx);
-	NNI_FREE_STRUCT(c);
+#ifdef NNG_ENABLE_STATS
+	nni_stat_unregister(&c->st_root);
+#endif
+	http_client_close(c);
 }
 
 int
@@ -120,21 +355,56 @@ nni_http_client_init(nni_http_client **cp, const nni_url *url)
 	}
 	nni_mtx_init(&c->mtx);
 	nni_aio_list_init(&c->aios);
+	NNI_LIST_INIT(&c->pool, http_pooled, node);
+	c->refcnt    = 1;
+	c->pool_max  = HTTP_POOL_MAX;
+	c->pool_time = HTTP_POOL_TIME;
+	http_client_stats_init(c, url);
 
 	if ((rv = nng_stream_dialer_alloc_url(&c->dialer, &my_url)) != 0) {
-		nni_http_client_fini(c);
+		http_client_close(c);
 		return (rv);
 	}
 
-	if ((rv = nni_aio_alloc(&c->aio, http_dial_cb, c)) != 0) {
-		nni_http_client_fini(c);
+	if (((rv = nni_aio_alloc(&c->aio, http_dial_cb, c)) != 0) ||
+	    ((rv = nni_aio_alloc(&c->pool_aio, http_pool_cb, c)) != 0)) {
+		http_client_close(c);
 		return (rv);
 	}
 
+#ifdef NNG_ENABLE_STATS
+	nni_stat_register(&c->st_root);
+#endif
 	*cp = c;
 	return (0);
 }
 
+int
+nni_http_client_set_pool(nni_http_client *c, int maxidle, nng_duration idle)
+{
+	nni_list dead;
+
+	if ((maxidle < 0) || (idle < 0)) {
+		return (NNG_EINVAL);
+	}
+	NNI_LIST_INIT(&dead, http_pooled, node);
+	nni_mtx_lock(&c->mtx);
+	c->pool_max  = (size_t) maxidle;
+	c->pool_time = idle;
+	while (c->pool_cnt > c->pool_max) {
+		http_pooled *pc = nni_list_first(&c->pool);
+		nni_list_remove(&c->pool, pc);
+		nni_list_append(&dead, pc);
+		c->pool_cnt--;
+	}
+#ifdef NNG_ENABLE_STATS
+	nni_stat_set_value(&c->st_idle, c->pool_cnt);
+#endif
+	nni_mtx_unlock(&c->mtx);
+	http_pool_free(&dead);
+	return (0);
+}
+
 int
 nni_http_client_set_tls(nni_http_client *c, nng_tls_config *tls)
 {
@@ -186,6 +456,11 @@ nni_http_client_connect(nni_http_client *c, nni_aio *aio)
 		return;
 	}
 	nni_mtx_lock(&c->mtx);
+	if (c->closed) {
+		nni_mtx_unlock(&c->mtx);
+		nni_aio_finish_error(aio, NNG_ECLOSED);
+		return;
+	}
 	if ((rv = nni_aio_schedule(aio, http_dial_cancel, c)) != 0) {
 		nni_mtx_unlock(&c->mtx);
 		nni_aio_finish_error(aio, rv);
@@ -215,6 +490,7 @@ typedef struct http_txn {
 	nni_http_res *   res;
 	nni_http_chunks *chunks;
 	http_txn_state   state;
+	bool             reused; // connection came from the pool
 } http_txn;
 
 static void
@@ -227,12 +503,99 @@ http_txn_fini(void *arg)
 			nni_http_conn_fini(txn->conn);
 			txn->conn = NULL;
 		}
+		http_client_rele(txn->client);
 	}
 	nni_http_chunks_free(txn->chunks);
 	nni_aio_reap(txn->aio);
 	NNI_FREE_STRUCT(txn);
 }
 
+// http_txn_keep returns the connection to the pool when the response is
+// complete, if it may be reused.  This requires that the end of the
+// response be known without closing the connection, and that neither side
+// asked for the connection to be closed.  This is done before the caller
+// is notified, so that a transaction started from the completion finds
+// the connection in the pool.
+static void
+http_txn_keep(http_txn *txn, bool framed)
+{
+	const char *str;
+
+	if ((txn->client == NULL) || (!framed)) {
+		return;
+	}
+	if ((((str = nni_http_req_get_header(txn->req, "Connection")) !=
+	         NULL) &&
+	        (nni_strcasestr(str, "close") != NULL)) ||
+	    (((str = nni_http_res_get_header(txn->res, "Connection")) !=
+	         NULL) &&
+	        (nni_strcasestr(str, "close") != NULL)) ||
+	    (strcmp(nni_http_res_get_version(txn->res), "HTTP/1.1") != 0)) {
+		return;
+	}
+	http_pool_put(txn->client, txn->conn);
+	txn->conn = NULL;
+}
+
+// http_method_idempotent returns true for the methods that RFC 7231
+// defines as idempotent, which a client may retry automatically.
+static bool
+http_method_idempotent(const char *method)
+{
+	static const char *methods[] = {
+		"GET",
+		"HEAD",
+		"OPTIONS",
+		"TRACE",
+		"PUT",
+		"DELETE",
+	};
+	for (size_t i = 0; i < NNI_NUM_ELEMENTS(methods); i++) {
+		if (strcmp(method, methods[i]) == 0) {
+			return (true);
+		}
+	}
+	return (false);
+}
+
+// http_txn_retry restarts a transaction on a new connection, if it failed
+// because the server closed a pooled connection while it was idle.  Even
+// a failure while sending does not prove that the server never saw (and
+// acted on) the request, so only idempotent requests are retried.  There
+// is no retry once the client is closed; the transaction fails with
+// NNG_ECLOSED instead.
+static bool
+http_txn_retry(http_txn *txn, int *rvp, nni_http_conn **stale)
+{
+	nni_http_client *c  = txn->client;
+	int              rv = *rvp;
+	bool             closed;
+
+	if ((!txn->reused) ||
+	    ((rv != NNG_ECONNSHUT) && (rv != NNG_ECONNRESET) &&
+	        (rv != NNG_ECLOSED))) {
+		return (false);
+	}
+	if (((txn->state != HTTP_SENDING) && (txn->state != HTTP_RECVING)) ||
+	    (!http_method_idempotent(nni_http_req_get_method(txn->req)))) {
+		return (false);
+	}
+	nni_mtx_lock(&c->mtx);
+	closed = c->closed;
+	nni_mtx_unlock(&c->mtx);
+	if (closed) {
+		*rvp = NNG_ECLOSED;
+		return (false);
+	}
+	*stale       = txn->conn;
+	txn->conn    = NULL;
+	txn->reused  = false;
+	txn->state   = HTTP_CONNECTING;
+	nni_http_res_reset(txn->res);
+	nni_http_client_connect(txn->client, txn->aio);
+	return (true);
+}
+
 static void
 http_txn_finish_aios(http_txn *txn, int rv)
 {
@@ -255,9 +618,15 @@ http_txn_cb(void *arg)
 	char *          dst;
 	size_t          sz;
 	nni_http_chunk *chunk = NULL;
+	nni_http_conn * stale = NULL;
 
 	nni_mtx_lock(&http_txn_lk);
 	if ((rv = nni_aio_result(txn->aio)) != 0) {
+		if (http_txn_retry(txn, &rv, &stale)) {
+			nni_mtx_unlock(&http_txn_lk);
+			nni_http_conn_fini(stale);
+			return;
+		}
 		http_txn_finish_aios(txn, rv);
 		nni_mtx_unlock(&http_txn_lk);
 		http_txn_fini(txn);
@@ -296,12 +665,26 @@ http_txn_cb(void *arg)
 
 		str = nni_http_req_get_method(txn->req);
 		if ((nni_strcasecmp(str, "HEAD") == 0) ||
-		    ((str = nni_http_res_get_header(
-		          txn->res, "Content-Length")) == NULL) ||
-		    ((len = (uint64_t) strtoull(str, &end, 10)) == 0) ||
-		    (end == NULL) || (*end != '\0')) {
-			// If no content-length, or HEAD (which per RFC
-			// never transfers data), then we are done.
+		    (nni_http_res_get_status(txn->res) == 204) ||
+		    (nni_http_res_get_status(txn->res) == 304)) {
+			// These never transfer data, per RFC.
+			http_txn_keep(txn, true);
+			http_txn_finish_aios(txn, 0);
+			nni_mtx_unlock(&http_txn_lk);
+			http_txn_fini(txn);
+			return;
+		}
+		len = 0;
+		end = NULL;
+		if ((str = nni_http_res_get_header(
+		         txn->res, "Content-Length")) != NULL) {
+			len = (uint64_t) strtoull(str, &end, 10);
+		}
+		if ((len == 0) || (end == NULL) || (*end != '\0')) {
+			// If no content-length, then we are done.  Without
+			// a valid one, the response cannot be followed by
+			// another on this connection.
+			http_txn_keep(txn, (end != NULL) && (*end == '\0'));
 			http_txn_finish_aios(txn, 0);
 			nni_mtx_unlock(&http_txn_lk);
 			http_txn_fini(txn);
@@ -321,6 +704,7 @@ http_txn_cb(void *arg)
 
 	case HTTP_RECVING_BODY:
 		// All done!
+		http_txn_keep(txn, true);
 		http_txn_finish_aios(txn, 0);
 		nni_mtx_unlock(&http_txn_lk);
 		http_txn_fini(txn);
@@ -340,6 +724,7 @@ http_txn_cb(void *arg)
 			    nni_http_chunk_size(chunk));
 			dst += nni_http_chunk_size(chunk);
 		}
+		http_txn_keep(txn, true);
 		http_txn_finish_aios(txn, 0);
 		nni_mtx_unlock(&http_txn_lk);
 		http_txn_fini(txn);
@@ -408,16 +793,20 @@ nni_http_transact_conn(
 	nni_mtx_unlock(&http_txn_lk);
 }
 
-// nni_http_transact_simple does a single transaction, creating a connection
-// just for the purpose, and closing it when done.  (No connection caching.)
-// The reason we require a client to be created first is to deal with TLS
-// settings.  A single global client (per server) may be used.
+// nni_http_transact does a single transaction using the client.  If the
+// client has an idle connection from an earlier transaction, that is used,
+// otherwise a new connection is made just for the purpose.  When done,
+// the connection is kept for reuse if possible, or closed.  The reason we
+// require a client to be created first is to deal with TLS settings.
+// A single global client (per server) may be used.
 void
 nni_http_transact(nni_http_client *client, nni_http_req *req,
     nni_http_res *res, nni_aio *aio)
 {
-	http_txn *txn;
-	int       rv;
+	http_txn *     txn;
+	nni_http_conn *conn;
+	bool           pool;
+	int            rv;
 
 	if (nni_aio_begin(aio) != 0) {
 		return;
@@ -432,11 +821,16 @@ nni_http_transact(nni_http_client *client, nni_http_req *req,
 		return;
 	}
 
-	if ((rv = nni_http_req_set_header(req, "Connection", "close")) != 0) {
-		nni_aio_finish_error(aio, rv);
+	nni_mtx_lock(&client->mtx);
+	if (client->closed) {
+		nni_mtx_unlock(&client->mtx);
+		nni_aio_finish_error(aio, NNG_ECLOSED);
 		http_txn_fini(txn);
 		return;
 	}
+	client->refcnt++;
+	pool = client->pool_max > 0;
+	nni_mtx_unlock(&client->mtx);
 
 	nni_aio_list_init(&txn->aios);
 	txn->client = client;
@@ -445,15 +839,36 @@ nni_http_transact(nni_http_client *client, nni_http_req *req,
 	txn->res    = res;
 	txn->state  = HTTP_CONNECTING;
 
+	// Without a pool, we tell the server we will not be back.
+	if ((!pool) &&
+	    ((rv = nni_http_req_set_header(req, "Connection", "close")) !=
+	        0)) {
+		nni_aio_finish_error(aio, rv);
+		http_txn_fini(txn);
+		return;
+	}
+	conn = pool ? http_pool_get(client) : NULL;
+
 	nni_mtx_lock(&http_txn_lk);
 	if ((rv = nni_aio_schedule(aio, http_txn_cancel, txn)) != 0) {
 		nni_mtx_unlock(&http_txn_lk);
 		nni_aio_finish_error(aio, rv);
+		if (conn != NULL) {
+			// Nothing was sent, so it is still good.
+			http_pool_put(client, conn);
+		}
 		http_txn_fini(txn);
 		return;
 	}
 	nni_http_res_reset(txn->res);
 	nni_list_append(&txn->aios, aio);
-	nni_http_client_connect(client, txn->aio);
+	if (conn != NULL) {
+		txn->conn   = conn;
+		txn->reused = true;
+		txn->state  = HTTP_SENDING;
+		nni_http_write_req(conn, req, txn->aio);
+	} else {
+		nni_http_client_connect(client, txn->aio);
+	}
 	nni_mtx_unlock(&http_txn_lk);
 }
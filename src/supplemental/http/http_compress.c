@@ -0,0 +1,201 @@
+//
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#include <ctype.h>
+#include <string.h>
+
+#include "core/nng_impl.h"
+
+#include "http_api.h"
+
+#ifdef NNG_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+// Content encoding (compression) of HTTP entities.  We only produce the
+// two encodings that every client understands, gzip and deflate (which in
+// HTTP means the zlib format, not raw deflate), and only when we have
+// zlib to do the work.
+
+// http_qvalue parses a quality value, which is a number between 0 and 1
+// with at most three decimal places.  We return it in thousandths, to
+// avoid floating point (and locale dependent parsing).
+static int
+http_qvalue(const char *s)
+{
+	int q;
+	int scale = 100;
+
+	if ((*s != '0') && (*s != '1')) {
+		return (-1);
+	}
+	q = (*s++ - '0') * 1000;
+	if (*s == '.') {
+		s++;
+		while (isdigit((unsigned char) *s) && (scale > 0)) {
+			q += (*s++ - '0') * scale;
+			scale /= 10;
+		}
+	}
+	return (q > 1000 ? 1000 : q);
+}
+
+nni_http_enc
+nni_http_accept_encoding(const char *val)
+{
+	int gzip    = -1;
+	int deflate = -1;
+	int star    = -1;
+
+	if (val == NULL) {
+		return (NNI_HTTP_ENC_IDENTITY);
+	}
+	while (*val != '\0') {
+		const char *tok;
+		size_t      len;
+		int         q = 1000;
+
+		while ((*val == ',') || (*val == ' ') || (*val == '\t')) {
+			val++;
+		}
+		tok = val;
+		while ((*val != '\0') && (*val != ',') && (*val != ';') &&
+		    (*val != ' ') && (*val != '\t')) {
+			val++;
+		}
+		len = (size_t) (val - tok);
+
+		// Parameters; the only one defined is the quality.
+		while ((*val != '\0') && (*val != ',')) {
+			if (((*val == 'q') || (*val == 'Q')) &&
+			    (val[1] == '=')) {
+				q = http_qvalue(val + 2);
+			}
+			val++;
+		}
+		if (len == 0) {
+			continue;
+		}
+		if (((len == 4) && (nni_strncasecmp(tok, "gzip", 4) == 0)) ||
+		    ((len == 6) && (nni_strncasecmp(tok, "x-gzip", 6) == 0))) {
+			gzip = q;
+		} else if ((len == 7) &&
+		    (nni_strncasecmp(tok, "deflate", 7) == 0)) {
+			deflate = q;
+		} else if ((len == 1) && (*tok == '*')) {
+			star = q;
+		}
+	}
+	// Encodings not named are acceptable if a wildcard is.
+	if (gzip < 0) {
+		gzip = star;
+	}
+	if (deflate < 0) {
+		deflate = star;
+	}
+#ifdef NNG_HAVE_ZLIB
+	if ((gzip > 0) && (gzip >= deflate)) {
+		return (NNI_HTTP_ENC_GZIP);
+	}
+	if (deflate > 0) {
+		return (NNI_HTTP_ENC_DEFLATE);
+	}
+#endif
+	return (NNI_HTTP_ENC_IDENTITY);
+}
+
+const char *
+nni_http_enc_name(nni_http_enc enc)
+{
+	switch (enc) {
+	case NNI_HTTP_ENC_GZIP:
+		return ("gzip");
+	case NNI_HTTP_ENC_DEFLATE:
+		return ("deflate");
+	default:
+		return (NULL);
+	}
+}
+
+int
+nni_http_compress(nni_http_enc enc, const void *data, size_t size,
+    void **outp, size_t *outszp)
+{
+#ifdef NNG_HAVE_ZLIB
+	z_stream z;
+	uint8_t *buf;
+	uint8_t *out;
+	size_t   bufsz;
+	size_t   len;
+	int      bits;
+	int      zrv;
+
+	switch (enc) {
+	case NNI_HTTP_ENC_GZIP:
+		bits = 15 + 16; // zlib's way of asking for a gzip wrapper
+		break;
+	case NNI_HTTP_ENC_DEFLATE:
+		bits = 15;
+		break;
+	default:
+		return (NNG_EINVAL);
+	}
+
+	// We compress in one step, which limits the size to what zlib's
+	// counters can hold.  Nobody should have bodies that large in
+	// memory anyway.
+	if (size > (1U << 30)) {
+		return (NNG_EMSGSIZE);
+	}
+	memset(&z, 0, sizeof(z));
+	if (deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, bits, 8,
+	        Z_DEFAULT_STRATEGY) != Z_OK) {
+		return (NNG_ENOMEM);
+	}
+	bufsz = deflateBound(&z, (uLong) size);
+	if ((buf = nni_alloc(bufsz)) == NULL) {
+		deflateEnd(&z);
+		return (NNG_ENOMEM);
+	}
+	z.next_in   = (Bytef *) data;
+	z.avail_in  = (uInt) size;
+	z.next_out  = buf;
+	z.avail_out = (uInt) bufsz;
+	zrv         = deflate(&z, Z_FINISH);
+	len         = bufsz - z.avail_out;
+	deflateEnd(&z);
+	if (zrv != Z_STREAM_END) {
+		nni_free(buf, bufsz);
+		return (NNG_EINTERNAL);
+	}
+
+	// The worst case is rarely reached, so keep only what we used.
+	if (len == bufsz) {
+		*outp   = buf;
+		*outszp = bufsz;
+		return (0);
+	}
+	if ((out = nni_alloc(len)) == NULL) {
+		nni_free(buf, bufsz);
+		return (NNG_ENOMEM);
+	}
+	memcpy(out, buf, len);
+	nni_free(buf, bufsz);
+	*outp   = out;
+	*outszp = len;
+	return (0);
+#else
+	NNI_ARG_UNUSED(enc);
+	NNI_ARG_UNUSED(data);
+	NNI_ARG_UNUSED(size);
+	NNI_ARG_UNUSED(outp);
+	NNI_ARG_UNUSED(outszp);
+	return (NNG_ENOTSUP);
+#endif
+}
@@ -1,5 +1,5 @@
 //
-// Copyright 2021 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 // Copyright 2019 Devolutions <info@devolutions.net>
 //
@@ -31,6 +31,7 @@ enum read_flavor {
 	HTTP_RD_REQ,
 	HTTP_RD_RES,
 	HTTP_RD_CHUNK,
+	HTTP_RD_BODY,
 };
 
 enum write_flavor {
@@ -61,9 +62,47 @@ struct nng_http_conn {
 	size_t           rd_bufsz;
 	bool             rd_buffered;
 
+	// Entity body being delivered by nni_http_read_body.  Chunked
+	// bodies are decoded by rd_chunks, which is kept for reuse.
+	bool             rd_body;    // body not yet completely read
+	bool             rd_chunked; // body uses chunked encoding
+	uint64_t         rd_resid;   // remaining body length, if not chunked
+	nni_http_chunks *rd_chunks;
+
 	enum write_flavor wr_flavor;
+
+	// Requests and responses have their headers rendered into wr_hdr,
+	// so that a fresh buffer is not needed for each message.  Only one
+	// message can use it at a time; wr_hdr_aio is the aio using it
+	// while that is still queued, and is cleared once it is started.
+	char    *wr_hdr;
+	size_t   wr_hdrsz;
+	nni_aio *wr_hdr_aio;
+	bool     wr_hdr_busy;
 };
 
+// http_wr_unqueue releases the header buffer if it was held by an aio
+// that is being discarded without having been started.
+static void
+http_wr_unqueue(nni_http_conn *conn, nni_aio *aio)
+{
+	if (aio == conn->wr_hdr_aio) {
+		conn->wr_hdr_aio  = NULL;
+		conn->wr_hdr_busy = false;
+	}
+}
+
+// http_wr_done is called when the lower level write has finished.
+// If the header buffer is busy but not held by a queued aio, then it
+// was the write that just finished that was using it.
+static void
+http_wr_done(nni_http_conn *conn)
+{
+	if (conn->wr_hdr_aio == NULL) {
+		conn->wr_hdr_busy = false;
+	}
+}
+
 void
 nni_http_conn_set_ctx(nni_http_conn *conn, void *ctx)
 {
@@ -102,6 +141,7 @@ http_close(nni_http_conn *conn)
 	// Abort all operations except the one in flight.
 	while ((aio = nni_list_first(&conn->wrq)) != NULL) {
 		nni_aio_list_remove(aio);
+		http_wr_unqueue(conn, aio);
 		nni_aio_finish_error(aio, NNG_ECLOSED);
 	}
 	while ((aio = nni_list_first(&conn->rdq)) != NULL) {
@@ -122,6 +162,95 @@ nni_http_conn_close(nni_http_conn *conn)
 	nni_mtx_unlock(&conn->mtx);
 }
 
+// http_rd_body delivers entity body data from the buffer, decoding it
+// if chunked.  Like a raw read, it finishes as soon as it has any data.
+// At the end of the body it finishes with no data at all.
+static int
+http_rd_body(nni_http_conn *conn, nni_aio *aio)
+{
+	nni_iov *iov;
+	unsigned nio;
+	nni_iov  iov1;
+	int      rv;
+
+	nni_aio_get_iov(aio, &nio, &iov);
+	while ((conn->rd_body) && (nio != 0) &&
+	    (conn->rd_get != conn->rd_put)) {
+		uint8_t *rbuf = conn->rd_buf + conn->rd_get;
+		size_t   cnt  = conn->rd_put - conn->rd_get;
+		void *   data;
+		size_t   n;
+
+		if (iov[0].iov_len == 0) {
+			nio--;
+			iov = &iov[1];
+			continue;
+		}
+		if (conn->rd_chunked) {
+			rv = nni_http_chunks_next(conn->rd_chunks, rbuf, cnt,
+			    iov[0].iov_len, &cnt, &data, &n);
+			if (rv == 0) {
+				conn->rd_body = false;
+			} else if (rv != NNG_EAGAIN) {
+				return (rv);
+			}
+		} else {
+			if (cnt > conn->rd_resid) {
+				cnt = (size_t) conn->rd_resid;
+			}
+			if (cnt > iov[0].iov_len) {
+				cnt = iov[0].iov_len;
+			}
+			data = rbuf;
+			n    = cnt;
+			conn->rd_resid -= cnt;
+			if (conn->rd_resid == 0) {
+				conn->rd_body = false;
+			}
+		}
+		conn->rd_get += cnt;
+		if (n != 0) {
+			memcpy(iov[0].iov_buf, data, n);
+			iov[0].iov_len -= n;
+			NNI_INCPTR(iov[0].iov_buf, n);
+			nni_aio_bump_count(aio, n);
+		}
+	}
+	if (conn->rd_get == conn->rd_put) {
+		conn->rd_get = conn->rd_put = 0;
+	}
+	if ((!conn->rd_chunked) && (conn->rd_resid == 0)) {
+		// A direct read may have finished the body.
+		conn->rd_body = false;
+	}
+	nni_aio_set_iov(aio, nio, iov);
+
+	if ((!conn->rd_body) || (nio == 0) || (nni_aio_count(aio) != 0)) {
+		return (0);
+	}
+
+	if (!conn->rd_chunked) {
+		// The buffer is empty, so read directly into the caller's
+		// buffer, taking care not to read past the body.  The
+		// residual is adjusted when the read completes.
+		iov1 = iov[0];
+		if (iov1.iov_len > conn->rd_resid) {
+			iov1.iov_len = (size_t) conn->rd_resid;
+		}
+		conn->rd_buffered = false;
+		nni_aio_set_iov(conn->rd_aio, 1, &iov1);
+		nng_stream_recv(conn->sock, conn->rd_aio);
+		return (NNG_EAGAIN);
+	}
+
+	iov1.iov_buf      = conn->rd_buf + conn->rd_put;
+	iov1.iov_len      = conn->rd_bufsz - conn->rd_put;
+	conn->rd_buffered = true;
+	nni_aio_set_iov(conn->rd_aio, 1, &iov1);
+	nng_stream_recv(conn->sock, conn->rd_aio);
+	return (NNG_EAGAIN);
+}
+
 // http_rd_buf attempts to satisfy the read from data in the buffer.
 static int
 http_rd_buf(nni_http_conn *conn, nni_aio *aio)
@@ -229,6 +358,9 @@ http_rd_buf(nni_http_conn *conn, nni_aio *aio)
 			nng_stream_recv(conn->sock, conn->rd_aio);
 		}
 		return (rv);
+
+	case HTTP_RD_BODY:
+		return (http_rd_body(conn, aio));
 	}
 	return (NNG_EINVAL);
 }
@@ -315,6 +447,10 @@ http_rd_cb(void *arg)
 		return;
 	}
 
+	if ((conn->rd_flavor == HTTP_RD_BODY) && (!conn->rd_chunked)) {
+		conn->rd_resid -= cnt;
+	}
+
 	nni_aio_get_iov(uaio, &niov, &iov);
 
 	while ((niov != 0) && (cnt != 0)) {
@@ -397,6 +533,9 @@ http_wr_start(nni_http_conn *conn)
 		}
 		nni_list_remove(&conn->wrq, aio);
 		conn->wr_uaio = aio;
+		if (aio == conn->wr_hdr_aio) {
+			conn->wr_hdr_aio = NULL;
+		}
 	}
 
 	nni_aio_get_iov(aio, &niov, &iov);
@@ -419,6 +558,7 @@ http_wr_cb(void *arg)
 
 	if ((rv = nni_aio_result(aio)) != 0) {
 		// We failed to complete the aio.
+		http_wr_done(conn);
 		if (uaio != NULL) {
 			conn->wr_uaio = NULL;
 			nni_aio_finish_error(uaio, rv);
@@ -432,6 +572,7 @@ http_wr_cb(void *arg)
 		// Write canceled?  This happens pretty much only during
 		// shutdown/close, so we don't want to resume writing.
 		// The stream is probably corrupted at this point anyway.
+		http_wr_done(conn);
 		nni_mtx_unlock(&conn->mtx);
 		return;
 	}
@@ -455,6 +596,7 @@ http_wr_cb(void *arg)
 
 done:
 	conn->wr_uaio = NULL;
+	http_wr_done(conn);
 	nni_aio_finish(uaio, 0, nni_aio_count(uaio));
 
 	// Start next write if another is ready.
@@ -475,6 +617,7 @@ http_wr_cancel(nni_aio *aio, void *arg, int rv)
 		nni_aio_finish_error(aio, rv);
 	} else if (nni_aio_list_active(aio)) {
 		nni_aio_list_remove(aio);
+		http_wr_unqueue(conn, aio);
 		nni_aio_finish_error(aio, rv);
 	}
 	nni_mtx_unlock(&conn->mtx);
@@ -486,13 +629,16 @@ http_wr_submit(nni_http_conn *conn, nni_aio *aio, enum write_flavor flavor)
 	int rv;
 
 	if (nni_aio_begin(aio) != 0) {
+		http_wr_unqueue(conn, aio);
 		return;
 	}
 	if (conn->closed) {
+		http_wr_unqueue(conn, aio);
 		nni_aio_finish_error(aio, NNG_ECLOSED);
 		return;
 	}
 	if ((rv = nni_aio_schedule(aio, http_wr_cancel, conn)) != 0) {
+		http_wr_unqueue(conn, aio);
 		nni_aio_finish_error(aio, rv);
 		return;
 	}
@@ -554,6 +700,48 @@ nni_http_read(nni_http_conn *conn, nni_aio *aio)
 	nni_mtx_unlock(&conn->mtx);
 }
 
+int
+nni_http_conn_set_body(nni_http_conn *conn, bool chunked, uint64_t len)
+{
+	int rv;
+
+	nni_mtx_lock(&conn->mtx);
+	if (chunked && (conn->rd_chunks == NULL) &&
+	    ((rv = nni_http_chunks_init(&conn->rd_chunks, 0)) != 0)) {
+		nni_mtx_unlock(&conn->mtx);
+		return (rv);
+	}
+	if (chunked) {
+		nni_http_chunks_stream(conn->rd_chunks);
+	}
+	conn->rd_chunked = chunked;
+	conn->rd_resid   = chunked ? 0 : len;
+	conn->rd_body    = chunked || (len > 0);
+	nni_mtx_unlock(&conn->mtx);
+	return (0);
+}
+
+bool
+nni_http_conn_body_done(nni_http_conn *conn)
+{
+	bool done;
+
+	nni_mtx_lock(&conn->mtx);
+	done = !conn->rd_body;
+	nni_mtx_unlock(&conn->mtx);
+	return (done);
+}
+
+void
+nni_http_read_body(nni_http_conn *conn, nni_aio *aio)
+{
+	nni_aio_set_prov_data(aio, NULL);
+
+	nni_mtx_lock(&conn->mtx);
+	http_rd_submit(conn, aio, HTTP_RD_BODY);
+	nni_mtx_unlock(&conn->mtx);
+}
+
 void
 nni_http_write_req(nni_http_conn *conn, nni_http_req *req, nni_aio *aio)
 {
@@ -564,8 +752,19 @@ nni_http_write_req(nni_http_conn *conn, nni_http_req *req, nni_aio *aio)
 	size_t  size;
 	nni_iov iov[2];
 	int     niov;
+	bool    hdr;
 
-	if ((rv = nni_http_req_get_buf(req, &buf, &bufsz)) != 0) {
+	nni_mtx_lock(&conn->mtx);
+	hdr = !conn->wr_hdr_busy;
+	if (hdr) {
+		rv = nni_http_req_render(
+		    req, &conn->wr_hdr, &conn->wr_hdrsz, &bufsz);
+		buf = conn->wr_hdr;
+	} else {
+		rv = nni_http_req_get_buf(req, &buf, &bufsz);
+	}
+	if (rv != 0) {
+		nni_mtx_unlock(&conn->mtx);
 		nni_aio_finish_error(aio, rv);
 		return;
 	}
@@ -580,7 +779,10 @@ nni_http_write_req(nni_http_conn *conn, nni_http_req *req, nni_aio *aio)
 	}
 	nni_aio_set_iov(aio, niov, iov);
 
-	nni_mtx_lock(&conn->mtx);
+	if (hdr) {
+		conn->wr_hdr_busy = true;
+		conn->wr_hdr_aio  = aio;
+	}
 	http_wr_submit(conn, aio, HTTP_WR_REQ);
 	nni_mtx_unlock(&conn->mtx);
 }
@@ -595,8 +797,19 @@ nni_http_write_res(nni_http_conn *conn, nni_http_res *res, nni_aio *aio)
 	size_t  size;
 	nni_iov iov[2];
 	int     nio;
+	bool    hdr;
 
-	if ((rv = nni_http_res_get_buf(res, &buf, &bufsz)) != 0) {
+	nni_mtx_lock(&conn->mtx);
+	hdr = !conn->wr_hdr_busy;
+	if (hdr) {
+		rv = nni_http_res_render(
+		    res, &conn->wr_hdr, &conn->wr_hdrsz, &bufsz);
+		buf = conn->wr_hdr;
+	} else {
+		rv = nni_http_res_get_buf(res, &buf, &bufsz);
+	}
+	if (rv != 0) {
+		nni_mtx_unlock(&conn->mtx);
 		nni_aio_finish_error(aio, rv);
 		return;
 	}
@@ -611,7 +824,10 @@ nni_http_write_res(nni_http_conn *conn, nni_http_res *res, nni_aio *aio)
 	}
 	nni_aio_set_iov(aio, nio, iov);
 
-	nni_mtx_lock(&conn->mtx);
+	if (hdr) {
+		conn->wr_hdr_busy = true;
+		conn->wr_hdr_aio  = aio;
+	}
 	http_wr_submit(conn, aio, HTTP_WR_RES);
 	nni_mtx_unlock(&conn->mtx);
 }
@@ -679,6 +895,8 @@ nni_http_conn_fini(nni_http_conn *conn)
 	nni_aio_free(conn->wr_aio);
 	nni_aio_free(conn->rd_aio);
 	nni_free(conn->rd_buf, conn->rd_bufsz);
+	nni_free(conn->wr_hdr, conn->wr_hdrsz);
+	nni_http_chunks_free(conn->rd_chunks);
 	nni_mtx_fini(&conn->mtx);
 	NNI_FREE_STRUCT(conn);
 }
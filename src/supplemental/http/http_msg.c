@@ -1,5 +1,5 @@
 //
-// Copyright 2019 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 //
 // This software is supplied under the terms of the MIT License, a
@@ -17,42 +17,77 @@
 #include "core/nng_impl.h"
 #include "http_api.h"
 
+// Headers are kept in a flat index, which carries a case-insensitive hash
+// of each name so that lookups rarely need a full string comparison.
+// The names and values themselves live in arena blocks owned by the
+// message.  Strings never move once stored, so a value returned by
+// get_header remains valid until the message is reset or freed; replaced
+// values are simply abandoned in the arena until then.  The index and
+// the most recent arena block are kept across resets, so a message that
+// is reused (as the server does for requests) normally parses headers
+// without allocating at all.
+//
 // Note that as we parse headers, the rule is that if a header is already
 // present, then we can append it to the existing header, separated by
 // a comma.  From experience, for example, Firefox uses a Connection:
 // header with two values, "keepalive", and "upgrade".
 typedef struct http_header {
-	char *        name;
-	char *        value;
-	nni_list_node node;
+	uint32_t    hash;
+	size_t      nlen;
+	size_t      vlen;
+	const char *name;
+	const char *value;
 } http_header;
 
+typedef struct http_arena http_arena;
+struct http_arena {
+	http_arena *next;
+	size_t      size;
+	size_t      used;
+};
+
+typedef struct http_headers {
+	http_header *index;
+	size_t       count;
+	size_t       cap;
+	http_arena  *arena; // most recent block first
+} http_headers;
+
+#define HTTP_HEADERS_ARENA 512   // size of first arena block
+#define HTTP_HEADERS_KEEP 8192   // largest arena block kept on reset
+#define HTTP_HEADERS_INDEX 16    // initial index size
+#define HTTP_HEADERS_KEEP_IDX 64 // largest index kept on reset
+
 typedef struct nni_http_entity {
 	char * data;
 	size_t size; // allocated/expected size
 	size_t len;  // current length
 	bool   own;  // if true, data is "ours", and should be freed
+	void (*rele)(void *); // if set, called when data is done with
+	void *rele_arg;
 } nni_http_entity;
 
 struct nng_http_req {
-	nni_list        hdrs;
+	http_headers    hdrs;
 	nni_http_entity data;
 	char *          meth;
 	char *          uri;
 	char *          vers;
 	char *          buf;
 	size_t          bufsz;
+	size_t          buflen;
 	bool            parsed;
 };
 
 struct nng_http_res {
-	nni_list        hdrs;
+	http_headers    hdrs;
 	nni_http_entity data;
 	uint16_t        code;
 	char *          rsn;
 	char *          vers;
 	char *          buf;
 	size_t          bufsz;
+	size_t          buflen;
 	bool            parsed;
 	bool            iserr;
 };
@@ -72,14 +107,174 @@ http_set_string(char **strp, const char *val)
 }
 
 static void
-http_headers_reset(nni_list *hdrs)
+http_arena_free(http_arena *a)
+{
+	nni_free(a, sizeof(*a) + a->size);
+}
+
+static void
+http_headers_reset(http_headers *hh)
+{
+	http_arena *a;
+
+	hh->count = 0;
+	if ((a = hh->arena) != NULL) {
+		http_arena *next;
+		while ((next = a->next) != NULL) {
+			a->next = next->next;
+			http_arena_free(next);
+		}
+		if (a->size > HTTP_HEADERS_KEEP) {
+			http_arena_free(a);
+			hh->arena = NULL;
+		} else {
+			a->used = 0;
+		}
+	}
+	if (hh->cap > HTTP_HEADERS_KEEP_IDX) {
+		nni_free(hh->index, hh->cap * sizeof(http_header));
+		hh->index = NULL;
+		hh->cap   = 0;
+	}
+}
+
+static void
+http_headers_fini(http_headers *hh)
+{
+	http_headers_reset(hh);
+	if (hh->arena != NULL) {
+		http_arena_free(hh->arena);
+		hh->arena = NULL;
+	}
+	if (hh->cap != 0) {
+		nni_free(hh->index, hh->cap * sizeof(http_header));
+		hh->index = NULL;
+		hh->cap   = 0;
+	}
+}
+
+// http_header_hash is FNV-1a over the ASCII lower case form of the name.
+// It also returns the length of the name.
+static uint32_t
+http_header_hash(const char *name, size_t *lenp)
+{
+	uint32_t hash = 2166136261u;
+	size_t   len;
+
+	for (len = 0; name[len] != '\0'; len++) {
+		uint8_t c = (uint8_t) name[len];
+		if ((c >= 'A') && (c <= 'Z')) {
+			c += 'a' - 'A';
+		}
+		hash ^= c;
+		hash *= 16777619u;
+	}
+	*lenp = len;
+	return (hash);
+}
+
+// http_headers_store copies a string into the arena, and returns the
+// stored copy.  If s2 is not NULL, then the stored string is the
+// concatenation of s1 and s2, separated by a comma, which is how repeated
+// headers are combined.  Either string may itself be in the arena.
+static const char *
+http_headers_store(http_headers *hh, const char *s1, size_t l1,
+    const char *s2, size_t l2, size_t *lenp)
+{
+	http_arena *a    = hh->arena;
+	size_t      need = l1 + 1;
+	char       *s;
+
+	if (s2 != NULL) {
+		need += l2 + 2;
+	}
+	if ((a == NULL) || ((a->size - a->used) < need)) {
+		size_t sz = (a == NULL) ? HTTP_HEADERS_ARENA : a->size * 2;
+		while (sz < need) {
+			sz *= 2;
+		}
+		if ((a = nni_alloc(sizeof(*a) + sz)) == NULL) {
+			return (NULL);
+		}
+		a->size   = sz;
+		a->used   = 0;
+		a->next   = hh->arena;
+		hh->arena = a;
+	}
+	s = ((char *) (a + 1)) + a->used;
+	memcpy(s, s1, l1);
+	if (s2 != NULL) {
+		s[l1++] = ',';
+		s[l1++] = ' ';
+		memcpy(s + l1, s2, l2);
+		l1 += l2;
+	}
+	s[l1] = '\0';
+	a->used += l1 + 1;
+	*lenp = l1;
+	return (s);
+}
+
+static http_header *
+http_headers_find(http_headers *hh, const char *key, uint32_t hash)
+{
+	for (size_t i = 0; i < hh->count; i++) {
+		http_header *h = &hh->index[i];
+		if ((h->hash == hash) && (nni_strcasecmp(h->name, key) == 0)) {
+			return (h);
+		}
+	}
+	return (NULL);
+}
+
+static int
+http_headers_append(http_headers *hh, const char *key, size_t klen,
+    uint32_t hash, const char *val, size_t vlen)
 {
 	http_header *h;
-	while ((h = nni_list_first(hdrs)) != NULL) {
-		nni_list_remove(hdrs, h);
-		nni_strfree(h->name);
-		nni_strfree(h->value);
-		NNI_FREE_STRUCT(h);
+	const char  *name;
+	const char  *value;
+
+	if (hh->count == hh->cap) {
+		http_header *idx;
+		size_t       cap;
+
+		cap = (hh->cap == 0) ? HTTP_HEADERS_INDEX : hh->cap * 2;
+		if ((idx = nni_alloc(cap * sizeof(http_header))) == NULL) {
+			return (NNG_ENOMEM);
+		}
+		if (hh->count != 0) {
+			memcpy(idx, hh->index, hh->count * sizeof(http_header));
+		}
+		if (hh->cap != 0) {
+			nni_free(hh->index, hh->cap * sizeof(http_header));
+		}
+		hh->index = idx;
+		hh->cap   = cap;
+	}
+	if (((name = http_headers_store(hh, key, klen, NULL, 0, &klen)) ==
+	        NULL) ||
+	    ((value = http_headers_store(hh, val, vlen, NULL, 0, &vlen)) ==
+	        NULL)) {
+		return (NNG_ENOMEM);
+	}
+	h        = &hh->index[hh->count++];
+	h->hash  = hash;
+	h->name  = name;
+	h->nlen  = klen;
+	h->value = value;
+	h->vlen  = vlen;
+	return (0);
+}
+
+static void
+http_entity_release(nni_http_entity *entity)
+{
+	void (*rele)(void *) = entity->rele;
+
+	if (rele != NULL) {
+		entity->rele = NULL;
+		rele(entity->rele_arg);
 	}
 }
 
@@ -89,6 +284,7 @@ http_entity_reset(nni_http_entity *entity)
 	if (entity->own && entity->size) {
 		nni_free(entity->data, entity->size);
 	}
+	http_entity_release(entity);
 	entity->data = NULL;
 	entity->size = 0;
 	entity->own  = false;
@@ -105,6 +301,7 @@ nni_http_req_reset(nni_http_req *req)
 	req->vers = req->meth = req->uri = NULL;
 	nni_free(req->buf, req->bufsz);
 	req->bufsz  = 0;
+	req->buflen = 0;
 	req->buf    = NULL;
 	req->parsed = false;
 }
@@ -121,8 +318,9 @@ nni_http_res_reset(nni_http_res *res)
 	res->code   = NNG_HTTP_STATUS_OK;
 	res->parsed = false;
 	nni_free(res->buf, res->bufsz);
-	res->buf   = NULL;
-	res->bufsz = 0;
+	res->buf    = NULL;
+	res->bufsz  = 0;
+	res->buflen = 0;
 }
 
 void
@@ -130,6 +328,7 @@ nni_http_req_free(nni_http_req *req)
 {
 	if (req != NULL) {
 		nni_http_req_reset(req);
+		http_headers_fini(&req->hdrs);
 		NNI_FREE_STRUCT(req);
 	}
 }
@@ -139,24 +338,26 @@ nni_http_res_free(nni_http_res *res)
 {
 	if (res != NULL) {
 		nni_http_res_reset(res);
+		http_headers_fini(&res->hdrs);
 		NNI_FREE_STRUCT(res);
 	}
 }
 
 static int
-http_del_header(nni_list *hdrs, const char *key)
+http_del_header(http_headers *hh, const char *key)
 {
 	http_header *h;
-	NNI_LIST_FOREACH (hdrs, h) {
-		if (nni_strcasecmp(key, h->name) == 0) {
-			nni_list_remove(hdrs, h);
-			nni_strfree(h->name);
-			nni_free(h->value, strlen(h->value) + 1);
-			NNI_FREE_STRUCT(h);
-			return (0);
-		}
+	size_t       len;
+	size_t       i;
+
+	if ((h = http_headers_find(hh, key, http_header_hash(key, &len))) ==
+	    NULL) {
+		return (NNG_ENOENT);
 	}
-	return (NNG_ENOENT);
+	i = (size_t) (h - hh->index);
+	hh->count--;
+	memmove(h, h + 1, (hh->count - i) * sizeof(http_header));
+	return (0);
 }
 
 int
@@ -172,34 +373,23 @@ nni_http_res_del_header(nni_http_res *res, const char *key)
 }
 
 static int
-http_set_header(nni_list *hdrs, const char *key, const char *val)
+http_set_header(http_headers *hh, const char *key, const char *val)
 {
 	http_header *h;
-	NNI_LIST_FOREACH (hdrs, h) {
-		if (nni_strcasecmp(key, h->name) == 0) {
-			char *news;
-			if ((news = nni_strdup(val)) == NULL) {
-				return (NNG_ENOMEM);
-			}
-			nni_strfree(h->value);
-			h->value = news;
-			return (0);
-		}
-	}
+	size_t       klen;
+	size_t       vlen = strlen(val);
+	uint32_t     hash = http_header_hash(key, &klen);
+	const char  *news;
 
-	if ((h = NNI_ALLOC_STRUCT(h)) == NULL) {
-		return (NNG_ENOMEM);
+	if ((h = http_headers_find(hh, key, hash)) == NULL) {
+		return (http_headers_append(hh, key, klen, hash, val, vlen));
 	}
-	if ((h->name = nni_strdup(key)) == NULL) {
-		NNI_FREE_STRUCT(h);
+	if ((news = http_headers_store(hh, val, vlen, NULL, 0, &vlen)) ==
+	    NULL) {
 		return (NNG_ENOMEM);
 	}
-	if ((h->value = nni_strdup(val)) == NULL) {
-		nni_strfree(h->name);
-		NNI_FREE_STRUCT(h);
-		return (NNG_ENOMEM);
-	}
-	nni_list_append(hdrs, h);
+	h->value = news;
+	h->vlen  = vlen;
 	return (0);
 }
 
@@ -216,36 +406,23 @@ nni_http_res_set_header(nni_http_res *res, const char *key, const char *val)
 }
 
 static int
-http_add_header(nni_list *hdrs, const char *key, const char *val)
+http_add_header(http_headers *hh, const char *key, const char *val)
 {
 	http_header *h;
-	NNI_LIST_FOREACH (hdrs, h) {
-		if (nni_strcasecmp(key, h->name) == 0) {
-			char *news;
-			int   rv;
-			rv = nni_asprintf(&news, "%s, %s", h->value, val);
-			if (rv != 0) {
-				return (rv);
-			}
-			nni_strfree(h->value);
-			h->value = news;
-			return (0);
-		}
-	}
+	size_t       klen;
+	size_t       vlen = strlen(val);
+	uint32_t     hash = http_header_hash(key, &klen);
+	const char  *news;
 
-	if ((h = NNI_ALLOC_STRUCT(h)) == NULL) {
-		return (NNG_ENOMEM);
-	}
-	if ((h->name = nni_strdup(key)) == NULL) {
-		NNI_FREE_STRUCT(h);
-		return (NNG_ENOMEM);
+	if ((h = http_headers_find(hh, key, hash)) == NULL) {
+		return (http_headers_append(hh, key, klen, hash, val, vlen));
 	}
-	if ((h->value = nni_strdup(val)) == NULL) {
-		nni_strfree(h->name);
-		NNI_FREE_STRUCT(h);
+	news = http_headers_store(hh, h->value, h->vlen, val, vlen, &vlen);
+	if (news == NULL) {
 		return (NNG_ENOMEM);
 	}
-	nni_list_append(hdrs, h);
+	h->value = news;
+	h->vlen  = vlen;
 	return (0);
 }
 
@@ -262,13 +439,14 @@ nni_http_res_add_header(nni_http_res *res, const char *key, const char *val)
 }
 
 static const char *
-http_get_header(nni_list *hdrs, const char *key)
+http_get_header(http_headers *hh, const char *key)
 {
 	http_header *h;
-	NNI_LIST_FOREACH (hdrs, h) {
-		if (nni_strcasecmp(h->name, key) == 0) {
-			return (h->value);
-		}
+	size_t       len;
+
+	if ((h = http_headers_find(hh, key, http_header_hash(key, &len))) !=
+	    NULL) {
+		return (h->value);
 	}
 	return (NULL);
 }
@@ -293,6 +471,7 @@ http_entity_set_data(nni_http_entity *entity, const void *data, size_t size)
 	if (entity->own) {
 		nni_free(entity->data, entity->size);
 	}
+	http_entity_release(entity);
 	entity->data = (void *) data;
 	entity->size = size;
 	entity->own  = false;
@@ -321,7 +500,7 @@ http_entity_copy_data(nni_http_entity *entity, const void *data, size_t size)
 }
 
 static int
-http_set_content_length(nni_http_entity *entity, nni_list *hdrs)
+http_set_content_length(nni_http_entity *entity, http_headers *hdrs)
 {
 	char buf[16];
 	(void) snprintf(buf, sizeof(buf), "%u", (unsigned) entity->size);
@@ -372,6 +551,27 @@ nni_http_res_set_data(nni_http_res *res, const void *data, size_t size)
 	return (rv);
 }
 
+// nni_http_res_set_data_ref is like nni_http_res_set_data, but the data
+// is reference counted by the caller.  The release function is called
+// once the response no longer needs the data.  If this fails, the
+// caller still holds the reference.
+int
+nni_http_res_set_data_ref(nni_http_res *res, const void *data, size_t size,
+    void (*rele)(void *), void *arg)
+{
+	int rv;
+
+	http_entity_set_data(&res->data, data, size);
+	if ((rv = http_set_content_length(&res->data, &res->hdrs)) != 0) {
+		http_entity_set_data(&res->data, NULL, 0);
+		return (rv);
+	}
+	res->data.rele     = rele;
+	res->data.rele_arg = arg;
+	res->iserr         = false;
+	return (0);
+}
+
 int
 nni_http_req_copy_data(nni_http_req *req, const void *data, size_t size)
 {
@@ -431,7 +631,7 @@ nni_http_res_is_error(nni_http_res *res)
 }
 
 static int
-http_parse_header(nni_list *hdrs, void *line)
+http_parse_header(http_headers *hdrs, void *line)
 {
 	char *key = line;
 	char *val;
@@ -458,48 +658,56 @@ http_parse_header(nni_list *hdrs, void *line)
 	return (http_add_header(hdrs, key, val));
 }
 
-// http_sprintf_headers makes headers for an HTTP request or an HTTP response
-// object.  Each header is dumped from the list. If the buf is NULL,
-// or the sz is 0, then a dryrun is done, in order to allow the caller to
-// determine how much space is needed. Returns the size of the space needed,
-// not including the terminating NULL byte.  Truncation occurs if the size
-// returned is >= the requested size.
+// http_headers_len returns the space needed to render the headers, not
+// including any terminating NUL byte.
 static size_t
-http_sprintf_headers(char *buf, size_t sz, nni_list *list)
+http_headers_len(http_headers *hh)
 {
-	size_t       rv = 0;
-	http_header *h;
-
-	if (buf == NULL) {
-		sz = 0;
+	size_t len = 0;
+	for (size_t i = 0; i < hh->count; i++) {
+		len += hh->index[i].nlen + hh->index[i].vlen + 4;
 	}
-
-	NNI_LIST_FOREACH (list, h) {
-		size_t l;
-		l = snprintf(buf, sz, "%s: %s\r\n", h->name, h->value);
-		if (buf != NULL) {
-			buf += l;
-		}
-		sz = (sz > l) ? sz - l : 0;
-		rv += l;
+	return (len);
+}
+
+// http_headers_render renders the headers into buf, which must have
+// at least http_headers_len() bytes available.  It returns a pointer
+// to the end of the rendered headers.  No NUL termination is done.
+static char *
+http_headers_render(http_headers *hh, char *buf)
+{
+	for (size_t i = 0; i < hh->count; i++) {
+		http_header *h = &hh->index[i];
+		memcpy(buf, h->name, h->nlen);
+		buf += h->nlen;
+		*buf++ = ':';
+		*buf++ = ' ';
+		memcpy(buf, h->value, h->vlen);
+		buf += h->vlen;
+		*buf++ = '\r';
+		*buf++ = '\n';
 	}
-	return (rv);
+	return (buf);
 }
 
+// http_render renders the first line and headers for an HTTP request or
+// response into the supplied buffer, which is only reallocated if it
+// is too small.  The length rendered, excluding the terminating NUL, is
+// returned in lenp.
 static int
-http_asprintf(char **bufp, size_t *szp, nni_list *hdrs, const char *fmt, ...)
+http_render(char **bufp, size_t *szp, size_t *lenp, http_headers *hdrs,
+    const char *fmt, ...)
 {
 	va_list ap;
 	size_t  len;
 	size_t  n;
-	char *  buf;
+	char   *buf;
 
 	va_start(ap, fmt);
-	len = vsnprintf(NULL, 0, fmt, ap);
+	n = vsnprintf(NULL, 0, fmt, ap);
 	va_end(ap);
 
-	len += http_sprintf_headers(NULL, 0, hdrs);
-	len += 3; // \r\n\0
+	len = n + http_headers_len(hdrs) + 3; // \r\n\0
 
 	if (len <= *szp) {
 		buf = *bufp;
@@ -512,65 +720,58 @@ http_asprintf(char **bufp, size_t *szp, nni_list *hdrs, const char *fmt, ...)
 		*szp  = len;
 	}
 	va_start(ap, fmt);
-	n = vsnprintf(buf, len, fmt, ap);
+	(void) vsnprintf(buf, n + 1, fmt, ap);
 	va_end(ap);
-	buf += n;
-	len -= n;
-	n = http_sprintf_headers(buf, len, hdrs);
-	buf += n;
-	len -= n;
-	snprintf(buf, len, "\r\n");
-	NNI_ASSERT(len == 3);
+	buf    = http_headers_render(hdrs, buf + n);
+	*buf++ = '\r';
+	*buf++ = '\n';
+	*buf   = '\0';
+	*lenp  = len - 1;
 	return (0);
 }
 
-static int
-http_req_prepare(nni_http_req *req)
+int
+nni_http_req_render(nni_http_req *req, char **bufp, size_t *szp, size_t *lenp)
 {
-	int rv;
 	if (req->uri == NULL) {
 		return (NNG_EINVAL);
 	}
-	rv = http_asprintf(&req->buf, &req->bufsz, &req->hdrs, "%s %s %s\r\n",
+	return (http_render(bufp, szp, lenp, &req->hdrs, "%s %s %s\r\n",
 	    req->meth != NULL ? req->meth : "GET", req->uri,
-	    req->vers != NULL ? req->vers : "HTTP/1.1");
-	return (rv);
+	    req->vers != NULL ? req->vers : "HTTP/1.1"));
 }
 
-static int
-http_res_prepare(nni_http_res *res)
+int
+nni_http_res_render(nni_http_res *res, char **bufp, size_t *szp, size_t *lenp)
 {
-	int rv;
-	rv = http_asprintf(&res->buf, &res->bufsz, &res->hdrs, "%s %d %s\r\n",
+	return (http_render(bufp, szp, lenp, &res->hdrs, "%s %d %s\r\n",
 	    nni_http_res_get_version(res), nni_http_res_get_status(res),
-	    nni_http_res_get_reason(res));
-	return (rv);
+	    nni_http_res_get_reason(res)));
 }
 
-char *
-nni_http_req_headers(nni_http_req *req)
+static char *
+http_headers_string(http_headers *hh)
 {
-	char * s;
+	char  *s;
 	size_t len;
 
-	len = http_sprintf_headers(NULL, 0, &req->hdrs) + 1;
+	len = http_headers_len(hh) + 1;
 	if ((s = nni_alloc(len)) != NULL) {
-		http_sprintf_headers(s, len, &req->hdrs);
+		*http_headers_render(hh, s) = '\0';
 	}
 	return (s);
 }
 
 char *
-nni_http_res_headers(nni_http_res *res)
+nni_http_req_headers(nni_http_req *req)
 {
-	char * s;
-	size_t len;
+	return (http_headers_string(&req->hdrs));
+}
 
-	len = http_sprintf_headers(NULL, 0, &res->hdrs) + 1;
-	if ((s = nni_alloc(len)) != NULL) {
-		http_sprintf_headers(s, len, &res->hdrs);
-	}
-	return (s);
+char *
+nni_http_res_headers(nni_http_res *res)
+{
+	return (http_headers_string(&res->hdrs));
 }
 
 int
@@ -578,11 +779,13 @@ nni_http_req_get_buf(nni_http_req *req, void **data, size_t *szp)
 {
 	int rv;
 
-	if ((req->buf == NULL) && (rv = http_req_prepare(req)) != 0) {
+	if ((req->buf == NULL) &&
+	    ((rv = nni_http_req_render(
+	          req, &req->buf, &req->bufsz, &req->buflen)) != 0)) {
 		return (rv);
 	}
 	*data = req->buf;
-	*szp  = req->bufsz - 1; // exclude terminating NUL
+	*szp  = req->buflen;
 	return (0);
 }
 
@@ -591,11 +794,13 @@ nni_http_res_get_buf(nni_http_res *res, void **data, size_t *szp)
 {
 	int rv;
 
-	if ((res->buf == NULL) && (rv = http_res_prepare(res)) != 0) {
+	if ((res->buf == NULL) &&
+	    ((rv = nni_http_res_render(
+	          res, &res->buf, &res->bufsz, &res->buflen)) != 0)) {
 		return (rv);
 	}
 	*data = res->buf;
-	*szp  = res->bufsz - 1; // exclude terminating NUL
+	*szp  = res->buflen;
 	return (0);
 }
 
@@ -606,7 +811,6 @@ nni_http_req_alloc(nni_http_req **reqp, const nni_url *url)
 	if ((req = NNI_ALLOC_STRUCT(req)) == NULL) {
 		return (NNG_ENOMEM);
 	}
-	NNI_LIST_INIT(&req->hdrs, http_header, node);
 	req->buf       = NULL;
 	req->bufsz     = 0;
 	req->data.data = NULL;
@@ -647,7 +851,6 @@ nni_http_res_alloc(nni_http_res **resp)
 	if ((res = NNI_ALLOC_STRUCT(res)) == NULL) {
 		return (NNG_ENOMEM);
 	}
-	NNI_LIST_INIT(&res->hdrs, http_header, node);
 	res->buf       = NULL;
 	res->bufsz     = 0;
 	res->data.data = NULL;
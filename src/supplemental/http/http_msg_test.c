@@ -0,0 +1,168 @@
+//
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include <nng/nng.h>
+#include <nng/supplemental/http/http.h>
+
+#include <nuts.h>
+
+#include "http_api.h"
+
+void
+test_header_set_get(void)
+{
+	nng_http_res *res;
+
+	NUTS_PASS(nng_http_res_alloc(&res));
+	NUTS_PASS(nng_http_res_set_header(res, "Content-Type", "text/plain"));
+	NUTS_MATCH(nng_http_res_get_header(res, "content-type"), "text/plain");
+	NUTS_MATCH(nng_http_res_get_header(res, "CONTENT-TYPE"), "text/plain");
+	NUTS_NULL(nng_http_res_get_header(res, "Content-Length"));
+
+	NUTS_PASS(nng_http_res_set_header(res, "content-TYPE", "text/html"));
+	NUTS_MATCH(nng_http_res_get_header(res, "Content-Type"), "text/html");
+
+	NUTS_PASS(nng_http_res_del_header(res, "CONTENT-type"));
+	NUTS_NULL(nng_http_res_get_header(res, "Content-Type"));
+	NUTS_FAIL(nng_http_res_del_header(res, "Content-Type"), NNG_ENOENT);
+	nng_http_res_free(res);
+}
+
+void
+test_header_add(void)
+{
+	nng_http_req *req;
+	const char   *v;
+
+	NUTS_PASS(nng_http_req_alloc(&req, NULL));
+	NUTS_PASS(nng_http_req_add_header(req, "Connection", "keep-alive"));
+	v = nng_http_req_get_header(req, "connection");
+	NUTS_PASS(nng_http_req_add_header(req, "CONNECTION", "upgrade"));
+	NUTS_MATCH(nng_http_req_get_header(req, "Connection"),
+	    "keep-alive, upgrade");
+
+	// Earlier values stay valid until the message is reset.
+	NUTS_MATCH(v, "keep-alive");
+	nng_http_req_free(req);
+}
+
+void
+test_header_many(void)
+{
+	nng_http_req *req;
+	char          key[32];
+	char          val[128];
+
+	NUTS_PASS(nng_http_req_alloc(&req, NULL));
+	for (int pass = 0; pass < 3; pass++) {
+		for (int i = 0; i < 200; i++) {
+			(void) snprintf(key, sizeof(key), "X-Header-%d", i);
+			(void) snprintf(val, sizeof(val), "%d-%0*d", pass,
+			    (i % 100) + 1, i);
+			NUTS_PASS(nng_http_req_set_header(req, key, val));
+		}
+		for (int i = 0; i < 200; i++) {
+			(void) snprintf(key, sizeof(key), "x-header-%d", i);
+			(void) snprintf(val, sizeof(val), "%d-%0*d", pass,
+			    (i % 100) + 1, i);
+			NUTS_MATCH(nng_http_req_get_header(req, key), val);
+		}
+		for (int i = 0; i < 200; i += 2) {
+			(void) snprintf(key, sizeof(key), "X-HEADER-%d", i);
+			NUTS_PASS(nng_http_req_del_header(req, key));
+		}
+		for (int i = 0; i < 200; i++) {
+			(void) snprintf(key, sizeof(key), "X-Header-%d", i);
+			if ((i % 2) == 0) {
+				NUTS_NULL(nng_http_req_get_header(req, key));
+			} else {
+				NUTS_ASSERT(
+				    nng_http_req_get_header(req, key) != NULL);
+			}
+		}
+		nni_http_req_reset(req);
+		NUTS_NULL(nng_http_req_get_header(req, "X-Header-1"));
+	}
+	nng_http_req_free(req);
+}
+
+void
+test_header_render(void)
+{
+	nng_http_res *res;
+	char         *buf  = NULL;
+	size_t        sz   = 0;
+	size_t        len  = 0;
+	const char   *want = "HTTP/1.1 404 Not Found\r\n"
+	                     "Content-Type: text/plain\r\n"
+	                     "X-Test: a, b\r\n"
+	                     "\r\n";
+	char         *hdrs;
+
+	NUTS_PASS(nng_http_res_alloc(&res));
+	NUTS_PASS(nng_http_res_set_status(res, NNG_HTTP_STATUS_NOT_FOUND));
+	NUTS_PASS(nng_http_res_set_header(res, "Content-Type", "text/plain"));
+	NUTS_PASS(nng_http_res_add_header(res, "X-Test", "a"));
+	NUTS_PASS(nng_http_res_add_header(res, "X-Test", "b"));
+	NUTS_PASS(nni_http_res_render(res, &buf, &sz, &len));
+	NUTS_TRUE(len == strlen(want));
+	NUTS_MATCH(buf, want);
+
+	// A buffer that is big enough is reused.
+	NUTS_PASS(nng_http_res_del_header(res, "X-Test"));
+	{
+		char *old = buf;
+		NUTS_PASS(nni_http_res_render(res, &buf, &sz, &len));
+		NUTS_TRUE(buf == old);
+	}
+	NUTS_MATCH(buf,
+	    "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\n\r\n");
+	nni_free(buf, sz);
+
+	NUTS_ASSERT((hdrs = nni_http_res_headers(res)) != NULL);
+	NUTS_MATCH(hdrs, "Content-Type: text/plain\r\n");
+	nni_strfree(hdrs);
+	nng_http_res_free(res);
+}
+
+void
+test_header_parse(void)
+{
+	nng_http_req *req;
+	size_t        len;
+	char          msg[] = "GET /index.html HTTP/1.1\r\n"
+	                      "Host: example.com\r\n"
+	                      "Accept: text/html\r\n"
+	                      "accept: text/plain\r\n"
+	                      "X-Empty:\r\n"
+	                      "\r\n";
+
+	NUTS_PASS(nng_http_req_alloc(&req, NULL));
+	// Parsing terminates the lines in place.
+	NUTS_PASS(nni_http_req_parse(req, msg, sizeof(msg) - 1, &len));
+	NUTS_TRUE(len == sizeof(msg) - 1);
+	NUTS_MATCH(nng_http_req_get_uri(req), "/index.html");
+	NUTS_MATCH(nng_http_req_get_header(req, "HOST"), "example.com");
+	NUTS_MATCH(
+	    nng_http_req_get_header(req, "Accept"), "text/html, text/plain");
+	NUTS_MATCH(nng_http_req_get_header(req, "x-empty"), "");
+	nng_http_req_free(req);
+}
+
+NUTS_TESTS = {
+	{ "http header set get", test_header_set_get },
+	{ "http header add", test_header_add },
+	{ "http header many", test_header_many },
+	{ "http header render", test_header_render },
+	{ "http header parse", test_header_parse },
+	{ NULL, NULL },
+};
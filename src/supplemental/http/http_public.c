@@ -1,5 +1,5 @@
 //
-// Copyright 2018 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 //
 // This software is supplied under the terms of the MIT License, a
@@ -425,6 +425,19 @@ nng_http_conn_read_all(nng_http_conn *conn, nng_aio *aio)
 #endif
 }
 
+void
+nng_http_conn_read_body(nng_http_conn *conn, nng_aio *aio)
+{
+#ifdef NNG_SUPP_HTTP
+	nni_http_read_body(conn, aio);
+#else
+	NNI_ARG_UNUSED(conn);
+	if (nni_aio_begin(aio) == 0) {
+		nni_aio_finish_error(aio, NNG_ENOTSUP);
+	}
+#endif
+}
+
 void
 nng_http_conn_write(nng_http_conn *conn, nng_aio *aio)
 {
@@ -589,6 +602,18 @@ nng_http_handler_alloc_static(nng_http_handler **hp, const char *uri,
 #endif
 }
 
+int
+nng_http_handler_alloc_stats(nng_http_handler **hp, const char *uri)
+{
+#ifdef NNG_SUPP_HTTP
+	return (nni_http_handler_init_stats(hp, uri));
+#else
+	NNI_ARG_UNUSED(hp);
+	NNI_ARG_UNUSED(uri);
+	return (NNG_ENOTSUP);
+#endif
+}
+
 int
 nng_http_handler_set_method(nng_http_handler *h, const char *meth)
 {
@@ -615,6 +640,18 @@ nng_http_handler_collect_body(nng_http_handler *h, bool want, size_t len)
 #endif
 }
 
+int
+nng_http_handler_stream_body(nng_http_handler *h, bool stream)
+{
+#ifdef NNG_SUPP_HTTP
+	return (nni_http_handler_stream_body(h, stream));
+#else
+	NNI_ARG_UNUSED(h);
+	NNI_ARG_UNUSED(stream);
+	return (NNG_ENOTSUP);
+#endif
+}
+
 int
 nng_http_handler_set_host(nng_http_handler *h, const char *host)
 {
@@ -649,6 +686,43 @@ nng_http_handler_set_tree_exclusive(nng_http_handler *h)
 #endif
 }
 
+int
+nng_http_handler_set_cache(nng_http_handler *h, size_t maxbytes)
+{
+#ifdef NNG_SUPP_HTTP
+	return (nni_http_handler_set_cache(h, maxbytes));
+#else
+	NNI_ARG_UNUSED(h);
+	NNI_ARG_UNUSED(maxbytes);
+	return (NNG_ENOTSUP);
+#endif
+}
+
+int
+nng_http_handler_set_pipeline(nng_http_handler *h, bool pipeline)
+{
+#ifdef NNG_SUPP_HTTP
+	return (nni_http_handler_set_pipeline(h, pipeline));
+#else
+	NNI_ARG_UNUSED(h);
+	NNI_ARG_UNUSED(pipeline);
+	return (NNG_ENOTSUP);
+#endif
+}
+
+int
+nng_http_handler_set_compress(nng_http_handler *h, bool enable, size_t minsz)
+{
+#ifdef NNG_SUPP_HTTP
+	return (nni_http_handler_set_compress(h, enable, minsz));
+#else
+	NNI_ARG_UNUSED(h);
+	NNI_ARG_UNUSED(enable);
+	NNI_ARG_UNUSED(minsz);
+	return (NNG_ENOTSUP);
+#endif
+}
+
 int
 nng_http_handler_set_data(nng_http_handler *h, void *dat, void (*dtor)(void *))
 {
@@ -892,6 +966,19 @@ nng_http_client_connect(nng_http_client *cli, nng_aio *aio)
 #endif
 }
 
+int
+nng_http_client_set_pool(nng_http_client *cli, int maxidle, nng_duration idle)
+{
+#ifdef NNG_SUPP_HTTP
+	return (nni_http_client_set_pool(cli, maxidle, idle));
+#else
+	NNI_ARG_UNUSED(cli);
+	NNI_ARG_UNUSED(maxidle);
+	NNI_ARG_UNUSED(idle);
+	return (NNG_ENOTSUP);
+#endif
+}
+
 void
 nng_http_client_transact(
     nng_http_client *cli, nng_http_req *req, nng_http_res *res, nng_aio *aio)
@@ -1,5 +1,5 @@
 //
-// Copyright 2023 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 // Copyright 2018 QXSoftware <lh563566994@126.com>
 // Copyright 2019 Devolutions <info@devolutions.net>
@@ -24,6 +24,8 @@
 
 struct nng_http_handler {
 	nni_list_node   node;
+	nni_list_node   rnode; // on http_route handlers
+	uint64_t        order; // position in server handlers list
 	char *          uri;
 	char *          method;
 	char *          host;
@@ -35,28 +37,71 @@ struct nng_http_handler {
 	nni_atomic_bool busy;
 	size_t          maxbody;
 	bool            getbody;
+	bool            stream;   // reads body itself with nni_http_read_body
+	bool            pipeline; // never uses conn, can run concurrently
+	bool            compress; // compress responses if client accepts
+	bool            compress_own; // handler does its own compression
+	size_t          compress_min; // smallest body worth compressing
 	void *          data;
 	nni_cb          dtor;
 	void (*cb)(nni_aio *);
 };
 
-typedef struct http_sconn {
+// Maximum number of requests outstanding on a single connection.
+// Requests beyond this are not read until earlier ones are answered.
+#define HTTP_SERVER_PIPELINE 8
+
+typedef struct http_sconn http_sconn;
+
+// http_sreq is one request on a server connection.  Clients may pipeline
+// requests, and we read ahead and run handlers concurrently for those
+// handlers that promise not to use the connection themselves.  Responses
+// are always written in the order the requests arrived.
+typedef struct http_sreq {
 	nni_list_node     node;
-	nni_http_conn *   conn;
-	nni_http_server * server;
+	http_sconn *      sc;
 	nni_http_req *    req;
 	nni_http_res *    res;
-	nni_http_handler *handler; // set if we deferred to read body
-	nni_http_handler *release; // set if we dispatched handler
-	bool              close;
-	bool              closed;
-	bool              finished;
+	nni_http_handler *handler; // reference held until handler is done
 	nni_aio *         cbaio;
-	nni_aio *         rxaio;
-	nni_aio *         txaio;
-	nni_aio *         txdataio;
-	nni_reap_node     reap;
-} http_sconn;
+	bool              running; // handler has been called
+	bool              ready;   // handler done, res (if any) can be sent
+	bool              close;   // close connection after responding
+	bool              pipe;    // ok to read further requests
+} http_sreq;
+
+struct http_sconn {
+	nni_list_node    node;
+	nni_http_conn *  conn;
+	nni_http_server *server;
+	nni_mtx          mtx;
+	nni_list         reqs;     // outstanding requests, in order
+	nni_list         idle;     // requests available for reuse
+	int              nreqs;    // number of requests on reqs list
+	http_sreq *      rxreq;    // request being read, also on reqs
+	http_sreq *      txreq;    // request being answered, head of reqs
+	bool             close;    // close requested, do so when unlocked
+	bool             rxclosed; // no further requests can be read
+	bool             closed;
+	bool             finished;
+	nni_aio *        rxaio;
+	nni_aio *        txaio;
+	nni_reap_node    reap;
+};
+
+// http_route collects the handlers registered for one exact URI, in the
+// order they were added.  Routes are found by a hash of the URI, and
+// routes with colliding hashes are chained.
+typedef struct http_route {
+	struct http_route *next;
+	char *             uri;
+	uint64_t           hash;
+	nni_list           handlers;
+} http_route;
+
+// Requests with no more than this many path segments are routed without
+// allocating.
+#define HTTP_ROUTE_SEGS 16
 
 typedef struct http_error {
 	nni_list_node node;
@@ -71,6 +116,8 @@ struct nng_http_server {
 	int                  refcnt;
 	int                  starts;
 	nni_list             handlers;
+	nni_id_map           routes; // http_route by hash of URI
+	nni_rwlock           routes_lk;
 	nni_list             conns;
 	nni_mtx              mtx;
 	bool                 closed;
@@ -120,12 +167,18 @@ nni_http_handler_init(
 		return (NNG_ENOMEM);
 	}
 	NNI_LIST_NODE_INIT(&h->node);
+	NNI_LIST_NODE_INIT(&h->rnode);
 	h->cb             = cb;
 	h->data           = NULL;
 	h->dtor           = NULL;
 	h->host           = NULL;
 	h->tree           = false;
 	h->tree_exclusive = false;
+	h->pipeline       = false;
+	h->stream         = false;
+	h->compress       = false;
+	h->compress_own   = false;
+	h->compress_min   = 0;
 	h->maxbody = 1024 * 1024; // By default we accept up to 1MB of body
 	h->getbody = true;
 	*hp        = h;
@@ -156,6 +209,16 @@ nni_http_handler_collect_body(nni_http_handler *h, bool want, size_t maxbody)
 	h->maxbody = maxbody;
 }
 
+int
+nni_http_handler_stream_body(nni_http_handler *h, bool stream)
+{
+	if (nni_atomic_get_bool(&h->busy) != 0) {
+		return (NNG_EBUSY);
+	}
+	h->stream = stream;
+	return (0);
+}
+
 int
 nni_http_handler_set_data(nni_http_handler *h, void *data, nni_cb dtor)
 {
@@ -204,6 +267,32 @@ nni_http_handler_set_tree_exclusive(nni_http_handler *h)
 	return (0);
 }
 
+int
+nni_http_handler_set_pipeline(nni_http_handler *h, bool pipeline)
+{
+	if (nni_atomic_get_bool(&h->busy) != 0) {
+		return (NNG_EBUSY);
+	}
+	h->pipeline = pipeline;
+	return (0);
+}
+
+int
+nni_http_handler_set_compress(nni_http_handler *h, bool enable, size_t minsz)
+{
+#ifndef NNG_HAVE_ZLIB
+	if (enable) {
+		return (NNG_ENOTSUP);
+	}
+#endif
+	if (nni_atomic_get_bool(&h->busy) != 0) {
+		return (NNG_EBUSY);
+	}
+	h->compress     = enable;
+	h->compress_min = minsz;
+	return (0);
+}
+
 int
 nni_http_handler_set_host(nni_http_handler *h, const char *host)
 {
@@ -274,27 +363,49 @@ static nni_list http_servers =
     NNI_LIST_INITIALIZER(http_servers, nni_http_server, node);
 static nni_mtx http_servers_lk = NNI_MTX_INITIALIZER;
 
+static void
+http_sreq_free(http_sreq *sr)
+{
+	nni_aio_free(sr->cbaio);
+	nni_http_req_free(sr->req);
+	nni_http_res_free(sr->res);
+	if (sr->handler != NULL) {
+		nni_http_handler_fini(sr->handler);
+	}
+	NNI_FREE_STRUCT(sr);
+}
+
 static void
 http_sc_reap(void *arg)
 {
 	http_sconn *     sc = arg;
 	nni_http_server *s  = sc->server;
+	http_sreq *      sr;
+
 	NNI_ASSERT(!sc->finished);
 	sc->finished = true;
 	nni_aio_stop(sc->rxaio);
 	nni_aio_stop(sc->txaio);
-	nni_aio_stop(sc->txdataio);
-	nni_aio_stop(sc->cbaio);
+	NNI_LIST_FOREACH (&sc->reqs, sr) {
+		nni_aio_stop(sr->cbaio);
+	}
+	NNI_LIST_FOREACH (&sc->idle, sr) {
+		nni_aio_stop(sr->cbaio);
+	}
 
 	if (sc->conn != NULL) {
 		nni_http_conn_fini(sc->conn);
 	}
-	nni_http_req_free(sc->req);
-	nni_http_res_free(sc->res);
+	while ((sr = nni_list_first(&sc->reqs)) != NULL) {
+		nni_list_remove(&sc->reqs, sr);
+		http_sreq_free(sr);
+	}
+	while ((sr = nni_list_first(&sc->idle)) != NULL) {
+		nni_list_remove(&sc->idle, sr);
+		http_sreq_free(sr);
+	}
 	nni_aio_free(sc->rxaio);
 	nni_aio_free(sc->txaio);
-	nni_aio_free(sc->txdataio);
-	nni_aio_free(sc->cbaio);
 
 	// Now it is safe to release our reference on the server.
 	nni_mtx_lock(&s->mtx);
@@ -306,6 +417,7 @@ http_sc_reap(void *arg)
 	}
 	nni_mtx_unlock(&s->mtx);
 
+	nni_mtx_fini(&sc->mtx);
 	NNI_FREE_STRUCT(sc);
 }
 
@@ -313,8 +425,11 @@ static void
 http_sc_close_locked(http_sconn *sc)
 {
 	nni_http_conn *conn;
+	http_sreq *    sr;
 
+	nni_mtx_lock(&sc->mtx);
 	if (sc->closed) {
+		nni_mtx_unlock(&sc->mtx);
 		return;
 	}
 	NNI_ASSERT(!sc->finished);
@@ -322,10 +437,13 @@ http_sc_close_locked(http_sconn *sc)
 	sc->closed = true;
 	nni_aio_close(sc->rxaio);
 	nni_aio_close(sc->txaio);
-	nni_aio_close(sc->txdataio);
-	nni_aio_close(sc->cbaio);
+	NNI_LIST_FOREACH (&sc->reqs, sr) {
+		nni_aio_close(sr->cbaio);
+	}
+	conn = sc->conn;
+	nni_mtx_unlock(&sc->mtx);
 
-	if ((conn = sc->conn) != NULL) {
+	if (conn != NULL) {
 		nni_http_conn_close(conn);
 	}
 	nni_reap(&http_sc_reap_list, sc);
@@ -342,28 +460,135 @@ http_sconn_close(http_sconn *sc)
 	nni_mtx_unlock(&s->mtx);
 }
 
+static void http_sreq_cbdone(void *);
+
+// http_sconn_rx_start begins reading the next request, if we can.  We
+// only read ahead of outstanding requests when the last one allows it,
+// and only up to our limit.
 static void
-http_sconn_txdatdone(void *arg)
+http_sconn_rx_start(http_sconn *sc)
 {
-	http_sconn *sc  = arg;
-	nni_aio *   aio = sc->txdataio;
+	http_sreq *sr;
 
-	if (nni_aio_result(aio) != 0) {
-		http_sconn_close(sc);
+	if ((sc->closed) || (sc->close) || (sc->rxclosed) ||
+	    (sc->rxreq != NULL) || (sc->nreqs >= HTTP_SERVER_PIPELINE)) {
+		return;
+	}
+	if (((sr = nni_list_last(&sc->reqs)) != NULL) && (!sr->pipe)) {
 		return;
 	}
+	if ((sr = nni_list_first(&sc->idle)) != NULL) {
+		nni_list_remove(&sc->idle, sr);
+	} else {
+		if ((sr = NNI_ALLOC_STRUCT(sr)) == NULL) {
+			// Try again when an outstanding request completes,
+			// or give up if there are none.
+			sc->close = (sc->nreqs == 0);
+			return;
+		}
+		sr->sc = sc;
+		if ((nni_http_req_alloc(&sr->req, NULL) != 0) ||
+		    (nni_aio_alloc(&sr->cbaio, http_sreq_cbdone, sr) != 0)) {
+			http_sreq_free(sr);
+			sc->close = (sc->nreqs == 0);
+			return;
+		}
+	}
+	nni_list_append(&sc->reqs, sr);
+	sc->nreqs++;
+	sc->rxreq = sr;
+	nni_http_read_req(sc->conn, sr->req, sc->rxaio);
+}
+
+// http_sreq_retire is called when we are done with the request at the
+// head of the list.  It is kept for reuse by a later request.
+static void
+http_sreq_retire(http_sconn *sc, http_sreq *sr)
+{
+	nni_list_remove(&sc->reqs, sr);
+	sc->nreqs--;
+	nni_http_res_free(sr->res);
+	nni_http_req_reset(sr->req);
+	sr->res     = NULL;
+	sr->running = false;
+	sr->ready   = false;
+	sr->close   = false;
+	sr->pipe    = false;
+	nni_list_prepend(&sc->idle, sr);
+}
+
+// http_sconn_tx_start sends the response for the request at the head of
+// the list, if it is ready.  Requests whose handlers sent the response
+// themselves are retired without sending anything.
+static void
+http_sconn_tx_start(http_sconn *sc)
+{
+	http_sreq *sr;
+
+	while ((!sc->closed) && (!sc->close) && (sc->txreq == NULL) &&
+	    ((sr = nni_list_first(&sc->reqs)) != NULL) && (sr->ready)) {
+		if (sr->res != NULL) {
+			sc->txreq = sr;
+			nni_http_write_res(sc->conn, sr->res, sc->txaio);
+			return;
+		}
+		if (sr->close) {
+			sc->close = true;
+			return;
+		}
+		http_sreq_retire(sc, sr);
+	}
+}
 
-	nni_http_res_free(sc->res);
-	sc->res = NULL;
+// http_sconn_unlock advances the connection state machine, drops the
+// lock, and then does those things that cannot be done with the lock
+// held: closing the connection, or running handlers.
+static void
+http_sconn_unlock(http_sconn *sc)
+{
+	http_sreq *run[HTTP_SERVER_PIPELINE];
+	int        nrun = 0;
+	bool       close;
+	http_sreq *sr;
+
+	http_sconn_tx_start(sc);
+	http_sconn_rx_start(sc);
+	NNI_LIST_FOREACH (&sc->reqs, sr) {
+		// Handlers that might use the connection themselves
+		// are only run once all earlier responses are sent.
+		if ((sr->handler == NULL) || (sr->running) ||
+		    (sr == sc->rxreq)) {
+			continue;
+		}
+		if ((!sr->handler->pipeline) &&
+		    (sr != nni_list_first(&sc->reqs))) {
+			continue;
+		}
+		sr->running = true;
+		run[nrun++] = sr;
+	}
+	if ((sc->rxclosed) && (sc->nreqs == 0)) {
+		sc->close = true;
+	}
+	close = sc->close || sc->closed;
+	nni_mtx_unlock(&sc->mtx);
 
-	if (sc->close) {
+	if (close) {
 		http_sconn_close(sc);
 		return;
 	}
+	for (int i = 0; i < nrun; i++) {
+		sr = run[i];
+		nni_aio_set_input(sr->cbaio, 0, sr->req);
+		nni_aio_set_input(sr->cbaio, 1, sr->handler);
+		nni_aio_set_input(sr->cbaio, 2, sc->conn);
 
-	sc->handler = NULL;
-	nni_http_req_reset(sc->req);
-	nni_http_read_req(sc->conn, sc->req, sc->rxaio);
+		// Documented that we call this on behalf of the callback.
+		if (nni_aio_begin(sr->cbaio) != 0) {
+			continue;
+		}
+		sr->handler->cb(sr->cbaio);
+	}
 }
 
 static void
@@ -371,22 +596,17 @@ http_sconn_txdone(void *arg)
 {
 	http_sconn *sc  = arg;
 	nni_aio *   aio = sc->txaio;
+	http_sreq * sr;
 
-	if (nni_aio_result(aio) != 0) {
-		http_sconn_close(sc);
-		return;
-	}
-
-	if (sc->close) {
-		http_sconn_close(sc);
-		return;
+	nni_mtx_lock(&sc->mtx);
+	sr        = sc->txreq;
+	sc->txreq = NULL;
+	if ((nni_aio_result(aio) != 0) || (sr->close)) {
+		sc->close = true;
+	} else {
+		http_sreq_retire(sc, sr);
 	}
-
-	nni_http_res_free(sc->res);
-	sc->res     = NULL;
-	sc->handler = NULL;
-	nni_http_req_reset(sc->req);
-	nni_http_read_req(sc->conn, sc->req, sc->rxaio);
+	http_sconn_unlock(sc);
 }
 
 static char
@@ -466,31 +686,36 @@ http_uri_canonify(char *path)
 	return ((strlen(path) != 0) ? path : "/");
 }
 
+// http_sreq_error answers the request with an error.  The caller holds
+// the connection lock.
 static void
-http_sconn_error(http_sconn *sc, uint16_t err)
+http_sreq_error(http_sreq *sr, uint16_t err)
 {
+	http_sconn *  sc = sr->sc;
 	nni_http_res *res;
 
+	sc->rxreq = NULL;
+	sr->pipe  = !sr->close;
 	if (nni_http_res_alloc(&res) != 0) {
-		http_sconn_close(sc);
+		sc->close = true;
 		return;
 	}
 	nni_http_res_set_status(res, err);
 	if (nni_http_server_res_error(sc->server, res) != 0) {
 		nni_http_res_free(res);
-		http_sconn_close(sc);
+		sc->close = true;
 		return;
 	}
 
-	if (sc->close) {
+	if (sr->close) {
 		if (nni_http_res_set_header(res, "Connection", "close") != 0) {
 			nni_http_res_free(res);
-			http_sconn_close(sc);
+			sc->close = true;
 			return;
 		}
 	}
-	sc->res = res;
-	nni_http_write_res(sc->conn, res, sc->txaio);
+	sr->res   = res;
+	sr->ready = true;
 }
 
 int
@@ -500,13 +725,18 @@ nni_http_hijack(nni_http_conn *conn)
 
 	sc = nni_http_conn_get_ctx(conn);
 	if (sc != NULL) {
-		nni_http_server *s = sc->server;
+		http_sreq *sr;
 		nni_http_conn_set_ctx(conn, NULL);
 
-		nni_mtx_lock(&s->mtx);
+		// Only a handler that is the sole outstanding request
+		// can be running with the connection, so the request
+		// being taken over is at the head of the list.
+		nni_mtx_lock(&sc->mtx);
 		sc->conn = NULL;
-		sc->req  = NULL;
-		nni_mtx_unlock(&s->mtx);
+		if ((sr = nni_list_first(&sc->reqs)) != NULL) {
+			sr->req = NULL;
+		}
+		nni_mtx_unlock(&sc->mtx);
 	}
 	return (0);
 }
@@ -569,32 +799,268 @@ http_handler_host_match(nni_http_handler *h, const char *host)
 	return (true);
 }
 
+#define HTTP_ROUTE_HASH_INIT 14695981039346656037ull
+#define HTTP_ROUTE_HASH_PRIME 1099511628211ull
+
+// http_route_hash is FNV-1a, which lets us hash every prefix of a path
+// in a single pass.
+static uint64_t
+http_route_hash(uint64_t hash, const char *s, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		hash ^= (uint8_t) s[i];
+		hash *= HTTP_ROUTE_HASH_PRIME;
+	}
+	return (hash);
+}
+
+static http_route *
+http_route_find(nni_http_server *s, uint64_t hash, const char *uri, size_t len)
+{
+	http_route *r;
+
+	for (r = nni_id_get(&s->routes, hash); r != NULL; r = r->next) {
+		if ((strncmp(r->uri, uri, len) == 0) && (r->uri[len] == '\0')) {
+			break;
+		}
+	}
+	return (r);
+}
+
+// http_route_add adds the handler to the route for its URI, creating
+// the route if needed.  Called with the routes lock held for writing.
+static int
+http_route_add(nni_http_server *s, nni_http_handler *h)
+{
+	size_t      len  = strlen(h->uri);
+	uint64_t    hash = http_route_hash(HTTP_ROUTE_HASH_INIT, h->uri, len);
+	http_route *r;
+	http_route *head;
+	int         rv;
+
+	if ((r = http_route_find(s, hash, h->uri, len)) == NULL) {
+		if ((r = NNI_ALLOC_STRUCT(r)) == NULL) {
+			return (NNG_ENOMEM);
+		}
+		if ((r->uri = nni_strdup(h->uri)) == NULL) {
+			NNI_FREE_STRUCT(r);
+			return (NNG_ENOMEM);
+		}
+		r->hash = hash;
+		NNI_LIST_INIT(&r->handlers, nni_http_handler, rnode);
+		head    = nni_id_get(&s->routes, hash);
+		r->next = head;
+		if ((rv = nni_id_set(&s->routes, hash, r)) != 0) {
+			nni_strfree(r->uri);
+			NNI_FREE_STRUCT(r);
+			return (rv);
+		}
+	}
+	nni_list_append(&r->handlers, h);
+	return (0);
+}
+
+// http_route_remove removes the handler from its route, discarding the
+// route once it is empty.  Called with the routes lock held for writing.
+static void
+http_route_remove(nni_http_server *s, nni_http_handler *h)
+{
+	size_t      len  = strlen(h->uri);
+	uint64_t    hash = http_route_hash(HTTP_ROUTE_HASH_INIT, h->uri, len);
+	http_route *r;
+	http_route *prev;
+
+	if ((r = http_route_find(s, hash, h->uri, len)) == NULL) {
+		return;
+	}
+	nni_list_remove(&r->handlers, h);
+	if (!nni_list_empty(&r->handlers)) {
+		return;
+	}
+	if ((prev = nni_id_get(&s->routes, hash)) == r) {
+		if (r->next != NULL) {
+			(void) nni_id_set(&s->routes, hash, r->next);
+		} else {
+			(void) nni_id_remove(&s->routes, hash);
+		}
+	} else {
+		while (prev->next != r) {
+			prev = prev->next;
+		}
+		prev->next = r->next;
+	}
+	nni_strfree(r->uri);
+	NNI_FREE_STRUCT(r);
+}
+
+// http_route_renumber records the position of each handler in the list
+// of handlers, which is the order of precedence when matching requests.
+// Called with the routes lock held for writing.
+static void
+http_route_renumber(nni_http_server *s)
+{
+	nni_http_handler *h;
+	uint64_t          order = 0;
+
+	NNI_LIST_FOREACH (&s->handlers, h) {
+		h->order = order++;
+	}
+}
+
+// http_route_match checks the handlers registered for one prefix of the
+// request path.  The best match is the one earliest in the list of
+// handlers, and failing that, the latest GET handler is used for HEAD.
+static void
+http_route_match(http_route *r, const char *path, size_t len,
+    const char *host, const char *method, nni_http_handler **best,
+    nni_http_handler **head, bool *badmeth)
+{
+	nni_http_handler *h;
+
+	NNI_LIST_FOREACH (&r->handlers, h) {
+		if ((*best != NULL) && ((*best)->order < h->order)) {
+			continue; // Lower precedence than what we have.
+		}
+		if ((path[len] == '/') && (path[len + 1] != '\0') &&
+		    (!h->tree)) {
+			// Trailing component and not a directory.
+			continue;
+		}
+		if (!http_handler_host_match(h, host)) {
+			continue;
+		}
+		if ((h->method == NULL) || (h->method[0] == '\0') ||
+		    (strcmp(method, h->method) == 0)) {
+			// Handler wants to process *all* methods, or this one.
+			*best = h;
+			continue;
+		}
+		// HEAD is remapped to GET, but only if no HEAD specific
+		// handler registered.
+		if ((strcmp(method, "HEAD") == 0) &&
+		    (strcmp(h->method, "GET") == 0)) {
+			if ((*head == NULL) || ((*head)->order < h->order)) {
+				*head = h;
+			}
+			continue;
+		}
+		*badmeth = true;
+	}
+}
+
+// nni_http_server_lookup finds the handler for a request.  The only
+// handlers that can match are those registered for a prefix of the path
+// that ends at a path separator, so we look those up directly rather than
+// considering every handler.  This runs under the routes lock, which is
+// only held exclusively when handlers are added or removed.
+int
+nni_http_server_lookup(nni_http_server *s, const char *host,
+    const char *method, const char *path, nni_http_handler **hp)
+{
+	struct {
+		size_t   len;
+		uint64_t hash;
+	} stack[HTTP_ROUTE_SEGS], *segs;
+	size_t            nsegs;
+	size_t            i;
+	uint64_t          hash;
+	nni_http_handler *best    = NULL;
+	nni_http_handler *head    = NULL;
+	bool              badmeth = false;
+
+	nsegs = 1;
+	for (i = 0; path[i] != '\0'; i++) {
+		if (path[i] == '/') {
+			nsegs++;
+		}
+	}
+	if (nsegs <= HTTP_ROUTE_SEGS) {
+		segs = stack;
+	} else if ((segs = nni_alloc(nsegs * sizeof(*segs))) == NULL) {
+		return (NNG_ENOMEM);
+	}
+
+	hash  = HTTP_ROUTE_HASH_INIT;
+	nsegs = 0;
+	for (i = 0;; i++) {
+		if ((path[i] == '/') || (path[i] == '\0')) {
+			segs[nsegs].len  = i;
+			segs[nsegs].hash = hash;
+			nsegs++;
+		}
+		if (path[i] == '\0') {
+			break;
+		}
+		hash = http_route_hash(hash, &path[i], 1);
+	}
+
+	nni_rwlock_rdlock(&s->routes_lk);
+	for (i = 0; i < nsegs; i++) {
+		http_route *r;
+		if ((r = http_route_find(
+		         s, segs[i].hash, path, segs[i].len)) != NULL) {
+			http_route_match(r, path, segs[i].len, host, method,
+			    &best, &head, &badmeth);
+		}
+	}
+	if (best == NULL) {
+		best = head;
+	}
+	if (best != NULL) {
+		// The caller gets a reference, as the handler might be
+		// removed from the server while it is still in use.
+		nni_atomic_inc64(&best->ref);
+	}
+	nni_rwlock_unlock(&s->routes_lk);
+
+	if (segs != stack) {
+		nni_free(segs, (nsegs) * sizeof(*segs));
+	}
+	if (best == NULL) {
+		return (badmeth ? NNG_ENOTSUP : NNG_ENOENT);
+	}
+	*hp = best;
+	return (0);
+}
+
 static void
 http_sconn_rxdone(void *arg)
 {
 	http_sconn *      sc  = arg;
-	nni_http_server * s   = sc->server;
 	nni_aio *         aio = sc->rxaio;
-	int               rv;
-	nni_http_handler *h    = NULL;
-	nni_http_handler *head = NULL;
+	http_sreq *       sr;
+	nni_http_handler *h = NULL;
 	const char *      val;
-	nni_http_req *    req = sc->req;
+	nni_http_req *    req;
 	char *            uri;
 	size_t            urisz;
 	char *            path;
-	bool              badmeth  = false;
 	bool              needhost = false;
+	bool              pipe     = true;
 	const char *      host;
 	const char *      cls;
+	int               rv;
 
-	if ((rv = nni_aio_result(aio)) != 0) {
-		http_sconn_close(sc);
+	nni_mtx_lock(&sc->mtx);
+	sr  = sc->rxreq;
+	req = sr->req;
+
+	if (nni_aio_result(aio) != 0) {
+		// No more requests can be read, but we still answer any
+		// that we already have before closing.
+		if ((h = sr->handler) != NULL) {
+			sr->handler = NULL;
+			nni_http_handler_fini(h);
+		}
+		sc->rxreq    = NULL;
+		sc->rxclosed = true;
+		http_sreq_retire(sc, sr);
+		http_sconn_unlock(sc);
 		return;
 	}
 
-	if ((h = sc->handler) != NULL) {
-		nni_mtx_lock(&s->mtx);
+	if ((h = sr->handler) != NULL) {
+		// We were reading the body for the handler.
 		goto finish;
 	}
 
@@ -602,19 +1068,21 @@ http_sconn_rxdone(void *arg)
 	// 1.x.  We flatly refuse to deal with HTTP 0.9, and we can't
 	// cope with HTTP/2.
 	if ((val = nni_http_req_get_version(req)) == NULL) {
-		sc->close = true;
-		http_sconn_error(sc, NNG_HTTP_STATUS_BAD_REQUEST);
+		sr->close = true;
+		http_sreq_error(sr, NNG_HTTP_STATUS_BAD_REQUEST);
+		http_sconn_unlock(sc);
 		return;
 	}
 	if (strncmp(val, "HTTP/1.", 7) != 0) {
-		sc->close = true;
-		http_sconn_error(sc, NNG_HTTP_STATUS_HTTP_VERSION_NOT_SUPP);
+		sr->close = true;
+		http_sreq_error(sr, NNG_HTTP_STATUS_HTTP_VERSION_NOT_SUPP);
+		http_sconn_unlock(sc);
 		return;
 	}
 	if (strcmp(val, "HTTP/1.1") != 0) {
 		// We treat HTTP/1.0 connections as non-persistent.
 		// No effort is made for non-standard "persistent" HTTP/1.0.
-		sc->close = true;
+		sr->close = true;
 	} else {
 		needhost = true;
 	}
@@ -629,14 +1097,15 @@ http_sconn_rxdone(void *arg)
 			// values are defined, so anyone who does that gets
 			// what they deserve. (Harmless actually, since it only
 			// prevents persistent connections.)
-			sc->close = true;
+			sr->close = true;
 		}
 	}
 
 	val   = nni_http_req_get_uri(req);
 	urisz = strlen(val) + 1;
 	if ((uri = nni_alloc(urisz)) == NULL) {
-		http_sconn_close(sc); // out of memory
+		sc->close = true; // out of memory
+		http_sconn_unlock(sc);
 		return;
 	}
 	strncpy(uri, val, urisz);
@@ -645,165 +1114,254 @@ http_sconn_rxdone(void *arg)
 	host = nni_http_req_get_header(req, "Host");
 	if ((host == NULL) && (needhost)) {
 		// Per RFC 2616 14.23 we have to send 400 status here.
-		http_sconn_error(sc, NNG_HTTP_STATUS_BAD_REQUEST);
+		http_sreq_error(sr, NNG_HTTP_STATUS_BAD_REQUEST);
 		nni_free(uri, urisz);
+		http_sconn_unlock(sc);
 		return;
 	}
 
-	nni_mtx_lock(&s->mtx);
-	NNI_LIST_FOREACH (&s->handlers, h) {
-		size_t len;
+	rv = nni_http_server_lookup(
+	    sc->server, host, nni_http_req_get_method(req), path, &h);
+	nni_free(uri, urisz);
+	switch (rv) {
+	case 0:
+		break;
+	case NNG_ENOENT:
+		http_sreq_error(sr, NNG_HTTP_STATUS_NOT_FOUND);
+		http_sconn_unlock(sc);
+		return;
+	case NNG_ENOTSUP:
+		http_sreq_error(sr, NNG_HTTP_STATUS_METHOD_NOT_ALLOWED);
+		http_sconn_unlock(sc);
+		return;
+	default:
+		sc->close = true; // out of memory
+		http_sconn_unlock(sc);
+		return;
+	}
 
-		if (!http_handler_host_match(h, host)) {
-			continue;
-		}
+	cls = nni_http_req_get_header(req, "Content-Length");
+	if (h->stream) {
+		uint16_t status = 0;
+		uint64_t len    = 0;
+		char *   end;
 
-		len = strlen(h->uri);
-		if (strncmp(path, h->uri, len) != 0) {
-			continue;
-		}
-		switch (path[len]) {
-		case '\0':
-			break;
-		case '/':
-			if ((path[len + 1] != '\0') && (!h->tree)) {
-				// Trailing component and not a directory.
-				continue;
+		// The handler reads the body as it arrives, so we only
+		// need to know how it is delimited.
+		if ((val = nni_http_req_get_header(
+		         req, "Transfer-Encoding")) != NULL) {
+			if (nni_strcasestr(val, "chunked") == NULL) {
+				status = NNG_HTTP_STATUS_NOT_IMPLEMENTED;
+			}
+		} else if (cls != NULL) {
+			// strtoull would accept leading white space and
+			// a minus sign, neither of which is legal here.
+			len = strtoull(cls, &end, 10);
+			if ((!isdigit((unsigned char) *cls)) || (end == NULL) ||
+			    (*end != '\0')) {
+				status = NNG_HTTP_STATUS_BAD_REQUEST;
 			}
-			break;
-		default:
-			continue; // Some other substring, not matched.
-		}
-
-		if ((h->method == NULL) || (h->method[0] == '\0')) {
-			// Handler wants to process *all* methods.
-			break;
-		}
-		// So, what about the method?
-		val = nni_http_req_get_method(req);
-		if (strcmp(val, h->method) == 0) {
-			break;
 		}
-		// HEAD is remapped to GET, but only if no HEAD specific
-		// handler registered.
-		if ((strcmp(val, "HEAD") == 0) &&
-		    (strcmp(h->method, "GET") == 0)) {
-			head = h;
-			continue;
+		if ((status == 0) &&
+		    (nni_http_conn_set_body(sc->conn, val != NULL, len) != 0)) {
+			status = NNG_HTTP_STATUS_INTERNAL_SERVER_ERROR;
 		}
-		badmeth = 1;
-	}
-
-	if ((h == NULL) && (head != NULL)) {
-		h = head;
-	}
-	nni_free(uri, urisz);
-	if (h == NULL) {
-		nni_mtx_unlock(&s->mtx);
-		if (badmeth) {
-			http_sconn_error(
-			    sc, NNG_HTTP_STATUS_METHOD_NOT_ALLOWED);
-		} else {
-			http_sconn_error(sc, NNG_HTTP_STATUS_NOT_FOUND);
+		if (status != 0) {
+			// We cannot find the end of the body, so we cannot
+			// read any further requests either.
+			nni_http_handler_fini(h);
+			sr->close = true;
+			http_sreq_error(sr, status);
+			http_sconn_unlock(sc);
+			return;
 		}
-		return;
-	}
-
-	if ((h->getbody) &&
-	    ((cls = nni_http_req_get_header(req, "Content-Length")) != NULL)) {
+		pipe = nni_http_conn_body_done(sc->conn);
+	} else if ((h->getbody) && (cls != NULL)) {
 		uint64_t len;
 		char *   end;
 
 		len = strtoull(cls, &end, 10);
 		if ((end == NULL) || (*end != '\0') || (len > h->maxbody)) {
-			nni_mtx_unlock(&s->mtx);
-			http_sconn_error(sc, NNG_HTTP_STATUS_BAD_REQUEST);
+			nni_http_handler_fini(h);
+			http_sreq_error(sr, NNG_HTTP_STATUS_BAD_REQUEST);
+			http_sconn_unlock(sc);
 			return;
 		}
 		if (len > 0) {
 			nng_iov iov;
 			if ((nni_http_req_alloc_data(req, (size_t) len)) !=
 			    0) {
-				nni_mtx_unlock(&s->mtx);
-				http_sconn_error(
-				    sc, NNG_HTTP_STATUS_INTERNAL_SERVER_ERROR);
+				nni_http_handler_fini(h);
+				http_sreq_error(
+				    sr, NNG_HTTP_STATUS_INTERNAL_SERVER_ERROR);
+				http_sconn_unlock(sc);
 				return;
 			}
 			nng_http_req_get_data(req, &iov.iov_buf, &iov.iov_len);
-			sc->handler = h;
-			nni_mtx_unlock(&s->mtx);
+			sr->handler = h;
 			nni_aio_set_iov(sc->rxaio, 1, &iov);
 			nni_http_read_full(sc->conn, aio);
+			nni_mtx_unlock(&sc->mtx);
 			return;
 		}
+	} else if ((cls != NULL) ||
+	    (nni_http_req_get_header(req, "Transfer-Encoding") != NULL)) {
+		// The body is left for the handler, so we cannot tell
+		// where any following request begins.
+		pipe = false;
 	}
 
 finish:
-	sc->release = h;
-	sc->handler = NULL;
-	nni_aio_set_input(sc->cbaio, 0, sc->req);
-	nni_aio_set_input(sc->cbaio, 1, h);
-	nni_aio_set_input(sc->cbaio, 2, sc->conn);
-
-	// Set a reference -- this because the callback may be running
-	// asynchronously even after it gets removed from the server.
-	nni_atomic_inc64(&h->ref);
-
-	// Documented that we call this on behalf of the callback.
-	if (nni_aio_begin(sc->cbaio) != 0) {
-		nni_mtx_unlock(&s->mtx);
-		return;
-	}
+	// We hold a reference on the handler from the lookup, because
+	// the callback may be running asynchronously even after it gets
+	// removed from the server.  It is dropped when the callback is done.
+	sr->handler = h;
+	sr->pipe    = pipe && h->pipeline && !sr->close;
+	sc->rxreq   = NULL;
+	http_sconn_unlock(sc);
+}
 
-	nni_mtx_unlock(&s->mtx);
-	h->cb(sc->cbaio);
+// http_compress_enc chooses the encoding for a response to the request
+// with a body of the given size.  The vary flag is set if the response
+// is a candidate for compression at all, as then caches must know that
+// it depends on Accept-Encoding.
+static nni_http_enc
+http_compress_enc(
+    nni_http_handler *h, nni_http_req *req, size_t size, bool *vary)
+{
+	*vary = false;
+	if ((!h->compress) || (size == 0) || (size < h->compress_min) ||
+	    (nni_http_req_get_header(req, "Range") != NULL)) {
+		return (NNI_HTTP_ENC_IDENTITY);
+	}
+	*vary = true;
+	return (nni_http_accept_encoding(
+	    nni_http_req_get_header(req, "Accept-Encoding")));
 }
 
+// http_etag_variant makes the entity tag for an encoded variant, as it
+// must differ from that of the original.
 static void
-http_sconn_cbdone(void *arg)
+http_etag_variant(const char *etag, nni_http_enc enc, char *buf, size_t sz)
 {
-	http_sconn *      sc  = arg;
-	nni_aio *         aio = sc->cbaio;
-	nni_http_res *    res;
-	nni_http_handler *h;
-	nni_http_server * s = sc->server;
+	size_t len = strlen(etag);
 
-	// Get the handler.  It may be set regardless of success or
-	// failure.  Clear it, and drop our reference, since we're
-	// done with the handler for now.
-	if ((h = sc->release) != NULL) {
-		sc->release = NULL;
-		nni_http_handler_fini(h);
+	if ((len < 2) || (etag[len - 1] != '"')) {
+		(void) snprintf(buf, sz, "%s", etag);
+		return;
 	}
+	(void) snprintf(buf, sz, "%.*s-%s\"", (int) (len - 1), etag,
+	    nni_http_enc_name(enc));
+}
 
-	if (nni_aio_result(aio) != 0) {
-		// Hard close, no further feedback.
-		http_sconn_close(sc);
-		return;
+// http_res_compress compresses the response in place, if the handler and
+// the client both want that.  Failure to compress just means the response
+// is sent as it is, but an error is returned if we damaged the response.
+static int
+http_res_compress(nni_http_handler *h, nni_http_req *req, nni_http_res *res)
+{
+	void *       data;
+	size_t       size;
+	void *       z;
+	size_t       zsize;
+	nni_http_enc enc;
+	bool         vary;
+	const char * etag;
+	char         buf[64];
+	int          rv;
+
+	if ((nni_http_res_get_status(res) != NNG_HTTP_STATUS_OK) ||
+	    (nni_http_res_get_header(res, "Content-Encoding") != NULL)) {
+		return (0);
+	}
+	nni_http_res_get_data(res, &data, &size);
+	enc = http_compress_enc(h, req, size, &vary);
+	if ((vary) &&
+	    ((rv = nni_http_res_set_header(res, "Vary", "Accept-Encoding")) !=
+	        0)) {
+		return (rv);
+	}
+	if ((enc == NNI_HTTP_ENC_IDENTITY) ||
+	    (nni_http_compress(enc, data, size, &z, &zsize) != 0)) {
+		return (0);
+	}
+	if (zsize >= size) {
+		nni_free(z, zsize);
+		return (0);
 	}
+	if ((etag = nni_http_res_get_header(res, "ETag")) != NULL) {
+		http_etag_variant(etag, enc, buf, sizeof(buf));
+		etag = buf;
+	}
+	if (((rv = nni_http_res_set_header(
+	          res, "Content-Encoding", nni_http_enc_name(enc))) != 0) ||
+	    ((etag != NULL) &&
+	        ((rv = nni_http_res_set_header(res, "ETag", etag)) != 0))) {
+		nni_free(z, zsize);
+		return (rv);
+	}
+	rv = nni_http_res_copy_data(res, z, zsize);
+	nni_free(z, zsize);
+	return (rv);
+}
 
-	res = nni_aio_get_output(aio, 0);
+static void
+http_sreq_cbdone(void *arg)
+{
+	http_sreq *       sr  = arg;
+	http_sconn *      sc  = sr->sc;
+	nni_aio *         aio = sr->cbaio;
+	nni_http_res *    res;
+	nni_http_handler *h;
+	nni_http_server * s = sc->server;
+	int               rv  = 0;
+
+	// Compression can take a while, so we do it before taking the
+	// lock.  Nothing else touches the request or handler meanwhile.
+	if ((nni_aio_result(aio) == 0) &&
+	    ((res = nni_aio_get_output(aio, 0)) != NULL) &&
+	    (sr->handler->compress) && (!sr->handler->compress_own) &&
+	    ((rv = http_res_compress(
+	          sr->handler, nni_aio_get_input(aio, 0), res)) != 0)) {
+		nni_http_res_free(res);
+		nni_aio_set_output(aio, 0, NULL);
+	}
 
-	// If it's an upgrader, and they didn't give us back a response,
-	// it means that they took over, and we should just discard
-	// this session, without closing the underlying channel.
-	if (sc->conn == NULL) {
-		// If this happens, then the session was hijacked.
-		// We close the context, but the http channel stays up.
-		http_sconn_close(sc);
-		return;
+	nni_mtx_lock(&sc->mtx);
+
+	// Get the handler.  Clear it, and drop our reference (once
+	// we have dropped the lock), since we're done with it for now.
+	h           = sr->handler;
+	sr->handler = NULL;
+	sr->ready   = true;
+
+	// A streaming handler that did not read its whole body leaves us
+	// unable to find the next request, so we close after responding.
+	if ((h != NULL) && (h->stream) && (sc->conn != NULL) &&
+	    (!nni_http_conn_body_done(sc->conn))) {
+		sr->close = true;
 	}
-	if (res != NULL) {
+
+	if ((nni_aio_result(aio) != 0) || (rv != 0)) {
+		// Hard close, no further feedback.
+		sc->close = true;
+	} else if (sc->conn == NULL) {
+		// If it's an upgrader, and they didn't give us back a
+		// response, it means that they took over, and we should
+		// just discard this session, without closing the underlying
+		// channel.  We close the context, but the channel stays up.
+		sc->close = true;
+	} else if ((res = nni_aio_get_output(aio, 0)) != NULL) {
 		const char *val;
 		val = nni_http_res_get_header(res, "Connection");
 		if ((val != NULL) && (strstr(val, "close") != NULL)) {
-			sc->close = true;
+			sr->close = true;
 		}
-		if (sc->close) {
+		if (sr->close) {
 			nni_http_res_set_header(res, "Connection", "close");
 		}
-		sc->res = res;
-		if (strcmp(nni_http_req_get_method(sc->req), "HEAD") == 0) {
+		sr->res = res;
+		if (strcmp(nni_http_req_get_method(sr->req), "HEAD") == 0) {
 			void * data;
 			size_t size;
 			// prune off the data, but preserve the content-length
@@ -815,15 +1373,12 @@ http_sconn_cbdone(void *arg)
 		} else if (nni_http_res_is_error(res)) {
 			(void) nni_http_server_res_error(s, res);
 		}
-		nni_http_write_res(sc->conn, res, sc->txaio);
-	} else if (sc->close) {
-		http_sconn_close(sc);
-	} else {
-		// Presumably client already sent a response.
-		// Wait for another request.
-		sc->handler = NULL;
-		nni_http_req_reset(sc->req);
-		nni_http_read_req(sc->conn, sc->req, sc->rxaio);
+	}
+	// Otherwise presumably the handler already sent a response.
+	http_sconn_unlock(sc);
+
+	if (h != NULL) {
+		nni_http_handler_fini(h);
 	}
 }
 
@@ -837,23 +1392,23 @@ http_sconn_init(http_sconn **scp, nng_stream *stream)
 		nng_stream_free(stream);
 		return (NNG_ENOMEM);
 	}
-
-	if (((rv = nni_http_req_alloc(&sc->req, NULL)) != 0) ||
-	    ((rv = nni_aio_alloc(&sc->rxaio, http_sconn_rxdone, sc)) != 0) ||
-	    ((rv = nni_aio_alloc(&sc->txaio, http_sconn_txdone, sc)) != 0) ||
-	    ((rv = nni_aio_alloc(&sc->txdataio, http_sconn_txdatdone, sc)) !=
-	        0) ||
-	    ((rv = nni_aio_alloc(&sc->cbaio, http_sconn_cbdone, sc)) != 0)) {
-		// Can't even accept the incoming request.  Hard close.
-		http_sconn_close(sc);
+	if ((rv = nni_http_conn_init(&sc->conn, stream)) != 0) {
+		// The stream is already cleaned up.
+		NNI_FREE_STRUCT(sc);
 		return (rv);
 	}
-
-	rv = nni_http_conn_init(&sc->conn, stream);
-	if (rv != 0) {
-		http_sconn_close(sc);
+	if (((rv = nni_aio_alloc(&sc->rxaio, http_sconn_rxdone, sc)) != 0) ||
+	    ((rv = nni_aio_alloc(&sc->txaio, http_sconn_txdone, sc)) != 0)) {
+		// Can't even accept the incoming request.  Hard close.
+		nni_http_conn_fini(sc->conn);
+		nni_aio_free(sc->rxaio);
+		nni_aio_free(sc->txaio);
+		NNI_FREE_STRUCT(sc);
 		return (rv);
 	}
+	nni_mtx_init(&sc->mtx);
+	NNI_LIST_INIT(&sc->reqs, http_sreq, node);
+	NNI_LIST_INIT(&sc->idle, http_sreq, node);
 	nni_http_conn_set_ctx(sc->conn, sc);
 	*scp = sc;
 	return (0);
@@ -866,6 +1421,7 @@ http_server_acccb(void *arg)
 	nni_aio *        aio = s->accaio;
 	nng_stream *     stream;
 	http_sconn *     sc;
+	bool             close;
 	int              rv;
 
 	nni_mtx_lock(&s->mtx);
@@ -894,8 +1450,13 @@ http_server_acccb(void *arg)
 	sc->server = s;
 	nni_list_append(&s->conns, sc);
 
-	sc->handler = NULL;
-	nni_http_read_req(sc->conn, sc->req, sc->rxaio);
+	nni_mtx_lock(&sc->mtx);
+	http_sconn_rx_start(sc);
+	close = sc->close;
+	nni_mtx_unlock(&sc->mtx);
+	if (close) {
+		http_sc_close_locked(sc);
+	}
 	nng_stream_listener_accept(s->listener, s->accaio);
 	nni_mtx_unlock(&s->mtx);
 }
@@ -911,10 +1472,13 @@ http_server_fini(nni_http_server *s)
 	nni_mtx_lock(&s->mtx);
 	NNI_ASSERT(nni_list_empty(&s->conns));
 	nng_stream_listener_free(s->listener);
+	nni_rwlock_wrlock(&s->routes_lk);
 	while ((h = nni_list_first(&s->handlers)) != NULL) {
 		nni_list_remove(&s->handlers, h);
+		http_route_remove(s, h);
 		nni_http_handler_fini(h);
 	}
+	nni_rwlock_unlock(&s->routes_lk);
 	nni_mtx_unlock(&s->mtx);
 	nni_mtx_lock(&s->errors_mtx);
 	while ((epage = nni_list_first(&s->errors)) != NULL) {
@@ -926,6 +1490,8 @@ http_server_fini(nni_http_server *s)
 	nni_mtx_fini(&s->errors_mtx);
 
 	nni_aio_free(s->accaio);
+	nni_id_map_fini(&s->routes);
+	nni_rwlock_fini(&s->routes_lk);
 	nni_mtx_fini(&s->mtx);
 	nni_strfree(s->hostname);
 	NNI_FREE_STRUCT(s);
@@ -953,6 +1519,8 @@ http_server_init(nni_http_server **serverp, const nni_url *url)
 	nni_mtx_init(&s->errors_mtx);
 	NNI_LIST_INIT(&s->handlers, nni_http_handler, node);
 	NNI_LIST_INIT(&s->conns, http_sconn, node);
+	nni_id_map_init(&s->routes, 0, 0, false);
+	nni_rwlock_init(&s->routes_lk);
 
 	nni_mtx_init(&s->errors_mtx);
 	NNI_LIST_INIT(&s->errors, http_error, node);
@@ -1204,6 +1772,7 @@ nni_http_server_add_handler(nni_http_server *s, nni_http_handler *h)
 {
 	nni_http_handler *h2;
 	size_t            len;
+	int               rv;
 
 	// Must have a legal method (and not one that is HEAD), path,
 	// and handler.  (The reason HEAD is verboten is that we supply
@@ -1285,6 +1854,13 @@ nni_http_server_add_handler(nni_http_server *s, nni_http_handler *h)
 		}
 	}
 
+	nni_rwlock_wrlock(&s->routes_lk);
+	if ((rv = http_route_add(s, h)) != 0) {
+		nni_rwlock_unlock(&s->routes_lk);
+		nni_mtx_unlock(&s->mtx);
+		return (rv);
+	}
+
 	// Maintain list of handlers in longest uri first order
 	NNI_LIST_FOREACH (&s->handlers, h2) {
 		size_t len2 = strlen(h2->uri);
@@ -1296,6 +1872,8 @@ nni_http_server_add_handler(nni_http_server *s, nni_http_handler *h)
 	if (h2 == NULL) {
 		nni_list_append(&s->handlers, h);
 	}
+	http_route_renumber(s);
+	nni_rwlock_unlock(&s->routes_lk);
 
 	// Note that we have borrowed the reference count on the handler.
 	// Thus we own it, and if the server is destroyed while we have it,
@@ -1317,7 +1895,11 @@ nni_http_server_del_handler(nni_http_server *s, nni_http_handler *h)
 		if (srch == h) {
 			// NB: We are giving the caller our reference
 			// on the handler.
+			nni_rwlock_wrlock(&s->routes_lk);
 			nni_list_remove(&s->handlers, h);
+			http_route_remove(s, h);
+			http_route_renumber(s);
+			nni_rwlock_unlock(&s->routes_lk);
 			rv = 0;
 			break;
 		}
@@ -1385,48 +1967,520 @@ http_lookup_type(const char *path)
 	return (NULL);
 }
 
+// Files (or ranges of them) larger than this are sent a piece at a time,
+// using a buffer of this size, rather than being read into memory all at
+// once.  This bounds the memory used by each transfer.
+#define HTTP_FILE_CHUNK (64 * 1024)
+
+// Cached files are checked against the file system no more often than
+// this, so that most requests for them never touch the disk.
+#define HTTP_CACHE_CHECK 1000 // msec
+
+// Only files up to this fraction of the cache size are cached.
+#define HTTP_CACHE_DIV 4
+
+// http_zvar is a compressed variant of a body that is sent repeatedly,
+// which is made the first time it is asked for.  If compression does not
+// make the body any smaller, data is left NULL, and the original is sent.
+typedef struct http_zvar {
+	void * data;
+	size_t size;
+	bool   done;
+} http_zvar;
+
+static void
+http_zvar_fini(http_zvar *zv)
+{
+	if (zv->data != NULL) {
+		nni_free(zv->data, zv->size);
+	}
+}
+
+// http_zvar_get finds the variant of the body for the encoding, making
+// it if needed.  The lock protects the variant; we compress without
+// holding it.  Returns the number of bytes added if we made the variant,
+// which is then stored in datap and sizep (NULL if it is of no use).
+static size_t
+http_zvar_get(http_zvar *zv, nni_mtx *mtx, nni_http_enc enc,
+    const void *body, size_t len, void **datap, size_t *sizep)
+{
+	void * z     = NULL;
+	size_t zsize = 0;
+	size_t added = 0;
+
+	nni_mtx_lock(mtx);
+	if (!zv->done) {
+		nni_mtx_unlock(mtx);
+		if (nni_http_compress(enc, body, len, &z, &zsize) != 0) {
+			// Try again next time.
+			*datap = NULL;
+			*sizep = 0;
+			return (0);
+		}
+		if (zsize >= len) {
+			nni_free(z, zsize);
+			z     = NULL;
+			zsize = 0;
+		}
+		nni_mtx_lock(mtx);
+		if (!zv->done) {
+			// Nobody beat us to it.
+			zv->data = z;
+			zv->size = zsize;
+			zv->done = true;
+			added    = zsize;
+			z        = NULL;
+		}
+	}
+	*datap = zv->data;
+	*sizep = zv->size;
+	nni_mtx_unlock(mtx);
+	if (z != NULL) {
+		nni_free(z, zsize);
+	}
+	return (added);
+}
+
 typedef struct http_file {
-	char *path;
-	char *ctype;
+	char *     path;
+	char *     ctype;
+	nni_mtx    mtx;       // protects transfers and the cache
+	size_t     cache_max; // zero if caching is disabled
+	size_t     cache_size;
+	nni_list   cache_lru; // most recently used first
+	nni_id_map cache;     // http_cent by hash of path
 } http_file;
 
+// http_cent is a file cached in memory, along with the validators used
+// for conditional requests.  Responses refer to the cached data rather
+// than copying it, holding a reference on the entry while they do.
+typedef struct http_cent {
+	nni_list_node  node;
+	nni_atomic_int ref;
+	uint64_t       hash;
+	char *         path;
+	void *         data;
+	size_t         size;
+	uint64_t       mtime;
+	nni_time       checked;
+	char           etag[40];
+	char           lastmod[32];
+	http_zvar      zvar[3]; // compressed variants, protected by file lock
+	size_t         zbytes;  // size of compressed variants
+} http_cent;
+
+// http_xfer is a file being sent to a client.
+typedef struct http_xfer {
+	nni_aio *      aio; // handler aio
+	nni_aio *      txaio;
+	nni_http_conn *conn;
+	nni_http_res * res;
+	http_file *    hf;
+	void *         fh;
+	uint64_t       off;
+	uint64_t       resid;
+	void *         buf;
+	int            err;
+} http_xfer;
+
 static void
-http_handle_file(nni_aio *aio)
+http_file_error(nni_aio *aio, int rv)
 {
-	nni_http_handler *h   = nni_aio_get_input(aio, 1);
-	nni_http_res *    res = NULL;
-	void *            data;
-	size_t            size;
-	int               rv;
-	http_file *       hf = nni_http_handler_get_data(h);
-	const char *      ctype;
+	nni_http_res *res;
+	uint16_t      status;
+
+	switch (rv) {
+	case NNG_ENOMEM:
+		status = NNG_HTTP_STATUS_INTERNAL_SERVER_ERROR;
+		break;
+	case NNG_ENOENT:
+		status = NNG_HTTP_STATUS_NOT_FOUND;
+		break;
+	case NNG_EPERM:
+		status = NNG_HTTP_STATUS_FORBIDDEN;
+		break;
+	default:
+		status = NNG_HTTP_STATUS_INTERNAL_SERVER_ERROR;
+		break;
+	}
+	if ((rv = nni_http_res_alloc_error(&res, status)) != 0) {
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+	nni_aio_set_output(aio, 0, res);
+	nni_aio_finish(aio, 0, 0);
+}
 
-	if ((ctype = hf->ctype) == NULL) {
-		ctype = "application/octet-stream";
+// http_file_range determines the part of the file to send, based on any
+// Range header in the request.  We only support a single byte range;
+// anything else is ignored, and the entire file is sent (which is
+// permitted by RFC 7233).
+static uint16_t
+http_file_range(
+    nni_http_req *req, uint64_t size, uint64_t *offp, uint64_t *lenp)
+{
+	const char *val;
+	char *      end;
+	uint64_t    first;
+	uint64_t    last;
+
+	*offp = 0;
+	*lenp = size;
+	if (((val = nni_http_req_get_header(req, "Range")) == NULL) ||
+	    (strncmp(val, "bytes=", 6) != 0) || (strchr(val, ',') != NULL)) {
+		return (NNG_HTTP_STATUS_OK);
+	}
+	val += 6;
+	if (*val == '-') {
+		// Suffix range, the last N bytes of the file.
+		if (!isdigit((unsigned char) val[1])) {
+			return (NNG_HTTP_STATUS_OK);
+		}
+		last = strtoull(val + 1, &end, 10);
+		if (*end != '\0') {
+			return (NNG_HTTP_STATUS_OK);
+		}
+		if ((last == 0) || (size == 0)) {
+			return (NNG_HTTP_STATUS_RANGE_NOT_SATISFIABLE);
+		}
+		if (last > size) {
+			last = size;
+		}
+		*offp = size - last;
+		*lenp = last;
+		return (NNG_HTTP_STATUS_PARTIAL_CONTENT);
+	}
+	if (!isdigit((unsigned char) *val)) {
+		return (NNG_HTTP_STATUS_OK);
+	}
+	first = strtoull(val, &end, 10);
+	if (*end != '-') {
+		return (NNG_HTTP_STATUS_OK);
+	}
+	val = end + 1;
+	if (*val == '\0') {
+		last = size - 1; // Open ended.
+	} else {
+		if (!isdigit((unsigned char) *val)) {
+			return (NNG_HTTP_STATUS_OK);
+		}
+		last = strtoull(val, &end, 10);
+		if ((*end != '\0') || (last < first)) {
+			return (NNG_HTTP_STATUS_OK);
+		}
 	}
+	if (first >= size) {
+		return (NNG_HTTP_STATUS_RANGE_NOT_SATISFIABLE);
+	}
+	if (last >= size) {
+		last = size - 1;
+	}
+	*offp = first;
+	*lenp = last - first + 1;
+	return (NNG_HTTP_STATUS_PARTIAL_CONTENT);
+}
 
-	// This is a very simplistic file server, suitable only for small
-	// files.  In the future we can use an AIO based file read, where
-	// we read files a bit at a time, or even mmap them, and serve
-	// them up chunkwise.  Applications could even come up with their own
-	// caching version of the http handler.
-	if ((rv = nni_file_get(hf->path, &data, &size)) != 0) {
-		uint16_t status;
-		switch (rv) {
-		case NNG_ENOMEM:
-			status = NNG_HTTP_STATUS_INTERNAL_SERVER_ERROR;
-			break;
-		case NNG_ENOENT:
-			status = NNG_HTTP_STATUS_NOT_FOUND;
-			break;
-		case NNG_EPERM:
-			status = NNG_HTTP_STATUS_FORBIDDEN;
-			break;
-		default:
-			status = NNG_HTTP_STATUS_INTERNAL_SERVER_ERROR;
-			break;
+static void
+http_file_unsatisfiable(nni_aio *aio, uint64_t size)
+{
+	nni_http_res *res = NULL;
+	char          buf[32];
+	int           rv;
+
+	(void) snprintf(
+	    buf, sizeof(buf), "bytes */%llu", (unsigned long long) size);
+	if (((rv = nni_http_res_alloc_error(
+	          &res, NNG_HTTP_STATUS_RANGE_NOT_SATISFIABLE)) != 0) ||
+	    ((rv = nni_http_res_set_header(res, "Content-Range", buf)) != 0)) {
+		nni_http_res_free(res);
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+	nni_aio_set_output(aio, 0, res);
+	nni_aio_finish(aio, 0, 0);
+}
+
+static int
+http_file_set_range(
+    nni_http_res *res, uint64_t off, uint64_t len, uint64_t size)
+{
+	char buf[80];
+
+	(void) snprintf(buf, sizeof(buf), "bytes %llu-%llu/%llu",
+	    (unsigned long long) off, (unsigned long long) (off + len - 1),
+	    (unsigned long long) size);
+	return (nni_http_res_set_header(res, "Content-Range", buf));
+}
+
+// http_date formats a time in seconds since the epoch as an HTTP date,
+// such as "Sun, 06 Nov 1994 08:49:37 GMT".  We do the calendar math
+// ourselves, as gmtime is not thread safe, and its thread safe variants
+// are not portable.
+static void
+http_date(uint64_t secs, char *buf, size_t sz)
+{
+	static const char *days[] = { "Thu", "Fri", "Sat", "Sun", "Mon",
+		"Tue", "Wed" };
+	static const char *mons[] = { "Jan", "Feb", "Mar", "Apr", "May",
+		"Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+	uint64_t           day = secs / 86400;
+	uint64_t           tod = secs % 86400;
+	uint64_t           z   = day + 719468; // days since 0000-03-01
+	uint64_t           era = z / 146097;
+	uint64_t           doe = z - era * 146097;
+	uint64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	uint64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	uint64_t mp  = (5 * doy + 2) / 153;
+	uint64_t dom = doy - (153 * mp + 2) / 5 + 1;
+	uint64_t mon = mp < 10 ? mp + 3 : mp - 9;
+	uint64_t yr  = yoe + era * 400 + (mon <= 2 ? 1 : 0);
+
+	(void) snprintf(buf, sz, "%s, %02u %s %04u %02u:%02u:%02u GMT",
+	    days[day % 7], (unsigned) dom, mons[mon - 1], (unsigned) yr,
+	    (unsigned) (tod / 3600), (unsigned) ((tod / 60) % 60),
+	    (unsigned) (tod % 60));
+}
+
+// http_not_modified checks the validators in a conditional request.
+// As RFC 7232 requires, If-None-Match takes precedence.  Dates are only
+// compared for an exact match, since clients echo back what we sent.
+static bool
+http_not_modified(nni_http_req *req, const char *etag, const char *lastmod)
+{
+	const char *val;
+
+	if ((val = nni_http_req_get_header(req, "If-None-Match")) != NULL) {
+		return ((strcmp(val, "*") == 0) || (strstr(val, etag) != NULL));
+	}
+	if ((lastmod != NULL) &&
+	    ((val = nni_http_req_get_header(req, "If-Modified-Since")) !=
+	        NULL)) {
+		return (strcmp(val, lastmod) == 0);
+	}
+	return (false);
+}
+
+static void
+http_send_not_modified(nni_aio *aio, const char *etag, const char *lastmod)
+{
+	nni_http_res *res = NULL;
+	int           rv;
+
+	if (((rv = nni_http_res_alloc(&res)) != 0) ||
+	    ((rv = nni_http_res_set_status(
+	          res, NNG_HTTP_STATUS_NOT_MODIFIED)) != 0) ||
+	    ((rv = nni_http_res_set_header(res, "ETag", etag)) != 0) ||
+	    ((lastmod != NULL) &&
+	        ((rv = nni_http_res_set_header(
+	              res, "Last-Modified", lastmod)) != 0))) {
+		nni_http_res_free(res);
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+	nni_aio_set_output(aio, 0, res);
+	nni_aio_finish(aio, 0, 0);
+}
+
+static void
+http_cent_rele(void *arg)
+{
+	http_cent *ent = arg;
+
+	if (nni_atomic_dec_nv(&ent->ref) != 0) {
+		return;
+	}
+	if (ent->size > 0) {
+		nni_free(ent->data, ent->size);
+	}
+	for (int i = 0; i < 3; i++) {
+		http_zvar_fini(&ent->zvar[i]);
+	}
+	nni_strfree(ent->path);
+	NNI_FREE_STRUCT(ent);
+}
+
+// http_cache_evict removes an entry from the cache.  Responses still
+// using it keep it alive.  Called with the lock held.
+static void
+http_cache_evict(http_file *hf, http_cent *ent)
+{
+	(void) nni_id_remove(&hf->cache, ent->hash);
+	nni_list_remove(&hf->cache_lru, ent);
+	hf->cache_size -= ent->size + ent->zbytes;
+	http_cent_rele(ent);
+}
+
+// http_cache_get returns a reference to the cached copy of the file, if
+// we have one and it is still current.
+static http_cent *
+http_cache_get(http_file *hf, const char *path, uint64_t hash)
+{
+	http_cent *ent;
+	nni_time   now = nni_clock();
+	uint64_t   size;
+	uint64_t   mtime;
+	bool       check;
+
+	nni_mtx_lock(&hf->mtx);
+	if (((ent = nni_id_get(&hf->cache, hash)) == NULL) ||
+	    (strcmp(ent->path, path) != 0)) {
+		nni_mtx_unlock(&hf->mtx);
+		return (NULL);
+	}
+	nni_list_remove(&hf->cache_lru, ent);
+	nni_list_prepend(&hf->cache_lru, ent);
+	nni_atomic_inc(&ent->ref);
+	check = (now >= ent->checked + HTTP_CACHE_CHECK);
+	nni_mtx_unlock(&hf->mtx);
+
+	if (!check) {
+		return (ent);
+	}
+	if ((nni_file_stat(path, &size, &mtime) == 0) &&
+	    (size == ent->size) && (mtime == ent->mtime)) {
+		nni_mtx_lock(&hf->mtx);
+		ent->checked = now;
+		nni_mtx_unlock(&hf->mtx);
+		return (ent);
+	}
+
+	// The file changed or went away, so forget about it.
+	nni_mtx_lock(&hf->mtx);
+	if (nni_id_get(&hf->cache, hash) == ent) {
+		http_cache_evict(hf, ent);
+	}
+	nni_mtx_unlock(&hf->mtx);
+	http_cent_rele(ent);
+	return (NULL);
+}
+
+// http_cache_load reads the file into a new cache entry, and returns a
+// reference to it.  Older entries are discarded to make room.
+static int
+http_cache_load(http_file *hf, const char *path, uint64_t hash, void *fh,
+    size_t size, uint64_t mtime, http_cent **entp)
+{
+	http_cent *ent;
+	http_cent *old;
+	size_t     n;
+	int        rv;
+
+	if ((ent = NNI_ALLOC_STRUCT(ent)) == NULL) {
+		return (NNG_ENOMEM);
+	}
+	nni_atomic_init(&ent->ref);
+	nni_atomic_set(&ent->ref, 1);
+	if (((ent->path = nni_strdup(path)) == NULL) ||
+	    ((size > 0) && ((ent->data = nni_alloc(size)) == NULL))) {
+		http_cent_rele(ent);
+		return (NNG_ENOMEM);
+	}
+	ent->size = size;
+	if ((size > 0) &&
+	    (((rv = nni_file_read(fh, 0, ent->data, size, &n)) != 0) ||
+	        ((rv = (n == size) ? 0 : NNG_EINVAL) != 0))) {
+		http_cent_rele(ent);
+		return (rv);
+	}
+	ent->hash    = hash;
+	ent->mtime   = mtime;
+	ent->checked = nni_clock();
+	(void) snprintf(ent->etag, sizeof(ent->etag), "\"%llx-%llx\"",
+	    (unsigned long long) mtime, (unsigned long long) size);
+	http_date(mtime, ent->lastmod, sizeof(ent->lastmod));
+
+	nni_mtx_lock(&hf->mtx);
+	if ((old = nni_id_get(&hf->cache, hash)) != NULL) {
+		http_cache_evict(hf, old);
+	}
+	if (nni_id_set(&hf->cache, hash, ent) == 0) {
+		nni_atomic_inc(&ent->ref); // for the cache
+		nni_list_prepend(&hf->cache_lru, ent);
+		hf->cache_size += size;
+		while (hf->cache_size > hf->cache_max) {
+			http_cache_evict(hf, nni_list_last(&hf->cache_lru));
 		}
-		if ((rv = nni_http_res_alloc_error(&res, status)) != 0) {
+	}
+	nni_mtx_unlock(&hf->mtx);
+	*entp = ent;
+	return (0);
+}
+
+// http_cache_variant finds the compressed variant of the cached file to
+// send, if any.  Variants count towards the size of the cache.
+static nni_http_enc
+http_cache_variant(nni_aio *aio, http_file *hf, http_cent *ent, bool *vary,
+    void **datap, size_t *sizep)
+{
+	nni_http_enc enc;
+	size_t       added;
+
+	enc = http_compress_enc(nni_aio_get_input(aio, 1),
+	    nni_aio_get_input(aio, 0), ent->size, vary);
+	if (enc == NNI_HTTP_ENC_IDENTITY) {
+		return (enc);
+	}
+	added = http_zvar_get(&ent->zvar[enc], &hf->mtx, enc, ent->data,
+	    ent->size, datap, sizep);
+	if (added > 0) {
+		nni_mtx_lock(&hf->mtx);
+		ent->zbytes += added;
+		if (nni_id_get(&hf->cache, ent->hash) == ent) {
+			hf->cache_size += added;
+			while (hf->cache_size > hf->cache_max) {
+				http_cache_evict(
+				    hf, nni_list_last(&hf->cache_lru));
+			}
+		}
+		nni_mtx_unlock(&hf->mtx);
+	}
+	return (*datap != NULL ? enc : NNI_HTTP_ENC_IDENTITY);
+}
+
+// http_cache_send replies from a cached file, consuming the reference.
+static void
+http_cache_send(nni_aio *aio, http_file *hf, http_cent *ent, const char *ctype)
+{
+	nni_http_req *req = nni_aio_get_input(aio, 0);
+	nni_http_res *res = NULL;
+	uint64_t      off;
+	uint64_t      len;
+	uint16_t      status;
+	char *        data;
+	int           rv;
+	nni_http_enc  enc;
+	bool          vary;
+	void *        zdata;
+	size_t        zsize;
+	const char *  etag = ent->etag;
+	char          zetag[64];
+
+	enc = http_cache_variant(aio, hf, ent, &vary, &zdata, &zsize);
+	if (enc != NNI_HTTP_ENC_IDENTITY) {
+		http_etag_variant(ent->etag, enc, zetag, sizeof(zetag));
+		etag = zetag;
+	}
+	if (http_not_modified(req, etag, ent->lastmod)) {
+		http_send_not_modified(aio, etag, ent->lastmod);
+		http_cent_rele(ent);
+		return;
+	}
+	if (enc != NNI_HTTP_ENC_IDENTITY) {
+		// Never a range, as those are not compressed.
+		if (((rv = nni_http_res_alloc(&res)) != 0) ||
+		    ((rv = nni_http_res_set_header(
+		          res, "Content-Type", ctype)) != 0) ||
+		    ((rv = nni_http_res_set_header(res, "ETag", etag)) != 0) ||
+		    ((rv = nni_http_res_set_header(
+		          res, "Last-Modified", ent->lastmod)) != 0) ||
+		    ((rv = nni_http_res_set_header(
+		          res, "Vary", "Accept-Encoding")) != 0) ||
+		    ((rv = nni_http_res_set_header(res, "Content-Encoding",
+		          nni_http_enc_name(enc))) != 0) ||
+		    ((rv = nni_http_res_set_data_ref(
+		          res, zdata, zsize, http_cent_rele, ent)) != 0)) {
+			nni_http_res_free(res);
+			http_cent_rele(ent);
 			nni_aio_finish_error(aio, rv);
 			return;
 		}
@@ -1434,29 +2488,299 @@ http_handle_file(nni_aio *aio)
 		nni_aio_finish(aio, 0, 0);
 		return;
 	}
+	status = http_file_range(req, ent->size, &off, &len);
+	if (status == NNG_HTTP_STATUS_RANGE_NOT_SATISFIABLE) {
+		http_file_unsatisfiable(aio, ent->size);
+		http_cent_rele(ent);
+		return;
+	}
+	data = (len > 0) ? (char *) ent->data + off : NULL;
 	if (((rv = nni_http_res_alloc(&res)) != 0) ||
-	    ((rv = nni_http_res_set_status(res, NNG_HTTP_STATUS_OK)) != 0) ||
+	    ((rv = nni_http_res_set_status(res, status)) != 0) ||
 	    ((rv = nni_http_res_set_header(res, "Content-Type", ctype)) !=
 	        0) ||
-	    ((rv = nni_http_res_copy_data(res, data, size)) != 0)) {
+	    ((rv = nni_http_res_set_header(res, "Accept-Ranges", "bytes")) !=
+	        0) ||
+	    ((rv = nni_http_res_set_header(res, "ETag", ent->etag)) != 0) ||
+	    ((rv = nni_http_res_set_header(
+	          res, "Last-Modified", ent->lastmod)) != 0) ||
+	    ((vary) &&
+	        ((rv = nni_http_res_set_header(
+	              res, "Vary", "Accept-Encoding")) != 0)) ||
+	    ((status == NNG_HTTP_STATUS_PARTIAL_CONTENT) &&
+	        ((rv = http_file_set_range(res, off, len, ent->size)) != 0)) ||
+	    ((rv = nni_http_res_set_data_ref(
+	          res, data, (size_t) len, http_cent_rele, ent)) != 0)) {
 		nni_http_res_free(res);
-		nni_free(data, size);
+		http_cent_rele(ent);
 		nni_aio_finish_error(aio, rv);
 		return;
 	}
-
-	nni_free(data, size);
 	nni_aio_set_output(aio, 0, res);
 	nni_aio_finish(aio, 0, 0);
 }
 
+static void
+http_xfer_free(http_xfer *xf)
+{
+	nni_file_close(xf->fh);
+	nni_http_res_free(xf->res);
+	if (xf->buf != NULL) {
+		nni_free(xf->buf, HTTP_FILE_CHUNK);
+	}
+	// We may be running on the callback for this aio.
+	nni_aio_reap(xf->txaio);
+	NNI_FREE_STRUCT(xf);
+}
+
+static void
+http_xfer_cancel(nni_aio *aio, void *arg, int rv)
+{
+	http_file *hf = arg;
+	http_xfer *xf;
+
+	nni_mtx_lock(&hf->mtx);
+	if ((xf = nni_aio_get_prov_data(aio)) != NULL) {
+		xf->err = rv;
+		nni_aio_abort(xf->txaio, rv);
+	}
+	nni_mtx_unlock(&hf->mtx);
+}
+
+static void
+http_xfer_cb(void *arg)
+{
+	http_xfer *xf  = arg;
+	http_file *hf  = xf->hf;
+	nni_aio *  aio = xf->aio;
+	size_t     n   = 0;
+	int        rv;
+	nni_iov    iov;
+
+	if (((rv = nni_aio_result(xf->txaio)) == 0) && (xf->resid > 0)) {
+		n = xf->resid > HTTP_FILE_CHUNK ? HTTP_FILE_CHUNK
+		                                : (size_t) xf->resid;
+		if (((rv = nni_file_read(xf->fh, xf->off, xf->buf, n, &n)) ==
+		        0) &&
+		    (n == 0)) {
+			rv = NNG_EINVAL; // File was truncated underneath us.
+		}
+	}
+
+	nni_mtx_lock(&hf->mtx);
+	if ((rv == 0) && (xf->err != 0)) {
+		rv = xf->err;
+	}
+	if ((rv == 0) && (xf->resid > 0)) {
+		xf->off += n;
+		xf->resid -= n;
+		iov.iov_buf = xf->buf;
+		iov.iov_len = n;
+		nni_aio_set_iov(xf->txaio, 1, &iov);
+		nni_http_write_full(xf->conn, xf->txaio);
+		nni_mtx_unlock(&hf->mtx);
+		return;
+	}
+	nni_aio_set_prov_data(aio, NULL);
+	nni_mtx_unlock(&hf->mtx);
+
+	http_xfer_free(xf);
+	if (rv != 0) {
+		// Part of the response may have been sent already, so
+		// the only thing we can do is drop the connection.
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+	// We already sent the response ourselves.
+	nni_aio_set_output(aio, 0, NULL);
+	nni_aio_finish(aio, 0, 0);
+}
+
+// http_file_send sends the named file (or the part of it requested).
+// Small files are read into the response like any other, but larger
+// ones are written to the connection from a fixed size buffer.
+static void
+http_file_send(nni_aio *aio, http_file *hf, const char *path, const char *ctype)
+{
+	nni_http_req * req  = nni_aio_get_input(aio, 0);
+	nni_http_conn *conn = nni_aio_get_input(aio, 2);
+	nni_http_res * res  = NULL;
+	http_xfer *    xf;
+	void *         fh;
+	uint64_t       size;
+	uint64_t       off;
+	uint64_t       len;
+	uint16_t       status;
+	const char *   val;
+	char           buf[64];
+	int            rv;
+	http_cent *    ent;
+	uint64_t       hash  = 0;
+	uint64_t       mtime = 0;
+
+	if (hf->cache_max > 0) {
+		hash = http_route_hash(
+		    HTTP_ROUTE_HASH_INIT, path, strlen(path));
+		if ((ent = http_cache_get(hf, path, hash)) != NULL) {
+			http_cache_send(aio, hf, ent, ctype);
+			return;
+		}
+		// Get the time first, so a change while we are reading it
+		// will be noticed later.
+		if ((rv = nni_file_stat(path, &size, &mtime)) != 0) {
+			http_file_error(aio, rv);
+			return;
+		}
+	}
+
+	if ((rv = nni_file_open(path, &fh, &size)) != 0) {
+		http_file_error(aio, rv);
+		return;
+	}
+
+	if ((hf->cache_max > 0) && (size <= hf->cache_max / HTTP_CACHE_DIV)) {
+		rv = http_cache_load(
+		    hf, path, hash, fh, (size_t) size, mtime, &ent);
+		nni_file_close(fh);
+		if (rv != 0) {
+			http_file_error(aio, rv);
+			return;
+		}
+		http_cache_send(aio, hf, ent, ctype);
+		return;
+	}
+
+	status = http_file_range(req, size, &off, &len);
+	if (status == NNG_HTTP_STATUS_RANGE_NOT_SATISFIABLE) {
+		nni_file_close(fh);
+		http_file_unsatisfiable(aio, size);
+		return;
+	}
+
+	(void) snprintf(buf, sizeof(buf), "%llu", (unsigned long long) len);
+	if (((rv = nni_http_res_alloc(&res)) != 0) ||
+	    ((rv = nni_http_res_set_status(res, status)) != 0) ||
+	    ((rv = nni_http_res_set_header(res, "Content-Type", ctype)) !=
+	        0) ||
+	    ((rv = nni_http_res_set_header(res, "Accept-Ranges", "bytes")) !=
+	        0) ||
+	    ((rv = nni_http_res_set_header(res, "Content-Length", buf)) !=
+	        0)) {
+		goto fail;
+	}
+	if ((status == NNG_HTTP_STATUS_PARTIAL_CONTENT) &&
+	    ((rv = http_file_set_range(res, off, len, size)) != 0)) {
+		goto fail;
+	}
+
+	if (len <= HTTP_FILE_CHUNK) {
+		void * data;
+		size_t n = 0;
+
+		if (len > 0) {
+			if ((rv = nni_http_res_alloc_data(res, (size_t) len)) !=
+			    0) {
+				goto fail;
+			}
+			nni_http_res_get_data(res, &data, &n);
+			if ((rv = nni_file_read(fh, off, data, n, &n)) != 0) {
+				goto fail;
+			}
+		}
+		if (n != len) {
+			rv = NNG_EINVAL; // File was truncated underneath us.
+			goto fail;
+		}
+		nni_file_close(fh);
+		if ((rv = http_res_compress(
+		         nni_aio_get_input(aio, 1), req, res)) != 0) {
+			nni_http_res_free(res);
+			nni_aio_finish_error(aio, rv);
+			return;
+		}
+		nni_aio_set_output(aio, 0, res);
+		nni_aio_finish(aio, 0, 0);
+		return;
+	}
+
+	// We write this response ourselves, so we have to follow the same
+	// rules for persistent connections that the server does.
+	if (((val = nni_http_req_get_version(req)) == NULL) ||
+	    (strcmp(val, "HTTP/1.1") != 0) ||
+	    (((val = nni_http_req_get_header(req, "Connection")) != NULL) &&
+	        (nni_strcasestr(val, "close") != NULL))) {
+		if ((rv = nni_http_res_set_header(
+		         res, "Connection", "close")) != 0) {
+			goto fail;
+		}
+	}
+
+	if ((xf = NNI_ALLOC_STRUCT(xf)) == NULL) {
+		rv = NNG_ENOMEM;
+		goto fail;
+	}
+	if (((xf->buf = nni_alloc(HTTP_FILE_CHUNK)) == NULL) ||
+	    ((rv = nni_aio_alloc(&xf->txaio, http_xfer_cb, xf)) != 0)) {
+		if (xf->buf != NULL) {
+			nni_free(xf->buf, HTTP_FILE_CHUNK);
+		}
+		NNI_FREE_STRUCT(xf);
+		rv = NNG_ENOMEM;
+		goto fail;
+	}
+	xf->aio  = aio;
+	xf->conn = conn;
+	xf->res  = res;
+	xf->hf   = hf;
+	xf->fh   = fh;
+	xf->off  = off;
+	xf->resid =
+	    strcmp(nni_http_req_get_method(req), "HEAD") == 0 ? 0 : len;
+
+	nni_mtx_lock(&hf->mtx);
+	if ((rv = nni_aio_schedule(aio, http_xfer_cancel, hf)) != 0) {
+		nni_mtx_unlock(&hf->mtx);
+		http_xfer_free(xf);
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+	nni_aio_set_prov_data(aio, xf);
+	nni_http_write_res(conn, res, xf->txaio);
+	nni_mtx_unlock(&hf->mtx);
+	return;
+
+fail:
+	nni_file_close(fh);
+	nni_http_res_free(res);
+	nni_aio_finish_error(aio, rv);
+}
+
+static void
+http_handle_file(nni_aio *aio)
+{
+	nni_http_handler *h  = nni_aio_get_input(aio, 1);
+	http_file *       hf = nni_http_handler_get_data(h);
+	const char *      ctype;
+
+	if ((ctype = hf->ctype) == NULL) {
+		ctype = "application/octet-stream";
+	}
+	http_file_send(aio, hf, hf->path, ctype);
+}
+
 static void
 http_file_free(void *arg)
 {
 	http_file *hf;
 	if ((hf = arg) != NULL) {
+		http_cent *ent;
+		while ((ent = nni_list_first(&hf->cache_lru)) != NULL) {
+			http_cache_evict(hf, ent);
+		}
+		nni_id_map_fini(&hf->cache);
 		nni_strfree(hf->path);
 		nni_strfree(hf->ctype);
+		nni_mtx_fini(&hf->mtx);
 		NNI_FREE_STRUCT(hf);
 	}
 }
@@ -1472,6 +2796,9 @@ nni_http_handler_init_file_ctype(nni_http_handler **hpp, const char *uri,
 	if ((hf = NNI_ALLOC_STRUCT(hf)) == NULL) {
 		return (NNG_ENOMEM);
 	}
+	nni_mtx_init(&hf->mtx);
+	NNI_LIST_INIT(&hf->cache_lru, http_cent, node);
+	nni_id_map_init(&hf->cache, 0, 0, false);
 
 	// Later we might want to do this in the server side, if we support
 	// custom media type lists on a per-server basis.  For now doing this
@@ -1500,6 +2827,7 @@ nni_http_handler_init_file_ctype(nni_http_handler **hpp, const char *uri,
 
 	// We don't permit a body for getting a file.
 	nni_http_handler_collect_body(h, true, 0);
+	h->compress_own = true;
 
 	*hpp = h;
 	return (0);
@@ -1517,9 +2845,6 @@ http_handle_dir(nni_aio *aio)
 {
 	nni_http_req *    req = nni_aio_get_input(aio, 0);
 	nni_http_handler *h   = nni_aio_get_input(aio, 1);
-	nni_http_res *    res = NULL;
-	void *            data;
-	size_t            size;
 	int               rv;
 	http_file *       hf   = nni_http_handler_get_data(h);
 	const char *      path = hf->path;
@@ -1572,12 +2897,6 @@ http_handle_dir(nni_aio *aio)
 
 	*dst = '\0';
 
-	// This is a very simplistic file server, suitable only for small
-	// files.  In the future we can use an AIO based file read, where
-	// we read files a bit at a time, or even mmap them, and serve
-	// them up chunkwise.  Applications could even come up with their
-	// own caching version of the http handler.
-
 	rv = 0;
 	if (nni_file_is_dir(pn)) {
 		sprintf(dst, "%s%s", NNG_PLATFORM_DIR_SEP, "index.html");
@@ -1589,58 +2908,17 @@ http_handle_dir(nni_aio *aio)
 		}
 	}
 
-	if (rv == 0) {
-		rv = nni_file_get(pn, &data, &size);
-	} else {
-		data = NULL;
-		size = 0;
+	if (rv != 0) {
+		nni_free(pn, pnsz);
+		http_file_error(aio, rv);
+		return;
 	}
 	ctype = http_lookup_type(pn);
 	if (ctype == NULL) {
 		ctype = "application/octet-stream";
 	}
-
+	http_file_send(aio, hf, pn, ctype);
 	nni_free(pn, pnsz);
-	if (rv != 0) {
-		uint16_t status;
-
-		switch (rv) {
-		case NNG_ENOMEM:
-			status = NNG_HTTP_STATUS_INTERNAL_SERVER_ERROR;
-			break;
-		case NNG_ENOENT:
-			status = NNG_HTTP_STATUS_NOT_FOUND;
-			break;
-		case NNG_EPERM:
-			status = NNG_HTTP_STATUS_FORBIDDEN;
-			break;
-		default:
-			status = NNG_HTTP_STATUS_INTERNAL_SERVER_ERROR;
-			break;
-		}
-		if ((rv = nni_http_res_alloc_error(&res, status)) != 0) {
-			nni_aio_finish_error(aio, rv);
-			return;
-		}
-		nni_aio_set_output(aio, 0, res);
-		nni_aio_finish(aio, 0, 0);
-		return;
-	}
-
-	if (((rv = nni_http_res_alloc(&res)) != 0) ||
-	    ((rv = nni_http_res_set_status(res, NNG_HTTP_STATUS_OK)) != 0) ||
-	    ((rv = nni_http_res_set_header(res, "Content-Type", ctype)) !=
-	        0) ||
-	    ((rv = nni_http_res_copy_data(res, data, size)) != 0)) {
-		nni_http_res_free(res);
-		nni_free(data, size);
-		nni_aio_finish_error(aio, rv);
-		return;
-	}
-
-	nni_free(data, size);
-	nni_aio_set_output(aio, 0, res);
-	nni_aio_finish(aio, 0, 0);
 }
 
 int
@@ -1654,8 +2932,11 @@ nni_http_handler_init_directory(
 	if ((hf = NNI_ALLOC_STRUCT(hf)) == NULL) {
 		return (NNG_ENOMEM);
 	}
+	nni_mtx_init(&hf->mtx);
+	NNI_LIST_INIT(&hf->cache_lru, http_cent, node);
+	nni_id_map_init(&hf->cache, 0, 0, false);
 	if ((hf->path = nni_strdup(path)) == NULL) {
-		NNI_FREE_STRUCT(hf);
+		http_file_free(hf);
 		return (NNG_ENOMEM);
 	}
 
@@ -1665,6 +2946,7 @@ nni_http_handler_init_directory(
 	}
 	// We don't permit a body for getting a file.
 	nni_http_handler_collect_body(h, true, 0);
+	h->compress_own = true;
 
 	if (((rv = nni_http_handler_set_tree_exclusive(h)) != 0) ||
 	    ((rv = nni_http_handler_set_data(h, hf, http_file_free)) != 0)) {
@@ -1677,6 +2959,22 @@ nni_http_handler_init_directory(
 	return (0);
 }
 
+int
+nni_http_handler_set_cache(nni_http_handler *h, size_t maxbytes)
+{
+	http_file *hf;
+
+	if (nni_atomic_get_bool(&h->busy) != 0) {
+		return (NNG_EBUSY);
+	}
+	if ((h->cb != http_handle_file) && (h->cb != http_handle_dir)) {
+		return (NNG_ENOTSUP);
+	}
+	hf            = h->data;
+	hf->cache_max = maxbytes;
+	return (0);
+}
+
 typedef struct http_redirect {
 	uint16_t code;
 	char *   where;
@@ -1796,17 +3094,40 @@ nni_http_handler_init_redirect(nni_http_handler **hpp, const char *uri,
 	// We don't need to collect the body at all, because the handler
 	// just discards the content and closes the connection.
 	nni_http_handler_collect_body(h, false, 0);
+	h->pipeline = true;
 
 	*hpp = h;
 	return (0);
 }
 
+// http_static is reference counted, because responses refer to the
+// data rather than copying it, and may outlive the handler.
 typedef struct http_static {
-	void * data;
-	size_t size;
-	char * ctype;
+	nni_atomic_int ref;
+	void *         data;
+	size_t         size;
+	char *         ctype;
+	char           etag[24];
+	nni_mtx        mtx; // protects the compressed variants
+	http_zvar      zvar[3];
 } http_static;
 
+static void
+http_static_free(void *arg)
+{
+	http_static *hs;
+
+	if (((hs = arg) != NULL) && (nni_atomic_dec_nv(&hs->ref) == 0)) {
+		for (int i = 0; i < 3; i++) {
+			http_zvar_fini(&hs->zvar[i]);
+		}
+		nni_mtx_fini(&hs->mtx);
+		nni_free(hs->data, hs->size);
+		nni_strfree(hs->ctype);
+		NNI_FREE_STRUCT(hs);
+	}
+}
+
 static void
 http_handle_static(nni_aio *aio)
 {
@@ -1815,6 +3136,12 @@ http_handle_static(nni_aio *aio)
 	nni_http_handler *h;
 	nni_http_res *    r = NULL;
 	int               rv;
+	nni_http_enc      enc;
+	bool              vary;
+	void *            data;
+	size_t            size;
+	const char *      etag;
+	char              zetag[48];
 
 	h  = nni_aio_get_input(aio, 1);
 	hs = nni_http_handler_get_data(h);
@@ -1822,12 +3149,42 @@ http_handle_static(nni_aio *aio)
 	if ((ctype = hs->ctype) == NULL) {
 		ctype = "application/octet-stream";
 	}
+	data = hs->data;
+	size = hs->size;
+	etag = hs->etag;
+	enc  = http_compress_enc(h, nni_aio_get_input(aio, 0), size, &vary);
+	if (enc != NNI_HTTP_ENC_IDENTITY) {
+		(void) http_zvar_get(&hs->zvar[enc], &hs->mtx, enc, hs->data,
+		    hs->size, &data, &size);
+		if (data != NULL) {
+			http_etag_variant(hs->etag, enc, zetag, sizeof(zetag));
+			etag = zetag;
+		} else {
+			enc  = NNI_HTTP_ENC_IDENTITY;
+			data = hs->data;
+			size = hs->size;
+		}
+	}
+	if (http_not_modified(nni_aio_get_input(aio, 0), etag, NULL)) {
+		http_send_not_modified(aio, etag, NULL);
+		return;
+	}
 
+	nni_atomic_inc(&hs->ref);
 	if (((rv = nni_http_res_alloc(&r)) != 0) ||
 	    ((rv = nni_http_res_set_header(r, "Content-Type", ctype)) != 0) ||
+	    ((rv = nni_http_res_set_header(r, "ETag", etag)) != 0) ||
+	    ((vary) &&
+	        ((rv = nni_http_res_set_header(
+	              r, "Vary", "Accept-Encoding")) != 0)) ||
+	    ((enc != NNI_HTTP_ENC_IDENTITY) &&
+	        ((rv = nni_http_res_set_header(r, "Content-Encoding",
+	              nni_http_enc_name(enc))) != 0)) ||
 	    ((rv = nni_http_res_set_status(r, NNG_HTTP_STATUS_OK)) != 0) ||
-	    ((rv = nni_http_res_set_data(r, hs->data, hs->size)) != 0)) {
+	    ((rv = nni_http_res_set_data_ref(
+	          r, data, size, http_static_free, hs)) != 0)) {
 		nni_http_res_free(r);
+		http_static_free(hs);
 		nni_aio_finish_error(aio, rv);
 		return;
 	}
@@ -1836,18 +3193,6 @@ http_handle_static(nni_aio *aio)
 	nni_aio_finish(aio, 0, 0);
 }
 
-static void
-http_static_free(void *arg)
-{
-	http_static *hs;
-
-	if ((hs = arg) != NULL) {
-		nni_free(hs->data, hs->size);
-		nni_strfree(hs->ctype);
-		NNI_FREE_STRUCT(hs);
-	}
-}
-
 int
 nni_http_handler_init_static(nni_http_handler **hpp, const char *uri,
     const void *data, size_t size, const char *ctype)
@@ -1859,6 +3204,9 @@ nni_http_handler_init_static(nni_http_handler **hpp, const char *uri,
 	if ((hs = NNI_ALLOC_STRUCT(hs)) == NULL) {
 		return (NNG_ENOMEM);
 	}
+	nni_atomic_init(&hs->ref);
+	nni_atomic_inc(&hs->ref);
+	nni_mtx_init(&hs->mtx);
 	if (((hs->ctype = nni_strdup(ctype)) == NULL) ||
 	    ((size > 0) && ((hs->data = nni_alloc(size)) == NULL))) {
 		http_static_free(hs);
@@ -1866,6 +3214,9 @@ nni_http_handler_init_static(nni_http_handler **hpp, const char *uri,
 	}
 	hs->size = size;
 	memcpy(hs->data, data, size);
+	(void) snprintf(hs->etag, sizeof(hs->etag), "\"%016llx\"",
+	    (unsigned long long) http_route_hash(
+	        HTTP_ROUTE_HASH_INIT, data, size));
 
 	if ((rv = nni_http_handler_init(&h, uri, http_handle_static)) != 0) {
 		http_static_free(hs);
@@ -1880,6 +3231,75 @@ nni_http_handler_init_static(nni_http_handler **hpp, const char *uri,
 
 	// We don't permit a body for getting static data.
 	nni_http_handler_collect_body(h, true, 0);
+	h->pipeline     = true;
+	h->compress_own = true;
+
+	*hpp = h;
+	return (0);
+}
+
+// http_stats_body is the formatted statistics, which responses refer to.
+typedef struct http_stats_body {
+	char  *text;
+	size_t size;
+} http_stats_body;
+
+static void
+http_stats_free(void *arg)
+{
+	http_stats_body *body = arg;
+
+	nni_free(body->text, body->size);
+	NNI_FREE_STRUCT(body);
+}
+
+static void
+http_handle_stats(nni_aio *aio)
+{
+	nni_http_res    *r = NULL;
+	http_stats_body *body;
+	int              rv;
+
+	if ((body = NNI_ALLOC_STRUCT(body)) == NULL) {
+		nni_aio_finish_error(aio, NNG_ENOMEM);
+		return;
+	}
+	if ((rv = nni_stat_openmetrics(&body->text, &body->size)) != 0) {
+		NNI_FREE_STRUCT(body);
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+
+	if (((rv = nni_http_res_alloc(&r)) != 0) ||
+	    ((rv = nni_http_res_set_header(r, "Content-Type",
+	          "application/openmetrics-text; version=1.0.0; "
+	          "charset=utf-8")) != 0) ||
+	    ((rv = nni_http_res_set_header(r, "Cache-Control", "no-cache")) !=
+	        0) ||
+	    ((rv = nni_http_res_set_status(r, NNG_HTTP_STATUS_OK)) != 0) ||
+	    ((rv = nni_http_res_set_data_ref(
+	          r, body->text, body->size, http_stats_free, body)) != 0)) {
+		nni_http_res_free(r);
+		http_stats_free(body);
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+	nni_aio_set_output(aio, 0, r);
+	nni_aio_finish(aio, 0, 0);
+}
+
+int
+nni_http_handler_init_stats(nni_http_handler **hpp, const char *uri)
+{
+	nni_http_handler *h;
+	int               rv;
+
+	if ((rv = nni_http_handler_init(&h, uri, http_handle_stats)) != 0) {
+		return (rv);
+	}
+	// Scrapers never send a body.
+	nni_http_handler_collect_body(h, true, 0);
+	h->pipeline = true;
 
 	*hpp = h;
 	return (0);
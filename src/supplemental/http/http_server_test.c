@@ -0,0 +1,982 @@
+//
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nng/nng.h>
+#include <nng/supplemental/http/http.h>
+
+#include <nuts.h>
+
+#include "http_api.h"
+
+#ifdef NNG_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+static void
+route_cb(nng_aio *aio)
+{
+	nng_aio_finish(aio, 0);
+}
+
+static nng_http_server *
+route_server(void)
+{
+	nng_http_server *s;
+	nng_url         *url;
+
+	NUTS_PASS(nng_url_parse(&url, "http://127.0.0.1:0"));
+	NUTS_PASS(nng_http_server_hold(&s, url));
+	nng_url_free(url);
+	return (s);
+}
+
+static nng_http_handler *
+route_add(nng_http_server *s, const char *uri, const char *method,
+    const char *host, bool tree)
+{
+	nng_http_handler *h;
+
+	NUTS_PASS(nng_http_handler_alloc(&h, uri, route_cb));
+	NUTS_PASS(nng_http_handler_set_method(h, method));
+	if (host != NULL) {
+		NUTS_PASS(nng_http_handler_set_host(h, host));
+	}
+	if (tree) {
+		NUTS_PASS(nng_http_handler_set_tree(h));
+	}
+	NUTS_PASS(nng_http_server_add_handler(s, h));
+	return (h);
+}
+
+static void
+route_check(nng_http_server *s, const char *host, const char *method,
+    const char *path, nng_http_handler *expect)
+{
+	nni_http_handler *h = NULL;
+
+	NUTS_PASS(nni_http_server_lookup(s, host, method, path, &h));
+	NUTS_TRUE(h == expect);
+	nni_http_handler_fini(h);
+}
+
+static void
+route_fail(nng_http_server *s, const char *host, const char *method,
+    const char *path, int err)
+{
+	nni_http_handler *h = NULL;
+
+	NUTS_FAIL(nni_http_server_lookup(s, host, method, path, &h), err);
+	NUTS_NULL(h);
+}
+
+void
+test_route_exact(void)
+{
+	nng_http_server  *s = route_server();
+	nng_http_handler *h1;
+	nng_http_handler *h2;
+	nng_http_handler *h3;
+
+	h1 = route_add(s, "/a", "GET", NULL, false);
+	h2 = route_add(s, "/a/b", "GET", NULL, false);
+	h3 = route_add(s, "/", "GET", NULL, false);
+
+	route_check(s, NULL, "GET", "/a", h1);
+	route_check(s, NULL, "GET", "/a/", h1);
+	route_check(s, NULL, "GET", "/a/b", h2);
+	route_check(s, NULL, "GET", "", h3);
+	route_check(s, NULL, "GET", "/", h3);
+	route_fail(s, NULL, "GET", "/a/c", NNG_ENOENT);
+	route_fail(s, NULL, "GET", "/ab", NNG_ENOENT);
+	route_fail(s, NULL, "GET", "/a/b/c", NNG_ENOENT);
+	nng_http_server_release(s);
+}
+
+void
+test_route_tree(void)
+{
+	nng_http_server  *s = route_server();
+	nng_http_handler *h1;
+	nng_http_handler *h2;
+
+	h1 = route_add(s, "/t", "GET", NULL, true);
+	h2 = route_add(s, "/t/x", "GET", NULL, false);
+
+	route_check(s, NULL, "GET", "/t", h1);
+	route_check(s, NULL, "GET", "/t/y/z", h1);
+	route_check(s, NULL, "GET", "/t/x", h2);
+	route_check(s, NULL, "GET", "/t/x/", h2);
+	route_check(s, NULL, "GET", "/t/x/y", h1);
+	route_fail(s, NULL, "GET", "/tx", NNG_ENOENT);
+	nng_http_server_release(s);
+}
+
+void
+test_route_method(void)
+{
+	nng_http_server  *s = route_server();
+	nng_http_handler *h1;
+	nng_http_handler *h2;
+	nng_http_handler *h3;
+	nng_http_handler *h4;
+
+	h1 = route_add(s, "/m", "POST", NULL, false);
+	h2 = route_add(s, "/g", "GET", NULL, false);
+	h3 = route_add(s, "/g", "HEAD", NULL, false);
+	h4 = route_add(s, "/any", "", NULL, true);
+
+	route_check(s, NULL, "POST", "/m", h1);
+	route_fail(s, NULL, "GET", "/m", NNG_ENOTSUP);
+	route_check(s, NULL, "GET", "/g", h2);
+	route_check(s, NULL, "HEAD", "/g", h3);
+	route_check(s, NULL, "DELETE", "/any/thing", h4);
+
+	// Without a HEAD specific handler, GET is used for HEAD.
+	NUTS_PASS(nng_http_server_del_handler(s, h3));
+	nng_http_handler_free(h3);
+	route_check(s, NULL, "HEAD", "/g", h2);
+	route_fail(s, NULL, "PUT", "/g", NNG_ENOTSUP);
+	nng_http_server_release(s);
+}
+
+void
+test_route_host(void)
+{
+	nng_http_server  *s = route_server();
+	nng_http_handler *h1;
+	nng_http_handler *h2;
+	nng_http_handler *h3;
+
+	h1 = route_add(s, "/h", "GET", "a.example", false);
+	h2 = route_add(s, "/h", "GET", "b.example", false);
+	h3 = route_add(s, "/h", "GET", NULL, false);
+
+	route_check(s, "a.example", "GET", "/h", h1);
+	route_check(s, "b.example:80", "GET", "/h", h2);
+	route_check(s, "c.example", "GET", "/h", h3);
+	route_check(s, NULL, "GET", "/h", h3);
+
+	NUTS_PASS(nng_http_server_del_handler(s, h3));
+	nng_http_handler_free(h3);
+	route_fail(s, "c.example", "GET", "/h", NNG_ENOENT);
+	route_check(s, "a.example", "GET", "/h", h1);
+	nng_http_server_release(s);
+}
+
+void
+test_route_deep(void)
+{
+	nng_http_server  *s = route_server();
+	nng_http_handler *h;
+	char              path[256];
+
+	h = route_add(s, "/d", "GET", NULL, true);
+
+	// More segments than we route without allocating.
+	(void) snprintf(path, sizeof(path), "/d");
+	for (int i = 0; i < 40; i++) {
+		(void) strcat(path, "/x");
+	}
+	route_check(s, NULL, "GET", path, h);
+	nng_http_server_release(s);
+}
+
+#define ROUTE_BENCH_HANDLERS 500
+#define ROUTE_BENCH_LOOKUPS 200000
+
+void
+test_route_bench(void)
+{
+	nng_http_server  *s = route_server();
+	nng_http_handler *hs[ROUTE_BENCH_HANDLERS];
+	char              uri[64];
+	nng_time          start;
+	nng_duration      elapsed;
+
+	for (int i = 0; i < ROUTE_BENCH_HANDLERS; i++) {
+		(void) snprintf(uri, sizeof(uri), "/api/v1/res%d", i);
+		hs[i] = route_add(s, uri, "GET", NULL, (i % 2) == 0);
+	}
+
+	start = nng_clock();
+	for (int i = 0; i < ROUTE_BENCH_LOOKUPS; i++) {
+		nni_http_handler *h;
+		int               n = i % ROUTE_BENCH_HANDLERS;
+
+		(void) snprintf(uri, sizeof(uri), "/api/v1/res%d%s", n,
+		    (n % 2) == 0 ? "/item/42" : "");
+		NUTS_PASS(nni_http_server_lookup(s, NULL, "GET", uri, &h));
+		NUTS_TRUE(h == hs[n]);
+		nni_http_handler_fini(h);
+	}
+	elapsed = (nng_duration) (nng_clock() - start);
+	(void) printf("%d handlers, %d lookups in %d ms (%.1f ns/lookup)\n",
+	    ROUTE_BENCH_HANDLERS, ROUTE_BENCH_LOOKUPS, (int) elapsed,
+	    (elapsed * 1000000.0) / ROUTE_BENCH_LOOKUPS);
+	nng_http_server_release(s);
+}
+
+// Pipelining tests.  The slow handler answers after a delay, so requests
+// pipelined behind it are only answered quickly if handlers run
+// concurrently.
+#define PIPE_DELAY 300
+
+typedef struct {
+	nng_aio *sleep;
+	nng_aio *uaio;
+} pipe_slow;
+
+static void
+pipe_slow_done(void *arg)
+{
+	pipe_slow    *ps  = arg;
+	nng_aio      *aio = ps->uaio;
+	nng_http_req *req = nng_aio_get_input(aio, 0);
+	nng_http_res *res;
+	const char   *uri = nng_http_req_get_uri(req);
+
+	nng_aio_reap(ps->sleep);
+	free(ps);
+	if (nng_http_res_alloc(&res) != 0) {
+		nng_aio_finish(aio, NNG_ENOMEM);
+		return;
+	}
+	if (nng_http_res_copy_data(res, uri, strlen(uri)) != 0) {
+		nng_http_res_free(res);
+		nng_aio_finish(aio, NNG_ENOMEM);
+		return;
+	}
+	nng_aio_set_output(aio, 0, res);
+	nng_aio_finish(aio, 0);
+}
+
+static void
+pipe_slow_cb(nng_aio *aio)
+{
+	pipe_slow *ps;
+
+	if ((ps = malloc(sizeof(*ps))) == NULL) {
+		nng_aio_finish(aio, NNG_ENOMEM);
+		return;
+	}
+	ps->uaio = aio;
+	if (nng_aio_alloc(&ps->sleep, pipe_slow_done, ps) != 0) {
+		free(ps);
+		nng_aio_finish(aio, NNG_ENOMEM);
+		return;
+	}
+	nng_sleep_aio(PIPE_DELAY, ps->sleep);
+}
+
+static void
+pipe_direct_cb(nng_aio *aio)
+{
+	nng_http_res *res;
+
+	NUTS_PASS(nng_http_res_alloc(&res));
+	NUTS_PASS(nng_http_res_copy_data(res, "direct", 6));
+	nng_aio_set_output(aio, 0, res);
+	nng_aio_finish(aio, 0);
+}
+
+static nng_http_server *
+pipe_server(void)
+{
+	nng_http_server  *s;
+	nng_http_handler *h;
+	nng_url          *url;
+
+	NUTS_PASS(nng_url_parse(&url, "http://127.0.0.1:0"));
+	NUTS_PASS(nng_http_server_hold(&s, url));
+	nng_url_free(url);
+
+	NUTS_PASS(nng_http_handler_alloc(&h, "/slow", pipe_slow_cb));
+	NUTS_PASS(nng_http_handler_set_tree(h));
+	NUTS_PASS(nng_http_handler_set_pipeline(h, true));
+	NUTS_PASS(nng_http_server_add_handler(s, h));
+	NUTS_FAIL(nng_http_handler_set_pipeline(h, false), NNG_EBUSY);
+
+	// This one is not marked, so it must wait for earlier responses.
+	NUTS_PASS(nng_http_handler_alloc(&h, "/direct", pipe_direct_cb));
+	NUTS_PASS(nng_http_server_add_handler(s, h));
+
+	NUTS_PASS(nng_http_handler_alloc_static(
+	    &h, "/static", "static", 6, "text/plain"));
+	NUTS_PASS(nng_http_server_add_handler(s, h));
+
+	NUTS_PASS(nng_http_server_start(s));
+	return (s);
+}
+
+// pipe_exchange sends all the requests in a single write, and collects
+// what the server sends back until it closes the connection.
+static void
+pipe_exchange(nng_http_server *s, const char *reqs, char *buf, size_t sz)
+{
+	nng_stream_dialer *d;
+	nng_stream        *c;
+	nng_aio           *aio;
+	nng_sockaddr       sa;
+	char               addr[64];
+	nng_iov            iov;
+	size_t             len = 0;
+
+	NUTS_PASS(nng_http_server_get_addr(s, &sa));
+	(void) snprintf(addr, sizeof(addr), "tcp://127.0.0.1:%u",
+	    nuts_be16(sa.s_in.sa_port));
+	NUTS_PASS(nng_stream_dialer_alloc(&d, addr));
+	NUTS_PASS(nng_aio_alloc(&aio, NULL, NULL));
+	nng_aio_set_timeout(aio, 5000);
+	nng_stream_dialer_dial(d, aio);
+	nng_aio_wait(aio);
+	NUTS_PASS(nng_aio_result(aio));
+	c = nng_aio_get_output(aio, 0);
+
+	NUTS_PASS(nuts_stream_wait(
+	    nuts_stream_send_start(c, (void *) reqs, strlen(reqs))));
+
+	for (;;) {
+		NUTS_TRUE(len < sz - 1);
+		iov.iov_buf = buf + len;
+		iov.iov_len = sz - 1 - len;
+		NUTS_PASS(nng_aio_set_iov(aio, 1, &iov));
+		nng_stream_recv(c, aio);
+		nng_aio_wait(aio);
+		if (nng_aio_result(aio) != 0) {
+			break;
+		}
+		len += nng_aio_count(aio);
+	}
+	buf[len] = '\0';
+	nng_stream_free(c);
+	nng_stream_dialer_free(d);
+	nng_aio_free(aio);
+}
+
+// pipe_bodies extracts the bodies of the responses, separated by spaces.
+static void
+pipe_bodies(const char *buf, char *out, size_t sz)
+{
+	const char *p = buf;
+
+	*out = '\0';
+	while ((p = strstr(p, "Content-Length: ")) != NULL) {
+		int len = atoi(p + strlen("Content-Length: "));
+		p       = strstr(p, "\r\n\r\n") + 4;
+		if (*out != '\0') {
+			(void) strncat(out, " ", sz - strlen(out) - 1);
+		}
+		(void) strncat(out, p, len < (int) (sz - strlen(out) - 1)
+		        ? (size_t) len
+		        : sz - strlen(out) - 1);
+		p += len;
+	}
+}
+
+void
+test_pipeline_order(void)
+{
+	nng_http_server *s = pipe_server();
+	char             buf[4096];
+	char             bodies[2048];
+	nng_time         start;
+	nng_duration     elapsed;
+
+	start = nng_clock();
+	pipe_exchange(s,
+	    "GET /slow/1 HTTP/1.1\r\nHost: x\r\n\r\n"
+	    "GET /slow/2 HTTP/1.1\r\nHost: x\r\n\r\n"
+	    "GET /static HTTP/1.1\r\nHost: x\r\n\r\n"
+	    "GET /slow/3 HTTP/1.1\r\nHost: x\r\n\r\n"
+	    "GET /missing HTTP/1.1\r\nHost: x\r\n\r\n"
+	    "GET /direct HTTP/1.1\r\nHost: x\r\n\r\n"
+	    "GET /slow/4 HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n",
+	    buf, sizeof(buf));
+	elapsed = (nng_duration) (nng_clock() - start);
+
+	pipe_bodies(buf, bodies, sizeof(bodies));
+	NUTS_ASSERT(strstr(bodies, "/slow/1 /slow/2 static /slow/3 ") ==
+	    bodies);
+	NUTS_ASSERT(strstr(bodies, " direct /slow/4") != NULL);
+	NUTS_ASSERT(strstr(buf, "404 Not Found") != NULL);
+
+	// The first three slow requests run together, then the direct
+	// handler waits for them, and the last one runs on its own.
+	NUTS_TRUE(elapsed < 3 * PIPE_DELAY);
+	nng_http_server_release(s);
+}
+
+void
+test_pipeline_close(void)
+{
+	nng_http_server *s = pipe_server();
+	char             buf[4096];
+	char             bodies[256];
+
+	// Requests after one asking to close are not answered.
+	pipe_exchange(s,
+	    "GET /slow/1 HTTP/1.1\r\nHost: x\r\n\r\n"
+	    "GET /static HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n"
+	    "GET /slow/2 HTTP/1.1\r\nHost: x\r\n\r\n",
+	    buf, sizeof(buf));
+	pipe_bodies(buf, bodies, sizeof(bodies));
+	NUTS_MATCH(bodies, "/slow/1 static");
+	nng_http_server_release(s);
+}
+
+void
+test_pipeline_limit(void)
+{
+	nng_http_server *s = pipe_server();
+	char             reqs[4096];
+	char             buf[16384];
+	char             bodies[1024];
+	char             want[1024];
+
+	// More requests than we run at once still all get answers,
+	// in order.
+	reqs[0] = '\0';
+	want[0] = '\0';
+	for (int i = 0; i < 20; i++) {
+		char line[128];
+		(void) snprintf(line, sizeof(line),
+		    "GET /slow/%d HTTP/1.1\r\nHost: x\r\n%s\r\n", i,
+		    i == 19 ? "Connection: close\r\n" : "");
+		(void) strcat(reqs, line);
+		(void) snprintf(line, sizeof(line), "%s/slow/%d",
+		    i == 0 ? "" : " ", i);
+		(void) strcat(want, line);
+	}
+	pipe_exchange(s, reqs, buf, sizeof(buf));
+	pipe_bodies(buf, bodies, sizeof(bodies));
+	NUTS_MATCH(bodies, want);
+	nng_http_server_release(s);
+}
+
+// Streaming body tests.  The upload handler reads the body a few bytes
+// at a time, and answers with its length and the start of it.
+typedef struct {
+	nng_aio *aio;
+	nng_aio *uaio;
+	size_t   len;
+	char     data[33];
+	char     rbuf[5];
+} stream_up;
+
+static void
+stream_up_reply(stream_up *su, int rv)
+{
+	nng_aio      *aio = su->uaio;
+	nng_http_res *res;
+	char          body[64];
+
+	if ((rv == 0) && ((rv = nng_http_res_alloc(&res)) == 0)) {
+		(void) snprintf(
+		    body, sizeof(body), "%u:%s", (unsigned) su->len, su->data);
+		if ((rv = nng_http_res_copy_data(res, body, strlen(body))) !=
+		    0) {
+			nng_http_res_free(res);
+		} else {
+			nng_aio_set_output(aio, 0, res);
+		}
+	}
+	nng_aio_reap(su->aio);
+	free(su);
+	nng_aio_finish(aio, rv);
+}
+
+static void
+stream_up_read(stream_up *su)
+{
+	nng_iov iov;
+
+	iov.iov_buf = su->rbuf;
+	iov.iov_len = sizeof(su->rbuf);
+	(void) nng_aio_set_iov(su->aio, 1, &iov);
+	nng_http_conn_read_body(nng_aio_get_input(su->uaio, 2), su->aio);
+}
+
+static void
+stream_up_done(void *arg)
+{
+	stream_up *su = arg;
+	size_t     n;
+	size_t     have;
+	int        rv;
+
+	if ((rv = nng_aio_result(su->aio)) != 0) {
+		stream_up_reply(su, rv);
+		return;
+	}
+	if ((n = nng_aio_count(su->aio)) == 0) {
+		stream_up_reply(su, 0);
+		return;
+	}
+	have = strlen(su->data);
+	if (have < sizeof(su->data) - 1) {
+		size_t room = sizeof(su->data) - 1 - have;
+		memcpy(su->data + have, su->rbuf, n < room ? n : room);
+	}
+	su->len += n;
+	stream_up_read(su);
+}
+
+static void
+stream_up_cb(nng_aio *aio)
+{
+	stream_up *su;
+
+	if ((su = calloc(1, sizeof(*su))) == NULL) {
+		nng_aio_finish(aio, NNG_ENOMEM);
+		return;
+	}
+	su->uaio = aio;
+	if (nng_aio_alloc(&su->aio, stream_up_done, su) != 0) {
+		free(su);
+		nng_aio_finish(aio, NNG_ENOMEM);
+		return;
+	}
+	stream_up_read(su);
+}
+
+static void
+stream_ignore_cb(nng_aio *aio)
+{
+	nng_http_res *res;
+
+	NUTS_PASS(nng_http_res_alloc(&res));
+	NUTS_PASS(nng_http_res_copy_data(res, "ignored", 7));
+	nng_aio_set_output(aio, 0, res);
+	nng_aio_finish(aio, 0);
+}
+
+static nng_http_server *
+stream_server(void)
+{
+	nng_http_server  *s;
+	nng_http_handler *h;
+	nng_url          *url;
+
+	NUTS_PASS(nng_url_parse(&url, "http://127.0.0.1:0"));
+	NUTS_PASS(nng_http_server_hold(&s, url));
+	nng_url_free(url);
+
+	NUTS_PASS(nng_http_handler_alloc(&h, "/upload", stream_up_cb));
+	NUTS_PASS(nng_http_handler_set_method(h, "POST"));
+	NUTS_PASS(nng_http_handler_stream_body(h, true));
+	NUTS_PASS(nng_http_server_add_handler(s, h));
+	NUTS_FAIL(nng_http_handler_stream_body(h, false), NNG_EBUSY);
+
+	NUTS_PASS(nng_http_handler_alloc(&h, "/ignore", stream_ignore_cb));
+	NUTS_PASS(nng_http_handler_set_method(h, "POST"));
+	NUTS_PASS(nng_http_handler_stream_body(h, true));
+	NUTS_PASS(nng_http_server_add_handler(s, h));
+
+	NUTS_PASS(nng_http_handler_alloc_static(
+	    &h, "/static", "static", 6, "text/plain"));
+	NUTS_PASS(nng_http_server_add_handler(s, h));
+
+	NUTS_PASS(nng_http_server_start(s));
+	return (s);
+}
+
+void
+test_stream_body_length(void)
+{
+	nng_http_server *s = stream_server();
+	char             buf[4096];
+	char             bodies[256];
+
+	// The request following the body is still found.
+	pipe_exchange(s,
+	    "POST /upload HTTP/1.1\r\nHost: x\r\nContent-Length: 11\r\n\r\n"
+	    "hello world"
+	    "POST /upload HTTP/1.1\r\nHost: x\r\n\r\n"
+	    "GET /static HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n",
+	    buf, sizeof(buf));
+	pipe_bodies(buf, bodies, sizeof(bodies));
+	NUTS_MATCH(bodies, "11:hello world 0: static");
+	nng_http_server_release(s);
+}
+
+void
+test_stream_body_chunked(void)
+{
+	nng_http_server *s = stream_server();
+	char             buf[4096];
+	char             bodies[256];
+
+	pipe_exchange(s,
+	    "POST /upload HTTP/1.1\r\nHost: x\r\n"
+	    "Transfer-Encoding: chunked\r\n\r\n"
+	    "5\r\nhello\r\n"
+	    "6;name=value\r\n world\r\n"
+	    "0\r\nX-Trailer: yes\r\n\r\n"
+	    "GET /static HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n",
+	    buf, sizeof(buf));
+	pipe_bodies(buf, bodies, sizeof(bodies));
+	NUTS_MATCH(bodies, "11:hello world static");
+	nng_http_server_release(s);
+}
+
+void
+test_stream_body_large(void)
+{
+	nng_http_server *s = stream_server();
+	char             buf[4096];
+	char             bodies[256];
+	char            *reqs;
+	size_t           size = 1024 * 1024;
+	size_t           len;
+
+	NUTS_TRUE((reqs = malloc(size + 256)) != NULL);
+	len = (size_t) snprintf(reqs, 256,
+	    "POST /upload HTTP/1.1\r\nHost: x\r\nConnection: close\r\n"
+	    "Content-Length: %u\r\n\r\n",
+	    (unsigned) size);
+	for (size_t i = 0; i < size; i++) {
+		reqs[len + i] = (char) ('a' + (i % 26));
+	}
+	reqs[len + size] = '\0';
+	pipe_exchange(s, reqs, buf, sizeof(buf));
+	pipe_bodies(buf, bodies, sizeof(bodies));
+	NUTS_MATCH(bodies, "1048576:abcdefghijklmnopqrstuvwxyzabcdef");
+	free(reqs);
+	nng_http_server_release(s);
+}
+
+void
+test_stream_body_unread(void)
+{
+	nng_http_server *s = stream_server();
+	char             buf[4096];
+	char             bodies[256];
+
+	// We cannot find the request after a body that was not read, so
+	// the connection is closed.
+	pipe_exchange(s,
+	    "POST /ignore HTTP/1.1\r\nHost: x\r\nContent-Length: 5\r\n\r\n"
+	    "hello"
+	    "GET /static HTTP/1.1\r\nHost: x\r\n\r\n",
+	    buf, sizeof(buf));
+	pipe_bodies(buf, bodies, sizeof(bodies));
+	NUTS_MATCH(bodies, "ignored");
+	NUTS_ASSERT(strstr(buf, "Connection: close") != NULL);
+	nng_http_server_release(s);
+}
+
+void
+test_stream_body_bad(void)
+{
+	nng_http_server *s = stream_server();
+	char             buf[4096];
+
+	pipe_exchange(s,
+	    "POST /upload HTTP/1.1\r\nHost: x\r\n"
+	    "Transfer-Encoding: gzip\r\n\r\n"
+	    "GET /static HTTP/1.1\r\nHost: x\r\n\r\n",
+	    buf, sizeof(buf));
+	NUTS_ASSERT(strstr(buf, "501 Not Implemented") != NULL);
+	NUTS_ASSERT(strstr(buf, "static") == NULL);
+
+	pipe_exchange(s,
+	    "POST /upload HTTP/1.1\r\nHost: x\r\n"
+	    "Content-Length: -1\r\n\r\n"
+	    "GET /static HTTP/1.1\r\nHost: x\r\n\r\n",
+	    buf, sizeof(buf));
+	NUTS_ASSERT(strstr(buf, "400 Bad Request") != NULL);
+	NUTS_ASSERT(strstr(buf, "static") == NULL);
+
+	pipe_exchange(s,
+	    "POST /upload HTTP/1.1\r\nHost: x\r\n"
+	    "Transfer-Encoding: chunked\r\n\r\n"
+	    "5\r\nhello\r\nbogus\r\n",
+	    buf, sizeof(buf));
+	NUTS_ASSERT(strstr(buf, "200 OK") == NULL);
+	nng_http_server_release(s);
+}
+
+// Compression tests.
+void
+test_compress_accept(void)
+{
+	NUTS_TRUE(nni_http_accept_encoding(NULL) == NNI_HTTP_ENC_IDENTITY);
+	NUTS_TRUE(nni_http_accept_encoding("br") == NNI_HTTP_ENC_IDENTITY);
+	NUTS_TRUE(
+	    nni_http_accept_encoding("identity") == NNI_HTTP_ENC_IDENTITY);
+	NUTS_TRUE(nni_http_accept_encoding("gzip;q=0, *;q=0") ==
+	    NNI_HTTP_ENC_IDENTITY);
+#ifdef NNG_HAVE_ZLIB
+	NUTS_TRUE(nni_http_accept_encoding("gzip") == NNI_HTTP_ENC_GZIP);
+	NUTS_TRUE(nni_http_accept_encoding("x-gzip") == NNI_HTTP_ENC_GZIP);
+	NUTS_TRUE(nni_http_accept_encoding("*") == NNI_HTTP_ENC_GZIP);
+	NUTS_TRUE(
+	    nni_http_accept_encoding("deflate") == NNI_HTTP_ENC_DEFLATE);
+	NUTS_TRUE(nni_http_accept_encoding("gzip, deflate, br") ==
+	    NNI_HTTP_ENC_GZIP);
+	NUTS_TRUE(nni_http_accept_encoding("deflate, gzip;q=0.5") ==
+	    NNI_HTTP_ENC_DEFLATE);
+	NUTS_TRUE(nni_http_accept_encoding("gzip;q=0, deflate") ==
+	    NNI_HTTP_ENC_DEFLATE);
+	NUTS_TRUE(nni_http_accept_encoding("GZIP ; Q=0.9, *;q=0.1") ==
+	    NNI_HTTP_ENC_GZIP);
+#else
+	NUTS_TRUE(nni_http_accept_encoding("gzip") == NNI_HTTP_ENC_IDENTITY);
+#endif
+}
+
+#ifdef NNG_HAVE_ZLIB
+#define COMP_SIZE 4096
+
+static char comp_text[COMP_SIZE];
+
+static void
+comp_cb(nng_aio *aio)
+{
+	nng_http_res *res;
+
+	NUTS_PASS(nng_http_res_alloc(&res));
+	NUTS_PASS(nng_http_res_copy_data(res, comp_text, COMP_SIZE));
+	NUTS_PASS(nng_http_res_set_header(res, "ETag", "\"dyn\""));
+	nng_aio_set_output(aio, 0, res);
+	nng_aio_finish(aio, 0);
+}
+
+static nng_http_server *
+comp_server(void)
+{
+	nng_http_server  *s;
+	nng_http_handler *h;
+	nng_url          *url;
+
+	for (int i = 0; i < COMP_SIZE; i++) {
+		comp_text[i] = "lorem ipsum dolor sit amet "[i % 27];
+	}
+	NUTS_PASS(nng_url_parse(&url, "http://127.0.0.1:0"));
+	NUTS_PASS(nng_http_server_hold(&s, url));
+	nng_url_free(url);
+
+	NUTS_PASS(nng_http_handler_alloc(&h, "/dyn", comp_cb));
+	NUTS_PASS(nng_http_handler_set_compress(h, true, 1024));
+	NUTS_PASS(nng_http_server_add_handler(s, h));
+	NUTS_FAIL(nng_http_handler_set_compress(h, false, 0), NNG_EBUSY);
+
+	// Too small to bother with.
+	NUTS_PASS(nng_http_handler_alloc(&h, "/big", comp_cb));
+	NUTS_PASS(nng_http_handler_set_compress(h, true, COMP_SIZE + 1));
+	NUTS_PASS(nng_http_server_add_handler(s, h));
+
+	NUTS_PASS(nng_http_handler_alloc_static(
+	    &h, "/static", comp_text, COMP_SIZE, "text/plain"));
+	NUTS_PASS(nng_http_handler_set_compress(h, true, 0));
+	NUTS_PASS(nng_http_server_add_handler(s, h));
+
+	NUTS_PASS(nng_http_server_start(s));
+	return (s);
+}
+
+// comp_check decompresses the body of the (single) response in buf, and
+// checks that it is the text we sent.
+static void
+comp_check(const char *buf)
+{
+	const char *p;
+	z_stream    z;
+	char        out[COMP_SIZE + 1];
+	int         len;
+
+	NUTS_TRUE((p = strstr(buf, "Content-Length: ")) != NULL);
+	len = atoi(p + strlen("Content-Length: "));
+	NUTS_TRUE(len > 0);
+	NUTS_TRUE(len < COMP_SIZE / 4);
+	p = strstr(p, "\r\n\r\n") + 4;
+
+	memset(&z, 0, sizeof(z));
+	NUTS_TRUE(inflateInit2(&z, 15 + 32) == Z_OK); // gzip or zlib
+	z.next_in   = (Bytef *) p;
+	z.avail_in  = (uInt) len;
+	z.next_out  = (Bytef *) out;
+	z.avail_out = sizeof(out);
+	NUTS_TRUE(inflate(&z, Z_FINISH) == Z_STREAM_END);
+	NUTS_TRUE(z.total_out == COMP_SIZE);
+	NUTS_TRUE(memcmp(out, comp_text, COMP_SIZE) == 0);
+	inflateEnd(&z);
+}
+
+void
+test_compress_dynamic(void)
+{
+	nng_http_server *s = comp_server();
+	char             buf[16384];
+
+	pipe_exchange(s,
+	    "GET /dyn HTTP/1.1\r\nHost: x\r\nConnection: close\r\n"
+	    "Accept-Encoding: gzip, deflate\r\n\r\n",
+	    buf, sizeof(buf));
+	NUTS_ASSERT(strstr(buf, "Content-Encoding: gzip\r\n") != NULL);
+	NUTS_ASSERT(strstr(buf, "Vary: Accept-Encoding\r\n") != NULL);
+	NUTS_ASSERT(strstr(buf, "ETag: \"dyn-gzip\"\r\n") != NULL);
+	comp_check(buf);
+
+	pipe_exchange(s,
+	    "GET /dyn HTTP/1.1\r\nHost: x\r\nConnection: close\r\n"
+	    "Accept-Encoding: deflate\r\n\r\n",
+	    buf, sizeof(buf));
+	NUTS_ASSERT(strstr(buf, "Content-Encoding: deflate\r\n") != NULL);
+	comp_check(buf);
+
+	// Not accepted, but the response still varies.
+	pipe_exchange(s,
+	    "GET /dyn HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n", buf,
+	    sizeof(buf));
+	NUTS_ASSERT(strstr(buf, "Content-Encoding") == NULL);
+	NUTS_ASSERT(strstr(buf, "Vary: Accept-Encoding\r\n") != NULL);
+	NUTS_ASSERT(strstr(buf, "Content-Length: 4096\r\n") != NULL);
+
+	// Below the threshold, so it never varies.
+	pipe_exchange(s,
+	    "GET /big HTTP/1.1\r\nHost: x\r\nConnection: close\r\n"
+	    "Accept-Encoding: gzip\r\n\r\n",
+	    buf, sizeof(buf));
+	NUTS_ASSERT(strstr(buf, "Content-Encoding") == NULL);
+	NUTS_ASSERT(strstr(buf, "Vary") == NULL);
+	nng_http_server_release(s);
+}
+
+void
+test_compress_static(void)
+{
+	nng_http_server *s = comp_server();
+	char             buf[16384];
+	char             etag[64];
+	char             req[256];
+	const char      *p;
+
+	for (int i = 0; i < 2; i++) {
+		pipe_exchange(s,
+		    "GET /static HTTP/1.1\r\nHost: x\r\nConnection: close\r\n"
+		    "Accept-Encoding: gzip\r\n\r\n",
+		    buf, sizeof(buf));
+		NUTS_ASSERT(strstr(buf, "Content-Encoding: gzip\r\n") != NULL);
+		comp_check(buf);
+	}
+	NUTS_TRUE((p = strstr(buf, "ETag: ")) != NULL);
+	(void) snprintf(etag, sizeof(etag), "%.*s",
+	    (int) (strstr(p, "\r\n") - p - 6), p + 6);
+	NUTS_ASSERT(strstr(etag, "-gzip\"") != NULL);
+
+	// The compressed representation has its own validator.
+	(void) snprintf(req, sizeof(req),
+	    "GET /static HTTP/1.1\r\nHost: x\r\nConnection: close\r\n"
+	    "Accept-Encoding: gzip\r\nIf-None-Match: %s\r\n\r\n",
+	    etag);
+	pipe_exchange(s, req, buf, sizeof(buf));
+	NUTS_ASSERT(strstr(buf, "304 Not Modified") != NULL);
+
+	(void) snprintf(req, sizeof(req),
+	    "GET /static HTTP/1.1\r\nHost: x\r\nConnection: close\r\n"
+	    "If-None-Match: %s\r\n\r\n",
+	    etag);
+	pipe_exchange(s, req, buf, sizeof(buf));
+	NUTS_ASSERT(strstr(buf, "200 OK") != NULL);
+	NUTS_ASSERT(strstr(buf, "Content-Length: 4096\r\n") != NULL);
+	nng_http_server_release(s);
+}
+#endif
+
+#ifdef NNG_ENABLE_STATS
+void
+test_stats_openmetrics(void)
+{
+	nng_http_server  *s;
+	nng_http_handler *h;
+	nng_url          *url;
+	nng_socket        s1;
+	nng_socket        s2;
+	char             *buf;
+	char              want[128];
+	size_t            sz = 1 << 20;
+
+	NUTS_ASSERT((buf = malloc(sz)) != NULL);
+	NUTS_OPEN(s1);
+	NUTS_OPEN(s2);
+	NUTS_PASS(nng_socket_set_string(s1, NNG_OPT_SOCKNAME, "say \"hi\""));
+	NUTS_MARRY(s1, s2);
+	NUTS_SEND(s1, "ping");
+	NUTS_RECV(s2, "ping");
+
+	NUTS_PASS(nng_url_parse(&url, "http://127.0.0.1:0"));
+	NUTS_PASS(nng_http_server_hold(&s, url));
+	nng_url_free(url);
+	NUTS_PASS(nng_http_handler_alloc_stats(&h, "/metrics"));
+	NUTS_PASS(nng_http_server_add_handler(s, h));
+	NUTS_PASS(nng_http_server_start(s));
+
+	pipe_exchange(s,
+	    "GET /metrics HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n",
+	    buf, sz);
+	NUTS_ASSERT(strstr(buf, "200 OK") != NULL);
+	NUTS_ASSERT(strstr(buf,
+	                "Content-Type: application/openmetrics-text; "
+	                "version=1.0.0; charset=utf-8\r\n") != NULL);
+
+	// Each family has a single header, ahead of all its samples.
+	NUTS_ASSERT(strstr(buf, "# TYPE nng_socket_tx_msgs counter\n") != NULL);
+	NUTS_ASSERT(strstr(strstr(buf, "# TYPE nng_socket_tx_msgs counter\n") +
+	                1,
+	                "# TYPE nng_socket_tx_msgs ") == NULL);
+	NUTS_ASSERT(strstr(buf, "# HELP nng_socket_tx_msgs sent messages\n") !=
+	    NULL);
+	(void) snprintf(want, sizeof(want),
+	    "nng_socket_tx_msgs_total{socket=\"%d\",name=\"say \\\"hi\\\"\","
+	    "protocol=\"pair1\"} 1\n",
+	    nng_socket_id(s1));
+	NUTS_ASSERT(strstr(buf, want) != NULL);
+	NUTS_ASSERT(strstr(buf, "# TYPE nng_pipe_rx_msgs counter\n") != NULL);
+	NUTS_ASSERT(strstr(buf, "# TYPE nng_socket_tx_wait summary\n") != NULL);
+	NUTS_ASSERT(strstr(buf, "quantile=\"0.99\"} ") != NULL);
+	NUTS_ASSERT(strstr(buf, "nng_socket_tx_wait_count{") != NULL);
+	NUTS_ASSERT(strcmp(buf + strlen(buf) - 6, "# EOF\n") == 0);
+
+	nng_http_server_release(s);
+	NUTS_CLOSE(s1);
+	NUTS_CLOSE(s2);
+	free(buf);
+}
+#endif
+
+NUTS_TESTS = {
+	{ "http route exact", test_route_exact },
+	{ "http route tree", test_route_tree },
+	{ "http route method", test_route_method },
+	{ "http route host", test_route_host },
+	{ "http route deep", test_route_deep },
+	{ "http route bench", test_route_bench },
+	{ "http pipeline order", test_pipeline_order },
+	{ "http pipeline close", test_pipeline_close },
+	{ "http pipeline limit", test_pipeline_limit },
+	{ "http stream body length", test_stream_body_length },
+	{ "http stream body chunked", test_stream_body_chunked },
+	{ "http stream body large", test_stream_body_large },
+	{ "http stream body unread", test_stream_body_unread },
+	{ "http stream body bad", test_stream_body_bad },
+	{ "http compress accept", test_compress_accept },
+#ifdef NNG_HAVE_ZLIB
+	{ "http compress dynamic", test_compress_dynamic },
+	{ "http compress static", test_compress_static },
+#endif
+#ifdef NNG_ENABLE_STATS
+	{ "http stats openmetrics", test_stats_openmetrics },
+#endif
+	{ NULL, NULL },
+};
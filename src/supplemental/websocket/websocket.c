@@ -1,5 +1,5 @@
 //
-// Copyright 2023 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 // Copyright 2019 Devolutions <info@devolutions.net>
 //
@@ -9,7 +9,9 @@
 // found online at https://opensource.org/licenses/MIT.
 //
 
+#include <ctype.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -22,6 +24,10 @@
 
 #include "websocket.h"
 
+#ifdef NNG_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 // This should be removed or handled differently in the future.
 typedef int (*nni_ws_listen_hook)(void *, nng_http_req *, nng_http_res *);
 
@@ -31,6 +37,7 @@ typedef int (*nni_ws_listen_hook)(void *, nng_http_req *, nng_http_res *);
 #define WS_DEF_RECVMAX (1U << 20)    // 1MB Message limit (message mode only)
 #define WS_DEF_MAXRXFRAME (1U << 20) // 1MB Frame size (recv)
 #define WS_DEF_MAXTXFRAME (1U << 16) // 64KB Frame size (send)
+#define WS_DEF_DEFLATE_BITS 15       // 32KB LZ77 window
 
 // Alias for checking the prefix of a string.
 #define startswith(s, t) (strncmp(s, t, strlen(t)) == 0)
@@ -80,6 +87,23 @@ struct nni_ws {
 	size_t           recvmax; // largest message size
 	nni_ws_listener *listener;
 	nni_ws_dialer   *dialer;
+	bool             deflate;       // permessage-deflate in use
+	bool             deflate_reset; // no context takeover (our side)
+	bool             rxdeflate;     // message being received is compressed
+#ifdef NNG_HAVE_ZLIB
+	z_stream *zdef;
+	z_stream *zinf;
+#endif
+	uint64_t      ztx_raw;
+	uint64_t      ztx_wire;
+	uint64_t      zrx_wire;
+	uint64_t      zrx_raw;
+	uint64_t      ztime; // microseconds
+	nni_stat_item st_tx_raw;
+	nni_stat_item st_tx_wire;
+	nni_stat_item st_rx_wire;
+	nni_stat_item st_rx_raw;
+	nni_stat_item st_time;
 };
 
 struct nni_ws_listener {
@@ -104,6 +128,9 @@ struct nni_ws_listener {
 	size_t              maxframe;
 	size_t              fragsize;
 	size_t              recvmax; // largest message size
+	bool                deflate;
+	bool                deflate_reset;
+	int                 deflate_bits;
 };
 
 // The dialer tracks user aios in two lists. The first list is for aios
@@ -130,6 +157,9 @@ struct nni_ws_dialer {
 	size_t            maxframe;
 	size_t            fragsize;
 	size_t            recvmax;
+	bool              deflate;
+	bool              deflate_reset;
+	int               deflate_bits;
 };
 
 typedef enum ws_type {
@@ -167,6 +197,14 @@ struct ws_frame {
 	uint8_t      *adata;
 	uint8_t      *buf;
 	nng_aio      *aio;
+	uint8_t      *zdata; // compressed message (send only)
+	size_t        zsize; // allocated size of zdata
+	size_t        zlen;  // compressed length
+	size_t        zoff;  // offset of the next frame to send
+	size_t        zraw;  // uncompressed length
+	bool          zpend; // not yet compressed (and so not yet prepared)
+	nni_iov       iov[7]; // payload, when sent in place (server only)
+	unsigned      niov;
 };
 
 static void ws_send_close(nni_ws *ws, uint16_t code);
@@ -346,12 +384,462 @@ ws_make_accept(const char *key, char *accept)
 	return (0);
 }
 
+// permessage-deflate (RFC 7692).  Each message is compressed as raw
+// deflate data ending in a sync flush, whose trailing empty block
+// (00 00 ff ff) is removed before sending, and put back by the receiver.
+// Unless "no context takeover" was agreed, the LZ77 window carries over
+// from one message to the next, which is where most of the gain comes
+// from with small messages that look alike.
+
+typedef struct ws_deflate_params {
+	bool server_reset; // server_no_context_takeover
+	bool client_reset; // client_no_context_takeover
+	int  server_bits;  // server_max_window_bits, 0 if absent
+	int  client_bits;  // client_max_window_bits, 0 if absent, -1 no value
+} ws_deflate_params;
+
+static const char *
+ws_skip_space(const char *s)
+{
+	while ((*s == ' ') || (*s == '\t')) {
+		s++;
+	}
+	return (s);
+}
+
+static size_t
+ws_token_len(const char *s)
+{
+	size_t len = 0;
+	while ((s[len] != '\0') && (strchr(" \t,;=\"", s[len]) == NULL)) {
+		len++;
+	}
+	return (len);
+}
+
+// ws_deflate_parse parses the next element of an extension list, as found
+// in Sec-WebSocket-Extensions, and advances past it.  It returns true only
+// for a well formed permessage-deflate element.
+static bool
+ws_deflate_parse(const char **sp, ws_deflate_params *p)
+{
+	const char *s = ws_skip_space(*sp);
+	size_t      len;
+	bool        ok;
+
+	memset(p, 0, sizeof(*p));
+	len = ws_token_len(s);
+	ok  = (len == 18) &&
+	    (nni_strncasecmp(s, "permessage-deflate", 18) == 0);
+	s   = ws_skip_space(s + len);
+
+	while (*s == ';') {
+		const char *name;
+		size_t      nlen;
+		int         val = -1; // no value
+
+		s    = ws_skip_space(s + 1);
+		name = s;
+		nlen = ws_token_len(s);
+		s    = ws_skip_space(s + nlen);
+		if (*s == '=') {
+			bool quoted;
+			s = ws_skip_space(s + 1);
+			if ((quoted = (*s == '"'))) {
+				s++;
+			}
+			len = ws_token_len(s);
+			val = 0;
+			for (size_t i = 0; i < len; i++) {
+				if ((len > 2) ||
+				    (!isdigit((unsigned char) s[i]))) {
+					val = 0; // will not match anything
+					break;
+				}
+				val = val * 10 + (s[i] - '0');
+			}
+			s += len;
+			if (quoted && (*s++ != '"')) {
+				ok = false;
+				break;
+			}
+			s = ws_skip_space(s);
+		}
+
+#define NAME(n) ((nlen == strlen(n)) && (nni_strncasecmp(name, n, nlen) == 0))
+		if (NAME("server_no_context_takeover") && (val < 0) &&
+		    (!p->server_reset)) {
+			p->server_reset = true;
+		} else if (NAME("client_no_context_takeover") && (val < 0) &&
+		    (!p->client_reset)) {
+			p->client_reset = true;
+		} else if (NAME("server_max_window_bits") && (val >= 8) &&
+		    (val <= 15) && (p->server_bits == 0)) {
+			p->server_bits = val;
+		} else if (NAME("client_max_window_bits") &&
+		    ((val < 0) || ((val >= 8) && (val <= 15))) &&
+		    (p->client_bits == 0)) {
+			p->client_bits = val;
+		} else {
+			ok = false;
+		}
+#undef NAME
+	}
+
+	// Anything else up to the next element is malformed.
+	if ((*s != ',') && (*s != '\0')) {
+		ok = false;
+		while ((*s != ',') && (*s != '\0')) {
+			s++;
+		}
+	}
+	if (*s == ',') {
+		s++;
+	}
+	*sp = s;
+	return (ok);
+}
+
+// ws_deflate_answer decides how a server answers a client's offer, and
+// formats the reply.  It returns false if we cannot honor the offer.
+static bool
+ws_deflate_answer(nni_ws_listener *l, const ws_deflate_params *p,
+    int *txbits, int *rxbits, bool *reset, char *buf, size_t sz)
+{
+	int    bits = l->deflate_bits;
+	size_t len;
+
+	if ((p->server_bits > 0) && (p->server_bits < bits)) {
+		bits = p->server_bits;
+	}
+	if (bits < 9) {
+		return (false); // zlib cannot do a 256 byte window
+	}
+	*txbits = bits;
+	*rxbits = 15;
+	*reset  = l->deflate_reset || p->server_reset;
+
+	(void) snprintf(buf, sz, "permessage-deflate%s%s",
+	    *reset ? "; server_no_context_takeover" : "",
+	    (l->deflate_reset || p->client_reset)
+	        ? "; client_no_context_takeover"
+	        : "");
+	len = strlen(buf);
+	if ((bits < 15) || (p->server_bits > 0)) {
+		(void) snprintf(
+		    buf + len, sz - len, "; server_max_window_bits=%d", bits);
+		len = strlen(buf);
+	}
+	// We can only limit the client if it said it can be limited.
+	if ((p->client_bits != 0) && (l->deflate_bits < 15)) {
+		*rxbits = l->deflate_bits;
+		if ((p->client_bits > 0) && (p->client_bits < *rxbits)) {
+			*rxbits = p->client_bits;
+		}
+		(void) snprintf(buf + len, sz - len,
+		    "; client_max_window_bits=%d", *rxbits);
+	}
+	return (true);
+}
+
+static void
+ws_deflate_offer(nni_ws_dialer *d, char *buf, size_t sz)
+{
+	size_t len;
+
+	(void) snprintf(buf, sz,
+	    "permessage-deflate; client_max_window_bits%s",
+	    d->deflate_reset
+	        ? "; server_no_context_takeover; client_no_context_takeover"
+	        : "");
+	len = strlen(buf);
+	if (d->deflate_bits < 15) {
+		(void) snprintf(buf + len, sz - len,
+		    "; server_max_window_bits=%d", d->deflate_bits);
+	}
+}
+
+static int
+ws_deflate_init(nni_ws *ws, int txbits, int rxbits, bool reset)
+{
+#ifdef NNG_HAVE_ZLIB
+	z_stream *z;
+
+	// Smaller windows get a proportionally smaller hash table too.
+	if ((z = NNI_ALLOC_STRUCT(z)) == NULL) {
+		return (NNG_ENOMEM);
+	}
+	if (deflateInit2(z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -txbits,
+	        txbits - 7, Z_DEFAULT_STRATEGY) != Z_OK) {
+		NNI_FREE_STRUCT(z);
+		return (NNG_ENOMEM);
+	}
+	ws->zdef = z;
+	if ((z = NNI_ALLOC_STRUCT(z)) == NULL) {
+		return (NNG_ENOMEM);
+	}
+	if (inflateInit2(z, -rxbits) != Z_OK) {
+		NNI_FREE_STRUCT(z);
+		return (NNG_ENOMEM);
+	}
+	ws->zinf          = z;
+	ws->deflate       = true;
+	ws->deflate_reset = reset;
+	return (0);
+#else
+	NNI_ARG_UNUSED(ws);
+	NNI_ARG_UNUSED(txbits);
+	NNI_ARG_UNUSED(rxbits);
+	NNI_ARG_UNUSED(reset);
+	return (NNG_ENOTSUP);
+#endif
+}
+
+// ws_deflate_accept checks the server's answer to our offer, and sets up
+// compression to match.  An extension we did not offer is an error.
+static int
+ws_deflate_accept(nni_ws *ws, nni_ws_dialer *d, const char *ext)
+{
+	ws_deflate_params p;
+	int               bits = d->deflate_bits;
+
+	if ((!d->deflate) || (!ws_deflate_parse(&ext, &p)) ||
+	    (*ext != '\0') || (p.client_bits < 0)) {
+		return (NNG_EPROTO);
+	}
+	if ((p.client_bits > 0) && (p.client_bits < bits)) {
+		bits = p.client_bits;
+	}
+	if (bits < 9) {
+		return (NNG_EPROTO);
+	}
+	if (p.server_bits == 0) {
+		p.server_bits = 15;
+	}
+	return (ws_deflate_init(
+	    ws, bits, p.server_bits, d->deflate_reset || p.client_reset));
+}
+
+#ifdef NNG_HAVE_ZLIB
+// ws_zbuf_grow doubles an output buffer (up to max, if not zero), keeping
+// the contents.
+static int
+ws_zbuf_grow(uint8_t **bufp, size_t *szp, size_t len, size_t max)
+{
+	size_t   sz = *szp * 2;
+	uint8_t *buf;
+
+	if ((max > 0) && (sz > max)) {
+		sz = max;
+	}
+	if ((buf = nni_alloc(sz)) == NULL) {
+		return (NNG_ENOMEM);
+	}
+	memcpy(buf, *bufp, len);
+	nni_free(*bufp, *szp);
+	*bufp = buf;
+	*szp  = sz;
+	return (0);
+}
+
+static void
+ws_deflate_time(nni_ws *ws, uint64_t start)
+{
+	uint64_t t = nni_clock_us() - start;
+
+	ws->ztime += t;
+	nni_stat_inc(&ws->st_time, t);
+}
+
+// ws_deflate_frame compresses the message from the frame's aio (or in
+// stream mode, as much of it as we would send in one frame).  The result
+// is then sent in as many frames as needed.  This is called with the lock
+// held, as the compressor state must follow the order on the wire.
+static int
+ws_deflate_frame(nni_ws *ws, ws_frame *frame)
+{
+	z_stream *z = ws->zdef;
+	nni_iov  *iov;
+	unsigned  niov;
+	size_t    resid = 0;
+	size_t    raw;
+	size_t    len = 0;
+	size_t    sz;
+	uint8_t  *buf;
+	uint64_t  start;
+	int       flush = Z_NO_FLUSH;
+	int       rv;
+
+	nni_aio_get_iov(frame->aio, &niov, &iov);
+	for (unsigned i = 0; i < niov; i++) {
+		resid += iov[i].iov_len;
+	}
+	if (ws->isstream && (ws->fragsize > 0) && (resid > ws->fragsize)) {
+		resid = ws->fragsize;
+	}
+	if (resid == 0) {
+		return (0); // empty messages are just sent as they are
+	}
+	raw   = resid;
+	start = nni_clock_us();
+	sz    = deflateBound(z, (uLong) raw) + 16;
+	if ((buf = nni_alloc(sz)) == NULL) {
+		return (NNG_ENOMEM);
+	}
+	for (;;) {
+		if ((z->avail_in == 0) && (flush == Z_NO_FLUSH)) {
+			if (resid == 0) {
+				flush = Z_SYNC_FLUSH;
+			} else {
+				size_t n;
+				while (iov->iov_len == 0) {
+					iov++;
+				}
+				n = iov->iov_len < resid ? iov->iov_len : resid;
+				z->next_in  = iov->iov_buf;
+				z->avail_in = (uInt) n;
+				resid -= n;
+				iov++;
+			}
+		}
+		if ((len == sz) &&
+		    ((rv = ws_zbuf_grow(&buf, &sz, len, 0)) != 0)) {
+			nni_free(buf, sz);
+			return (rv);
+		}
+		z->next_out  = buf + len;
+		z->avail_out = (uInt) (sz - len);
+		(void) deflate(z, flush);
+		len = sz - z->avail_out;
+		if ((flush == Z_SYNC_FLUSH) && (z->avail_out != 0)) {
+			break;
+		}
+	}
+	NNI_ASSERT(len >= 4);
+	if (ws->deflate_reset) {
+		(void) deflateReset(z);
+	}
+	frame->zdata = buf;
+	frame->zsize = sz;
+	frame->zlen  = len - 4; // drop the empty block
+	frame->zoff  = 0;
+	frame->zraw  = raw;
+
+	ws->ztx_raw += raw;
+	ws->ztx_wire += frame->zlen;
+	nni_stat_inc(&ws->st_tx_raw, raw);
+	nni_stat_inc(&ws->st_tx_wire, frame->zlen);
+	ws_deflate_time(ws, start);
+	return (0);
+}
+
+// ws_inflate_frame decompresses a received frame in place.  The limit
+// (if not zero) protects us from decompression bombs.
+static int
+ws_inflate_frame(nni_ws *ws, ws_frame *frame, size_t limit)
+{
+	static uint8_t tail[4] = { 0, 0, 0xff, 0xff };
+	z_stream      *z       = ws->zinf;
+	uint8_t       *buf;
+	size_t         sz;
+	size_t         len  = 0;
+	bool           last = false;
+	uint64_t       start;
+	int            zrv;
+	int            rv;
+
+	start = nni_clock_us();
+	sz    = frame->len * 4 + 64;
+	if ((limit > 0) && (sz > limit + 1)) {
+		sz = limit + 1;
+	}
+	if ((buf = nni_alloc(sz)) == NULL) {
+		return (NNG_ENOMEM);
+	}
+	z->next_in  = frame->buf;
+	z->avail_in = (uInt) frame->len;
+	for (;;) {
+		if ((z->avail_in == 0) && frame->final && !last) {
+			z->next_in  = tail;
+			z->avail_in = sizeof(tail);
+			last        = true;
+		}
+		if (len == sz) {
+			if ((limit > 0) && (len > limit)) {
+				rv = NNG_EMSGSIZE;
+				goto fail;
+			}
+			rv = ws_zbuf_grow(
+			    &buf, &sz, len, limit > 0 ? limit + 1 : 0);
+			if (rv != 0) {
+				goto fail;
+			}
+		}
+		z->next_out  = buf + len;
+		z->avail_out = (uInt) (sz - len);
+		zrv          = inflate(z, Z_SYNC_FLUSH);
+		len          = sz - z->avail_out;
+		if (zrv == Z_STREAM_END) {
+			// The peer ended the deflate stream (BFINAL); it
+			// will start a new one with the next message.
+			(void) inflateReset(z);
+		} else if ((zrv != Z_OK) && (zrv != Z_BUF_ERROR)) {
+			rv = NNG_EPROTO;
+			goto fail;
+		}
+		if ((z->avail_in == 0) && (len < sz) &&
+		    (last || !frame->final)) {
+			break;
+		}
+	}
+
+	ws->zrx_wire += frame->len;
+	ws->zrx_raw += len;
+	nni_stat_inc(&ws->st_rx_wire, frame->len);
+	nni_stat_inc(&ws->st_rx_raw, len);
+	ws_deflate_time(ws, start);
+
+	if (frame->asize != 0) {
+		nni_free(frame->adata, frame->asize);
+	}
+	frame->adata = buf;
+	frame->asize = sz;
+	frame->buf   = buf;
+	frame->len   = len;
+	return (0);
+
+fail:
+	nni_free(buf, sz);
+	return (rv);
+}
+#else
+static int
+ws_deflate_frame(nni_ws *ws, ws_frame *frame)
+{
+	NNI_ARG_UNUSED(ws);
+	NNI_ARG_UNUSED(frame);
+	return (NNG_ENOTSUP);
+}
+
+static int
+ws_inflate_frame(nni_ws *ws, ws_frame *frame, size_t limit)
+{
+	NNI_ARG_UNUSED(ws);
+	NNI_ARG_UNUSED(frame);
+	NNI_ARG_UNUSED(limit);
+	return (NNG_ENOTSUP);
+}
+#endif
+
 static void
 ws_frame_fini(ws_frame *frame)
 {
 	if (frame->asize != 0) {
 		nni_free(frame->adata, frame->asize);
 	}
+	if (frame->zsize != 0) {
+		nni_free(frame->zdata, frame->zsize);
+	}
 	NNI_FREE_STRUCT(frame);
 }
 
@@ -431,6 +919,30 @@ ws_frame_prep_tx(nni_ws *ws, ws_frame *frame)
 	unsigned niov;
 	size_t   len;
 	uint8_t *buf;
+	int      rv;
+
+	// Compressed messages are compressed whole, then fragmented.
+	if (ws->deflate && (frame->zdata == NULL) &&
+	    ((rv = ws_deflate_frame(ws, frame)) != 0)) {
+		return (rv);
+	}
+	if (frame->zdata != NULL) {
+		frame->len   = frame->zlen - frame->zoff;
+		frame->final = true;
+		if ((frame->len > ws->fragsize) && (ws->fragsize > 0)) {
+			frame->len   = ws->fragsize;
+			frame->final = false;
+		}
+		frame->buf = frame->zdata + frame->zoff;
+		if (frame->zoff != 0) {
+			frame->op = WS_CONT;
+		} else if (ws->send_text) {
+			frame->op = WS_TEXT;
+		} else {
+			frame->op = WS_BINARY;
+		}
+		goto header;
+	}
 
 	// Figure out how much we need for the entire aio.
 	frame->len = 0;
@@ -452,6 +964,31 @@ ws_frame_prep_tx(nni_ws *ws, ws_frame *frame)
 		// so we're done.
 		frame->final = true;
 	}
+
+	// Servers do not mask, so the payload can be written directly from
+	// the caller's buffers, which stay valid until the aio completes.
+	// This saves a copy per connection when one (shared) message is
+	// broadcast to many peers.  Only if the frame needs more segments
+	// than we can hand to the write do we fall back to copying it.
+	frame->niov = 0;
+	if (ws->server) {
+		unsigned n = 0;
+		len        = frame->len;
+		while ((len != 0) && (n < niov) &&
+		    (n < NNI_NUM_ELEMENTS(frame->iov))) {
+			frame->iov[n] = iov[n];
+			if (frame->iov[n].iov_len > len) {
+				frame->iov[n].iov_len = len;
+			}
+			len -= frame->iov[n].iov_len;
+			n++;
+		}
+		if (len == 0) {
+			frame->niov = n;
+			goto opcode;
+		}
+	}
+
 	// Potentially allocate space for the data if we need to.
 	// Note that an empty message is legal.
 	if ((frame->asize < frame->len) && (frame->len > 0)) {
@@ -479,6 +1016,7 @@ ws_frame_prep_tx(nni_ws *ws, ws_frame *frame)
 		buf += n;
 	}
 
+opcode:
 	if (nni_aio_count(aio) == 0) {
 		// This is the first frame.
 		if (ws->send_text) {
@@ -490,12 +1028,16 @@ ws_frame_prep_tx(nni_ws *ws, ws_frame *frame)
 		frame->op = WS_CONT;
 	}
 
+header:
 	// Populate the frame header.
 	frame->head[0] = frame->op;
 	frame->hlen    = 2;
 	if (frame->final) {
 		frame->head[0] |= 0x80; // final frame bit
 	}
+	if ((frame->zdata != NULL) && (frame->zoff == 0)) {
+		frame->head[0] |= 0x40; // RSV1, this message is compressed
+	}
 	if (frame->len < 126) {
 		frame->head[1] = frame->len & 0x7f;
 	} else if (frame->len < 65536) {
@@ -573,8 +1115,8 @@ static void
 ws_start_write(nni_ws *ws)
 {
 	ws_frame *frame;
-	nni_iov   iov[2];
-	int       niov;
+	nni_iov   iov[8];
+	unsigned  niov;
 
 	if ((ws->txframe != NULL) || (!ws->ready)) {
 		return; // busy
@@ -586,12 +1128,33 @@ ws_start_write(nni_ws *ws)
 	NNI_ASSERT(frame != NULL);
 	nni_list_remove(&ws->txq, frame);
 
+	// Messages are only compressed once they are about to go out, as
+	// a message canceled while queued must not have been fed to the
+	// compressor; the peer's decompressor would never see it.
+	if (frame->zpend) {
+		int rv;
+		frame->zpend = false;
+		if ((rv = ws_frame_prep_tx(ws, frame)) != 0) {
+			nni_aio *aio = frame->aio;
+			frame->aio   = NULL;
+			nni_aio_list_remove(aio);
+			nni_aio_finish_error(aio, rv);
+			ws_frame_fini(frame);
+			// Our compressor may no longer agree with the peer.
+			ws_close(ws, WS_CLOSE_INTERNAL);
+			return;
+		}
+	}
+
 	// Push it out.
 	ws->txframe    = frame;
 	niov           = 1;
 	iov[0].iov_len = frame->hlen;
 	iov[0].iov_buf = frame->head;
-	if (frame->len > 0) {
+	for (unsigned i = 0; i < frame->niov; i++) {
+		iov[niov++] = frame->iov[i];
+	}
+	if ((frame->niov == 0) && (frame->len > 0)) {
 		niov++;
 		iov[1].iov_len = frame->len;
 		iov[1].iov_buf = frame->buf;
@@ -669,8 +1232,16 @@ ws_write_cb(void *arg)
 	}
 
 	if (aio != NULL) {
-		nni_aio_iov_advance(aio, frame->len);
-		nni_aio_bump_count(aio, frame->len);
+		if (frame->zdata != NULL) {
+			// The user only sees the uncompressed size.
+			frame->zoff += frame->len;
+			if (frame->final) {
+				nni_aio_bump_count(aio, frame->zraw);
+			}
+		} else {
+			nni_aio_iov_advance(aio, frame->len);
+			nni_aio_bump_count(aio, frame->len);
+		}
 		if (frame->final) {
 			frame->aio = NULL;
 			nni_aio_list_remove(aio);
@@ -725,11 +1296,18 @@ ws_write_cancel(nni_aio *aio, void *arg, int rv)
 		// We will wait for callback on the txaio to finish aio.
 	} else {
 		// If scheduled, just need to remove node and complete it.
+		// A compressed message is only queued again once part of
+		// it was sent, and what remains cannot be dropped without
+		// leaving the peer unable to decompress anything after it.
+		bool partial = frame->zdata != NULL;
 		nni_list_remove(&ws->txq, frame);
 		frame->aio = NULL;
 		nni_aio_list_remove(aio);
 		nni_aio_finish_error(aio, rv);
 		ws_frame_fini(frame);
+		if (partial) {
+			ws_close(ws, WS_CLOSE_INTERNAL);
+		}
 	}
 	nni_mtx_unlock(&ws->mtx);
 }
@@ -944,15 +1522,62 @@ ws_read_finish(nni_ws *ws)
 	}
 }
 
+// ws_read_inflate decompresses a frame of a compressed message, closing
+// the connection if that fails.
+static bool
+ws_read_inflate(nni_ws *ws, ws_frame *frame)
+{
+	size_t limit = ws->maxframe;
+	int    rv;
+
+	if ((!ws->isstream) && (ws->recvmax > 0)) {
+		ws_frame *fr;
+		limit = ws->recvmax;
+		NNI_LIST_FOREACH (&ws->rxq, fr) {
+			limit -= fr->len;
+		}
+	}
+	if ((rv = ws_inflate_frame(ws, frame, limit)) != 0) {
+		switch (rv) {
+		case NNG_EMSGSIZE:
+			ws_close(ws, WS_CLOSE_TOO_BIG);
+			break;
+		case NNG_ENOMEM:
+			ws_close(ws, WS_CLOSE_INTERNAL);
+			break;
+		default:
+			ws_close(ws, WS_CLOSE_INVALID_DATA);
+			break;
+		}
+		return (false);
+	}
+	if (frame->final) {
+		ws->rxdeflate = false;
+	}
+	return (true);
+}
+
 static void
 ws_read_frame_cb(nni_ws *ws, ws_frame *frame)
 {
+	// The only reserved bit we know of is RSV1, which marks the first
+	// frame of a compressed message.
+	if (((frame->head[0] & 0x70u) != 0) &&
+	    (((frame->head[0] & 0x30u) != 0) || (!ws->deflate) ||
+	        ((frame->op != WS_TEXT) && (frame->op != WS_BINARY)))) {
+		ws_close(ws, WS_CLOSE_PROTOCOL_ERR);
+		return;
+	}
+
 	switch (frame->op) {
 	case WS_CONT:
 		if (!ws->inmsg) {
 			ws_close(ws, WS_CLOSE_PROTOCOL_ERR);
 			return;
 		}
+		if (ws->rxdeflate && !ws_read_inflate(ws, frame)) {
+			return;
+		}
 		if (frame->final) {
 			ws->inmsg = false;
 		}
@@ -970,6 +1595,10 @@ ws_read_frame_cb(nni_ws *ws, ws_frame *frame)
 			ws_close(ws, WS_CLOSE_PROTOCOL_ERR);
 			return;
 		}
+		ws->rxdeflate = (frame->head[0] & 0x40u) != 0;
+		if (ws->rxdeflate && !ws_read_inflate(ws, frame)) {
+			return;
+		}
 		if (!frame->final) {
 			ws->inmsg = true;
 		}
@@ -1037,7 +1666,7 @@ ws_read_cb(void *arg)
 
 	if (frame->hlen == 0) {
 		frame->hlen   = 2;
-		frame->op     = frame->head[0] & 0x7fu;
+		frame->op     = frame->head[0] & 0x0fu;
 		frame->final  = (frame->head[0] & 0x80u) ? 1 : 0;
 		frame->masked = (frame->head[1] & 0x80u) ? 1 : 0;
 		if (frame->masked) {
@@ -1253,6 +1882,16 @@ ws_fini(void *arg)
 		nni_http_res_free(ws->res);
 	}
 
+#ifdef NNG_HAVE_ZLIB
+	if (ws->zdef != NULL) {
+		(void) deflateEnd(ws->zdef);
+		NNI_FREE_STRUCT(ws->zdef);
+	}
+	if (ws->zinf != NULL) {
+		(void) inflateEnd(ws->zinf);
+		NNI_FREE_STRUCT(ws->zinf);
+	}
+#endif
 	nni_strfree(ws->reqhdrs);
 	nni_strfree(ws->reshdrs);
 	nni_aio_free(ws->rxaio);
@@ -1389,6 +2028,11 @@ ws_http_cb_dialer(nni_ws *ws, nni_aio *aio)
 			goto err;
 		}
 	}
+	if (((ptr = GETH("Sec-WebSocket-Extensions")) != NULL) &&
+	    ((rv = ws_deflate_accept(ws, d, ptr)) != 0)) {
+		ws_close_error(ws, WS_CLOSE_PROTOCOL_ERR);
+		goto err;
+	}
 #undef GETH
 
 	// At this point, we are in business!
@@ -1431,6 +2075,69 @@ ws_http_cb(void *arg)
 	}
 }
 
+#ifdef NNG_ENABLE_STATS
+static void
+ws_stats_init(nni_ws *ws)
+{
+	static const nni_stat_info tx_raw_info = {
+		.si_name   = "deflate_tx_raw",
+		.si_desc   = "bytes compressed",
+		.si_type   = NNG_STAT_COUNTER,
+		.si_unit   = NNG_UNIT_BYTES,
+		.si_atomic = true,
+	};
+	static const nni_stat_info tx_wire_info = {
+		.si_name   = "deflate_tx_wire",
+		.si_desc   = "compressed bytes sent",
+		.si_type   = NNG_STAT_COUNTER,
+		.si_unit   = NNG_UNIT_BYTES,
+		.si_atomic = true,
+	};
+	static const nni_stat_info rx_wire_info = {
+		.si_name   = "deflate_rx_wire",
+		.si_desc   = "compressed bytes received",
+		.si_type   = NNG_STAT_COUNTER,
+		.si_unit   = NNG_UNIT_BYTES,
+		.si_atomic = true,
+	};
+	static const nni_stat_info rx_raw_info = {
+		.si_name   = "deflate_rx_raw",
+		.si_desc   = "bytes decompressed",
+		.si_type   = NNG_STAT_COUNTER,
+		.si_unit   = NNG_UNIT_BYTES,
+		.si_atomic = true,
+	};
+	static const nni_stat_info time_info = {
+		.si_name   = "deflate_time",
+		.si_desc   = "microseconds spent (de)compressing",
+		.si_type   = NNG_STAT_COUNTER,
+		.si_unit   = NNG_UNIT_NONE,
+		.si_atomic = true,
+	};
+
+	nni_stat_init(&ws->st_tx_raw, &tx_raw_info);
+	nni_stat_init(&ws->st_tx_wire, &tx_wire_info);
+	nni_stat_init(&ws->st_rx_wire, &rx_wire_info);
+	nni_stat_init(&ws->st_rx_raw, &rx_raw_info);
+	nni_stat_init(&ws->st_time, &time_info);
+}
+#endif
+
+void
+nni_ws_pipe_stats(nng_stream *s, nni_pipe *p)
+{
+	nni_ws *ws = (void *) s;
+
+	// Only connections that compress have anything to say.
+	if (ws->deflate) {
+		nni_pipe_add_stat(p, &ws->st_tx_raw);
+		nni_pipe_add_stat(p, &ws->st_tx_wire);
+		nni_pipe_add_stat(p, &ws->st_rx_wire);
+		nni_pipe_add_stat(p, &ws->st_rx_raw);
+		nni_pipe_add_stat(p, &ws->st_time);
+	}
+}
+
 static int
 ws_init(nni_ws **wsp)
 {
@@ -1445,6 +2152,9 @@ ws_init(nni_ws **wsp)
 	NNI_LIST_INIT(&ws->txq, ws_frame, node);
 	nni_aio_list_init(&ws->sendq);
 	nni_aio_list_init(&ws->recvq);
+#ifdef NNG_ENABLE_STATS
+	ws_stats_init(ws);
+#endif
 
 	if (((rv = nni_aio_alloc(&ws->closeaio, ws_close_cb, ws)) != 0) ||
 	    ((rv = nni_aio_alloc(&ws->txaio, ws_write_cb, ws)) != 0) ||
@@ -1522,6 +2232,10 @@ ws_handler(nni_aio *aio)
 	uint16_t          status;
 	int               rv;
 	char              key[29];
+	char              ext[160];
+	int               txbits;
+	int               rxbits;
+	bool              reset;
 	ws_header        *hdr;
 
 	req  = nni_aio_get_input(aio, 0);
@@ -1590,6 +2304,19 @@ ws_handler(nni_aio *aio)
 		goto err;
 	}
 
+	// Take the first permessage-deflate offer that we can honor, if any.
+	ext[0] = '\0';
+	if (l->deflate && ((ptr = GETH("Sec-WebSocket-Extensions")) != NULL)) {
+		ws_deflate_params zp;
+		while (*ptr != '\0') {
+			if (ws_deflate_parse(&ptr, &zp) &&
+			    ws_deflate_answer(l, &zp, &txbits, &rxbits, &reset,
+			        ext, sizeof(ext))) {
+				break;
+			}
+		}
+	}
+
 	if ((rv = nni_http_res_alloc(&res)) != 0) {
 		// Give a chance to reply to client.
 		status = NNG_HTTP_STATUS_INTERNAL_SERVER_ERROR;
@@ -1614,6 +2341,11 @@ ws_handler(nni_aio *aio)
 		nni_http_res_free(res);
 		goto err;
 	}
+	if ((ext[0] != '\0') && (SETH("Sec-WebSocket-Extensions", ext) != 0)) {
+		status = NNG_HTTP_STATUS_INTERNAL_SERVER_ERROR;
+		nni_http_res_free(res);
+		goto err;
+	}
 
 	// Set any user supplied headers.  This is better than using a hook
 	// for most things, because it is loads easier.
@@ -1667,6 +2399,14 @@ ws_handler(nni_aio *aio)
 		status = NNG_HTTP_STATUS_INTERNAL_SERVER_ERROR;
 		goto err;
 	}
+	if ((ext[0] != '\0') &&
+	    ((rv = ws_deflate_init(ws, txbits, rxbits, reset)) != 0)) {
+		ws_fini(ws);
+		nni_http_req_free(req);
+		nni_http_res_free(res);
+		status = NNG_HTTP_STATUS_INTERNAL_SERVER_ERROR;
+		goto err;
+	}
 	ws->http      = conn;
 	ws->req       = req;
 	ws->res       = res;
@@ -2017,6 +2757,91 @@ ws_listener_get_url(void *arg, void *buf, size_t *szp, nni_type t)
 	return (rv);
 }
 
+static int
+ws_listener_set_deflate(void *arg, const void *buf, size_t sz, nni_type t)
+{
+	nni_ws_listener *l = arg;
+	int              rv;
+	bool              b;
+
+	if ((rv = nni_copyin_bool(&b, buf, sz, t)) == 0) {
+#ifndef NNG_HAVE_ZLIB
+		if (b) {
+			return (NNG_ENOTSUP);
+		}
+#endif
+		nni_mtx_lock(&l->mtx);
+		l->deflate = b;
+		nni_mtx_unlock(&l->mtx);
+	}
+	return (rv);
+}
+
+static int
+ws_listener_get_deflate(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	nni_ws_listener *l = arg;
+	int              rv;
+	nni_mtx_lock(&l->mtx);
+	rv = nni_copyout_bool(l->deflate, buf, szp, t);
+	nni_mtx_unlock(&l->mtx);
+	return (rv);
+}
+
+static int
+ws_listener_set_deflate_reset(
+    void *arg, const void *buf, size_t sz, nni_type t)
+{
+	nni_ws_listener *l = arg;
+	int              rv;
+	bool              b;
+
+	if ((rv = nni_copyin_bool(&b, buf, sz, t)) == 0) {
+		nni_mtx_lock(&l->mtx);
+		l->deflate_reset = b;
+		nni_mtx_unlock(&l->mtx);
+	}
+	return (rv);
+}
+
+static int
+ws_listener_get_deflate_reset(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	nni_ws_listener *l = arg;
+	int              rv;
+	nni_mtx_lock(&l->mtx);
+	rv = nni_copyout_bool(l->deflate_reset, buf, szp, t);
+	nni_mtx_unlock(&l->mtx);
+	return (rv);
+}
+
+static int
+ws_listener_set_deflate_bits(
+    void *arg, const void *buf, size_t sz, nni_type t)
+{
+	nni_ws_listener *l = arg;
+	int              rv;
+	int              bits;
+
+	if ((rv = nni_copyin_int(&bits, buf, sz, 9, 15, t)) == 0) {
+		nni_mtx_lock(&l->mtx);
+		l->deflate_bits = bits;
+		nni_mtx_unlock(&l->mtx);
+	}
+	return (rv);
+}
+
+static int
+ws_listener_get_deflate_bits(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	nni_ws_listener *l = arg;
+	int              rv;
+	nni_mtx_lock(&l->mtx);
+	rv = nni_copyout_int(l->deflate_bits, buf, szp, t);
+	nni_mtx_unlock(&l->mtx);
+	return (rv);
+}
+
 static const nni_option ws_listener_options[] = {
 	{
 	    .o_name = NNI_OPT_WS_MSGMODE,
@@ -2061,6 +2886,21 @@ static const nni_option ws_listener_options[] = {
 	    .o_set  = ws_listener_set_send_text,
 	    .o_get  = ws_listener_get_send_text,
 	},
+	{
+	    .o_name = NNG_OPT_WS_DEFLATE,
+	    .o_set  = ws_listener_set_deflate,
+	    .o_get  = ws_listener_get_deflate,
+	},
+	{
+	    .o_name = NNG_OPT_WS_DEFLATE_NO_TAKEOVER,
+	    .o_set  = ws_listener_set_deflate_reset,
+	    .o_get  = ws_listener_get_deflate_reset,
+	},
+	{
+	    .o_name = NNG_OPT_WS_DEFLATE_WINDOW,
+	    .o_set  = ws_listener_set_deflate_bits,
+	    .o_get  = ws_listener_get_deflate_bits,
+	},
 	{
 	    .o_name = NULL,
 	},
@@ -2157,6 +2997,7 @@ nni_ws_listener_alloc(nng_stream_listener **wslp, const nng_url *url)
 	l->fragsize      = WS_DEF_MAXTXFRAME;
 	l->maxframe      = WS_DEF_MAXRXFRAME;
 	l->recvmax       = WS_DEF_RECVMAX;
+	l->deflate_bits  = WS_DEF_DEFLATE_BITS;
 	l->isstream      = true;
 	l->ops.sl_free   = ws_listener_free;
 	l->ops.sl_close  = ws_listener_close;
@@ -2179,6 +3020,7 @@ ws_conn_cb(void *arg)
 	int            rv;
 	uint8_t        raw[16];
 	char           wskey[25];
+	char           ext[128];
 	ws_header     *hdr;
 
 	ws = arg;
@@ -2237,6 +3079,12 @@ ws_conn_cb(void *arg)
 	    ((rv = SETH("Sec-WebSocket-Protocol", d->proto)) != 0)) {
 		goto err;
 	}
+	if (d->deflate) {
+		ws_deflate_offer(d, ext, sizeof(ext));
+		if ((rv = SETH("Sec-WebSocket-Extensions", ext)) != 0) {
+			goto err;
+		}
+	}
 
 	NNI_LIST_FOREACH (&d->headers, hdr) {
 		if ((rv = SETH(hdr->name, hdr->value)) != 0) {
@@ -2551,6 +3399,91 @@ ws_dialer_get_send_text(void *arg, void *buf, size_t *szp, nni_type t)
 	return (rv);
 }
 
+static int
+ws_dialer_set_deflate(void *arg, const void *buf, size_t sz, nni_type t)
+{
+	nni_ws_dialer *d = arg;
+	int            rv;
+	bool            b;
+
+	if ((rv = nni_copyin_bool(&b, buf, sz, t)) == 0) {
+#ifndef NNG_HAVE_ZLIB
+		if (b) {
+			return (NNG_ENOTSUP);
+		}
+#endif
+		nni_mtx_lock(&d->mtx);
+		d->deflate = b;
+		nni_mtx_unlock(&d->mtx);
+	}
+	return (rv);
+}
+
+static int
+ws_dialer_get_deflate(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	nni_ws_dialer *d = arg;
+	int            rv;
+	nni_mtx_lock(&d->mtx);
+	rv = nni_copyout_bool(d->deflate, buf, szp, t);
+	nni_mtx_unlock(&d->mtx);
+	return (rv);
+}
+
+static int
+ws_dialer_set_deflate_reset(
+    void *arg, const void *buf, size_t sz, nni_type t)
+{
+	nni_ws_dialer *d = arg;
+	int            rv;
+	bool            b;
+
+	if ((rv = nni_copyin_bool(&b, buf, sz, t)) == 0) {
+		nni_mtx_lock(&d->mtx);
+		d->deflate_reset = b;
+		nni_mtx_unlock(&d->mtx);
+	}
+	return (rv);
+}
+
+static int
+ws_dialer_get_deflate_reset(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	nni_ws_dialer *d = arg;
+	int            rv;
+	nni_mtx_lock(&d->mtx);
+	rv = nni_copyout_bool(d->deflate_reset, buf, szp, t);
+	nni_mtx_unlock(&d->mtx);
+	return (rv);
+}
+
+static int
+ws_dialer_set_deflate_bits(
+    void *arg, const void *buf, size_t sz, nni_type t)
+{
+	nni_ws_dialer *d = arg;
+	int            rv;
+	int            bits;
+
+	if ((rv = nni_copyin_int(&bits, buf, sz, 9, 15, t)) == 0) {
+		nni_mtx_lock(&d->mtx);
+		d->deflate_bits = bits;
+		nni_mtx_unlock(&d->mtx);
+	}
+	return (rv);
+}
+
+static int
+ws_dialer_get_deflate_bits(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	nni_ws_dialer *d = arg;
+	int            rv;
+	nni_mtx_lock(&d->mtx);
+	rv = nni_copyout_int(d->deflate_bits, buf, szp, t);
+	nni_mtx_unlock(&d->mtx);
+	return (rv);
+}
+
 static const nni_option ws_dialer_options[] = {
 	{
 	    .o_name = NNI_OPT_WS_MSGMODE,
@@ -2591,6 +3524,21 @@ static const nni_option ws_dialer_options[] = {
 	    .o_set  = ws_dialer_set_send_text,
 	    .o_get  = ws_dialer_get_send_text,
 	},
+	{
+	    .o_name = NNG_OPT_WS_DEFLATE,
+	    .o_set  = ws_dialer_set_deflate,
+	    .o_get  = ws_dialer_get_deflate,
+	},
+	{
+	    .o_name = NNG_OPT_WS_DEFLATE_NO_TAKEOVER,
+	    .o_set  = ws_dialer_set_deflate_reset,
+	    .o_get  = ws_dialer_get_deflate_reset,
+	},
+	{
+	    .o_name = NNG_OPT_WS_DEFLATE_WINDOW,
+	    .o_set  = ws_dialer_set_deflate_bits,
+	    .o_get  = ws_dialer_get_deflate_bits,
+	},
 
 	{
 	    .o_name = NULL,
@@ -2672,6 +3620,8 @@ nni_ws_dialer_alloc(nng_stream_dialer **dp, const nng_url *url)
 	d->maxframe = WS_DEF_MAXRXFRAME;
 	d->fragsize = WS_DEF_MAXTXFRAME;
 
+	d->deflate_bits = WS_DEF_DEFLATE_BITS;
+
 	d->ops.sd_free  = ws_dialer_free;
 	d->ops.sd_close = ws_dialer_close;
 	d->ops.sd_dial  = ws_dialer_dial;
@@ -2738,7 +3688,10 @@ ws_str_send(void *arg, nni_aio *aio)
 		return;
 	}
 	frame->aio = aio;
-	if ((rv = ws_frame_prep_tx(ws, frame)) != 0) {
+	if (ws->deflate) {
+		// Compressed when it is sent; see ws_start_write.
+		frame->zpend = true;
+	} else if ((rv = ws_frame_prep_tx(ws, frame)) != 0) {
 		nni_aio_finish_error(aio, rv);
 		ws_frame_fini(frame);
 		return;
@@ -2844,6 +3797,58 @@ ws_get_send_text(void *arg, void *buf, size_t *szp, nni_type t)
 	return (nni_copyout_bool(b, buf, szp, t));
 }
 
+static int
+ws_get_deflate(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	nni_ws *ws = arg;
+	return (nni_copyout_bool(ws->deflate, buf, szp, t));
+}
+
+static int
+ws_get_counter(nni_ws *ws, uint64_t *valp, void *buf, size_t *szp, nni_type t)
+{
+	uint64_t val;
+	nni_mtx_lock(&ws->mtx);
+	val = *valp;
+	nni_mtx_unlock(&ws->mtx);
+	return (nni_copyout_u64(val, buf, szp, t));
+}
+
+static int
+ws_get_tx_raw(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	nni_ws *ws = arg;
+	return (ws_get_counter(ws, &ws->ztx_raw, buf, szp, t));
+}
+
+static int
+ws_get_tx_wire(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	nni_ws *ws = arg;
+	return (ws_get_counter(ws, &ws->ztx_wire, buf, szp, t));
+}
+
+static int
+ws_get_rx_wire(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	nni_ws *ws = arg;
+	return (ws_get_counter(ws, &ws->zrx_wire, buf, szp, t));
+}
+
+static int
+ws_get_rx_raw(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	nni_ws *ws = arg;
+	return (ws_get_counter(ws, &ws->zrx_raw, buf, szp, t));
+}
+
+static int
+ws_get_deflate_time(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	nni_ws *ws = arg;
+	return (ws_get_counter(ws, &ws->ztime, buf, szp, t));
+}
+
 static const nni_option ws_options[] = {
 	{
 	    .o_name = NNG_OPT_WS_REQUEST_HEADERS,
@@ -2865,6 +3870,30 @@ static const nni_option ws_options[] = {
 	    .o_name = NNG_OPT_WS_SEND_TEXT,
 	    .o_get  = ws_get_send_text,
 	},
+	{
+	    .o_name = NNG_OPT_WS_DEFLATE,
+	    .o_get  = ws_get_deflate,
+	},
+	{
+	    .o_name = NNG_OPT_WS_DEFLATE_TX_RAW,
+	    .o_get  = ws_get_tx_raw,
+	},
+	{
+	    .o_name = NNG_OPT_WS_DEFLATE_TX_WIRE,
+	    .o_get  = ws_get_tx_wire,
+	},
+	{
+	    .o_name = NNG_OPT_WS_DEFLATE_RX_WIRE,
+	    .o_get  = ws_get_rx_wire,
+	},
+	{
+	    .o_name = NNG_OPT_WS_DEFLATE_RX_RAW,
+	    .o_get  = ws_get_rx_raw,
+	},
+	{
+	    .o_name = NNG_OPT_WS_DEFLATE_TIME,
+	    .o_get  = ws_get_deflate_time,
+	},
 	{
 	    .o_name = NULL,
 	},
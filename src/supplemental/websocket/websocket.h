@@ -1,5 +1,5 @@
 //
-// Copyright 2020 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 // Copyright 2019 Devolutions <info@devolutions.net>
 //
@@ -34,4 +34,9 @@ typedef struct nni_ws_dialer   nni_ws_dialer;
 extern int nni_ws_listener_alloc(nng_stream_listener **, const nni_url *);
 extern int nni_ws_dialer_alloc(nng_stream_dialer **, const nni_url *);
 
+// nni_ws_pipe_stats adds the statistics for a WebSocket connection (at
+// present, only those for compression) to the pipe.  This is used by the
+// SP transport, and the stream must outlive the pipe's statistics.
+extern void nni_ws_pipe_stats(nng_stream *, nni_pipe *);
+
 #endif // NNG_SUPPLEMENTAL_WEBSOCKET_WEBSOCKET_H
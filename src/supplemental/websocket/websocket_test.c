@@ -13,6 +13,10 @@
 
 #include <nuts.h>
 
+#ifdef NNG_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 void
 test_websocket_wildcard(void)
 {
@@ -510,10 +514,505 @@ test_websocket_fragmentation(void)
 	nng_stream_listener_free(l);
 }
 
+static void
+deflate_connect(nng_stream_listener *l, nng_stream_dialer *d,
+    nng_stream **c1, nng_stream **c2)
+{
+	nng_aio *daio;
+	nng_aio *laio;
+
+	NUTS_PASS(nng_aio_alloc(&daio, NULL, NULL));
+	NUTS_PASS(nng_aio_alloc(&laio, NULL, NULL));
+	nng_aio_set_timeout(daio, 5000);
+	nng_aio_set_timeout(laio, 5000);
+
+	NUTS_PASS(nng_stream_listener_listen(l));
+	nng_stream_listener_accept(l, laio);
+	nng_stream_dialer_dial(d, daio);
+	nng_aio_wait(laio);
+	nng_aio_wait(daio);
+	NUTS_PASS(nng_aio_result(laio));
+	NUTS_PASS(nng_aio_result(daio));
+	*c1 = nng_aio_get_output(laio, 0);
+	*c2 = nng_aio_get_output(daio, 0);
+	nng_aio_free(daio);
+	nng_aio_free(laio);
+}
+
+// deflate_xfer sends the buffer on one stream, and reads it back on
+// the other, checking that it arrived intact.
+static void
+deflate_xfer(nng_stream *tx, nng_stream *rx, const uint8_t *data, size_t len)
+{
+	nng_aio *txaio;
+	nng_aio *rxaio;
+	uint8_t *buf;
+	size_t   got = 0;
+	nng_iov  iov;
+
+	NUTS_TRUE((buf = nng_alloc(len)) != NULL);
+	NUTS_PASS(nng_aio_alloc(&txaio, NULL, NULL));
+	NUTS_PASS(nng_aio_alloc(&rxaio, NULL, NULL));
+	nng_aio_set_timeout(txaio, 5000);
+	nng_aio_set_timeout(rxaio, 5000);
+
+	iov.iov_buf = (void *) data;
+	iov.iov_len = len;
+	NUTS_PASS(nng_aio_set_iov(txaio, 1, &iov));
+	nng_stream_send(tx, txaio);
+
+	while (got < len) {
+		iov.iov_buf = buf + got;
+		iov.iov_len = len - got;
+		NUTS_PASS(nng_aio_set_iov(rxaio, 1, &iov));
+		nng_stream_recv(rx, rxaio);
+		nng_aio_wait(rxaio);
+		NUTS_PASS(nng_aio_result(rxaio));
+		got += nng_aio_count(rxaio);
+	}
+	nng_aio_wait(txaio);
+	NUTS_PASS(nng_aio_result(txaio));
+	NUTS_TRUE(nng_aio_count(txaio) == len);
+	NUTS_TRUE(memcmp(buf, data, len) == 0);
+
+	nng_aio_free(txaio);
+	nng_aio_free(rxaio);
+	nng_free(buf, len);
+}
+
+// deflate_fill fills the buffer with random, but compressible, text.
+static void
+deflate_fill(uint8_t *buf, size_t len)
+{
+	static const char *words[] = { "alpha ", "bravo ", "charlie ",
+		"delta ", "echo ", "foxtrot " };
+
+	for (size_t i = 0; i < len;) {
+		const char *w = words[nng_random() % 6];
+		while ((*w != '\0') && (i < len)) {
+			buf[i++] = (uint8_t) *w++;
+		}
+	}
+}
+
+#ifdef NNG_HAVE_ZLIB
+void
+test_websocket_deflate(void)
+{
+	nng_stream_listener *l  = NULL;
+	nng_stream_dialer   *d  = NULL;
+	nng_stream          *c1 = NULL;
+	nng_stream          *c2 = NULL;
+	char                 uri[64];
+	char                *str;
+	uint8_t             *data;
+	size_t               len = 20000;
+	bool                 on;
+	uint64_t             raw;
+	uint64_t             wire;
+
+	(void) snprintf(
+	    uri, sizeof(uri), "ws://127.0.0.1:%u/test", nuts_next_port());
+	NUTS_TRUE((data = nng_alloc(len)) != NULL);
+	deflate_fill(data, len);
+
+	NUTS_PASS(nng_stream_listener_alloc(&l, uri));
+	NUTS_PASS(nng_stream_dialer_alloc(&d, uri));
+	NUTS_PASS(nng_stream_listener_set_bool(l, NNG_OPT_WS_DEFLATE, true));
+	NUTS_PASS(nng_stream_dialer_set_bool(d, NNG_OPT_WS_DEFLATE, true));
+	NUTS_PASS(nng_stream_listener_get_bool(l, NNG_OPT_WS_DEFLATE, &on));
+	NUTS_TRUE(on);
+	deflate_connect(l, d, &c1, &c2);
+
+	NUTS_PASS(nng_stream_get_bool(c1, NNG_OPT_WS_DEFLATE, &on));
+	NUTS_TRUE(on);
+	NUTS_PASS(nng_stream_get_bool(c2, NNG_OPT_WS_DEFLATE, &on));
+	NUTS_TRUE(on);
+	NUTS_PASS(nng_stream_get_string(
+	    c2, NNG_OPT_WS_RESPONSE_HEADER "Sec-WebSocket-Extensions", &str));
+	NUTS_MATCH(str, "permessage-deflate");
+	nng_strfree(str);
+
+	for (int i = 0; i < 4; i++) {
+		deflate_xfer(c1, c2, data, len);
+		deflate_xfer(c2, c1, data, len);
+	}
+
+	NUTS_PASS(nng_stream_get_uint64(c1, NNG_OPT_WS_DEFLATE_TX_RAW, &raw));
+	NUTS_PASS(
+	    nng_stream_get_uint64(c1, NNG_OPT_WS_DEFLATE_TX_WIRE, &wire));
+	NUTS_TRUE(raw == 4 * len);
+	NUTS_TRUE(wire < raw / 2);
+	NUTS_PASS(nng_stream_get_uint64(c2, NNG_OPT_WS_DEFLATE_RX_RAW, &raw));
+	NUTS_TRUE(raw == 4 * len);
+	NUTS_PASS(
+	    nng_stream_get_uint64(c2, NNG_OPT_WS_DEFLATE_RX_WIRE, &raw));
+	NUTS_TRUE(raw == wire);
+
+	nng_stream_close(c1);
+	nng_stream_free(c1);
+	nng_stream_close(c2);
+	nng_stream_free(c2);
+	nng_stream_listener_free(l);
+	nng_stream_dialer_free(d);
+	nng_free(data, len);
+}
+
+void
+test_websocket_deflate_params(void)
+{
+	nng_stream_listener *l  = NULL;
+	nng_stream_dialer   *d  = NULL;
+	nng_stream          *c1 = NULL;
+	nng_stream          *c2 = NULL;
+	char                 uri[64];
+	char                *str;
+	uint8_t             *data;
+	size_t               len = 5000;
+	int                  bits;
+
+	(void) snprintf(
+	    uri, sizeof(uri), "ws://127.0.0.1:%u/test", nuts_next_port());
+	NUTS_TRUE((data = nng_alloc(len)) != NULL);
+
+	NUTS_PASS(nng_stream_listener_alloc(&l, uri));
+	NUTS_PASS(nng_stream_dialer_alloc(&d, uri));
+	NUTS_PASS(nng_stream_listener_set_bool(l, NNG_OPT_WS_DEFLATE, true));
+	NUTS_PASS(nng_stream_listener_set_bool(
+	    l, NNG_OPT_WS_DEFLATE_NO_TAKEOVER, true));
+	NUTS_FAIL(nng_stream_listener_set_int(l, NNG_OPT_WS_DEFLATE_WINDOW, 8),
+	    NNG_EINVAL);
+	NUTS_PASS(
+	    nng_stream_listener_set_int(l, NNG_OPT_WS_DEFLATE_WINDOW, 10));
+	NUTS_PASS(
+	    nng_stream_listener_get_int(l, NNG_OPT_WS_DEFLATE_WINDOW, &bits));
+	NUTS_TRUE(bits == 10);
+	NUTS_PASS(nng_stream_dialer_set_bool(d, NNG_OPT_WS_DEFLATE, true));
+	deflate_connect(l, d, &c1, &c2);
+
+	NUTS_PASS(nng_stream_get_string(
+	    c2, NNG_OPT_WS_RESPONSE_HEADER "Sec-WebSocket-Extensions", &str));
+	NUTS_TRUE(strstr(str, "server_no_context_takeover") != NULL);
+	NUTS_TRUE(strstr(str, "client_no_context_takeover") != NULL);
+	NUTS_TRUE(strstr(str, "server_max_window_bits=10") != NULL);
+	NUTS_TRUE(strstr(str, "client_max_window_bits=10") != NULL);
+	nng_strfree(str);
+
+	for (int i = 0; i < 8; i++) {
+		deflate_fill(data, len);
+		deflate_xfer(c1, c2, data, len);
+		deflate_xfer(c2, c1, data, len);
+	}
+
+	nng_stream_close(c1);
+	nng_stream_free(c1);
+	nng_stream_close(c2);
+	nng_stream_free(c2);
+	nng_stream_listener_free(l);
+	nng_stream_dialer_free(d);
+	nng_free(data, len);
+}
+
+// A message canceled while it is still queued never reaches the
+// compressor, so the peer can still decompress what comes after it.
+void
+test_websocket_deflate_cancel(void)
+{
+	nng_stream_listener *l  = NULL;
+	nng_stream_dialer   *d  = NULL;
+	nng_stream          *c1 = NULL;
+	nng_stream          *c2 = NULL;
+	nng_aio             *aio[4];
+	nng_aio             *rxaio;
+	char                 uri[64];
+	uint8_t             *big;
+	uint8_t             *buf;
+	uint8_t              msg[2][2000];
+	size_t               len = 16 << 20;
+	size_t               got = 0;
+	nng_iov              iov;
+
+	(void) snprintf(
+	    uri, sizeof(uri), "ws://127.0.0.1:%u/test", nuts_next_port());
+	// Random data does not compress.  The peer reads ahead one
+	// message, and the second one fills the socket.
+	NUTS_TRUE((big = nng_alloc(len)) != NULL);
+	NUTS_TRUE((buf = nng_alloc(2 * len + sizeof(msg[1]))) != NULL);
+	for (size_t i = 0; i < len; i += sizeof(uint32_t)) {
+		uint32_t r = nng_random();
+		memcpy(big + i, &r, sizeof(r));
+	}
+	deflate_fill(msg[0], sizeof(msg[0]));
+	deflate_fill(msg[1], sizeof(msg[1]));
+
+	NUTS_PASS(nng_stream_listener_alloc(&l, uri));
+	NUTS_PASS(nng_stream_dialer_alloc(&d, uri));
+	NUTS_PASS(nng_stream_listener_set_bool(l, NNG_OPT_WS_DEFLATE, true));
+	NUTS_PASS(nng_stream_dialer_set_bool(d, NNG_OPT_WS_DEFLATE, true));
+	NUTS_PASS(nng_stream_listener_set_size(
+	    l, NNG_OPT_WS_SENDMAXFRAME, 2 * len));
+	NUTS_PASS(
+	    nng_stream_dialer_set_size(d, NNG_OPT_WS_RECVMAXFRAME, 2 * len));
+	deflate_connect(l, d, &c1, &c2);
+
+	for (int i = 0; i < 4; i++) {
+		NUTS_PASS(nng_aio_alloc(&aio[i], NULL, NULL));
+		nng_aio_set_timeout(aio[i], 5000);
+	}
+	NUTS_PASS(nng_aio_alloc(&rxaio, NULL, NULL));
+	nng_aio_set_timeout(rxaio, 5000);
+
+	iov.iov_buf = big;
+	iov.iov_len = len;
+	NUTS_PASS(nng_aio_set_iov(aio[0], 1, &iov));
+	NUTS_PASS(nng_aio_set_iov(aio[1], 1, &iov));
+	nng_stream_send(c1, aio[0]);
+	nng_stream_send(c1, aio[1]);
+	for (int i = 0; i < 2; i++) {
+		iov.iov_buf = msg[i];
+		iov.iov_len = sizeof(msg[i]);
+		NUTS_PASS(nng_aio_set_iov(aio[i + 2], 1, &iov));
+		nng_stream_send(c1, aio[i + 2]);
+	}
+	nng_aio_cancel(aio[2]);
+	nng_aio_wait(aio[2]);
+	NUTS_FAIL(nng_aio_result(aio[2]), NNG_ECANCELED);
+
+	while (got < 2 * len + sizeof(msg[1])) {
+		iov.iov_buf = buf + got;
+		iov.iov_len = 2 * len + sizeof(msg[1]) - got;
+		NUTS_PASS(nng_aio_set_iov(rxaio, 1, &iov));
+		nng_stream_recv(c2, rxaio);
+		nng_aio_wait(rxaio);
+		NUTS_PASS(nng_aio_result(rxaio));
+		got += nng_aio_count(rxaio);
+	}
+	for (int i = 0; i < 4; i++) {
+		nng_aio_wait(aio[i]);
+	}
+	NUTS_PASS(nng_aio_result(aio[0]));
+	NUTS_PASS(nng_aio_result(aio[1]));
+	NUTS_PASS(nng_aio_result(aio[3]));
+	NUTS_TRUE(memcmp(buf, big, len) == 0);
+	NUTS_TRUE(memcmp(buf + len, big, len) == 0);
+	NUTS_TRUE(memcmp(buf + 2 * len, msg[1], sizeof(msg[1])) == 0);
+
+	// And the stream is still usable.
+	deflate_xfer(c1, c2, msg[0], sizeof(msg[0]));
+
+	for (int i = 0; i < 4; i++) {
+		nng_aio_free(aio[i]);
+	}
+	nng_aio_free(rxaio);
+	nng_stream_close(c1);
+	nng_stream_free(c1);
+	nng_stream_close(c2);
+	nng_stream_free(c2);
+	nng_stream_listener_free(l);
+	nng_stream_dialer_free(d);
+	nng_free(buf, 2 * len + sizeof(msg[1]));
+	nng_free(big, len);
+}
+
+void
+test_websocket_deflate_declined(void)
+{
+	nng_stream_listener *l  = NULL;
+	nng_stream_dialer   *d  = NULL;
+	nng_stream          *c1 = NULL;
+	nng_stream          *c2 = NULL;
+	char                 uri[64];
+	uint8_t              data[1000];
+	bool                 on;
+
+	(void) snprintf(
+	    uri, sizeof(uri), "ws://127.0.0.1:%u/test", nuts_next_port());
+	deflate_fill(data, sizeof(data));
+
+	// Only the dialer asks for it, so the server must refuse.
+	NUTS_PASS(nng_stream_listener_alloc(&l, uri));
+	NUTS_PASS(nng_stream_dialer_alloc(&d, uri));
+	NUTS_PASS(nng_stream_dialer_set_bool(d, NNG_OPT_WS_DEFLATE, true));
+	deflate_connect(l, d, &c1, &c2);
+
+	NUTS_PASS(nng_stream_get_bool(c1, NNG_OPT_WS_DEFLATE, &on));
+	NUTS_TRUE(on == false);
+	NUTS_PASS(nng_stream_get_bool(c2, NNG_OPT_WS_DEFLATE, &on));
+	NUTS_TRUE(on == false);
+	deflate_xfer(c1, c2, data, sizeof(data));
+	deflate_xfer(c2, c1, data, sizeof(data));
+
+	nng_stream_close(c1);
+	nng_stream_free(c1);
+	nng_stream_close(c2);
+	nng_stream_free(c2);
+	nng_stream_listener_free(l);
+	nng_stream_dialer_free(d);
+}
+
+// This checks us against the example in RFC 7692, so that we know we
+// interoperate with other implementations, and not just ourselves.
+void
+test_websocket_deflate_raw(void)
+{
+	nng_stream_listener *l  = NULL;
+	nng_stream_dialer   *d  = NULL;
+	nng_stream          *c1 = NULL;
+	nng_stream          *c2 = NULL;
+	nng_aio             *aio;
+	char                 uri[64];
+	char                 req[512];
+	char                 buf[512];
+	uint16_t             port = nuts_next_port();
+	size_t               len  = 0;
+	nng_iov              iov;
+	z_stream             z;
+	uint8_t              out[16];
+	uint8_t              tail[] = { 0x00, 0x00, 0xff, 0xff };
+	// "Hello", compressed, in a masked binary frame with RSV1 set.
+	uint8_t frame[] = { 0xc2, 0x87, 0, 0, 0, 0, 0xf2, 0x48, 0xcd, 0xc9,
+		0xc9, 0x07, 0x00 };
+
+	(void) snprintf(uri, sizeof(uri), "ws://127.0.0.1:%u/test", port);
+	NUTS_PASS(nng_stream_listener_alloc(&l, uri));
+	NUTS_PASS(nng_stream_listener_set_bool(l, NNG_OPT_WS_DEFLATE, true));
+	NUTS_PASS(nng_stream_listener_listen(l));
+	(void) snprintf(uri, sizeof(uri), "tcp://127.0.0.1:%u", port);
+	NUTS_PASS(nng_stream_dialer_alloc(&d, uri));
+	NUTS_PASS(nng_aio_alloc(&aio, NULL, NULL));
+	nng_aio_set_timeout(aio, 5000);
+
+	nng_stream_dialer_dial(d, aio);
+	nng_aio_wait(aio);
+	NUTS_PASS(nng_aio_result(aio));
+	c2 = nng_aio_get_output(aio, 0);
+
+	(void) snprintf(req, sizeof(req),
+	    "GET /test HTTP/1.1\r\n"
+	    "Host: 127.0.0.1:%u\r\n"
+	    "Upgrade: websocket\r\n"
+	    "Connection: Upgrade\r\n"
+	    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+	    "Sec-WebSocket-Version: 13\r\n"
+	    "Sec-WebSocket-Extensions: x-webkit-deflate-frame, "
+	    "permessage-deflate; client_max_window_bits\r\n"
+	    "\r\n",
+	    port);
+	iov.iov_buf = req;
+	iov.iov_len = strlen(req);
+	NUTS_PASS(nng_aio_set_iov(aio, 1, &iov));
+	nng_stream_send(c2, aio);
+	nng_aio_wait(aio);
+	NUTS_PASS(nng_aio_result(aio));
+
+	// Read the reply, up to the blank line.
+	while ((len < 4) || (memcmp(buf + len - 4, "\r\n\r\n", 4) != 0)) {
+		NUTS_TRUE(len < sizeof(buf) - 1);
+		iov.iov_buf = buf + len;
+		iov.iov_len = 1;
+		NUTS_PASS(nng_aio_set_iov(aio, 1, &iov));
+		nng_stream_recv(c2, aio);
+		nng_aio_wait(aio);
+		NUTS_PASS(nng_aio_result(aio));
+		len++;
+	}
+	buf[len] = '\0';
+	NUTS_TRUE(strstr(buf, " 101 ") != NULL);
+	NUTS_TRUE(strstr(buf,
+	              "Sec-WebSocket-Extensions: permessage-deflate\r\n") !=
+	    NULL);
+
+	nng_stream_listener_accept(l, aio);
+	nng_aio_wait(aio);
+	NUTS_PASS(nng_aio_result(aio));
+	c1 = nng_aio_get_output(aio, 0);
+
+	iov.iov_buf = frame;
+	iov.iov_len = sizeof(frame);
+	NUTS_PASS(nng_aio_set_iov(aio, 1, &iov));
+	nng_stream_send(c2, aio);
+	nng_aio_wait(aio);
+	NUTS_PASS(nng_aio_result(aio));
+
+	iov.iov_buf = buf;
+	iov.iov_len = sizeof(buf);
+	NUTS_PASS(nng_aio_set_iov(aio, 1, &iov));
+	nng_stream_recv(c1, aio);
+	nng_aio_wait(aio);
+	NUTS_PASS(nng_aio_result(aio));
+	NUTS_TRUE(nng_aio_count(aio) == 5);
+	NUTS_TRUE(memcmp(buf, "Hello", 5) == 0);
+
+	// And the other direction, which we must decompress ourselves.
+	iov.iov_buf = "Hello";
+	iov.iov_len = 5;
+	NUTS_PASS(nng_aio_set_iov(aio, 1, &iov));
+	nng_stream_send(c1, aio);
+	nng_aio_wait(aio);
+	NUTS_PASS(nng_aio_result(aio));
+
+	len = 0;
+	while ((len < 2) || (len < (size_t) (2 + (buf[1] & 0x7f)))) {
+		iov.iov_buf = buf + len;
+		iov.iov_len = 1;
+		NUTS_PASS(nng_aio_set_iov(aio, 1, &iov));
+		nng_stream_recv(c2, aio);
+		nng_aio_wait(aio);
+		NUTS_PASS(nng_aio_result(aio));
+		len++;
+	}
+	NUTS_TRUE((buf[0] & 0xff) == 0xc2); // FIN, RSV1, binary
+	NUTS_TRUE((buf[1] & 0x80) == 0);    // servers do not mask
+
+	memset(&z, 0, sizeof(z));
+	NUTS_TRUE(inflateInit2(&z, -15) == Z_OK);
+	z.next_in   = (Bytef *) buf + 2;
+	z.avail_in  = (uInt) (len - 2);
+	z.next_out  = out;
+	z.avail_out = sizeof(out);
+	NUTS_TRUE(inflate(&z, Z_SYNC_FLUSH) == Z_OK);
+	z.next_in  = tail;
+	z.avail_in = sizeof(tail);
+	(void) inflate(&z, Z_SYNC_FLUSH);
+	NUTS_TRUE(sizeof(out) - z.avail_out == 5);
+	NUTS_TRUE(memcmp(out, "Hello", 5) == 0);
+	inflateEnd(&z);
+
+	nng_stream_close(c1);
+	nng_stream_free(c1);
+	nng_stream_close(c2);
+	nng_stream_free(c2);
+	nng_aio_free(aio);
+	nng_stream_listener_free(l);
+	nng_stream_dialer_free(d);
+}
+#else
+void
+test_websocket_deflate_missing(void)
+{
+	nng_stream_listener *l = NULL;
+
+	NUTS_PASS(nng_stream_listener_alloc(&l, "ws://127.0.0.1:0/test"));
+	NUTS_FAIL(nng_stream_listener_set_bool(l, NNG_OPT_WS_DEFLATE, true),
+	    NNG_ENOTSUP);
+	NUTS_PASS(nng_stream_listener_set_bool(l, NNG_OPT_WS_DEFLATE, false));
+	nng_stream_listener_free(l);
+}
+#endif
+
 NUTS_TESTS = {
 	{ "websocket stream wildcard", test_websocket_wildcard },
 	{ "websocket conn properties", test_websocket_conn_props },
 	{ "websocket fragmentation", test_websocket_fragmentation },
 	{ "websocket text mode", test_websocket_text_mode },
+#ifdef NNG_HAVE_ZLIB
+	{ "websocket deflate", test_websocket_deflate },
+	{ "websocket deflate params", test_websocket_deflate_params },
+	{ "websocket deflate cancel", test_websocket_deflate_cancel },
+	{ "websocket deflate declined", test_websocket_deflate_declined },
+	{ "websocket deflate raw", test_websocket_deflate_raw },
+#else
+	{ "websocket deflate missing", test_websocket_deflate_missing },
+#endif
 	{ NULL, NULL },
 };
@@ -0,0 +1,761 @@
+//
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+// Microbenchmarks for the core data structures.  These use the internal
+// APIs directly (linking against nng_testing), so that changes to these
+// primitives can be measured without the noise of a full socket stack.
+//
+// Each benchmark is a function that performs a given number of
+// operations.  Unless --iters is given, the number of operations is
+// first calibrated so that a run takes about --time milliseconds, and
+// then the run is repeated --repeat times.  The median and best times
+// per operation are reported.  Multi-threaded benchmarks run the same
+// function on --threads threads at once, and report the time per
+// operation on each thread, as well as the total rate.
+//
+// Usage: bench [--time <ms>] [--repeat <n>] [--iters <n>]
+//              [--threads <n>] [--format text|csv|json] [--list]
+//              [<name-substring>...]
+
+#include "core/nng_impl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef NNG_PLATFORM_POSIX
+#include "platform/posix/posix_pollq.h"
+#include <errno.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <nng/supplemental/util/options.h>
+
+#define BENCH_MAX_REPEAT 101
+
+enum bench_format {
+	BENCH_TEXT,
+	BENCH_CSV,
+	BENCH_JSON,
+};
+
+// A benchmark.  Threads of zero means use the --threads value.  The
+// setup function, if any, makes state shared by all threads, outside of
+// the timed region.
+typedef struct {
+	const char *name;
+	int         threads;
+	void *(*setup)(void);
+	void (*teardown)(void *);
+	void (*run)(void *, uint64_t);
+} bench;
+
+typedef struct {
+	const bench *b;
+	void        *state;
+	uint64_t     iters;
+	int          ready;
+	bool         go;
+	nni_mtx      mtx;
+	nni_cv       cv;
+} bench_run;
+
+static int      bench_time_ms = 200;
+static int      bench_repeat  = 5;
+static uint64_t bench_iters   = 0;
+static int      bench_threads = 4;
+static int      bench_fmt     = BENCH_TEXT;
+static bool     bench_header  = false;
+static uint64_t bench_junk    = 0; // defeats dead code elimination
+
+static void
+die(const char *msg, int rv)
+{
+	fprintf(stderr, "%s: %s\n", msg, nng_strerror(rv));
+	exit(1);
+}
+
+// xorshift64*, so that every run looks up the same keys.
+static uint64_t
+bench_random(uint64_t *state)
+{
+	uint64_t x = *state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return (x * 2685821657736338717ull);
+}
+
+static void
+lmq_put_get(void *arg, uint64_t iters)
+{
+	nni_lmq  lmq;
+	nni_msg *msg;
+	int      rv;
+
+	NNI_ARG_UNUSED(arg);
+	nni_lmq_init(&lmq, 64);
+	if ((rv = nni_msg_alloc(&msg, 0)) != 0) {
+		die("nni_msg_alloc", rv);
+	}
+	for (uint64_t i = 0; i < iters; i++) {
+		(void) nni_lmq_put(&lmq, msg);
+		(void) nni_lmq_get(&lmq, &msg);
+	}
+	nni_msg_free(msg);
+	nni_lmq_fini(&lmq);
+}
+
+static void
+msgq_put_get(void *arg, uint64_t iters)
+{
+	nni_msgq *mq;
+	nni_aio  *aio;
+	nni_msg  *msg;
+	int       rv;
+
+	NNI_ARG_UNUSED(arg);
+	if (((rv = nni_msgq_init(&mq, 64)) != 0) ||
+	    ((rv = nni_aio_alloc(&aio, NULL, NULL)) != 0) ||
+	    ((rv = nni_msg_alloc(&msg, 0)) != 0)) {
+		die("setup", rv);
+	}
+	for (uint64_t i = 0; i < iters; i++) {
+		(void) nni_msgq_tryput(mq, msg);
+		nni_msgq_aio_get(mq, aio);
+		nni_aio_wait(aio);
+		msg = nni_aio_get_msg(aio);
+	}
+	nni_msg_free(msg);
+	nni_aio_free(aio);
+	nni_msgq_fini(mq);
+}
+
+#define ID_MAP_SIZE 65536
+
+static void *
+id_map_setup(void)
+{
+	nni_id_map *m;
+	int         rv;
+
+	if ((m = nni_zalloc(sizeof(*m))) == NULL) {
+		die("nni_zalloc", NNG_ENOMEM);
+	}
+	nni_id_map_init(m, 1, ID_MAP_SIZE, false);
+	for (uint64_t id = 1; id <= ID_MAP_SIZE; id++) {
+		if ((rv = nni_id_set(m, id, m)) != 0) {
+			die("nni_id_set", rv);
+		}
+	}
+	return (m);
+}
+
+static void
+id_map_teardown(void *arg)
+{
+	nni_id_map_fini(arg);
+	nni_free(arg, sizeof(nni_id_map));
+}
+
+static void
+id_map_get(void *arg, uint64_t iters)
+{
+	nni_id_map *m    = arg;
+	uint64_t    seed = 1;
+
+	for (uint64_t i = 0; i < iters; i++) {
+		uint64_t id = bench_random(&seed) % ID_MAP_SIZE + 1;
+		bench_junk += (uintptr_t) nni_id_get(m, id);
+	}
+}
+
+static void
+id_map_alloc_remove(void *arg, uint64_t iters)
+{
+	nni_id_map m;
+	uint64_t   id;
+	int        rv;
+
+	NNI_ARG_UNUSED(arg);
+	nni_id_map_init(&m, 1, 0x7fffffff, true);
+	// Keep some entries around, so this is not just an empty table.
+	for (int i = 0; i < 1024; i++) {
+		if ((rv = nni_id_alloc(&m, &id, &m)) != 0) {
+			die("nni_id_alloc", rv);
+		}
+	}
+	for (uint64_t i = 0; i < iters; i++) {
+		if ((rv = nni_id_alloc(&m, &id, &m)) != 0) {
+			die("nni_id_alloc", rv);
+		}
+		(void) nni_id_remove(&m, id);
+	}
+	nni_id_map_fini(&m);
+}
+
+static void
+aio_begin_finish(void *arg, uint64_t iters)
+{
+	nni_aio *aio;
+	int      rv;
+
+	NNI_ARG_UNUSED(arg);
+	if ((rv = nni_aio_alloc(&aio, NULL, NULL)) != 0) {
+		die("nni_aio_alloc", rv);
+	}
+	for (uint64_t i = 0; i < iters; i++) {
+		(void) nni_aio_begin(aio);
+		nni_aio_finish(aio, 0, 0);
+		nni_aio_wait(aio);
+	}
+	nni_aio_free(aio);
+}
+
+static void
+aio_begin_finish_sync(void *arg, uint64_t iters)
+{
+	nni_aio *aio;
+	int      rv;
+
+	NNI_ARG_UNUSED(arg);
+	if ((rv = nni_aio_alloc(&aio, NULL, NULL)) != 0) {
+		die("nni_aio_alloc", rv);
+	}
+	for (uint64_t i = 0; i < iters; i++) {
+		(void) nni_aio_begin(aio);
+		nni_aio_finish_sync(aio, 0, 0);
+	}
+	nni_aio_free(aio);
+}
+
+static void
+task_cb(void *arg)
+{
+	(*(uint64_t *) arg)++;
+}
+
+static void
+task_dispatch(void *arg, uint64_t iters)
+{
+	nni_task task;
+	uint64_t count = 0;
+
+	NNI_ARG_UNUSED(arg);
+	nni_task_init(&task, NULL, task_cb, &count);
+	for (uint64_t i = 0; i < iters; i++) {
+		nni_task_dispatch(&task);
+		nni_task_wait(&task);
+	}
+	nni_task_fini(&task);
+	bench_junk += count;
+}
+
+static void
+msg_alloc_free(void *arg, uint64_t iters)
+{
+	nni_msg *msg;
+	int      rv;
+
+	NNI_ARG_UNUSED(arg);
+	for (uint64_t i = 0; i < iters; i++) {
+		if ((rv = nni_msg_alloc(&msg, 64)) != 0) {
+			die("nni_msg_alloc", rv);
+		}
+		nni_msg_free(msg);
+	}
+}
+
+static void
+msg_alloc_free_4k(void *arg, uint64_t iters)
+{
+	nni_msg *msg;
+	int      rv;
+
+	NNI_ARG_UNUSED(arg);
+	for (uint64_t i = 0; i < iters; i++) {
+		if ((rv = nni_msg_alloc(&msg, 4096)) != 0) {
+			die("nni_msg_alloc", rv);
+		}
+		nni_msg_free(msg);
+	}
+}
+
+static void
+msg_dup_free(void *arg, uint64_t iters)
+{
+	nni_msg *msg;
+	nni_msg *dup;
+	int      rv;
+
+	NNI_ARG_UNUSED(arg);
+	if ((rv = nni_msg_alloc(&msg, 1024)) != 0) {
+		die("nni_msg_alloc", rv);
+	}
+	for (uint64_t i = 0; i < iters; i++) {
+		if ((rv = nni_msg_dup(&dup, msg)) != 0) {
+			die("nni_msg_dup", rv);
+		}
+		nni_msg_free(dup);
+	}
+	nni_msg_free(msg);
+}
+
+static void
+msg_pull_up(void *arg, uint64_t iters)
+{
+	nni_msg *msg;
+	nni_msg *copy;
+	int      rv;
+
+	NNI_ARG_UNUSED(arg);
+	if ((rv = nni_msg_alloc(&msg, 1024)) != 0) {
+		die("nni_msg_alloc", rv);
+	}
+	for (uint64_t i = 0; i < iters; i++) {
+		// A shared message has to be copied.
+		nni_msg_clone(msg);
+		if ((copy = nni_msg_pull_up(msg)) == NULL) {
+			die("nni_msg_pull_up", NNG_ENOMEM);
+		}
+		nni_msg_free(copy);
+	}
+	nni_msg_free(msg);
+}
+
+static nni_stat_info stat_atomic_info = {
+	.si_name   = "bench-atomic",
+	.si_desc   = "atomic counter",
+	.si_type   = NNG_STAT_COUNTER,
+	.si_atomic = true,
+};
+
+static nni_stat_info stat_sharded_info = {
+	.si_name  = "bench-sharded",
+	.si_desc  = "sharded counter",
+	.si_type  = NNG_STAT_COUNTER,
+	.si_shard = true,
+};
+
+static void *
+stat_setup(const nni_stat_info *info)
+{
+	nni_stat_item *item;
+
+	if ((item = nni_zalloc(sizeof(*item))) == NULL) {
+		die("nni_zalloc", NNG_ENOMEM);
+	}
+	nni_stat_init(item, info);
+	nni_stat_register(item);
+	return (item);
+}
+
+static void *
+stat_atomic_setup(void)
+{
+	return (stat_setup(&stat_atomic_info));
+}
+
+static void *
+stat_sharded_setup(void)
+{
+	return (stat_setup(&stat_sharded_info));
+}
+
+static void
+stat_teardown(void *arg)
+{
+	nni_stat_unregister(arg);
+	nni_stat_fini(arg);
+	nni_free(arg, sizeof(nni_stat_item));
+}
+
+static void
+stat_inc(void *arg, uint64_t iters)
+{
+	nni_stat_item *item = arg;
+
+	for (uint64_t i = 0; i < iters; i++) {
+		nni_stat_inc(item, 1);
+	}
+}
+
+#ifdef NNG_PLATFORM_POSIX
+typedef struct {
+	nni_mtx mtx;
+	nni_cv  cv;
+	bool    fired;
+} pollq_arg;
+
+static void
+pollq_cb(nni_posix_pfd *pfd, unsigned events, void *arg)
+{
+	pollq_arg *pa = arg;
+	char       c;
+
+	NNI_ARG_UNUSED(events);
+	(void) read(nni_posix_pfd_fd(pfd), &c, 1);
+	nni_mtx_lock(&pa->mtx);
+	pa->fired = true;
+	nni_cv_wake(&pa->cv);
+	nni_mtx_unlock(&pa->mtx);
+}
+
+// pollq_roundtrip measures the time from a descriptor becoming readable
+// to its callback running, including the re-arm.
+static void
+pollq_roundtrip(void *arg, uint64_t iters)
+{
+	nni_posix_pfd *pfd;
+	pollq_arg      pa;
+	int            fds[2];
+	int            rv;
+
+	NNI_ARG_UNUSED(arg);
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+		die("socketpair", nni_plat_errno(errno));
+	}
+	if ((rv = nni_posix_pfd_init(&pfd, fds[0])) != 0) {
+		die("nni_posix_pfd_init", rv);
+	}
+	nni_mtx_init(&pa.mtx);
+	nni_cv_init(&pa.cv, &pa.mtx);
+	nni_posix_pfd_set_cb(pfd, pollq_cb, &pa);
+	for (uint64_t i = 0; i < iters; i++) {
+		pa.fired = false;
+		if ((rv = nni_posix_pfd_arm(pfd, NNI_POLL_IN)) != 0) {
+			die("nni_posix_pfd_arm", rv);
+		}
+		if (write(fds[1], "", 1) != 1) {
+			die("write", nni_plat_errno(errno));
+		}
+		nni_mtx_lock(&pa.mtx);
+		while (!pa.fired) {
+			nni_cv_wait(&pa.cv);
+		}
+		nni_mtx_unlock(&pa.mtx);
+	}
+	nni_posix_pfd_fini(pfd); // closes fds[0]
+	(void) close(fds[1]);
+	nni_cv_fini(&pa.cv);
+	nni_mtx_fini(&pa.mtx);
+}
+#endif
+
+static const bench benches[] = {
+	{ .name = "lmq_put_get", .threads = 1, .run = lmq_put_get },
+	{ .name = "msgq_put_get", .threads = 1, .run = msgq_put_get },
+	{
+	    .name     = "id_map_get",
+	    .threads  = 1,
+	    .setup    = id_map_setup,
+	    .teardown = id_map_teardown,
+	    .run      = id_map_get,
+	},
+	{
+	    .name    = "id_map_alloc_remove",
+	    .threads = 1,
+	    .run     = id_map_alloc_remove,
+	},
+	{ .name = "aio_begin_finish", .threads = 1, .run = aio_begin_finish },
+	{ .name = "aio_begin_finish_mt", .run = aio_begin_finish },
+	{
+	    .name    = "aio_begin_finish_sync",
+	    .threads = 1,
+	    .run     = aio_begin_finish_sync,
+	},
+	{ .name = "task_dispatch", .threads = 1, .run = task_dispatch },
+	{ .name = "task_dispatch_mt", .run = task_dispatch },
+	{ .name = "msg_alloc_free", .threads = 1, .run = msg_alloc_free },
+	{ .name = "msg_alloc_free_mt", .run = msg_alloc_free },
+	{
+	    .name    = "msg_alloc_free_4k",
+	    .threads = 1,
+	    .run     = msg_alloc_free_4k,
+	},
+	{ .name = "msg_dup_free", .threads = 1, .run = msg_dup_free },
+	{ .name = "msg_pull_up", .threads = 1, .run = msg_pull_up },
+	{
+	    .name     = "stat_inc_atomic",
+	    .threads  = 1,
+	    .setup    = stat_atomic_setup,
+	    .teardown = stat_teardown,
+	    .run      = stat_inc,
+	},
+	{
+	    .name     = "stat_inc_atomic_mt",
+	    .setup    = stat_atomic_setup,
+	    .teardown = stat_teardown,
+	    .run      = stat_inc,
+	},
+	{
+	    .name     = "stat_inc_sharded_mt",
+	    .setup    = stat_sharded_setup,
+	    .teardown = stat_teardown,
+	    .run      = stat_inc,
+	},
+#ifdef NNG_PLATFORM_POSIX
+	{ .name = "pollq_roundtrip", .threads = 1, .run = pollq_roundtrip },
+#endif
+	{ .name = NULL },
+};
+
+static void
+bench_thread(void *arg)
+{
+	bench_run *br = arg;
+
+	nni_mtx_lock(&br->mtx);
+	br->ready++;
+	nni_cv_wake(&br->cv);
+	while (!br->go) {
+		nni_cv_wait(&br->cv);
+	}
+	nni_mtx_unlock(&br->mtx);
+	br->b->run(br->state, br->iters);
+}
+
+// bench_once runs the benchmark with the given number of iterations on
+// each thread, returning the elapsed time in microseconds.
+static uint64_t
+bench_once(const bench *b, void *state, int nthreads, uint64_t iters)
+{
+	bench_run br;
+	nni_thr   thrs[64];
+	uint64_t  start;
+	int       rv;
+
+	if (nthreads == 1) {
+		start = nni_clock_us();
+		b->run(state, iters);
+		return (nni_clock_us() - start);
+	}
+
+	memset(&br, 0, sizeof(br));
+	br.b     = b;
+	br.state = state;
+	br.iters = iters;
+	nni_mtx_init(&br.mtx);
+	nni_cv_init(&br.cv, &br.mtx);
+	for (int i = 0; i < nthreads; i++) {
+		if ((rv = nni_thr_init(&thrs[i], bench_thread, &br)) != 0) {
+			die("nni_thr_init", rv);
+		}
+		nni_thr_run(&thrs[i]);
+	}
+	nni_mtx_lock(&br.mtx);
+	while (br.ready < nthreads) {
+		nni_cv_wait(&br.cv);
+	}
+	start = nni_clock_us();
+	br.go = true;
+	nni_cv_wake(&br.cv);
+	nni_mtx_unlock(&br.mtx);
+	for (int i = 0; i < nthreads; i++) {
+		nni_thr_fini(&thrs[i]);
+	}
+	start = nni_clock_us() - start;
+	nni_cv_fini(&br.cv);
+	nni_mtx_fini(&br.mtx);
+	return (start);
+}
+
+static int
+bench_cmp(const void *a, const void *b)
+{
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+
+	return (x < y ? -1 : x > y ? 1 : 0);
+}
+
+static void
+bench_report(const bench *b, int nthreads, uint64_t iters, double *ns)
+{
+	double median = ns[bench_repeat / 2];
+	double best   = ns[0];
+	double mops   = (double) nthreads * 1e3 / median;
+
+	switch (bench_fmt) {
+	case BENCH_CSV:
+		if (!bench_header) {
+			printf("name,threads,iters,repeat,median_ns,best_ns,"
+			       "mops_per_sec\n");
+			bench_header = true;
+		}
+		printf("%s,%d,%llu,%d,%.2f,%.2f,%.3f\n", b->name, nthreads,
+		    (unsigned long long) iters, bench_repeat, median, best,
+		    mops);
+		break;
+	case BENCH_JSON:
+		printf("{\"name\":\"%s\",\"threads\":%d,\"iters\":%llu,"
+		       "\"repeat\":%d,\"median_ns\":%.2f,\"best_ns\":%.2f,"
+		       "\"mops_per_sec\":%.3f}\n",
+		    b->name, nthreads, (unsigned long long) iters,
+		    bench_repeat, median, best, mops);
+		break;
+	default:
+		if (!bench_header) {
+			printf("%-24s %7s %12s %12s %12s %10s\n", "name",
+			    "threads", "iters", "median ns", "best ns",
+			    "Mops/s");
+			bench_header = true;
+		}
+		printf("%-24s %7d %12llu %12.2f %12.2f %10.3f\n", b->name,
+		    nthreads, (unsigned long long) iters, median, best, mops);
+		break;
+	}
+	fflush(stdout);
+}
+
+static void
+bench_one(const bench *b)
+{
+	int      nthreads = b->threads ? b->threads : bench_threads;
+	uint64_t iters    = bench_iters;
+	uint64_t target   = (uint64_t) bench_time_ms * 1000;
+	void    *state    = b->setup ? b->setup() : NULL;
+	double   ns[BENCH_MAX_REPEAT];
+
+	// Calibrate, unless told how many iterations to use.  This also
+	// serves to warm things up.
+	if (iters == 0) {
+		iters = 1;
+		for (;;) {
+			uint64_t us = bench_once(b, state, nthreads, iters);
+			if (us >= target) {
+				break;
+			}
+			if (us < target / 100) {
+				iters *= 100;
+			} else {
+				iters = iters * target * 12 / (us * 10) + 1;
+			}
+		}
+	}
+	for (int i = 0; i < bench_repeat; i++) {
+		uint64_t us = bench_once(b, state, nthreads, iters);
+		ns[i]       = (double) us * 1000.0 / (double) iters;
+	}
+	qsort(ns, bench_repeat, sizeof(double), bench_cmp);
+	bench_report(b, nthreads, iters, ns);
+
+	if (b->teardown != NULL) {
+		b->teardown(state);
+	}
+}
+
+static int
+parse_num(const char *arg, const char *what, int min, int max)
+{
+	char *end;
+	long  val = strtol(arg, &end, 10);
+
+	if ((end == arg) || (*end != '\0') || (val < min) || (val > max)) {
+		fprintf(stderr, "Invalid %s: %s\n", what, arg);
+		exit(2);
+	}
+	return ((int) val);
+}
+
+enum {
+	OPT_TIME = 1,
+	OPT_REPEAT,
+	OPT_ITERS,
+	OPT_THREADS,
+	OPT_FORMAT,
+	OPT_LIST,
+};
+
+static nng_optspec opts[] = {
+	{ .o_name = "time", .o_val = OPT_TIME, .o_arg = true },
+	{ .o_name = "repeat", .o_val = OPT_REPEAT, .o_arg = true },
+	{ .o_name = "iters", .o_val = OPT_ITERS, .o_arg = true },
+	{ .o_name = "threads", .o_val = OPT_THREADS, .o_arg = true },
+	{ .o_name = "format", .o_val = OPT_FORMAT, .o_arg = true },
+	{ .o_name = "list", .o_val = OPT_LIST },
+	{ .o_name = NULL, .o_val = 0 },
+};
+
+int
+main(int argc, char **argv)
+{
+	int   optidx = 1;
+	int   val;
+	int   rv;
+	char *arg;
+	bool  list = false;
+
+	while ((rv = nng_opts_parse(argc, argv, opts, &val, &arg, &optidx)) ==
+	    0) {
+		switch (val) {
+		case OPT_TIME:
+			bench_time_ms = parse_num(arg, "time", 1, 600000);
+			break;
+		case OPT_REPEAT:
+			bench_repeat =
+			    parse_num(arg, "repeat", 1, BENCH_MAX_REPEAT);
+			break;
+		case OPT_ITERS:
+			bench_iters = (uint64_t) parse_num(
+			    arg, "iterations", 1, 1000000000);
+			break;
+		case OPT_THREADS:
+			bench_threads = parse_num(arg, "threads", 1, 64);
+			break;
+		case OPT_FORMAT:
+			if (strcmp(arg, "text") == 0) {
+				bench_fmt = BENCH_TEXT;
+			} else if (strcmp(arg, "csv") == 0) {
+				bench_fmt = BENCH_CSV;
+			} else if (strcmp(arg, "json") == 0) {
+				bench_fmt = BENCH_JSON;
+			} else {
+				fprintf(stderr, "Unknown format: %s\n", arg);
+				exit(2);
+			}
+			break;
+		case OPT_LIST:
+			list = true;
+			break;
+		}
+	}
+	if (rv != -1) {
+		fprintf(stderr, "%s\n", nng_strerror(rv));
+		exit(2);
+	}
+
+	if ((rv = nni_init()) != 0) {
+		die("nni_init", rv);
+	}
+	for (const bench *b = benches; b->name != NULL; b++) {
+		bool match = (optidx == argc);
+		for (int i = optidx; i < argc; i++) {
+			if (strstr(b->name, argv[i]) != NULL) {
+				match = true;
+			}
+		}
+		if (!match) {
+			continue;
+		}
+		if (list) {
+			printf("%s\n", b->name);
+		} else {
+			bench_one(b);
+		}
+	}
+	if (bench_junk == 42) {
+		printf("\n"); // just to keep the compiler honest
+	}
+	nng_fini();
+	return (0);
+}
@@ -15,6 +15,13 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#include <time.h>
+#endif
+
 #include <nng/nng.h>
 #include <nng/supplemental/util/options.h>
 
@@ -36,6 +43,7 @@ static open_func open_client = no_open;
 #include <nng/protocol/pair1/pair.h>
 #else
 #define nng_pair1_open no_open
+#define nng_pair1_open_poly no_open
 #endif
 
 #if defined(NNG_HAVE_PAIR0)
@@ -99,6 +107,18 @@ enum options {
 	OPT_SURVEY0,
 	OPT_BUS0,
 	OPT_URL,
+	OPT_TCP_OPT,
+	OPT_SWEEP,
+	OPT_RECV_SPIN,
+	OPT_THREADS,
+	OPT_SOCKETS,
+	OPT_CONTEXTS,
+	OPT_SIZE,
+	OPT_RATE,
+	OPT_FORMAT,
+	OPT_SERVER,
+	OPT_CLIENT,
+	OPT_SEED,
 };
 
 // These are not universally supported by the variants yet.
@@ -110,9 +130,63 @@ static nng_optspec opts[] = {
 	{ .o_name = "pubsub0", .o_val = OPT_PUBSUB0 },
 	{ .o_name = "pipeline0", .o_val = OPT_PIPELINE0 },
 	{ .o_name = "url", .o_val = OPT_URL, .o_arg = true },
+	{ .o_name = "tcp-opt", .o_val = OPT_TCP_OPT, .o_arg = true },
+	{ .o_name = "sweep", .o_val = OPT_SWEEP, .o_arg = true },
+	{ .o_name = "recv-spin", .o_val = OPT_RECV_SPIN, .o_arg = true },
+	{ .o_name = "threads", .o_val = OPT_THREADS, .o_arg = true },
+	{ .o_name = "sockets", .o_val = OPT_SOCKETS, .o_arg = true },
+	{ .o_name = "contexts", .o_val = OPT_CONTEXTS },
+	{ .o_name = "size", .o_val = OPT_SIZE, .o_arg = true },
+	{ .o_name = "rate", .o_val = OPT_RATE, .o_arg = true },
+	{ .o_name = "format", .o_val = OPT_FORMAT, .o_arg = true },
+	{ .o_name = "server", .o_val = OPT_SERVER },
+	{ .o_name = "client", .o_val = OPT_CLIENT },
+	{ .o_name = "seed", .o_val = OPT_SEED, .o_arg = true },
 	{ .o_name = NULL, .o_val = 0 },
 };
 
+// TCP tuning options that may be given with --tcp-opt <name>=<value>.
+// These are applied to every dialer and listener we create, and so are
+// only meaningful for tcp:// (and tls+tcp://) URLs.  The in-process modes
+// also accept --sweep <name>=<v1>,<v2>,... which repeats the test once
+// for each value, to make it easy to compare settings.
+enum tune_type {
+	TUNE_BOOL,
+	TUNE_INT,
+	TUNE_SIZE,
+	TUNE_MS,
+};
+
+static const struct {
+	const char    *name;
+	enum tune_type type;
+} tunables[] = {
+	{ NNG_OPT_TCP_NODELAY, TUNE_BOOL },
+	{ NNG_OPT_TCP_KEEPALIVE, TUNE_BOOL },
+	{ NNG_OPT_TCP_BUSY_POLL, TUNE_INT },
+	{ NNG_OPT_TCP_QUICKACK, TUNE_BOOL },
+	{ NNG_OPT_TCP_NOTSENT_LOWAT, TUNE_SIZE },
+	{ NNG_OPT_TCP_SNDBUF, TUNE_SIZE },
+	{ NNG_OPT_TCP_RCVBUF, TUNE_SIZE },
+	{ NNG_OPT_TCP_INCOMING_CPU, TUNE_INT },
+	{ NNG_OPT_TCP_USER_TIMEOUT, TUNE_MS },
+	{ NULL, TUNE_INT },
+};
+
+#define MAX_TUNES 16
+
+static struct {
+	int  index; // into tunables
+	long value;
+} tunes[MAX_TUNES];
+static int tune_count = 0;
+
+static const char *sweep_values = NULL;
+static int         sweep_index  = -1;
+
+// Receive spin time (usec), see NNG_OPT_RECVSPIN.
+static int recv_spin = 0;
+
 static void latency_client(const char *, size_t, int);
 static void latency_server(const char *, size_t, int);
 static void throughput_client(const char *, size_t, int);
@@ -123,7 +197,9 @@ static void do_remote_thr(int argc, char **argv);
 static void do_local_thr(int argc, char **argv);
 static void do_inproc_thr(int argc, char **argv);
 static void do_inproc_lat(int argc, char **argv);
+static void do_loadgen(int argc, char **argv);
 static void die(const char *, ...);
+static int  parse_int(const char *, const char *);
 
 // perf implements the same performance tests found in the standard
 // nanomsg & mangos performance tests.  As with mangos, the decision
@@ -138,6 +214,10 @@ static void die(const char *, ...);
 // - remote_thr - remote throughput side
 // - inproc_lat - inproc latency
 // - inproc_thr - inproc throughput
+// - loadgen    - multi-threaded load generator, with latency percentiles
+//
+// Despite their names, the inproc variants can be used with any transport
+// by giving them a different --url.
 //
 
 bool
@@ -214,6 +294,8 @@ main(int argc, char **argv)
 		do_inproc_thr(argc, argv);
 	} else if (matches(prog, "inproc_lat")) {
 		do_inproc_lat(argc, argv);
+	} else if (matches(prog, "loadgen")) {
+		do_loadgen(argc, argv);
 	} else {
 		die("Unknown program mode? Use -m <mode>.");
 	}
@@ -245,14 +327,246 @@ parse_int(const char *arg, const char *what)
 	return ((int) val);
 }
 
+static int
+find_tunable(const char *name)
+{
+	for (int i = 0; tunables[i].name != NULL; i++) {
+		if (strcmp(tunables[i].name, name) == 0) {
+			return (i);
+		}
+	}
+	die("Unknown TCP option: %s", name);
+	return (-1);
+}
+
+static long
+parse_tune_value(int index, const char *val)
+{
+	if (tunables[index].type == TUNE_BOOL) {
+		if ((strcmp(val, "true") == 0) || (strcmp(val, "1") == 0)) {
+			return (1);
+		}
+		if ((strcmp(val, "false") == 0) || (strcmp(val, "0") == 0)) {
+			return (0);
+		}
+		die("Invalid boolean for %s", tunables[index].name);
+	}
+	return (parse_int(val, tunables[index].name));
+}
+
+static void
+set_tune(int index, long value)
+{
+	int i;
+	for (i = 0; i < tune_count; i++) {
+		if (tunes[i].index == index) {
+			break;
+		}
+	}
+	if (i == MAX_TUNES) {
+		die("Too many TCP options");
+	}
+	if (i == tune_count) {
+		tune_count++;
+	}
+	tunes[i].index = index;
+	tunes[i].value = value;
+}
+
+// parse_tune handles an argument of the form <name>=<value>.
+static void
+parse_tune(char *arg)
+{
+	char *eq;
+	int   index;
+
+	if ((eq = strchr(arg, '=')) == NULL) {
+		die("TCP options must be of the form <name>=<value>");
+	}
+	*eq   = '\0';
+	index = find_tunable(arg);
+	set_tune(index, parse_tune_value(index, eq + 1));
+}
+
+// parse_sweep handles an argument of the form <name>=<v1>,<v2>,...
+static void
+parse_sweep(char *arg)
+{
+	char *eq;
+
+	if ((eq = strchr(arg, '=')) == NULL) {
+		die("Sweeps must be of the form <name>=<v1>,<v2>,...");
+	}
+	*eq          = '\0';
+	sweep_index  = find_tunable(arg);
+	sweep_values = eq + 1;
+}
+
+// parse_common parses the options that all modes support, and returns the
+// number of arguments consumed.
+static int
+parse_common(int argc, char **argv)
+{
+	int   rv;
+	int   val;
+	int   optidx = 0;
+	char *arg;
+
+	while ((rv = nng_opts_parse(argc, argv, opts, &val, &arg, &optidx)) ==
+	    0) {
+		switch (val) {
+		case OPT_TCP_OPT:
+			parse_tune(arg);
+			break;
+		case OPT_RECV_SPIN:
+			recv_spin = parse_int(arg, "receive spin");
+			break;
+		default:
+			die("bad option");
+		}
+	}
+	return (optidx);
+}
+
+static void
+tune_dialer(nng_dialer d)
+{
+	for (int i = 0; i < tune_count; i++) {
+		const char *name  = tunables[tunes[i].index].name;
+		long        value = tunes[i].value;
+		int         rv;
+
+		switch (tunables[tunes[i].index].type) {
+		case TUNE_BOOL:
+			rv = nng_dialer_set_bool(d, name, value != 0);
+			break;
+		case TUNE_SIZE:
+			rv = nng_dialer_set_size(d, name, (size_t) value);
+			break;
+		case TUNE_MS:
+			rv = nng_dialer_set_ms(d, name, (nng_duration) value);
+			break;
+		default:
+			rv = nng_dialer_set_int(d, name, (int) value);
+			break;
+		}
+		if (rv != 0) {
+			die("Cannot set %s: %s", name, nng_strerror(rv));
+		}
+	}
+}
+
+static void
+tune_listener(nng_listener l)
+{
+	for (int i = 0; i < tune_count; i++) {
+		const char *name  = tunables[tunes[i].index].name;
+		long        value = tunes[i].value;
+		int         rv;
+
+		switch (tunables[tunes[i].index].type) {
+		case TUNE_BOOL:
+			rv = nng_listener_set_bool(l, name, value != 0);
+			break;
+		case TUNE_SIZE:
+			rv = nng_listener_set_size(l, name, (size_t) value);
+			break;
+		case TUNE_MS:
+			rv = nng_listener_set_ms(l, name, (nng_duration) value);
+			break;
+		default:
+			rv = nng_listener_set_int(l, name, (int) value);
+			break;
+		}
+		if (rv != 0) {
+			die("Cannot set %s: %s", name, nng_strerror(rv));
+		}
+	}
+}
+
+static void
+set_recv_spin(nng_socket s)
+{
+	int rv;
+	if ((recv_spin > 0) &&
+	    ((rv = nng_socket_set_int(s, NNG_OPT_RECVSPIN, recv_spin)) != 0)) {
+		die("nng_socket_set(nng_opt_recvspin): %s", nng_strerror(rv));
+	}
+}
+
+static void
+perf_dial(nng_socket s, const char *addr)
+{
+	nng_dialer d;
+	int        rv;
+
+	if ((rv = nng_dialer_create(&d, s, addr)) != 0) {
+		die("nng_dialer_create: %s", nng_strerror(rv));
+	}
+	tune_dialer(d);
+	if ((rv = nng_dialer_start(d, 0)) != 0) {
+		die("nng_dial: %s", nng_strerror(rv));
+	}
+}
+
+static void
+perf_listen(nng_socket s, const char *addr)
+{
+	nng_listener l;
+	int          rv;
+
+	if ((rv = nng_listener_create(&l, s, addr)) != 0) {
+		die("nng_listener_create: %s", nng_strerror(rv));
+	}
+	tune_listener(l);
+	if ((rv = nng_listener_start(l, 0)) != 0) {
+		die("nng_listen: %s", nng_strerror(rv));
+	}
+}
+
+// run_sweep calls the function once for each value being swept (or just
+// once if there is no sweep).
+static void
+run_sweep(void (*func)(void *), void *arg)
+{
+	char *values;
+	char *val;
+	char *next;
+
+	if (sweep_index < 0) {
+		func(arg);
+		return;
+	}
+	if ((values = strdup(sweep_values)) == NULL) {
+		die("Out of memory");
+	}
+	for (val = values; val != NULL; val = next) {
+		if ((next = strchr(val, ',')) != NULL) {
+			*next++ = '\0';
+		}
+		set_tune(sweep_index, parse_tune_value(sweep_index, val));
+		printf("%s: %s\n", tunables[sweep_index].name, val);
+		func(arg);
+		fflush(stdout);
+	}
+	free(values);
+}
+
 void
 do_local_lat(int argc, char **argv)
 {
 	long int msgsize;
 	long int trips;
+	int      optidx;
+
+	optidx = parse_common(argc, argv);
+	argc -= optidx;
+	argv += optidx;
 
 	if (argc != 3) {
-		die("Usage: local_lat <listen-addr> <msg-size> <roundtrips>");
+		die("Usage: local_lat [--tcp-opt <name>=<val>]... "
+		    "[--recv-spin <usec>] <listen-addr> <msg-size> "
+		    "<roundtrips>");
 	}
 
 	msgsize = parse_int(argv[1], "message size");
@@ -266,9 +580,16 @@ do_remote_lat(int argc, char **argv)
 {
 	int msgsize;
 	int trips;
+	int optidx;
+
+	optidx = parse_common(argc, argv);
+	argc -= optidx;
+	argv += optidx;
 
 	if (argc != 3) {
-		die("Usage: remote_lat <connect-to> <msg-size> <roundtrips>");
+		die("Usage: remote_lat [--tcp-opt <name>=<val>]... "
+		    "[--recv-spin <usec>] <connect-to> <msg-size> "
+		    "<roundtrips>");
 	}
 
 	msgsize = parse_int(argv[1], "message size");
@@ -282,9 +603,15 @@ do_local_thr(int argc, char **argv)
 {
 	int msgsize;
 	int trips;
+	int optidx;
+
+	optidx = parse_common(argc, argv);
+	argc -= optidx;
+	argv += optidx;
 
 	if (argc != 3) {
-		die("Usage: local_thr <listen-addr> <msg-size> <count>");
+		die("Usage: local_thr [--tcp-opt <name>=<val>]... "
+		    "[--recv-spin <usec>] <listen-addr> <msg-size> <count>");
 	}
 
 	msgsize = parse_int(argv[1], "message size");
@@ -298,9 +625,15 @@ do_remote_thr(int argc, char **argv)
 {
 	int msgsize;
 	int trips;
+	int optidx;
+
+	optidx = parse_common(argc, argv);
+	argc -= optidx;
+	argv += optidx;
 
 	if (argc != 3) {
-		die("Usage: remote_thr <connect-to> <msg-size> <count>");
+		die("Usage: remote_thr [--tcp-opt <name>=<val>]... "
+		    "[--recv-spin <usec>] <connect-to> <msg-size> <count>");
 	}
 
 	msgsize = parse_int(argv[1], "message size");
@@ -314,6 +647,7 @@ struct inproc_args {
 	int         msgsize;
 	const char *addr;
 	void (*func)(const char *, size_t, int);
+	void (*client)(const char *, size_t, int);
 };
 
 static void
@@ -324,10 +658,29 @@ do_inproc(void *args)
 	ia->func(ia->addr, ia->msgsize, ia->count);
 }
 
+// run_inproc runs a single pass of an in-process test, with the server
+// side on a separate thread.
+static void
+run_inproc(void *args)
+{
+	struct inproc_args *ia = args;
+	nng_thread         *thr;
+	int                 rv;
+
+	if ((rv = nng_thread_create(&thr, do_inproc, ia)) != 0) {
+		die("Cannot create thread: %s", nng_strerror(rv));
+	}
+
+	// Sleep a bit.
+	nng_msleep(100);
+
+	ia->client(ia->addr, ia->msgsize, ia->count);
+	nng_thread_destroy(thr);
+}
+
 void
 do_inproc_lat(int argc, char **argv)
 {
-	nng_thread        *thr;
 	struct inproc_args ia;
 	int                rv;
 	int                val;
@@ -357,10 +710,18 @@ do_inproc_lat(int argc, char **argv)
 			open_client = nng_bus0_open;
 			open_server = nng_bus0_open;
 			break;
-
 		case OPT_URL:
 			addr = arg;
 			break;
+		case OPT_TCP_OPT:
+			parse_tune(arg);
+			break;
+		case OPT_SWEEP:
+			parse_sweep(arg);
+			break;
+		case OPT_RECV_SPIN:
+			recv_spin = parse_int(arg, "receive spin");
+			break;
 		default:
 			die("bad option");
 		}
@@ -369,29 +730,23 @@ do_inproc_lat(int argc, char **argv)
 	argv += optidx;
 
 	if (argc != 2) {
-		die("Usage: inproc_lat <msg-size> <count>");
+		die("Usage: inproc_lat [--url <url>] "
+		    "[--tcp-opt <name>=<val>]... [--recv-spin <usec>] "
+		    "[--sweep <name>=<v1>,<v2>,...] <msg-size> <count>");
 	}
 
 	ia.addr    = addr;
 	ia.msgsize = parse_int(argv[0], "message size");
 	ia.count   = parse_int(argv[1], "count");
 	ia.func    = latency_server;
+	ia.client  = latency_client;
 
-	if ((rv = nng_thread_create(&thr, do_inproc, &ia)) != 0) {
-		die("Cannot create thread: %s", nng_strerror(rv));
-	}
-
-	// Sleep a bit.
-	nng_msleep(100);
-
-	latency_client(addr, ia.msgsize, ia.count);
-	nng_thread_destroy(thr);
+	run_sweep(run_inproc, &ia);
 }
 
 void
 do_inproc_thr(int argc, char **argv)
 {
-	nng_thread        *thr;
 	struct inproc_args ia;
 	int                rv;
 	int                optidx;
@@ -429,6 +784,15 @@ do_inproc_thr(int argc, char **argv)
 		case OPT_URL:
 			addr = arg;
 			break;
+		case OPT_TCP_OPT:
+			parse_tune(arg);
+			break;
+		case OPT_SWEEP:
+			parse_sweep(arg);
+			break;
+		case OPT_RECV_SPIN:
+			recv_spin = parse_int(arg, "receive spin");
+			break;
 		default:
 			die("bad option");
 		}
@@ -437,23 +801,18 @@ do_inproc_thr(int argc, char **argv)
 	argv += optidx;
 
 	if (argc != 2) {
-		die("Usage: inproc_thr <msg-size> <count>");
+		die("Usage: inproc_thr [--url <url>] "
+		    "[--tcp-opt <name>=<val>]... [--recv-spin <usec>] "
+		    "[--sweep <name>=<v1>,<v2>,...] <msg-size> <count>");
 	}
 
 	ia.addr    = addr;
 	ia.msgsize = parse_int(argv[0], "message size");
 	ia.count   = parse_int(argv[1], "count");
 	ia.func    = throughput_server;
+	ia.client  = throughput_client;
 
-	if ((rv = nng_thread_create(&thr, do_inproc, &ia)) != 0) {
-		die("Cannot create thread: %s", nng_strerror(rv));
-	}
-
-	// Sleep a bit.
-	nng_msleep(100);
-
-	throughput_client(addr, ia.msgsize, ia.count);
-	nng_thread_destroy(thr);
+	run_sweep(run_inproc, &ia);
 }
 
 void
@@ -470,12 +829,10 @@ latency_client(const char *addr, size_t msgsize, int trips)
 		die("nng_socket: %s", nng_strerror(rv));
 	}
 
-	// XXX: set no delay
 	// XXX: other options (TLS in the future?, Linger?)
 
-	if ((rv = nng_dial(s, addr, NULL, 0)) != 0) {
-		die("nng_dial: %s", nng_strerror(rv));
-	}
+	set_recv_spin(s);
+	perf_dial(s, addr);
 
 	nng_msleep(100);
 
@@ -518,12 +875,10 @@ latency_server(const char *addr, size_t msgsize, int trips)
 		die("nng_socket: %s", nng_strerror(rv));
 	}
 
-	// XXX: set no delay
 	// XXX: other options (TLS in the future?, Linger?)
 
-	if ((rv = nng_listen(s, addr, NULL, 0)) != 0) {
-		die("nng_listen: %s", nng_strerror(rv));
-	}
+	set_recv_spin(s);
+	perf_listen(s, addr);
 
 	for (i = 0; i < trips; i++) {
 		if ((rv = nng_recvmsg(s, &msg, 0)) != 0) {
@@ -566,12 +921,10 @@ throughput_server(const char *addr, size_t msgsize, int count)
 		die("nng_socket_set(nng_opt_recvbuf): %s", nng_strerror(rv));
 	}
 
-	// XXX: set no delay
 	// XXX: other options (TLS in the future?, Linger?)
 
-	if ((rv = nng_listen(s, addr, NULL, 0)) != 0) {
-		die("nng_listen: %s", nng_strerror(rv));
-	}
+	set_recv_spin(s);
+	perf_listen(s, addr);
 
 	// Receive first synchronization message.
 	if ((rv = nng_recvmsg(s, &msg, 0)) != 0) {
@@ -621,7 +974,6 @@ throughput_client(const char *addr, size_t msgsize, int count)
 		die("nng_socket: %s", nng_strerror(rv));
 	}
 
-	// XXX: set no delay
 	// XXX: other options (TLS in the future?, Linger?)
 
 	rv = nng_socket_set_int(s, NNG_OPT_SENDBUF, 128);
@@ -634,9 +986,8 @@ throughput_client(const char *addr, size_t msgsize, int count)
 		die("nng_socket_set(nng_opt_recvtimeo): %s", nng_strerror(rv));
 	}
 
-	if ((rv = nng_dial(s, addr, NULL, 0)) != 0) {
-		die("nng_dial: %s", nng_strerror(rv));
-	}
+	set_recv_spin(s);
+	perf_dial(s, addr);
 
 	if ((rv = nng_msg_alloc(&msg, 0)) != 0) {
 		die("nng_msg_alloc: %s", nng_strerror(rv));
@@ -663,3 +1014,741 @@ throughput_client(const char *addr, size_t msgsize, int count)
 
 	nng_close(s);
 }
+
+// The load generator runs a number of client threads, each of which keeps
+// a request outstanding on each of its "streams" (sockets, or contexts on
+// a single socket), against an echo server.  The server normally runs in
+// the same process, but can be run separately with --server, with the
+// clients started elsewhere with --client.
+//
+// Without --rate, each thread sends again as soon as it has its replies
+// (closed loop).  With --rate, messages are sent on a fixed schedule, and
+// latency is measured from when the message should have been sent, so
+// that a stalled server is not hidden by the clients backing off.
+//
+// Latencies are kept in a log-linear histogram, with 32 buckets for each
+// power of two, so percentiles are accurate to about 3%.
+
+#define LG_SUB_BITS 5
+#define LG_SUB (1 << LG_SUB_BITS)
+#define LG_BUCKETS ((64 - LG_SUB_BITS + 1) * LG_SUB)
+#define LG_MAX_SIZES 16
+
+enum lg_format {
+	LG_TEXT,
+	LG_CSV,
+	LG_JSON,
+};
+
+typedef struct {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t buckets[LG_BUCKETS];
+} lg_hist;
+
+typedef struct {
+	int         threads;
+	int         streams;  // per thread
+	bool        contexts; // streams are contexts on one socket
+	bool        reqrep;   // else pair1
+	bool        server;   // run the server
+	bool        client;   // run the clients
+	int         duration; // seconds
+	uint64_t    rate;     // total messages per second, 0 for closed loop
+	uint64_t    seed;
+	const char *addr;
+	const char *size_spec;
+	size_t      sizes[LG_MAX_SIZES];
+	int         nsizes;
+	bool        size_range; // uniform between sizes[0] and sizes[1]
+	int         format;
+} lg_config;
+
+typedef struct {
+	lg_config  *cfg;
+	int         id;
+	nng_thread *thr;
+	nng_socket *socks;
+	nng_ctx    *ctxs;
+	uint64_t   *sent;
+	uint64_t    rng;
+	uint64_t    msgs;
+	uint64_t    bytes;
+	uint64_t    errors;
+	lg_hist     hist;
+} lg_client;
+
+typedef struct {
+	nng_socket sock;
+	nng_ctx    ctx;
+	nng_aio   *aio;
+	bool       reqrep;
+	bool       sending;
+} lg_worker;
+
+static uint64_t
+lg_now(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER        now;
+
+	if (freq.QuadPart == 0) {
+		QueryPerformanceFrequency(&freq);
+	}
+	QueryPerformanceCounter(&now);
+	return ((uint64_t) ((double) now.QuadPart * 1e9 /
+	    (double) freq.QuadPart));
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec);
+#endif
+}
+
+static void
+lg_yield(void)
+{
+#ifdef _WIN32
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+}
+
+static int
+lg_bucket(uint64_t v)
+{
+	int shift = 0;
+
+	if (v < LG_SUB) {
+		return ((int) v);
+	}
+	while ((v >> shift) >= (2 * LG_SUB)) {
+		shift++;
+	}
+	return ((shift + 1) * LG_SUB + (int) ((v >> shift) - LG_SUB));
+}
+
+// lg_bucket_max returns the largest value that lands in the bucket.
+static uint64_t
+lg_bucket_max(int idx)
+{
+	int shift;
+
+	if (idx < LG_SUB) {
+		return ((uint64_t) idx);
+	}
+	shift = idx / LG_SUB - 1;
+	return ((((uint64_t) (LG_SUB + idx % LG_SUB) + 1) << shift) - 1);
+}
+
+static void
+lg_hist_add(lg_hist *h, uint64_t v)
+{
+	if ((h->count == 0) || (v < h->min)) {
+		h->min = v;
+	}
+	if (v > h->max) {
+		h->max = v;
+	}
+	h->count++;
+	h->sum += v;
+	h->buckets[lg_bucket(v)]++;
+}
+
+static void
+lg_hist_merge(lg_hist *h, const lg_hist *src)
+{
+	if (src->count == 0) {
+		return;
+	}
+	if ((h->count == 0) || (src->min < h->min)) {
+		h->min = src->min;
+	}
+	if (src->max > h->max) {
+		h->max = src->max;
+	}
+	h->count += src->count;
+	h->sum += src->sum;
+	for (int i = 0; i < LG_BUCKETS; i++) {
+		h->buckets[i] += src->buckets[i];
+	}
+}
+
+static uint64_t
+lg_hist_percentile(const lg_hist *h, double pct)
+{
+	uint64_t target;
+	uint64_t seen = 0;
+
+	if (h->count == 0) {
+		return (0);
+	}
+	target = (uint64_t) ((double) h->count * pct / 100.0 + 0.5);
+	if (target == 0) {
+		target = 1;
+	}
+	for (int i = 0; i < LG_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= target) {
+			uint64_t v = lg_bucket_max(i);
+			return (v > h->max ? h->max : v);
+		}
+	}
+	return (h->max);
+}
+
+// xorshift64*, so that runs with the same seed send the same sizes.
+static uint64_t
+lg_random(uint64_t *state)
+{
+	uint64_t x = *state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return (x * 2685821657736338717ull);
+}
+
+static size_t
+lg_size(lg_config *cfg, uint64_t *rng)
+{
+	if (cfg->size_range) {
+		size_t span = cfg->sizes[1] - cfg->sizes[0] + 1;
+		return (cfg->sizes[0] + (size_t) (lg_random(rng) % span));
+	}
+	if (cfg->nsizes == 1) {
+		return (cfg->sizes[0]);
+	}
+	return (cfg->sizes[lg_random(rng) % (uint64_t) cfg->nsizes]);
+}
+
+// lg_parse_size handles <n>, <min>-<max>, or <n1>,<n2>,... (chosen with
+// equal probability).
+static void
+lg_parse_size(lg_config *cfg, const char *spec)
+{
+	char *copy;
+	char *val;
+	char *next;
+
+	if ((copy = strdup(spec)) == NULL) {
+		die("Out of memory");
+	}
+	cfg->size_spec  = spec;
+	cfg->nsizes     = 0;
+	cfg->size_range = false;
+	if ((next = strchr(copy, '-')) != NULL) {
+		*next++         = '\0';
+		cfg->sizes[0]   = parse_int(copy, "message size");
+		cfg->sizes[1]   = parse_int(next, "message size");
+		cfg->nsizes     = 2;
+		cfg->size_range = true;
+		if (cfg->sizes[1] < cfg->sizes[0]) {
+			die("Invalid message size range");
+		}
+		free(copy);
+		return;
+	}
+	for (val = copy; val != NULL; val = next) {
+		if ((next = strchr(val, ',')) != NULL) {
+			*next++ = '\0';
+		}
+		if (cfg->nsizes == LG_MAX_SIZES) {
+			die("Too many message sizes");
+		}
+		cfg->sizes[cfg->nsizes++] = parse_int(val, "message size");
+	}
+	free(copy);
+}
+
+static void
+lg_worker_cb(void *arg)
+{
+	lg_worker *w = arg;
+	nng_msg   *msg;
+	int        rv;
+
+	if ((rv = nng_aio_result(w->aio)) != 0) {
+		if (w->sending) {
+			nng_msg_free(nng_aio_get_msg(w->aio));
+		}
+		if (rv == NNG_ECLOSED) {
+			return;
+		}
+		w->sending = false;
+	} else if (!w->sending) {
+		// Echo it back.  For pair1 the message carries the pipe it
+		// came in on, which is where it goes back out.
+		msg        = nng_aio_get_msg(w->aio);
+		w->sending = true;
+		nng_aio_set_msg(w->aio, msg);
+		if (w->reqrep) {
+			nng_ctx_send(w->ctx, w->aio);
+		} else {
+			nng_send_aio(w->sock, w->aio);
+		}
+		return;
+	} else {
+		w->sending = false;
+	}
+	if (w->reqrep) {
+		nng_ctx_recv(w->ctx, w->aio);
+	} else {
+		nng_recv_aio(w->sock, w->aio);
+	}
+}
+
+static nng_socket
+lg_server_start(lg_config *cfg, lg_worker **workersp, int *nworkersp)
+{
+	nng_socket s;
+	lg_worker *workers;
+	int        nworkers;
+	int        rv;
+
+	rv = cfg->reqrep ? nng_rep0_open(&s) : nng_pair1_open_poly(&s);
+	if (rv != 0) {
+		die("nng_socket: %s", nng_strerror(rv));
+	}
+	set_recv_spin(s);
+	perf_listen(s, cfg->addr);
+
+	// One worker for each request that can be outstanding.
+	nworkers = cfg->threads * cfg->streams;
+	if ((workers = calloc(nworkers, sizeof(*workers))) == NULL) {
+		die("Out of memory");
+	}
+	for (int i = 0; i < nworkers; i++) {
+		lg_worker *w = &workers[i];
+
+		w->sock   = s;
+		w->reqrep = cfg->reqrep;
+		if ((rv = nng_aio_alloc(&w->aio, lg_worker_cb, w)) != 0) {
+			die("nng_aio_alloc: %s", nng_strerror(rv));
+		}
+		if (w->reqrep) {
+			if ((rv = nng_ctx_open(&w->ctx, s)) != 0) {
+				die("nng_ctx_open: %s", nng_strerror(rv));
+			}
+			nng_ctx_recv(w->ctx, w->aio);
+		} else {
+			nng_recv_aio(s, w->aio);
+		}
+	}
+	*workersp  = workers;
+	*nworkersp = nworkers;
+	return (s);
+}
+
+static void
+lg_server_stop(nng_socket s, lg_worker *workers, int nworkers)
+{
+	nng_close(s);
+	for (int i = 0; i < nworkers; i++) {
+		nng_aio_stop(workers[i].aio);
+		nng_aio_free(workers[i].aio);
+	}
+	free(workers);
+}
+
+static nng_socket
+lg_client_socket(lg_config *cfg)
+{
+	nng_socket s;
+	int        rv;
+
+	rv = cfg->reqrep ? nng_req0_open(&s) : nng_pair1_open(&s);
+	if (rv != 0) {
+		die("nng_socket: %s", nng_strerror(rv));
+	}
+	if ((rv = nng_socket_set_ms(s, NNG_OPT_RECVTIMEO, 5000)) != 0) {
+		die("nng_socket_set(nng_opt_recvtimeo): %s", nng_strerror(rv));
+	}
+	set_recv_spin(s);
+	perf_dial(s, cfg->addr);
+	return (s);
+}
+
+static int
+lg_send(lg_client *c, int i, nng_msg *msg)
+{
+	if (c->cfg->contexts) {
+		return (nng_ctx_sendmsg(c->ctxs[i], msg, 0));
+	}
+	return (nng_sendmsg(c->socks[i], msg, 0));
+}
+
+static int
+lg_recv(lg_client *c, int i, nng_msg **msgp)
+{
+	if (c->cfg->contexts) {
+		return (nng_ctx_recvmsg(c->ctxs[i], msgp, 0));
+	}
+	return (nng_recvmsg(c->socks[i], msgp, 0));
+}
+
+static void
+lg_client_run(void *arg)
+{
+	lg_client *c   = arg;
+	lg_config *cfg = c->cfg;
+	uint64_t   interval;
+	uint64_t   next;
+	uint64_t   end;
+	uint64_t   now;
+
+	// Each thread takes an equal share of the rate, and sends a message
+	// on each of its streams together.
+	interval = cfg->rate
+	    ? 1000000000ull * cfg->threads * cfg->streams / cfg->rate
+	    : 0;
+	next = lg_now();
+	end  = next + (uint64_t) cfg->duration * 1000000000ull;
+
+	while ((now = lg_now()) < end) {
+		if (interval != 0) {
+			// Sleep for whole milliseconds (sleeps may run over),
+			// and then spin, yielding to the I/O threads.
+			if (next > now + 2000000) {
+				uint64_t ms = (next - now) / 1000000 - 1;
+				nng_msleep((nng_duration) ms);
+			}
+			while (lg_now() < next) {
+				lg_yield();
+			}
+			now = next;
+			next += interval;
+		}
+		for (int i = 0; i < cfg->streams; i++) {
+			nng_msg *msg;
+			size_t   len = lg_size(cfg, &c->rng);
+			int      rv;
+
+			c->sent[i] = now;
+			if ((rv = nng_msg_alloc(&msg, len)) != 0) {
+				die("nng_msg_alloc: %s", nng_strerror(rv));
+			}
+			if ((rv = lg_send(c, i, msg)) != 0) {
+				nng_msg_free(msg);
+				c->errors++;
+				c->sent[i] = 0;
+			}
+		}
+		for (int i = 0; i < cfg->streams; i++) {
+			nng_msg *msg;
+
+			if (c->sent[i] == 0) {
+				continue;
+			}
+			if (lg_recv(c, i, &msg) != 0) {
+				c->errors++;
+				continue;
+			}
+			lg_hist_add(&c->hist, lg_now() - c->sent[i]);
+			c->msgs++;
+			c->bytes += nng_msg_len(msg);
+			nng_msg_free(msg);
+		}
+	}
+}
+
+static void
+lg_client_start(lg_config *cfg, lg_client *c, int id)
+{
+	int n = cfg->contexts ? 1 : cfg->streams;
+	int rv;
+
+	c->cfg = cfg;
+	c->id  = id;
+	c->rng = (cfg->seed + (uint64_t) id) * 0x9e3779b97f4a7c15ull;
+	if (c->rng == 0) {
+		c->rng = 1;
+	}
+	if (((c->socks = calloc(n, sizeof(nng_socket))) == NULL) ||
+	    ((c->ctxs = calloc(cfg->streams, sizeof(nng_ctx))) == NULL) ||
+	    ((c->sent = calloc(cfg->streams, sizeof(uint64_t))) == NULL)) {
+		die("Out of memory");
+	}
+	for (int i = 0; i < n; i++) {
+		c->socks[i] = lg_client_socket(cfg);
+	}
+	if (cfg->contexts) {
+		for (int i = 0; i < cfg->streams; i++) {
+			rv = nng_ctx_open(&c->ctxs[i], c->socks[0]);
+			if (rv != 0) {
+				die("nng_ctx_open: %s", nng_strerror(rv));
+			}
+		}
+	}
+}
+
+static void
+lg_client_fini(lg_client *c)
+{
+	int n = c->cfg->contexts ? 1 : c->cfg->streams;
+
+	for (int i = 0; i < n; i++) {
+		nng_close(c->socks[i]);
+	}
+	free(c->socks);
+	free(c->ctxs);
+	free(c->sent);
+}
+
+static void
+lg_report(lg_config *cfg, lg_client *clients, double secs)
+{
+	static lg_hist hist;
+	uint64_t       msgs   = 0;
+	uint64_t       bytes  = 0;
+	uint64_t       errors = 0;
+	double         mean;
+	double         pcts[] = { 50, 90, 99, 99.9, 99.99 };
+	const char    *names[] = { "p50", "p90", "p99", "p99.9", "p99.99" };
+	uint64_t       vals[5];
+
+	memset(&hist, 0, sizeof(hist));
+	for (int i = 0; i < cfg->threads; i++) {
+		msgs += clients[i].msgs;
+		bytes += clients[i].bytes;
+		errors += clients[i].errors;
+		lg_hist_merge(&hist, &clients[i].hist);
+	}
+	mean = hist.count ? (double) hist.sum / (double) hist.count : 0;
+	for (int i = 0; i < 5; i++) {
+		vals[i] = lg_hist_percentile(&hist, pcts[i]);
+	}
+
+	switch (cfg->format) {
+	case LG_CSV:
+		printf("protocol,url,threads,streams,contexts,size,rate,"
+		       "seconds,messages,bytes,errors,msg_per_sec,mb_per_sec,"
+		       "min_us,mean_us");
+		for (int i = 0; i < 5; i++) {
+			printf(",%s_us", names[i]);
+		}
+		printf(",max_us\n");
+		printf("%s,%s,%d,%d,%d,%s,%llu,%.3f,%llu,%llu,%llu,%.1f,%.3f,"
+		       "%.3f,%.3f",
+		    cfg->reqrep ? "reqrep0" : "pair1", cfg->addr, cfg->threads,
+		    cfg->streams, cfg->contexts ? 1 : 0, cfg->size_spec,
+		    (unsigned long long) cfg->rate, secs,
+		    (unsigned long long) msgs, (unsigned long long) bytes,
+		    (unsigned long long) errors, (double) msgs / secs,
+		    (double) bytes / secs / 1e6, (double) hist.min / 1e3,
+		    mean / 1e3);
+		for (int i = 0; i < 5; i++) {
+			printf(",%.3f", (double) vals[i] / 1e3);
+		}
+		printf(",%.3f\n", (double) hist.max / 1e3);
+		break;
+
+	case LG_JSON:
+		printf("{\"protocol\":\"%s\",\"url\":\"%s\",\"threads\":%d,"
+		       "\"streams\":%d,\"contexts\":%s,\"size\":\"%s\","
+		       "\"rate\":%llu,\"seconds\":%.3f,\"messages\":%llu,"
+		       "\"bytes\":%llu,\"errors\":%llu,\"msg_per_sec\":%.1f,"
+		       "\"mb_per_sec\":%.3f,\"latency_us\":{\"min\":%.3f,"
+		       "\"mean\":%.3f",
+		    cfg->reqrep ? "reqrep0" : "pair1", cfg->addr, cfg->threads,
+		    cfg->streams, cfg->contexts ? "true" : "false",
+		    cfg->size_spec, (unsigned long long) cfg->rate, secs,
+		    (unsigned long long) msgs, (unsigned long long) bytes,
+		    (unsigned long long) errors, (double) msgs / secs,
+		    (double) bytes / secs / 1e6, (double) hist.min / 1e3,
+		    mean / 1e3);
+		for (int i = 0; i < 5; i++) {
+			printf(",\"%s\":%.3f", names[i],
+			    (double) vals[i] / 1e3);
+		}
+		printf(",\"max\":%.3f}}\n", (double) hist.max / 1e3);
+		break;
+
+	default:
+		printf("protocol: %s\n", cfg->reqrep ? "reqrep0" : "pair1");
+		printf("url: %s\n", cfg->addr);
+		printf("threads: %d\n", cfg->threads);
+		printf("%s per thread: %d\n",
+		    cfg->contexts ? "contexts" : "sockets", cfg->streams);
+		printf("message size: %s [B]\n", cfg->size_spec);
+		if (cfg->rate != 0) {
+			printf("target rate: %llu [msg/s]\n",
+			    (unsigned long long) cfg->rate);
+		}
+		printf("total time: %.3f [s]\n", secs);
+		printf("round trip count: %llu\n", (unsigned long long) msgs);
+		printf("errors: %llu\n", (unsigned long long) errors);
+		printf("throughput: %.f [msg/s]\n", (double) msgs / secs);
+		printf("throughput: %.3f [MB/s]\n",
+		    (double) bytes / secs / 1e6);
+		printf("latency min: %.3f [us]\n", (double) hist.min / 1e3);
+		printf("latency mean: %.3f [us]\n", mean / 1e3);
+		for (int i = 0; i < 5; i++) {
+			printf("latency %s: %.3f [us]\n", names[i],
+			    (double) vals[i] / 1e3);
+		}
+		printf("latency max: %.3f [us]\n", (double) hist.max / 1e3);
+		break;
+	}
+}
+
+static void
+run_loadgen(lg_config *cfg)
+{
+	nng_socket server;
+	lg_worker *workers  = NULL;
+	int        nworkers = 0;
+	lg_client *clients;
+	uint64_t   start;
+	double     secs;
+	int        rv;
+
+	if (cfg->server) {
+		server = lg_server_start(cfg, &workers, &nworkers);
+	}
+	if (!cfg->client) {
+		nng_msleep((nng_duration) cfg->duration * 1000);
+		lg_server_stop(server, workers, nworkers);
+		return;
+	}
+
+	if ((clients = calloc(cfg->threads, sizeof(*clients))) == NULL) {
+		die("Out of memory");
+	}
+	for (int i = 0; i < cfg->threads; i++) {
+		lg_client_start(cfg, &clients[i], i);
+	}
+	nng_msleep(100); // let the connections settle
+
+	start = lg_now();
+	for (int i = 0; i < cfg->threads; i++) {
+		rv = nng_thread_create(&clients[i].thr, lg_client_run,
+		    &clients[i]);
+		if (rv != 0) {
+			die("Cannot create thread: %s", nng_strerror(rv));
+		}
+	}
+	for (int i = 0; i < cfg->threads; i++) {
+		nng_thread_destroy(clients[i].thr);
+	}
+	secs = (double) (lg_now() - start) / 1e9;
+
+	lg_report(cfg, clients, secs);
+	for (int i = 0; i < cfg->threads; i++) {
+		lg_client_fini(&clients[i]);
+	}
+	free(clients);
+	if (cfg->server) {
+		lg_server_stop(server, workers, nworkers);
+	}
+}
+
+void
+do_loadgen(int argc, char **argv)
+{
+	lg_config cfg;
+	int       rv;
+	int       optidx;
+	int       val;
+	char     *arg;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.addr    = "inproc://loadgen";
+	cfg.threads = 1;
+	cfg.streams = 1;
+	cfg.reqrep  = true;
+	cfg.server  = true;
+	cfg.client  = true;
+	cfg.seed    = 1;
+	cfg.format  = LG_TEXT;
+	lg_parse_size(&cfg, "64");
+
+	optidx = 0;
+	while ((rv = nng_opts_parse(argc, argv, opts, &val, &arg, &optidx)) ==
+	    0) {
+		switch (val) {
+		case OPT_REQREP0:
+			cfg.reqrep = true;
+			break;
+		case OPT_PAIR1:
+			cfg.reqrep = false;
+			break;
+		case OPT_URL:
+			cfg.addr = arg;
+			break;
+		case OPT_TCP_OPT:
+			parse_tune(arg);
+			break;
+		case OPT_RECV_SPIN:
+			recv_spin = parse_int(arg, "receive spin");
+			break;
+		case OPT_THREADS:
+			cfg.threads = parse_int(arg, "threads");
+			break;
+		case OPT_SOCKETS:
+			cfg.streams = parse_int(arg, "sockets");
+			break;
+		case OPT_CONTEXTS:
+			cfg.contexts = true;
+			break;
+		case OPT_SIZE:
+			lg_parse_size(&cfg, arg);
+			break;
+		case OPT_RATE:
+			cfg.rate = (uint64_t) parse_int(arg, "rate");
+			break;
+		case OPT_SEED:
+			cfg.seed = (uint64_t) parse_int(arg, "seed");
+			break;
+		case OPT_SERVER:
+			cfg.client = false;
+			break;
+		case OPT_CLIENT:
+			cfg.server = false;
+			break;
+		case OPT_FORMAT:
+			if (strcmp(arg, "text") == 0) {
+				cfg.format = LG_TEXT;
+			} else if (strcmp(arg, "csv") == 0) {
+				cfg.format = LG_CSV;
+			} else if (strcmp(arg, "json") == 0) {
+				cfg.format = LG_JSON;
+			} else {
+				die("Format must be text, csv, or json");
+			}
+			break;
+		default:
+			die("bad option");
+		}
+	}
+	argc -= optidx;
+	argv += optidx;
+
+	if (argc != 1) {
+		die("Usage: loadgen [--url <url>] [--reqrep0|--pair1] "
+		    "[--threads <n>] [--sockets <n>] [--contexts] "
+		    "[--size <n>|<min>-<max>|<n1>,<n2>,...] "
+		    "[--rate <msg/s>] [--seed <n>] "
+		    "[--format text|csv|json] [--server|--client] "
+		    "[--tcp-opt <name>=<val>]... [--recv-spin <usec>] "
+		    "<seconds>");
+	}
+	cfg.duration = parse_int(argv[0], "duration");
+
+	if ((cfg.threads < 1) || (cfg.streams < 1)) {
+		die("Need at least one thread and one socket");
+	}
+	if (!cfg.server && !cfg.client) {
+		die("Cannot use both --server and --client");
+	}
+	if (cfg.contexts && !cfg.reqrep) {
+		die("Contexts are only supported with reqrep0");
+	}
+	run_loadgen(&cfg);
+}
@@ -1,5 +1,5 @@
 //
-// Copyright 2022 Staysail Systems, Inc. <info@staysail.tech>
+// Copyright 2024 Staysail Systems, Inc. <info@staysail.tech>
 // Copyright 2018 Capitar IT Group BV <info@capitar.com>
 // Copyright 2020 Dirac Research <robert.bielik@dirac.com>
 //
@@ -155,6 +155,67 @@ fail:
 	return (rv);
 }
 
+// httpgetwith does a GET with the given request header, returning the
+// value of the named response header.
+static int
+httpgetwith(const char *addr, const char *hdr, const char *val, void **datap,
+    size_t *sizep, uint16_t *statp, const char *rhdr, char **rvalp)
+{
+	int           rv;
+	nng_http_req *req  = NULL;
+	nng_http_res *res  = NULL;
+	nng_url *     url  = NULL;
+	size_t        clen = 0;
+	void *        data = NULL;
+	char *        rval = NULL;
+	const char *  ptr;
+
+	if (((rv = nng_url_parse(&url, addr)) != 0) ||
+	    ((rv = nng_http_req_alloc(&req, url)) != 0) ||
+	    ((rv = nng_http_res_alloc(&res)) != 0) ||
+	    ((rv = nng_http_req_set_header(req, hdr, val)) != 0)) {
+		goto fail;
+	}
+	if ((rv = httpdo(url, req, res, &data, &clen)) != 0) {
+		goto fail;
+	}
+
+	*statp = nng_http_res_get_status(res);
+	if ((ptr = nng_http_res_get_header(res, rhdr)) != NULL) {
+		rval = strdup(ptr);
+	}
+
+	*datap = data;
+	*sizep = clen;
+	*rvalp = rval;
+
+fail:
+	if (rv != 0) {
+		if (data != NULL) {
+			nng_free(data, clen);
+		}
+	}
+	if (url != NULL) {
+		nni_url_free(url);
+	}
+	if (req != NULL) {
+		nng_http_req_free(req);
+	}
+	if (res != NULL) {
+		nng_http_res_free(res);
+	}
+
+	return (rv);
+}
+
+static int
+httpgetrange(const char *addr, const char *range, void **datap, size_t *sizep,
+    uint16_t *statp, char **crangep)
+{
+	return (httpgetwith(addr, "Range", range, datap, sizep, statp,
+	    "Content-Range", crangep));
+}
+
 static void
 httpecho(nng_aio *aio)
 {
@@ -212,6 +273,63 @@ TestMain("HTTP Server", {
 		So(nng_http_server_add_handler(s, h) == 0);
 		So(nng_http_server_start(s) == 0);
 
+		Convey("Client transactions reuse connections", {
+			nng_http_client *cli;
+			nng_http_req *   req;
+			nng_http_res *   res;
+			void *           data;
+			size_t           size;
+
+			So(nng_http_client_alloc(&cli, url) == 0);
+			So(nng_http_client_set_pool(cli, 8, 4000) == 0);
+			So(nng_http_req_alloc(&req, url) == 0);
+			So(nng_http_res_alloc(&res) == 0);
+			So(nng_http_req_set_uri(req, "/home.html") == 0);
+
+			Reset({
+				nng_http_client_free(cli);
+				nng_http_req_free(req);
+				nng_http_res_free(res);
+			});
+
+			for (int i = 0; i < 3; i++) {
+				nng_http_client_transact(cli, req, res, aio);
+				nng_aio_wait(aio);
+				So(nng_aio_result(aio) == 0);
+				So(nng_http_res_get_status(res) ==
+				    NNG_HTTP_STATUS_OK);
+				nng_http_res_get_data(res, &data, &size);
+				So(size == strlen(doc1));
+				So(memcmp(data, doc1, size) == 0);
+			}
+			So(nng_http_req_get_header(req, "Connection") == NULL);
+#ifdef NNG_ENABLE_STATS
+			{
+				nng_stat *stats;
+				nng_stat *st;
+				So(nng_stats_get(&stats) == 0);
+				st = nng_stat_find(stats, "pool_hits");
+				So(st != NULL);
+				So(nng_stat_value(st) == 2);
+				st = nng_stat_find(stats, "pool_misses");
+				So(st != NULL);
+				So(nng_stat_value(st) == 1);
+				nng_stats_free(stats);
+			}
+#endif
+
+			Convey("Reuse can be disabled", {
+				So(nng_http_client_set_pool(cli, 0, 0) == 0);
+				nng_http_client_transact(cli, req, res, aio);
+				nng_aio_wait(aio);
+				So(nng_aio_result(aio) == 0);
+				So(nng_http_res_get_status(res) ==
+				    NNG_HTTP_STATUS_OK);
+				So(nng_http_client_set_pool(cli, -1, 0) ==
+				    NNG_EINVAL);
+			});
+		});
+
 		Convey("We can connect a client to it", {
 			nng_http_client *cli;
 			nng_http_conn *  h;
@@ -806,6 +924,208 @@ TestMain("HTTP Server", {
 		});
 	});
 
+	Convey("Large file serving works", {
+		char     urlstr[32];
+		nng_url *url;
+		char *   tmpdir;
+		char *   file1;
+		char *   big;
+		size_t   bigsz = 1024 * 1024 + 123;
+
+		trantest_next_address(urlstr, "http://127.0.0.1:");
+		So(nng_url_parse(&url, urlstr) == 0);
+		So(nng_http_server_hold(&s, url) == 0);
+		So((tmpdir = nni_plat_temp_dir()) != NULL);
+		So((file1 = nni_file_join(tmpdir, "httpbig.bin")) != NULL);
+		So((big = malloc(bigsz)) != NULL);
+		for (size_t i = 0; i < bigsz; i++) {
+			big[i] = (char) ((i * 7) % 251);
+		}
+		So(nni_file_put(file1, big, bigsz) == 0);
+
+		Reset({
+			nng_http_server_release(s);
+			nni_file_delete(file1);
+			free(tmpdir);
+			free(file1);
+			free(big);
+			nng_url_free(url);
+		});
+
+		So(nng_http_handler_alloc_file(&h, "/big", file1) == 0);
+		So(nng_http_server_add_handler(s, h) == 0);
+		So(nng_http_server_start(s) == 0);
+		nng_msleep(100);
+
+		Convey("Whole file works", {
+			char     fullurl[256];
+			void *   data;
+			size_t   size;
+			uint16_t stat;
+			char *   ctype;
+
+			snprintf(fullurl, sizeof(fullurl), "%s/big", urlstr);
+			So(httpget(fullurl, &data, &size, &stat, &ctype) == 0);
+			So(stat == NNG_HTTP_STATUS_OK);
+			So(size == bigsz);
+			So(memcmp(data, big, size) == 0);
+			So(strcmp(ctype, "application/octet-stream") == 0);
+			nni_strfree(ctype);
+			nng_free(data, size);
+		});
+
+		Convey("Byte range works", {
+			char     fullurl[256];
+			void *   data;
+			size_t   size;
+			uint16_t stat;
+			char *   crange;
+
+			snprintf(fullurl, sizeof(fullurl), "%s/big", urlstr);
+			So(httpgetrange(fullurl, "bytes=100000-299999", &data,
+			       &size, &stat, &crange) == 0);
+			So(stat == NNG_HTTP_STATUS_PARTIAL_CONTENT);
+			So(size == 200000);
+			So(memcmp(data, big + 100000, size) == 0);
+			So(crange != NULL);
+			So(strcmp(crange, "bytes 100000-299999/1048699") == 0);
+			free(crange);
+			nng_free(data, size);
+		});
+
+		Convey("Suffix range works", {
+			char     fullurl[256];
+			void *   data;
+			size_t   size;
+			uint16_t stat;
+			char *   crange;
+
+			snprintf(fullurl, sizeof(fullurl), "%s/big", urlstr);
+			So(httpgetrange(fullurl, "bytes=-10", &data, &size,
+			       &stat, &crange) == 0);
+			So(stat == NNG_HTTP_STATUS_PARTIAL_CONTENT);
+			So(size == 10);
+			So(memcmp(data, big + bigsz - 10, size) == 0);
+			So(crange != NULL);
+			So(strcmp(crange, "bytes 1048689-1048698/1048699") ==
+			    0);
+			free(crange);
+			nng_free(data, size);
+		});
+
+		Convey("Unsatisfiable range gives 416", {
+			char     fullurl[256];
+			void *   data;
+			size_t   size;
+			uint16_t stat;
+			char *   crange;
+
+			snprintf(fullurl, sizeof(fullurl), "%s/big", urlstr);
+			So(httpgetrange(fullurl, "bytes=2000000-", &data,
+			       &size, &stat, &crange) == 0);
+			So(stat == NNG_HTTP_STATUS_RANGE_NOT_SATISFIABLE);
+			So(crange != NULL);
+			So(strcmp(crange, "bytes */1048699") == 0);
+			free(crange);
+			if (size > 0) {
+				nng_free(data, size);
+			}
+		});
+	});
+
+	Convey("Cached file serving works", {
+		char     urlstr[32];
+		char     fullurl[256];
+		nng_url *url;
+		char *   tmpdir;
+		char *   file1;
+
+		trantest_next_address(urlstr, "http://127.0.0.1:");
+		So(nng_url_parse(&url, urlstr) == 0);
+		So(nng_http_server_hold(&s, url) == 0);
+		So((tmpdir = nni_plat_temp_dir()) != NULL);
+		So((file1 = nni_file_join(tmpdir, "httpcache.html")) != NULL);
+		So(nni_file_put(file1, doc1, strlen(doc1)) == 0);
+		snprintf(fullurl, sizeof(fullurl), "%s/cached", urlstr);
+
+		Reset({
+			nng_http_server_release(s);
+			nni_file_delete(file1);
+			free(tmpdir);
+			free(file1);
+			nng_url_free(url);
+		});
+
+		So(nng_http_handler_alloc_file(&h, "/cached", file1) == 0);
+		So(nng_http_handler_set_cache(h, 1024 * 1024) == 0);
+		So(nng_http_server_add_handler(s, h) == 0);
+		So(nng_http_handler_set_cache(h, 0) == NNG_EBUSY);
+		So(nng_http_server_start(s) == 0);
+		nng_msleep(100);
+
+		Convey("Conditional requests get 304", {
+			void *   data;
+			size_t   size;
+			uint16_t stat;
+			char *   etag;
+			char *   lastmod;
+			char *   dummy;
+
+			So(httpgetwith(fullurl, "Accept", "*/*", &data, &size,
+			       &stat, "ETag", &etag) == 0);
+			So(stat == NNG_HTTP_STATUS_OK);
+			So(size == strlen(doc1));
+			So(memcmp(data, doc1, size) == 0);
+			So(etag != NULL);
+			nng_free(data, size);
+
+			So(httpgetwith(fullurl, "If-None-Match", etag, &data,
+			       &size, &stat, "Last-Modified", &lastmod) == 0);
+			So(stat == NNG_HTTP_STATUS_NOT_MODIFIED);
+			So(size == 0);
+			So(lastmod != NULL);
+			So(strstr(lastmod, " GMT") != NULL);
+
+			So(httpgetwith(fullurl, "If-Modified-Since", lastmod,
+			       &data, &size, &stat, "ETag", &dummy) == 0);
+			So(stat == NNG_HTTP_STATUS_NOT_MODIFIED);
+			So(dummy != NULL);
+			So(strcmp(dummy, etag) == 0);
+			free(dummy);
+
+			So(httpgetwith(fullurl, "If-None-Match", "\"nope\"",
+			       &data, &size, &stat, "ETag", &dummy) == 0);
+			So(stat == NNG_HTTP_STATUS_OK);
+			So(size == strlen(doc1));
+			nng_free(data, size);
+			free(dummy);
+			free(lastmod);
+			free(etag);
+		});
+
+		Convey("Changed files are reloaded", {
+			void *   data;
+			size_t   size;
+			uint16_t stat;
+			char *   ctype;
+
+			So(httpget(fullurl, &data, &size, &stat, &ctype) == 0);
+			So(stat == NNG_HTTP_STATUS_OK);
+			So(size == strlen(doc1));
+			nni_strfree(ctype);
+			nng_free(data, size);
+
+			So(nni_file_put(file1, doc3, strlen(doc3)) == 0);
+			nng_msleep(1100); // wait for the cache to recheck
+			So(httpget(fullurl, &data, &size, &stat, &ctype) == 0);
+			So(stat == NNG_HTTP_STATUS_OK);
+			So(size == strlen(doc3));
+			So(memcmp(data, doc3, size) == 0);
+			nni_strfree(ctype);
+			nng_free(data, size);
+		});
+	});
+
 	Convey("Custom POST handler works", {
 		char     urlstr[32];
 		nng_url *url;